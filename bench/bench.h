@@ -0,0 +1,81 @@
+/*
+ * Water Flow Meter - Host Benchmarks
+ * Shared helpers for the [env:bench] benchmark runner
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * Wall clock in nanoseconds (host time, not simulated time)
+ */
+static inline uint64_t bench_now_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Host CPU cycle counter (falls back to nanoseconds off x86)
+ * Host cycles are only comparable with each other - the C6 has no FPU,
+ * so float-heavy code costs far more there than these numbers suggest
+ */
+static inline uint64_t bench_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return bench_now_ns();
+#endif
+}
+
+/**
+ * Synthetic household usage: flow rate (L/min) for a given second of the day
+ * A few showers, toilet flushes, taps and a dishwasher cycle
+ */
+static inline float bench_household_flow(uint32_t secondOfDay) {
+    struct Draw { uint32_t start; uint32_t duration; float rate; };
+    static const Draw draws[] = {
+        { 6 * 3600 + 30 * 60, 480, 9.0f },   // Morning shower
+        { 6 * 3600 + 45 * 60,  40, 6.0f },   // Toilet
+        { 7 * 3600,            30, 4.0f },   // Kitchen tap
+        { 7 * 3600 + 10 * 60, 420, 8.5f },   // Second shower
+        { 12 * 3600 + 15 * 60, 40, 6.0f },   // Toilet
+        { 13 * 3600,           60, 3.0f },   // Tap
+        { 18 * 3600 + 30 * 60, 90, 5.0f },   // Cooking
+        { 19 * 3600 + 30 * 60, 1500, 1.5f }, // Dishwasher (intermittent fill)
+        { 21 * 3600,           40, 6.0f },   // Toilet
+        { 22 * 3600,           20, 2.0f },   // Tap
+    };
+    for (const Draw& d : draws) {
+        if (secondOfDay >= d.start && secondOfDay < d.start + d.duration) {
+            return d.rate;
+        }
+    }
+    return 0.0f;
+}
+
+// Benchmark suites
+void FlowMeterBenchmarks(void);
+void FlowMathBenchmarks(void);
+void CounterJournalBenchmarks(void);
+void SchedulerBenchmarks(void);
+void BatteryBenchmarks(void);
+void BootBenchmarks(void);
+void DeferredLogBenchmarks(void);
+void FlowHistoryBenchmarks(void);
+void PulseSourceBenchmarks(void);
+void SeqlockBenchmarks(void);
+void LatencyStatsBenchmarks(void);
+void ChannelsBenchmarks(void);
+void LeakBenchmarks(void);
+void AlarmBenchmarks(void);
+void UsageBenchmarks(void);
+void ConsumptionBenchmarks(void);
+
+#endif // BENCH_H
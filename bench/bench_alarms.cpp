@@ -0,0 +1,125 @@
+/*
+ * Alarm Report Benchmarks
+ * A burst pipe replayed through the scheduled metering core, on a clean
+ * and a lossy link: time from the pulse that crossed the burst volume to
+ * the alarm on air, retries and acknowledgement
+ */
+
+#include "bench.h"
+#include "hal_native.h"
+#include "flow_meter.h"
+#include "scheduler.h"
+#include "metering_cluster.h"
+#include "report_engine.h"
+#include "leak_detector.h"
+#include "config_traits.h"
+
+#define BENCH_AFTER_MS 10000         // Replay kept running after the alarm
+
+struct AlarmScenario {
+    float lpm;               // Burst flow (L/min)
+    uint32_t phaseUs;        // First pulse after the flow window boundary
+    uint32_t lostAcks;       // Alarm frames the coordinator never acknowledges
+};
+
+static const AlarmScenario scenarios[] = {
+    { 30.0f,      0, 0 },
+    { 30.0f, 500000, 0 },
+    { 12.0f, 250000, 0 },
+    {  6.0f, 750000, 0 },
+    { 30.0f,      0, 1 },
+    { 30.0f,      0, 3 },
+};
+
+static uint64_t periodUs = 0;
+static uint64_t nextEdgeUs = 0;
+
+static void fireEdges(uint64_t deadlineUs) {
+    while (nextEdgeUs <= deadlineUs && !hal_native_notify_pending()) {
+        hal_native_set_micros(nextEdgeUs);
+        hal_native_pulse();
+        nextEdgeUs += periodUs;
+    }
+}
+
+static bool alarmFrame(const NativeRadioFrame* frame) {
+    for (uint8_t a = 0; a < frame->count; a++) {
+        if (frame->attrs[a].attrId == METERING_STATUS_ATTR && frame->attrs[a].value[0] != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void runScenario(const AlarmScenario* s) {
+    static uint8_t battery = 100;
+    hal_native_reset();
+    resetFlowMeter();
+    schedulerReset();
+    NativeNetworkConfig network;
+    network.lostAcks = s->lostAcks;
+    hal_native_radio_set_network(&network);
+    loadTotalVolume();
+    setupFlowSensor();
+    scheduleFlowMeter(&battery);
+    zigbeeConnected = true;
+
+    // Joined and idle, then the burst starts
+    requestFlowReport();
+    hal_native_advance_ms(FLOW_CALC_INTERVAL);
+    schedulerRun();
+    hal_native_radio_clear();
+
+    periodUs = (uint64_t)(60e6 / (s->lpm * CALIBRATION_FACTOR));
+    uint64_t startUs = hal_native_now_us() + s->phaseUs;
+    nextEdgeUs = startUs;
+    hal_native_set_wait_hook(fireEdges);
+    while (leakAlarms() == 0) {
+        schedulerRun();
+    }
+    uint64_t alarmUs = hal_native_now_us();
+    while (hal_native_now_us() < alarmUs + BENCH_AFTER_MS * 1000ULL) {
+        schedulerRun();
+    }
+    hal_native_set_wait_hook(nullptr);
+
+    // The pulse that took the draw past the burst volume
+    uint64_t crossedUs = startUs + LEAK_BURST_PULSES * periodUs;
+    uint64_t firstUs = UINT64_MAX;
+    uint64_t lastUs = 0;
+    uint32_t alongside = 0;
+    for (size_t i = 0; i < hal_native_radio_frame_count(); i++) {
+        const NativeRadioFrame* frame = hal_native_radio_frame(i);
+        if (alarmFrame(frame)) {
+            firstUs = frame->timeUs < firstUs ? frame->timeUs : firstUs;
+            lastUs = frame->timeUs;
+        }
+    }
+    for (size_t i = 0; i < hal_native_radio_frame_count(); i++) {
+        const NativeRadioFrame* frame = hal_native_radio_frame(i);
+        if (frame->timeUs == firstUs && !alarmFrame(frame)) {
+            alongside++;
+        }
+    }
+
+    const ReportEngineStats* stats = reportEngineStats();
+    printf("  %5.1f %6lu %5lu %10.1f %10.1f %7lu %7lu %10.1f\n", s->lpm,
+           (unsigned long)(s->phaseUs / 1000), (unsigned long)s->lostAcks,
+           (firstUs - crossedUs) / 1000.0, stats->alarmLatencyUs / 1000.0,
+           (unsigned long)stats->alarmFrames, (unsigned long)alongside,
+           (lastUs - firstUs) / 1000.0 + network.ackMs);
+}
+
+// Benchmark suite runner
+void AlarmBenchmarks(void) {
+    printf("[bench] alarm reports (burst %.0f L, window %d ms, ack timeout %d ms, %d tries)\n",
+           LEAK_BURST_VOLUME, FLOW_CALC_INTERVAL, REPORT_ACK_TIMEOUT, REPORT_ALARM_TRIES);
+    printf("  %5s %6s %5s %10s %10s %7s %7s %10s\n", "L/min", "phase", "lost",
+           "cross->air", "pulse->air", "alarm", "other", "acked");
+    printf("  %5s %6s %5s %10s %10s %7s %7s %10s\n", "", "ms", "acks", "ms", "ms", "frames",
+           "frames", "after ms");
+    for (const AlarmScenario& s : scenarios) {
+        runScenario(&s);
+    }
+    printf("\n");
+}
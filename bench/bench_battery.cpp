@@ -0,0 +1,93 @@
+/*
+ * Battery Monitor Benchmarks
+ * Main task stall per battery check: old blocking read vs sampler jobs
+ */
+
+#include "bench.h"
+#include "hal_native.h"
+#include "flow_meter.h"
+#include "battery_monitor.h"
+#include "scheduler.h"
+
+#define BENCH_BATTERY_HOURS 1
+#define BENCH_PULSE_PERIOD_US 83333   // 12 pulses/s (96 L/min)
+
+static uint64_t nextPulseUs = 0;
+
+static void pulseHook(uint64_t deadlineUs) {
+    while (nextPulseUs <= deadlineUs && !hal_native_notify_pending()) {
+        hal_native_set_micros(nextPulseUs);
+        hal_native_pulse();
+        nextPulseUs += BENCH_PULSE_PERIOD_US;
+    }
+}
+
+// ============================================================================
+// Old implementation: 16 x delay(10), called twice per check
+// ============================================================================
+
+static uint32_t legacyReadBatteryMillivolts() {
+    uint32_t sum = 0;
+    for (int i = 0; i < BATTERY_SAMPLES; i++) {
+        sum += hal_adc_read_mv(BATTERY_PIN);
+        uint64_t wakeUs = hal_native_now_us() + 10000;   // delay(10) - pulses keep arriving
+        pulseHook(wakeUs);
+        hal_native_set_micros(wakeUs);
+    }
+    return sum / BATTERY_SAMPLES * BATTERY_DIVIDER_RATIO;
+}
+
+static void legacyBatteryJob() {
+    batteryMillivolts = legacyReadBatteryMillivolts();                          // readBatteryVoltage()
+    batteryPercent = batteryPercentFromMillivolts(legacyReadBatteryMillivolts()); // getBatteryPercentage()
+}
+
+// ============================================================================
+// Runner
+// ============================================================================
+
+static void runHour(bool legacy) {
+    static uint8_t battery = 100;
+    hal_native_reset();
+    hal_native_radio_set_capture(false);
+    resetFlowMeter();
+    resetBatteryMonitor();
+    schedulerReset();
+    hal_native_set_adc_mv(1900);
+    setupFlowSensor();
+    zigbeeConnected = true;
+    scheduleFlowMeter(&battery);
+
+    if (legacy) {
+        schedulerAdd(legacyBatteryJob, BATTERY_CHECK_INTERVAL, 0);
+    } else {
+        setupBatteryMonitor();
+    }
+
+    nextPulseUs = BENCH_PULSE_PERIOD_US;
+    hal_native_set_wait_hook(pulseHook);
+
+    uint64_t start = bench_now_ns();
+    uint64_t endUs = (uint64_t)BENCH_BATTERY_HOURS * 3600 * 1000000ULL;
+    while (hal_native_now_us() < endUs) {
+        schedulerRun();
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+
+    const SchedulerStats* stats = schedulerStats();
+    uint32_t checks = hal_native_adc_read_count() / BATTERY_SAMPLES / (legacy ? 2 : 1);
+    printf("  %-16s %6lu %10.1f %12lu %14.1f %8lu mV\n",
+           legacy ? "blocking read" : "sampler jobs", (unsigned long)checks,
+           stats->maxRunUs / 1000.0, (unsigned long)stats->maxLateMs,
+           (double)elapsed / stats->runs, (unsigned long)batteryMillivolts);
+}
+
+// Benchmark suite runner
+void BatteryBenchmarks(void) {
+    printf("[bench] battery check stall (%d h, flow at 12 pulses/s)\n", BENCH_BATTERY_HOURS);
+    printf("  %-16s %6s %10s %12s %14s %11s\n", "", "checks", "stall (ms)",
+           "flow late ms", "host ns/job", "reading");
+    runHour(true);
+    runHour(false);
+    printf("\n");
+}
@@ -0,0 +1,118 @@
+/*
+ * Boot Benchmarks
+ * Boot to first counted pulse / first report: old blocking setup() vs
+ * background join
+ */
+
+#include "bench.h"
+#include "hal_native.h"
+#include "flow_meter.h"
+#include "scheduler.h"
+#include "zigbee_network.h"
+
+#define BENCH_BOOT_WINDOW_MS 20000
+#define BENCH_FLOW_START_US 50000      // Water already running 50 ms after reset
+#define BENCH_PULSE_PERIOD_US 83333    // 12 pulses/s
+
+static uint64_t nextPulseUs = 0;
+static uint32_t pulsesFired = 0;
+
+static void firePulsesUntil(uint64_t untilUs, bool stopOnNotify) {
+    while (nextPulseUs <= untilUs && !(stopOnNotify && hal_native_notify_pending())) {
+        hal_native_set_micros(nextPulseUs);
+        hal_native_pulse();
+        pulsesFired++;
+        nextPulseUs += BENCH_PULSE_PERIOD_US;
+    }
+}
+
+static void pulseHook(uint64_t deadlineUs) {
+    firePulsesUntil(deadlineUs, true);
+}
+
+// Busy delay(): pulses keep arriving, nothing wakes early
+static void benchDelay(uint32_t ms) {
+    uint64_t wakeUs = hal_native_now_us() + (uint64_t)ms * 1000;
+    firePulsesUntil(wakeUs, false);
+    hal_native_set_micros(wakeUs);
+}
+
+static void resetBoot(bool storedNetwork) {
+    hal_native_reset();
+    hal_native_radio_set_capture(false);
+    resetFlowMeter();
+    resetZigbeeNetwork();
+    schedulerReset();
+
+    NativeNetworkConfig network;
+    network.storedNetwork = storedNetwork;
+    hal_native_radio_set_network(&network);
+
+    nextPulseUs = BENCH_FLOW_START_US;
+    pulsesFired = 0;
+}
+
+static void printBoot(const char* name) {
+    printf("  %-24s %10lu %12lu %6lu of %lu\n", name,
+           (unsigned long)firstPulseMs, (unsigned long)firstReportMs,
+           (unsigned long)(pulsesFired - pulseSourceCount()), (unsigned long)pulsesFired);
+}
+
+/**
+ * Old setup(): delay(1000), load, attach ISR, blocking join in 100 ms
+ * steps (full join every boot), then the delay(10) polling loop
+ */
+static void bench_blocking_boot(bool storedNetwork) {
+    resetBoot(storedNetwork);
+
+    benchDelay(1000);                 // Serial start-up delay
+    loadTotalVolume();
+    setupFlowSensor();                // Pulses before this point are lost
+
+    hal_radio_join();
+    while (hal_radio_network_state() != HAL_NET_JOINED) {
+        benchDelay(100);
+    }
+    zigbeeConnected = true;
+
+    while (hal_millis() < BENCH_BOOT_WINDOW_MS) {
+        benchDelay(10);
+        calculateFlow();
+        periodicSave();
+        shouldReportFlow(flowRateMlMin, totalVolumeMl(), 100);
+    }
+    printBoot(storedNetwork ? "blocking, warm" : "blocking, cold");
+}
+
+/**
+ * New setup(): ISR first, background join, scheduler loop
+ */
+static void bench_background_boot(bool storedNetwork) {
+    static uint8_t battery = 100;
+    resetBoot(storedNetwork);
+
+    setupFlowSensor();
+    loadTotalVolume();
+    scheduleFlowMeter(&battery);
+    zigbeeNetworkBegin();
+
+    hal_native_set_wait_hook(pulseHook);
+    while (hal_millis() < BENCH_BOOT_WINDOW_MS) {
+        schedulerRun();
+    }
+    printBoot(storedNetwork ? "background, warm rejoin" : "background, cold join");
+}
+
+// Benchmark suite runner
+void BootBenchmarks(void) {
+    NativeNetworkConfig network;
+    printf("[bench] boot latency (flow running from %d ms, rejoin %lu ms, join %lu ms)\n",
+           BENCH_FLOW_START_US / 1000, (unsigned long)network.rejoinMs,
+           (unsigned long)network.joinMs);
+    printf("  %-24s %10s %12s %14s\n", "", "pulse (ms)", "report (ms)", "missed by ISR");
+    bench_blocking_boot(false);
+    bench_blocking_boot(true);
+    bench_background_boot(false);
+    bench_background_boot(true);
+    printf("\n");
+}
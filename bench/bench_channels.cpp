@@ -0,0 +1,72 @@
+/*
+ * Flow Channels Benchmarks
+ * Flow window cost against the channel count, every sensor at full flow
+ */
+
+#include "bench.h"
+#include "hal.h"
+#include "flow_channels.h"
+
+#define BENCH_FLOW_LPM 30            // YF-S201 rated maximum, on every channel
+#define BENCH_WINDOWS 1000000        // Flow windows timed per channel count
+
+static const uint64_t pulsePeriodUs =
+    (uint64_t)(60.0e6 / (BENCH_FLOW_LPM * CALIBRATION_FACTOR));
+static const uint64_t windowUs = (uint64_t)FLOW_CALC_INTERVAL * 1000;
+
+/**
+ * BENCH_WINDOWS flow windows of N sensors, each a little out of phase so
+ * the estimators see different edge times
+ */
+template <uint8_t N>
+static void runChannels() {
+    static FlowChannels<N> channels;
+    static CalibrationTable tables[N];
+    channels = flowChannelsInit<N>();
+    for (uint8_t i = 0; i < N; i++) {
+        tables[i] = CALIBRATION_CONFIG_TABLE;
+    }
+
+    PulseReading readings[N];
+    uint64_t cycles = 0;
+    uint64_t startNs = bench_now_ns();
+    for (uint64_t w = 1; w <= BENCH_WINDOWS; w++) {
+        uint64_t nowUs = w * windowUs;
+        for (uint8_t i = 0; i < N; i++) {
+            uint64_t phaseUs = i * pulsePeriodUs / N;
+            uint64_t count = (nowUs - phaseUs) / pulsePeriodUs;
+            readings[i].count = count;
+            readings[i].edgeCount = count;
+            readings[i].edgeUs = count * pulsePeriodUs + phaseUs;
+        }
+        uint64_t start = bench_cycles();
+        flowChannelsUpdate(&channels, readings, tables, nowUs, true);
+        cycles += bench_cycles() - start;
+    }
+    uint64_t elapsedNs = bench_now_ns() - startNs;
+
+    uint64_t sum = 0;
+    for (uint8_t i = 0; i < N; i++) {
+        sum += channels.ledger[i];
+    }
+    double cyclesPerWindow = (double)cycles / BENCH_WINDOWS;
+    printf("  %8u %12.1f %13.1f %10.0f %9.2f   (checksum %llu)\n", (unsigned)N,
+           cyclesPerWindow, cyclesPerWindow / N, (double)elapsedNs / BENCH_WINDOWS,
+           N * 1e6 / pulsePeriodUs, (unsigned long long)(sum & 0xFFFF));
+}
+
+// Benchmark suite runner
+void ChannelsBenchmarks(void) {
+    printf("[bench] flow channels at %d L/min each (%d windows, %u PCNT units)\n",
+           BENCH_FLOW_LPM, BENCH_WINDOWS, (unsigned)HAL_PCNT_UNITS);
+    printf("  %8s %12s %13s %10s %9s\n", "channels", "cyc/window", "cyc/channel",
+           "ns/window", "edges/s");
+    printf("  %8s %12s %13s %10s %9s\n", "", "(host)", "(host)", "(host)", "");
+    runChannels<1>();
+    runChannels<2>();
+    runChannels<4>();
+    runChannels<8>();
+    printf("  (8 channels exceed the C6's %u PCNT units - shown for the per-channel trend)\n",
+           (unsigned)HAL_PCNT_UNITS);
+    printf("\n");
+}
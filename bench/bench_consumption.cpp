@@ -0,0 +1,120 @@
+/*
+ * Consumption Bucket Benchmarks
+ * Household month replayed through the history and the buckets: this
+ * month and yesterday from the buckets vs a history scan, and the NVS
+ * writes the buckets add
+ */
+
+#include "bench.h"
+#include "hal_native.h"
+#include "flow_history.h"
+#include "consumption.h"
+#include "scheduler.h"
+#include "flow_math.h"
+#include "config_traits.h"
+
+#define BENCH_MONTH_START 823219200UL   // 2026-02-01 00:00 UTC
+#define BENCH_DAYS 27
+#define BENCH_SAVE_S (MAX_SAVE_INTERVAL / 1000)
+#define BENCH_RUNS 1000
+
+static uint64_t ledgers[FLOW_CHANNELS];
+static uint32_t bucketWrites = 0;
+
+/**
+ * BENCH_DAYS of household usage from the start of a month, one ledger
+ * step and history update per second like the flow job; the buckets are
+ * saved with the ledger every MAX_SAVE_INTERVAL
+ */
+static void runHouseholdMonth(void) {
+    hal_native_reset();
+    hal_flash_begin(DATA_PARTITION_LABEL);
+    schedulerReset();
+    resetFlowHistory();
+    resetConsumption();
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        ledgers[i] = 0;
+    }
+    historyBegin(&ledgers[0]);
+    historySetClock(BENCH_MONTH_START);
+    consumptionBegin(ledgers);
+    consumptionSave();
+
+    bucketWrites = 0;
+    double pulses = 0.0;
+    for (uint32_t day = 0; day < BENCH_DAYS; day++) {
+        for (uint32_t second = 0; second < 86400; second++) {
+            pulses += bench_household_flow(second) * CALIBRATION_FACTOR / 60.0;
+            ledgers[0] = (uint64_t)pulses;
+            hal_native_advance_ms(1000);
+            historyUpdate();
+            schedulerRunDue();
+            if (second % BENCH_SAVE_S == 0) {
+                uint32_t writes = hal_native_nvs_write_count();
+                consumptionSave();
+                bucketWrites += hal_native_nvs_write_count() - writes;
+            }
+        }
+    }
+    historyFlush();
+}
+
+struct ScanTotal {
+    uint64_t pulses;
+};
+
+static bool addRun(uint32_t startTime, uint32_t intervals, uint32_t pulses, void* context) {
+    (void)startTime;
+    ((ScanTotal*)context)->pulses += (uint64_t)intervals * pulses;
+    return true;
+}
+
+// Cycles per history scan of [from, now) on a tier, and its total
+static double scanCycles(HistoryTier tier, uint32_t from, uint64_t* totalMl) {
+    uint32_t now = historyNow();
+    ScanTotal total = { 0 };
+    historyQuery(tier, from, now, addRun, &total);
+    *totalMl = pulsesToMillilitres(total.pulses);
+
+    uint64_t start = bench_cycles();
+    for (int i = 0; i < BENCH_RUNS; i++) {
+        ScanTotal run = { 0 };
+        historyQuery(tier, from, now, addRun, &run);
+    }
+    return (double)(bench_cycles() - start) / BENCH_RUNS;
+}
+
+// Benchmark suite runner
+void ConsumptionBenchmarks(void) {
+    runHouseholdMonth();
+    ConsumptionTotals totals;
+    consumptionTotals(0, &totals);
+
+    // The replay ends at midnight: yesterday is the last day replayed
+    uint32_t yesterday = BENCH_MONTH_START + (BENCH_DAYS - 1) * 86400;
+    uint64_t scanMonthMl;
+    uint64_t scanYesterdayMl;
+    double monthCycles = scanCycles(HISTORY_1H, BENCH_MONTH_START, &scanMonthMl);
+    double yesterdayCycles = scanCycles(HISTORY_10S, yesterday, &scanYesterdayMl);
+
+    uint64_t start = bench_cycles();
+    uint64_t sum = 0;
+    for (int i = 0; i < BENCH_RUNS * 100; i++) {
+        ConsumptionTotals t;
+        consumptionTotals(0, &t);
+        sum += t.monthMl;
+    }
+    double bucketCycles = (double)(bench_cycles() - start) / (BENCH_RUNS * 100);
+
+    printf("[bench] consumption buckets (%d household days from 2026-02-01)\n", BENCH_DAYS);
+    printf("  this month: %8llu mL buckets, %8llu mL 1 h history scan (%.0f cycles host)\n",
+           (unsigned long long)totals.monthMl, (unsigned long long)scanMonthMl, monthCycles);
+    printf("  yesterday:  %8llu mL buckets, %8llu mL 10 s history scan (%.0f cycles host)\n",
+           (unsigned long long)totals.yesterdayMl, (unsigned long long)scanYesterdayMl,
+           yesterdayCycles);
+    printf("  all five buckets: %.1f cycles (host)  (sum %llu)\n", bucketCycles,
+           (unsigned long long)sum);
+    printf("  NVS writes by the buckets: %.1f per day, one blob after each midnight"
+           " (%u bytes of state per channel)\n\n",
+           (double)bucketWrites / BENCH_DAYS, (unsigned)sizeof(ConsumptionBuckets));
+}
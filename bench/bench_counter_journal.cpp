@@ -0,0 +1,94 @@
+/*
+ * Counter Journal Benchmarks
+ * Flash cost of persisting the pulse ledger: journal vs NVS rewrites
+ */
+
+#include "bench.h"
+#include "hal_native.h"
+#include "counter_journal.h"
+#include "flow_math.h"
+#include "config.h"
+
+#define BENCH_SAVES 100000
+#define BENCH_FLASH_ENDURANCE 100000  // Rated erase cycles per sector
+
+// ESP-IDF NVS: a u64 write appends one 32-byte entry; a 4 KB page holds
+// 126 entries, so roughly one page erase every 126 writes (ignoring the
+// extra copy done when a page is reclaimed)
+#define NVS_ENTRY_BYTES 32
+#define NVS_ENTRIES_PER_PAGE 126
+#define NVS_PAGES 5                   // 20 KB nvs partition
+
+/**
+ * Write amplification and wear for BENCH_SAVES ledger saves
+ */
+static void bench_journal_wear(void) {
+    hal_native_reset();
+    hal_flash_begin(DATA_PARTITION_LABEL);
+
+    CounterJournal journal;
+    uint64_t value = 0;
+    journalBegin(&journal, JOURNAL_OFFSET, JOURNAL_SECTORS);
+    journalRecover(&journal, &value);
+
+    uint64_t start = bench_now_ns();
+    for (uint32_t i = 0; i < BENCH_SAVES; i++) {
+        value += LITRES_TO_PULSES(SAVE_THRESHOLD);
+        journalAppend(&journal, value);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+
+    const NativeFlashStats* stats = hal_native_flash_stats();
+    double nvsErasesPerPage = (double)BENCH_SAVES / NVS_ENTRIES_PER_PAGE / NVS_PAGES;
+
+    // Saves until the most-worn sector reaches its rated endurance
+    double journalLifetime = (double)BENCH_SAVES / stats->maxSectorErases * BENCH_FLASH_ENDURANCE;
+    double nvsLifetime = (double)BENCH_SAVES / nvsErasesPerPage * BENCH_FLASH_ENDURANCE;
+
+    printf("[bench] counter_journal (%d saves, %d sectors)\n", BENCH_SAVES, JOURNAL_SECTORS);
+    printf("  Bytes programmed/save:  %.1f (NVS ~%d)\n",
+           (double)stats->bytesWritten / BENCH_SAVES, NVS_ENTRY_BYTES);
+    printf("  Sector erases:          %lu (NVS ~%.0f)\n",
+           (unsigned long)stats->erases, (double)BENCH_SAVES / NVS_ENTRIES_PER_PAGE);
+    printf("  Max sector wear:        %lu (NVS ~%.0f)\n",
+           (unsigned long)stats->maxSectorErases, nvsErasesPerPage);
+    printf("  Lifetime saves:         %.2e (NVS ~%.2e)\n", journalLifetime, nvsLifetime);
+    printf("  Lifetime @1 save/min:   %.0f years\n", journalLifetime / (60.0 * 24 * 365));
+    printf("  ns per append (host):   %.1f\n\n", (double)elapsed / BENCH_SAVES);
+}
+
+/**
+ * Flash reads needed to find the latest record at boot
+ */
+static void bench_journal_recovery(void) {
+    hal_native_reset();
+    hal_flash_begin(DATA_PARTITION_LABEL);
+
+    CounterJournal journal;
+    uint64_t value = 0;
+    journalBegin(&journal, JOURNAL_OFFSET, JOURNAL_SECTORS);
+    journalRecover(&journal, &value);
+
+    // Leave the ring part-way round, mid-sector
+    uint32_t appends = JOURNAL_SLOTS_PER_SECTOR * JOURNAL_SECTORS * 2 + JOURNAL_SLOTS_PER_SECTOR / 3;
+    for (uint32_t i = 1; i <= appends; i++) {
+        journalAppend(&journal, i);
+    }
+
+    hal_native_flash_clear_stats();
+    journalBegin(&journal, JOURNAL_OFFSET, JOURNAL_SECTORS);
+    bool ok = journalRecover(&journal, &value);
+    const NativeFlashStats* stats = hal_native_flash_stats();
+
+    printf("[bench] counter_journal recovery\n");
+    printf("  Recovered:              %s (%llu of %lu)\n", ok ? "yes" : "NO",
+           (unsigned long long)value, (unsigned long)appends);
+    printf("  Flash reads:            %lu (%llu bytes)\n\n",
+           (unsigned long)stats->reads, (unsigned long long)stats->bytesRead);
+}
+
+// Benchmark suite runner
+void CounterJournalBenchmarks(void) {
+    bench_journal_wear();
+    bench_journal_recovery();
+}
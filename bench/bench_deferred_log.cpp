@@ -0,0 +1,189 @@
+/*
+ * Deferred Logger Benchmarks
+ * Call-site cost and heap use: String/printf logging vs binary records
+ */
+
+#include "bench.h"
+#include "hal_native.h"
+#include "deferred_log.h"
+#include <stdlib.h>
+#include <new>
+#include <string>
+
+#define BENCH_LOG_CALLS 2000000
+#define BENCH_STATUS_PRINTS 20000
+#define BENCH_LOG_BURST 32          // Records between drains (fits the ring)
+
+// Keeps results observable so the compiler can't drop the loops
+static volatile size_t sinkSize;
+
+// Heap allocations made by this process (the firmware's String temporaries)
+static uint64_t heapAllocations = 0;
+
+void* operator new(size_t size) {
+    heapAllocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t size) noexcept {
+    (void)size;
+    free(p);
+}
+
+// ============================================================================
+// Old implementation: format on the call site
+// ============================================================================
+
+/**
+ * hal_log() as used in calculateFlow(): vsnprintf with floats, then the
+ * serial write (the write itself is not timed here)
+ */
+static void legacyFlowLine(uint32_t flowMlMin, uint64_t volumeMl) {
+    char line[160];
+    sinkSize = snprintf(line, sizeof(line), "[Flow] Rate: %.2f L/min, Volume: %.3f L",
+                        flowMlMin / 1000.0f, volumeMl / 1000.0f);
+}
+
+// Arduino String(float, decimals)
+static std::string legacyString(double value, int decimals) {
+    char buf[24];
+    snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+    return std::string(buf);
+}
+
+/**
+ * printSystemStatus() body: one String temporary per operand and per '+'
+ */
+static void legacyStatusPrint(uint32_t flowMlMin, uint64_t volumeMl, uint64_t pulses) {
+    size_t out = 0;
+    out += std::string("Boot #" + std::to_string(12)).size();
+    out += std::string("Uptime: " + std::to_string(86400) + " seconds").size();
+    out += std::string("Wake-ups: " + std::to_string(3814) + " (max late " + std::to_string(0) +
+                       " ms, longest job " + std::to_string(250) + " us)").size();
+    out += std::string("  Flow Rate: " + legacyString(flowMlMin / 1000.0, 2) + " L/min").size();
+    out += std::string("  Total Volume: " + legacyString(volumeMl / 1000.0, 3) + " L").size();
+    out += std::string("  Total Pulses: " + std::to_string(pulses)).size();
+    out += std::string("  Status: " + std::string(flowMlMin > 100 ? "FLOWING" : "IDLE")).size();
+    out += std::string("  First pulse counted: " + std::to_string(50) + " ms").size();
+    out += std::string("  First report: " + std::to_string(300) + " ms").size();
+    out += std::string("  Status: " + std::string("CONNECTED")).size();
+    sinkSize = out;
+}
+
+// ============================================================================
+// Deferred logger
+// ============================================================================
+
+static void deferredStatusPrint(uint32_t flowMlMin, uint64_t volumeMl, uint64_t pulses) {
+    logWrite(LOG_ID_STATUS_BOOT, 12UL);
+    logWrite(LOG_ID_STATUS_UPTIME, 86400UL);
+    logWrite(LOG_ID_STATUS_WAKEUPS, 3814UL, 0UL, 250UL);
+    logWrite(LOG_ID_STATUS_FLOW_RATE, (unsigned long)(flowMlMin / 1000), (unsigned long)(flowMlMin % 1000));
+    logWrite(LOG_ID_STATUS_VOLUME, (unsigned long long)(volumeMl / 1000), (unsigned long)(volumeMl % 1000));
+    logWrite(LOG_ID_STATUS_PULSES, (unsigned long long)pulses);
+    logWrite(flowMlMin > 100 ? LOG_ID_STATUS_FLOWING : LOG_ID_STATUS_IDLE);
+    logWrite(LOG_ID_STATUS_FIRST_PULSE, 50UL);
+    logWrite(LOG_ID_STATUS_FIRST_REPORT, 300UL);
+    logWrite(LOG_ID_STATUS_ZIGBEE_CONNECTED);
+}
+
+// ============================================================================
+// Runner
+// ============================================================================
+
+static void bench_flow_line(void) {
+    uint64_t allocs = heapAllocations;
+    uint64_t start = bench_cycles();
+    for (uint32_t i = 0; i < BENCH_LOG_CALLS; i++) {
+        legacyFlowLine(6000 + (i & 1023), 123456789ULL + i);
+    }
+    uint64_t legacyCycles = bench_cycles() - start;
+    uint64_t legacyAllocs = heapAllocations - allocs;
+
+    // Call site only - the drain runs while the main task sleeps
+    resetDeferredLog();
+    allocs = heapAllocations;
+    uint64_t callCycles = 0;
+    uint64_t drainCycles = 0;
+    uint64_t textBytes = 0;
+    uint64_t frameBytes = 0;
+    LogRecord record;
+    char line[LOG_LINE_MAX];
+    uint8_t frame[LOG_FRAME_MAX];
+
+    for (uint32_t i = 0; i < BENCH_LOG_CALLS; i += BENCH_LOG_BURST) {
+        start = bench_cycles();
+        for (uint32_t j = 0; j < BENCH_LOG_BURST; j++) {
+            logWrite(LOG_ID_FLOW_RATE, (unsigned long)(6000 + ((i + j) & 1023)),
+                     (unsigned long long)(123456789ULL + i + j));
+        }
+        callCycles += bench_cycles() - start;
+
+        start = bench_cycles();
+        while (logRead(&record)) {
+            textBytes += logFormat(&record, line, sizeof(line)) + 1;
+            frameBytes += logEncodeFrame(&record, frame);
+        }
+        drainCycles += bench_cycles() - start;
+    }
+    uint64_t deferredAllocs = heapAllocations - allocs;
+
+    printf("  printf at call site: %7.1f cycles/call, %.2f allocs/call\n",
+           (double)legacyCycles / BENCH_LOG_CALLS, (double)legacyAllocs / BENCH_LOG_CALLS);
+    printf("  LOG() at call site:  %7.1f cycles/call, %.2f allocs/call, %lu dropped\n",
+           (double)callCycles / BENCH_LOG_CALLS, (double)deferredAllocs / BENCH_LOG_CALLS,
+           (unsigned long)logStats()->dropped);
+    printf("  drain (off path):    %7.1f cycles/record (format + encode)\n",
+           (double)drainCycles / BENCH_LOG_CALLS);
+    printf("  serial bytes/record: %5.1f text, %.1f binary\n",
+           (double)textBytes / BENCH_LOG_CALLS, (double)frameBytes / BENCH_LOG_CALLS);
+}
+
+static void bench_status_print(void) {
+    uint64_t allocs = heapAllocations;
+    uint64_t start = bench_cycles();
+    for (uint32_t i = 0; i < BENCH_STATUS_PRINTS; i++) {
+        legacyStatusPrint(6000 + i, 123456789ULL + i, 55555555ULL + i);
+    }
+    uint64_t legacyCycles = bench_cycles() - start;
+    uint64_t legacyAllocs = heapAllocations - allocs;
+
+    resetDeferredLog();
+    allocs = heapAllocations;
+    uint64_t callCycles = 0;
+    LogRecord record;
+    for (uint32_t i = 0; i < BENCH_STATUS_PRINTS; i++) {
+        start = bench_cycles();
+        deferredStatusPrint(6000 + i, 123456789ULL + i, 55555555ULL + i);
+        callCycles += bench_cycles() - start;
+        while (logRead(&record)) {
+        }
+    }
+    uint64_t deferredAllocs = heapAllocations - allocs;
+
+    printf("  String concatenation: %8.1f cycles, %5.1f heap allocs per status print\n",
+           (double)legacyCycles / BENCH_STATUS_PRINTS, (double)legacyAllocs / BENCH_STATUS_PRINTS);
+    printf("  LOG() records:        %8.1f cycles, %5.1f heap allocs per status print (%lu words peak)\n",
+           (double)callCycles / BENCH_STATUS_PRINTS, (double)deferredAllocs / BENCH_STATUS_PRINTS,
+           (unsigned long)logStats()->maxUsedWords);
+}
+
+// Benchmark suite runner
+void DeferredLogBenchmarks(void) {
+    hal_native_reset();
+    printf("[bench] flow debug line (%d calls)\n", BENCH_LOG_CALLS);
+    bench_flow_line();
+    printf("\n[bench] status print (%d prints)\n", BENCH_STATUS_PRINTS);
+    bench_status_print();
+    printf("  LOG_LEVEL 0 (env:release): calls compile out, 0 cycles\n");
+    printf("\n");
+    resetDeferredLog();
+}
@@ -0,0 +1,122 @@
+/*
+ * Flow History Benchmarks
+ * Storage cost of the compressed history and range query throughput
+ */
+
+#include "bench.h"
+#include "hal_native.h"
+#include "flow_history.h"
+#include "scheduler.h"
+#include "flow_math.h"
+#include "config.h"
+
+#define BENCH_HISTORY_DAYS 14
+#define BENCH_RAW_RECORD_BYTES 8     // Fixed-width record: 4-byte time + 4-byte count
+#define BENCH_QUERY_RUNS 200
+
+static uint64_t ledger = 0;
+
+static const uint16_t tierSectors[HISTORY_TIERS] = {
+    HISTORY_SECTORS_10S, HISTORY_SECTORS_1MIN, HISTORY_SECTORS_1H
+};
+static const char* const tierNames[HISTORY_TIERS] = { "10 s", "1 min", "1 h" };
+
+/**
+ * Feed BENCH_HISTORY_DAYS of household usage through the history, one
+ * ledger step and update per second like the flow job, with the hourly
+ * flush job running from the scheduler
+ */
+static void runHouseholdDays(void) {
+    hal_native_reset();
+    hal_flash_begin(DATA_PARTITION_LABEL);
+    schedulerReset();
+    resetFlowHistory();
+    ledger = 0;
+    historyBegin(&ledger);
+
+    double pulses = 0.0;
+    for (uint32_t day = 0; day < BENCH_HISTORY_DAYS; day++) {
+        for (uint32_t second = 0; second < 86400; second++) {
+            pulses += bench_household_flow(second) * CALIBRATION_FACTOR / 60.0;
+            ledger = (uint64_t)pulses;
+            hal_native_advance_ms(1000);
+            historyUpdate();
+            schedulerRunDue();
+        }
+    }
+    historyFlush();
+}
+
+struct QueryCount {
+    uint32_t calls;
+    uint64_t pulses;
+};
+
+static bool countRuns(uint32_t startTime, uint32_t intervals, uint32_t pulses, void* context) {
+    (void)startTime;
+    QueryCount* q = (QueryCount*)context;
+    q->calls++;
+    q->pulses += (uint64_t)intervals * pulses;
+    return true;
+}
+
+/**
+ * Flash bytes per day and retention of each tier vs fixed-width records
+ */
+static void bench_history_storage(void) {
+    runHouseholdDays();
+    const HistoryStats* stats = historyStats();
+
+    printf("[bench] flow_history storage (%d household days)\n", BENCH_HISTORY_DAYS);
+    for (int tier = 0; tier < HISTORY_TIERS; tier++) {
+        uint32_t intervalsPerDay = 86400 / historyIntervalSeconds((HistoryTier)tier);
+        double perDay = (double)stats->tierBytes[tier] / BENCH_HISTORY_DAYS;
+        double raw = (double)intervalsPerDay * BENCH_RAW_RECORD_BYTES;
+        double retention = (double)(tierSectors[tier] - 1) * HAL_FLASH_SECTOR_SIZE / perDay;
+        printf("  %-5s bytes/day:        %.0f (raw %.0f, %.0fx), retention ~%.0f days\n",
+               tierNames[tier], perDay, raw, raw / perDay, retention);
+    }
+    printf("  Blocks written/day:     %.1f\n", (double)stats->blocksWritten / BENCH_HISTORY_DAYS);
+    printf("  Sector erases:          %lu\n\n", (unsigned long)stats->sectorErases);
+}
+
+/**
+ * Streaming a long range out of flash: intervals and callbacks per second
+ */
+static void bench_history_query(void) {
+    runHouseholdDays();
+
+    QueryCount q = { 0, 0 };
+    hal_native_flash_clear_stats();
+    uint32_t intervals = historyQuery(HISTORY_10S, 0, UINT32_MAX, countRuns, &q);
+    const NativeFlashStats* flash = hal_native_flash_stats();
+    uint64_t bytesRead = flash->bytesRead;
+
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < BENCH_QUERY_RUNS; i++) {
+        QueryCount run = { 0, 0 };
+        historyQuery(HISTORY_10S, 0, UINT32_MAX, countRuns, &run);
+    }
+    double seconds = (double)(bench_now_ns() - start) / 1e9 / BENCH_QUERY_RUNS;
+
+    // One day in the middle: the sector search skips everything before it
+    uint32_t dayStart = 86400 * (BENCH_HISTORY_DAYS / 2);
+    QueryCount day = { 0, 0 };
+    hal_native_flash_clear_stats();
+    historyQuery(HISTORY_10S, dayStart, dayStart + 86400, countRuns, &day);
+
+    printf("[bench] flow_history query (10 s tier, %d days)\n", BENCH_HISTORY_DAYS);
+    printf("  Intervals / callbacks:  %lu / %lu (%s ledger)\n", (unsigned long)intervals,
+           (unsigned long)q.calls, q.pulses == ledger ? "matches" : "DIFFERS FROM");
+    printf("  Flash read:             %llu bytes\n", (unsigned long long)bytesRead);
+    printf("  Full scans/s (host):    %.0f (%.1f ns per callback)\n",
+           1.0 / seconds, seconds * 1e9 / q.calls);
+    printf("  One-day query reads:    %llu bytes\n\n",
+           (unsigned long long)hal_native_flash_stats()->bytesRead);
+}
+
+// Benchmark suite runner
+void FlowHistoryBenchmarks(void) {
+    bench_history_storage();
+    bench_history_query();
+}
@@ -0,0 +1,132 @@
+/*
+ * Fixed-Point Flow Math Benchmarks
+ * Per-tick cost and long-run accuracy: legacy float path vs pulse ledger
+ */
+
+#include "bench.h"
+#include "flow_meter.h"
+#include "calibration.h"
+
+#define BENCH_TICKS 20000000ULL
+#define BENCH_DRIFT_PULSES 1000000000ULL
+
+// Keeps results observable so the compiler can't drop the loops
+static volatile uint32_t sinkU32;
+static volatile float sinkFloat;
+
+// Pulses per window cycling through idle, trickle and full flow
+static inline uint32_t benchWindowPulses(uint64_t tick) {
+    static const uint8_t pattern[8] = { 0, 1, 3, 7, 15, 30, 0, 2 };
+    return pattern[tick & 7];
+}
+
+/**
+ * Legacy calculateFlow() arithmetic (float/double, before the ledger)
+ */
+static void bench_tick_legacy(void) {
+    float flowRate = 0.0;
+    float totalVolume = 0.0;
+
+    uint64_t start = bench_cycles();
+    for (uint64_t tick = 0; tick < BENCH_TICKS; tick++) {
+        uint32_t pulses = benchWindowPulses(tick);
+        if (pulses > 0) {
+            flowRate = (pulses / CALIBRATION_FACTOR) * 60.0;
+            float volumeThisSecond = pulses / (CALIBRATION_FACTOR * 60.0);
+            totalVolume += volumeThisSecond;
+        }
+        sinkFloat = flowRate;
+    }
+    uint64_t cycles = bench_cycles() - start;
+    sinkFloat = totalVolume;
+
+    printf("  Legacy float tick:   %.2f cycles\n", (double)cycles / BENCH_TICKS);
+}
+
+/**
+ * Ledger arithmetic used by calculateFlow() + totalVolumeMl() for reports
+ */
+static void bench_tick_ledger(void) {
+    uint64_t ledger = 0;
+    uint32_t rate = 0;
+
+    uint64_t start = bench_cycles();
+    for (uint64_t tick = 0; tick < BENCH_TICKS; tick++) {
+        uint32_t pulses = benchWindowPulses(tick);
+        if (pulses > 0) {
+            ledger += pulses;
+            rate = windowPulsesToFlowRate(pulses);
+        }
+        sinkU32 = rate + (uint32_t)pulsesToMillilitres(ledger);
+    }
+    uint64_t cycles = bench_cycles() - start;
+
+    printf("  Ledger integer tick: %.2f cycles\n", (double)cycles / BENCH_TICKS);
+}
+
+/**
+ * Ledger tick with a calibration curve: table lookup at the current rate,
+ * pulses scaled into the ledger with the fraction carried
+ */
+static void bench_tick_calibrated(void) {
+    static const CalibrationCurve curve = {
+        3, { { 100, 6000 }, { 500, 7000 }, { 1500, 7500 } }
+    };
+    calibrationSetCurve(&curve);
+    uint64_t ledger = 0;
+    uint32_t carry = 0;
+    uint32_t rate = 0;
+
+    uint64_t start = bench_cycles();
+    for (uint64_t tick = 0; tick < BENCH_TICKS; tick++) {
+        uint32_t pulses = benchWindowPulses(tick);
+        if (pulses > 0) {
+            uint32_t nominal = windowPulsesToFlowRate(pulses);
+            uint32_t scale = calibrationScaleAtRate(nominal);
+            uint64_t scaled = (uint64_t)pulses * scale + carry;
+            ledger += scaled >> 16;
+            carry = (uint32_t)(scaled & 0xFFFF);
+            rate = (uint32_t)(((uint64_t)nominal * scale) >> 16);
+        }
+        sinkU32 = rate + (uint32_t)pulsesToMillilitres(ledger);
+    }
+    uint64_t cycles = bench_cycles() - start;
+    resetCalibration();
+
+    printf("  Calibrated tick:     %.2f cycles\n", (double)cycles / BENCH_TICKS);
+}
+
+/**
+ * Volume after 10^9 pulses: float accumulator vs ledger, against exact
+ */
+static void bench_long_run_drift(void) {
+    const uint32_t pulsesPerWindow = 8;   // ~64 L/min
+    float floatVolume = 0.0f;
+    uint64_t ledger = 0;
+
+    for (uint64_t p = 0; p < BENCH_DRIFT_PULSES; p += pulsesPerWindow) {
+        floatVolume += pulsesPerWindow / CALIBRATION_FACTOR;
+        ledger += pulsesPerWindow;
+    }
+
+    double exactLitres = BENCH_DRIFT_PULSES / CALIBRATION_FACTOR;
+    double ledgerLitres = pulsesToMillilitres(ledger) / 1000.0;
+
+    printf("  After %llu pulses (exact %.3f L):\n",
+           (unsigned long long)BENCH_DRIFT_PULSES, exactLitres);
+    printf("    float accumulator: %.3f L (error %.3f L)\n",
+           floatVolume, floatVolume - exactLitres);
+    printf("    pulse ledger:      %.3f L (error %.3f L)\n",
+           ledgerLitres, ledgerLitres - exactLitres);
+}
+
+// Benchmark suite runner
+void FlowMathBenchmarks(void) {
+    printf("[bench] flow math per tick (%llu ticks)\n", (unsigned long long)BENCH_TICKS);
+    bench_tick_legacy();
+    bench_tick_ledger();
+    bench_tick_calibrated();
+    printf("\n[bench] long-run volume accuracy\n");
+    bench_long_run_drift();
+    printf("\n");
+}
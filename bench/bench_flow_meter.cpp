@@ -0,0 +1,72 @@
+/*
+ * Flow Meter Core Benchmarks
+ * Simulates days of household usage through the production loop body
+ */
+
+#include "bench.h"
+#include "hal_native.h"
+#include "flow_meter.h"
+
+#define BENCH_LOOP_PERIOD_MS 10      // Old delay(10) loop - worst-case call rate
+#define BENCH_SIM_DAYS 7
+
+/**
+ * Run the loop body (calculateFlow/periodicSave/shouldReportFlow) for
+ * BENCH_SIM_DAYS of simulated household usage
+ */
+static void bench_simulated_week(void) {
+    hal_native_reset();
+    hal_native_radio_set_capture(false);
+    resetFlowMeter();
+    loadTotalVolume();
+    setupFlowSensor();
+    zigbeeConnected = true;
+
+    const uint64_t ticks = (uint64_t)BENCH_SIM_DAYS * 86400ULL * 1000 / BENCH_LOOP_PERIOD_MS;
+    float pulseFraction = 0.0f;
+    uint32_t reports = 0;
+    uint64_t expectedPulses = 0;
+
+    uint64_t start = bench_now_ns();
+
+    for (uint64_t tick = 0; tick < ticks; tick++) {
+        hal_native_advance_ms(BENCH_LOOP_PERIOD_MS);
+
+        // Feed sensor pulses for this tick
+        uint32_t secondOfDay = (uint32_t)((hal_native_now_us() / 1000000ULL) % 86400);
+        pulseFraction += bench_household_flow(secondOfDay) / 60.0f * CALIBRATION_FACTOR
+                         * BENCH_LOOP_PERIOD_MS / 1000.0f;
+        while (pulseFraction >= 1.0f) {
+            hal_native_pulse();
+            pulseFraction -= 1.0f;
+            expectedPulses++;
+        }
+
+        // Loop body
+        calculateFlow();
+        periodicSave();
+        if (shouldReportFlow(flowRateMlMin, totalVolumeMl(), 100)) {
+            reports++;
+        }
+    }
+
+    uint64_t elapsed = bench_now_ns() - start;
+    double simHours = BENCH_SIM_DAYS * 24.0;
+    double wallMinutes = elapsed / 60e9;
+
+    printf("[bench] flow_meter loop (%d days, %d ms ticks)\n",
+           BENCH_SIM_DAYS, BENCH_LOOP_PERIOD_MS);
+    printf("  Ticks:             %llu\n", (unsigned long long)ticks);
+    printf("  Pulses:            %llu\n", (unsigned long long)expectedPulses);
+    printf("  Reports:           %lu\n", (unsigned long)reports);
+    printf("  NVS writes:        %lu\n", (unsigned long)hal_native_nvs_write_count());
+    printf("  Flash programmed:  %llu bytes\n",
+           (unsigned long long)hal_native_flash_stats()->bytesWritten);
+    printf("  ns per tick:       %.1f\n", (double)elapsed / ticks);
+    printf("  Sim hours/minute:  %.0f\n\n", simHours / wallMinutes);
+}
+
+// Benchmark suite runner
+void FlowMeterBenchmarks(void) {
+    bench_simulated_week();
+}
@@ -0,0 +1,45 @@
+/*
+ * Latency Statistics Benchmarks
+ * Cost of one latency probe sample
+ */
+
+#include "bench.h"
+#include "latency_stats.h"
+
+#define BENCH_SAMPLES 100000000ULL
+
+void LatencyStatsBenchmarks(void) {
+    printf("[bench] latency probe (host cycles/sample)\n");
+
+    #if LATENCY_STATS_ENABLED
+    resetLatencyStats();
+
+    // Spread over the buckets like real durations (LCG, mostly small)
+    uint32_t value = 1;
+    uint64_t start = bench_cycles();
+    for (uint64_t i = 0; i < BENCH_SAMPLES; i++) {
+        value = value * 1664525 + 1013904223;
+        latencyRecord(LATENCY_LOOP, value >> (value & 31));
+    }
+    uint64_t cycles = bench_cycles() - start;
+
+    // The same loop without the record call
+    uint32_t sum = 0;
+    value = 1;
+    start = bench_cycles();
+    for (uint64_t i = 0; i < BENCH_SAMPLES; i++) {
+        value = value * 1664525 + 1013904223;
+        sum += value >> (value & 31);
+    }
+    uint64_t baseline = bench_cycles() - start;
+
+    printf("  latencyRecord()            %8.2f   (%lu samples, checksum %lu)\n",
+           (double)(cycles > baseline ? cycles - baseline : 0) / BENCH_SAMPLES,
+           (unsigned long)latencySamples(LATENCY_LOOP), (unsigned long)(sum & 0xFFFF));
+    printf("  histogram memory           %5u bytes (%u sections)\n\n",
+           (unsigned)(LATENCY_SECTIONS * sizeof(LatencyHistogram)), (unsigned)LATENCY_SECTIONS);
+    resetLatencyStats();
+    #else
+    printf("  compiled out (LATENCY_STATS_ENABLED=0)\n\n");
+    #endif
+}
@@ -0,0 +1,163 @@
+/*
+ * Leak Detection Benchmarks
+ * Synthetic leak traces replayed through the scheduled metering core:
+ * alarm detection latency, false alarms, and the detector's cost
+ */
+
+#include "bench.h"
+#include "hal_native.h"
+#include "flow_meter.h"
+#include "scheduler.h"
+#include "metering_cluster.h"
+#include "leak_detector.h"
+#include "config_traits.h"
+
+#define BENCH_UPDATES 10000000ULL    // Detector updates timed
+
+struct LeakScenario {
+    const char* name;
+    uint32_t days;           // Replay length
+    uint32_t leakStart;      // Second of the replay the leak starts (UINT32_MAX: none)
+    float leakLpm;           // Leak flow on top of the household's (L/min)
+    uint8_t expected;        // LEAK_ALARM_* the leak should raise
+};
+
+static const LeakScenario scenarios[] = {
+    { "household day",       2, UINT32_MAX,  0.0f,  0 },
+    { "running toilet",      1, 2 * 3600,    0.5f,  LEAK_ALARM_CONTINUOUS },
+    { "weeping valve",       2, 1 * 3600,    0.3f,  LEAK_ALARM_CONTINUOUS },
+    { "slow drip",           2, 1 * 3600,    0.05f, LEAK_ALARM_NEVER_QUIET },
+    { "burst pipe",          1, 3 * 3600,    30.0f, LEAK_ALARM_BURST },
+    { "garden hose left on", 1, 19 * 3600,   12.0f, LEAK_ALARM_BURST },
+};
+
+// Edge generator: household flow plus the scenario's leak, second by second
+static const LeakScenario* scenario = nullptr;
+static uint32_t edgeSecond = 0;      // Second the generator has reached
+static double secondPulses = 0.0;    // Pulses the trace put before edgeSecond
+static uint64_t edgesFired = 0;
+static uint64_t nextEdgeUs = 0;
+static uint32_t endSecond = 0;
+
+static double pulsesPerSecond(uint32_t second) {
+    double lpm = bench_household_flow(second % 86400);
+    if (second >= scenario->leakStart) {
+        lpm += scenario->leakLpm;
+    }
+    return lpm * CALIBRATION_FACTOR / 60.0;
+}
+
+// Time of the next edge: where the integrated flow reaches the next pulse
+static uint64_t edgeTime() {
+    double target = (double)(edgesFired + 1);
+    while (edgeSecond < endSecond) {
+        double pps = pulsesPerSecond(edgeSecond);
+        if (secondPulses + pps >= target) {
+            return (uint64_t)edgeSecond * 1000000ULL + (uint64_t)((target - secondPulses) / pps * 1e6);
+        }
+        secondPulses += pps;
+        edgeSecond++;
+    }
+    return UINT64_MAX;
+}
+
+static void fireEdges(uint64_t deadlineUs) {
+    while (nextEdgeUs <= deadlineUs && !hal_native_notify_pending()) {
+        hal_native_set_micros(nextEdgeUs);
+        hal_native_pulse();
+        edgesFired++;
+        nextEdgeUs = edgeTime();
+    }
+}
+
+/**
+ * Replay one scenario, joined, with the jobs as on the device
+ */
+static void runScenario(const LeakScenario* s) {
+    static uint8_t battery = 100;
+    hal_native_reset();
+    resetFlowMeter();
+    schedulerReset();
+    loadTotalVolume();
+    setupFlowSensor();
+    scheduleFlowMeter(&battery);
+    zigbeeConnected = true;
+
+    scenario = s;
+    edgeSecond = 0;
+    secondPulses = 0.0;
+    edgesFired = 0;
+    endSecond = s->days * 86400;
+    nextEdgeUs = edgeTime();
+    hal_native_set_wait_hook(fireEdges);
+
+    // First frame carrying an alarm, the alarms raised before the leak
+    // started (false alarms) and after
+    uint64_t onAirUs = UINT64_MAX;
+    uint8_t raised = 0;
+    uint8_t falseAlarms = 0;
+    uint64_t leakUs = s->leakStart == UINT32_MAX ? UINT64_MAX : (uint64_t)s->leakStart * 1000000ULL;
+    uint64_t endUs = (uint64_t)endSecond * 1000000ULL;
+    while (hal_native_now_us() < endUs) {
+        schedulerRun();
+        if (hal_native_now_us() < leakUs) {
+            falseAlarms |= leakAlarms();
+        } else {
+            raised |= leakAlarms();
+        }
+        for (size_t i = 0; i < hal_native_radio_frame_count(); i++) {
+            const NativeRadioFrame* frame = hal_native_radio_frame(i);
+            for (uint8_t a = 0; a < frame->count; a++) {
+                if (frame->attrs[a].attrId == METERING_STATUS_ATTR && frame->attrs[a].value[0] != 0 &&
+                    frame->timeUs >= leakUs && onAirUs == UINT64_MAX) {
+                    onAirUs = frame->timeUs;
+                }
+            }
+        }
+        hal_native_radio_clear();
+    }
+    hal_native_set_wait_hook(nullptr);
+
+    const char* detected = s->expected == 0 ? "-" : (raised & s->expected) ? "yes" : "MISSED";
+    char latency[24] = "-";
+    if (s->expected != 0 && onAirUs != UINT64_MAX) {
+        snprintf(latency, sizeof(latency), "%.1f min", (onAirUs - leakUs) / 60e6);
+    }
+    printf("  %-20s %5.2f %6u %7s %12s %7s   0x%02x\n", s->name, s->leakLpm, (unsigned)s->days * 24,
+           detected, latency, falseAlarms ? "YES" : "none", (unsigned)raised);
+}
+
+/**
+ * Cost of one detector update while a draw runs (the per-window path)
+ */
+static void detectorCost() {
+    LeakDetector leak;
+    leakDetectorReset(&leak, 0, 0);
+    uint64_t ledger = 0;
+    uint8_t alarms = 0;
+    uint64_t start = bench_cycles();
+    for (uint64_t i = 1; i <= BENCH_UPDATES; i++) {
+        ledger += i & 3;
+        alarms |= leakDetectorUpdate(&leak, ledger, 30000, (uint32_t)i * FLOW_CALC_INTERVAL);
+        if ((i & 0xFFF) == 0) {
+            leakDetectorUpdate(&leak, ledger, 0, (uint32_t)i * FLOW_CALC_INTERVAL);   // Draw ends
+        }
+    }
+    uint64_t cycles = bench_cycles() - start;
+    printf("  detector update:   %.1f cycles (host), %u bytes of state per channel  (alarms 0x%02x)\n",
+           (double)cycles / BENCH_UPDATES, (unsigned)sizeof(LeakDetector), (unsigned)alarms);
+}
+
+// Benchmark suite runner
+void LeakBenchmarks(void) {
+    printf("[bench] leak detection (continuous %d min, quiet %d min in %d h, burst %.0f L)\n",
+           LEAK_CONTINUOUS_FLOW, LEAK_QUIET_PERIOD, LEAK_NEVER_QUIET, LEAK_BURST_VOLUME);
+    printf("  %-20s %5s %6s %7s %12s %7s   %s\n", "trace", "L/min", "hours", "alarm",
+           "leak->on air", "false", "raised");
+    printf("  %-20s %5s %6s %7s %12s %7s   %s\n", "", "leak", "", "", "", "", "(leak on)");
+    for (const LeakScenario& s : scenarios) {
+        runScenario(&s);
+    }
+    detectorCost();
+    printf("\n");
+}
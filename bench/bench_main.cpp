@@ -0,0 +1,36 @@
+/*
+ * Water Flow Meter - Host Benchmark Runner
+ * Runs the real metering core against simulated time on the host
+ *
+ * Run: pio run -e bench -t exec
+ */
+
+#include "bench.h"
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+
+    printf("========================================\n");
+    printf("Water Flow Meter - Host Benchmarks\n");
+    printf("========================================\n\n");
+
+    FlowMeterBenchmarks();
+    FlowMathBenchmarks();
+    CounterJournalBenchmarks();
+    SchedulerBenchmarks();
+    BatteryBenchmarks();
+    BootBenchmarks();
+    DeferredLogBenchmarks();
+    FlowHistoryBenchmarks();
+    PulseSourceBenchmarks();
+    SeqlockBenchmarks();
+    LatencyStatsBenchmarks();
+    ChannelsBenchmarks();
+    LeakBenchmarks();
+    AlarmBenchmarks();
+    UsageBenchmarks();
+    ConsumptionBenchmarks();
+
+    return 0;
+}
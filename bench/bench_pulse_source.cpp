@@ -0,0 +1,84 @@
+/*
+ * Pulse Source Benchmarks
+ * Interrupts and CPU at 30 L/min: GPIO interrupt per edge vs PCNT
+ */
+
+#include "bench.h"
+#include "hal_native.h"
+#include "flow_meter.h"
+#include "scheduler.h"
+
+#define BENCH_FLOW_LPM 30            // YF-S201 rated maximum
+#define BENCH_SIM_SECONDS 3600
+#define BENCH_BOUNCES 3              // Noise spikes after each edge (noisy sensor)
+#define BENCH_BOUNCE_NS 2000         // Spike width - below the PCNT glitch filter
+
+static const uint64_t pulsePeriodUs =
+    (uint64_t)(60.0e6 / (BENCH_FLOW_LPM * CALIBRATION_FACTOR));
+static uint64_t nextEdgeUs = 0;
+static uint32_t bounces = 0;
+static uint64_t edgeCycles = 0;      // Host cycles spent firing edges (ISR path)
+
+static void fireEdges(uint64_t deadlineUs) {
+    while (nextEdgeUs <= deadlineUs && !hal_native_notify_pending()) {
+        hal_native_set_micros(nextEdgeUs);
+        uint64_t start = bench_cycles();
+        hal_native_pulse();
+        for (uint32_t i = 0; i < bounces; i++) {
+            hal_native_glitch(BENCH_BOUNCE_NS);
+        }
+        edgeCycles += bench_cycles() - start;
+        nextEdgeUs += pulsePeriodUs;
+    }
+}
+
+/**
+ * An hour of steady 30 L/min through the scheduled flow jobs
+ */
+static void runBackend(uint8_t backend, uint32_t bouncesPerEdge) {
+    static uint8_t battery = 100;
+    hal_native_reset();
+    hal_native_radio_set_capture(false);
+    resetFlowMeter();
+    schedulerReset();
+    loadTotalVolume();
+    selectPulseBackend(backend);
+    scheduleFlowMeter(&battery);
+
+    nextEdgeUs = pulsePeriodUs;
+    bounces = bouncesPerEdge;
+    edgeCycles = 0;
+    hal_native_set_wait_hook(fireEdges);
+
+    uint64_t endUs = (uint64_t)BENCH_SIM_SECONDS * 1000000ULL;
+    uint64_t start = bench_cycles();
+    while (hal_native_now_us() < endUs) {
+        schedulerRun();
+    }
+    uint64_t taskCycles = bench_cycles() - start - edgeCycles;
+    calculateFlow();
+
+    uint64_t truePulses = (endUs - pulsePeriodUs) / pulsePeriodUs + 1;
+    printf("  %-5s %-6s %8.2f %9.2f %9.2f %11.0f %10.0f\n",
+           backend == PULSE_BACKEND_PCNT ? "PCNT" : "GPIO", bouncesPerEdge ? "noisy" : "clean",
+           (double)pulseSourceStats()->interrupts / BENCH_SIM_SECONDS,
+           (double)schedulerStats()->wakeups / BENCH_SIM_SECONDS,
+           (double)totalPulses / truePulses,
+           (double)edgeCycles / BENCH_SIM_SECONDS,
+           (double)taskCycles / BENCH_SIM_SECONDS);
+}
+
+// Benchmark suite runner
+void PulseSourceBenchmarks(void) {
+    printf("[bench] pulse source at %d L/min (%.2f pulses/s, %d s)\n", BENCH_FLOW_LPM,
+           1e6 / pulsePeriodUs, BENCH_SIM_SECONDS);
+    printf("  %-5s %-6s %8s %9s %9s %11s %10s\n", "", "", "ISRs/s", "wakeups/s",
+           "counted/", "edge cyc/s", "task cyc/s");
+    printf("  %-5s %-6s %8s %9s %9s %11s %10s\n", "", "", "", "", "true", "(host)", "(host)");
+    runBackend(PULSE_BACKEND_GPIO, 0);
+    runBackend(PULSE_BACKEND_PCNT, 0);
+    runBackend(PULSE_BACKEND_GPIO, BENCH_BOUNCES);
+    runBackend(PULSE_BACKEND_PCNT, BENCH_BOUNCES);
+    printf("  (edge cycles include the host simulation of the edge itself;\n");
+    printf("   PCNT counting costs no CPU on the device)\n\n");
+}
@@ -0,0 +1,198 @@
+/*
+ * Scheduler Benchmarks
+ * Wake-ups and deadline lateness: old delay(10) polling loop vs scheduler
+ */
+
+#include "bench.h"
+#include "hal_native.h"
+#include "flow_meter.h"
+#include "scheduler.h"
+#include <math.h>
+#include <vector>
+
+#define BENCH_SIM_HOURS 24
+#define BENCH_POLL_PERIOD_MS 10      // delay(10) in the old loop()
+
+// Pulse edge times for the simulated day of household usage
+static std::vector<uint64_t> pulseTimes;
+static size_t nextPulse = 0;
+
+// Flow start latency: second edge after idle -> first non-zero rate
+static uint32_t edgesWhileIdle = 0;
+static uint64_t startPendingUs = 0;
+static uint64_t startLatencySumUs = 0;
+static uint64_t startLatencyMaxUs = 0;
+static uint32_t flowStarts = 0;
+
+static void buildPulseTimes() {
+    pulseTimes.clear();
+    double carry = 0.0;   // Fraction of a pulse accumulated so far
+    for (uint32_t second = 0; second < BENCH_SIM_HOURS * 3600; second++) {
+        double perSecond = bench_household_flow(second % 86400) / 60.0 * CALIBRATION_FACTOR;
+        if (perSecond <= 0.0) {
+            continue;
+        }
+        for (double t = (1.0 - carry) / perSecond; t < 1.0; t += 1.0 / perSecond) {
+            pulseTimes.push_back((uint64_t)second * 1000000ULL + (uint64_t)(t * 1e6));
+        }
+        carry = carry + perSecond - floor(carry + perSecond);
+    }
+}
+
+static void resetMeter() {
+    hal_native_reset();
+    hal_native_radio_set_capture(false);
+    resetFlowMeter();
+    schedulerReset();
+    loadTotalVolume();
+    setupFlowSensor();
+    zigbeeConnected = true;
+
+    nextPulse = 0;
+    edgesWhileIdle = 0;
+    startPendingUs = 0;
+    startLatencySumUs = 0;
+    startLatencyMaxUs = 0;
+    flowStarts = 0;
+}
+
+static void firePulse(uint64_t atUs) {
+    hal_native_set_micros(atUs);
+    hal_native_pulse();
+    if (flowRateMlMin == 0 && ++edgesWhileIdle == 2) {
+        startPendingUs = atUs;
+    }
+}
+
+// Called whenever the main task has run - closes a pending start
+static void checkFlowStart() {
+    if (flowRateMlMin == 0 || startPendingUs == 0) {
+        if (flowRateMlMin != 0) {
+            edgesWhileIdle = 0;
+        }
+        return;
+    }
+    uint64_t latency = hal_native_now_us() - startPendingUs;
+    startLatencySumUs += latency;
+    if (latency > startLatencyMaxUs) {
+        startLatencyMaxUs = latency;
+    }
+    flowStarts++;
+    startPendingUs = 0;
+    edgesWhileIdle = 0;
+}
+
+static void printResult(const char* name, uint64_t wakeups, uint32_t runs,
+                        uint64_t lateSumMs, uint32_t lateMaxMs) {
+    printf("  %-10s %10.0f %9.2f %7lu %10.2f %9.2f %9llu\n", name,
+           (double)wakeups / BENCH_SIM_HOURS,
+           runs ? (double)lateSumMs / runs : 0.0, (unsigned long)lateMaxMs,
+           flowStarts ? startLatencySumUs / 1000.0 / flowStarts : 0.0,
+           startLatencyMaxUs / 1000.0, (unsigned long long)totalPulses);
+}
+
+// ============================================================================
+// Old loop(): wake every 10 ms and poll every timer
+// ============================================================================
+
+// "if (millis() - last > interval) { ...; last = millis(); }"
+struct PollTimer {
+    uint32_t interval;
+    uint32_t last;
+};
+
+static uint32_t pollRuns = 0;
+static uint64_t pollLateSum = 0;
+static uint32_t pollLateMax = 0;
+
+static void pollTimer(PollTimer* timer) {
+    uint32_t now = hal_millis();
+    if (now - timer->last <= timer->interval) {
+        return;
+    }
+    // Lateness of this run against its own deadline (the drift this adds
+    // to every following deadline is not counted)
+    uint32_t late = now - timer->last - timer->interval;
+    pollRuns++;
+    pollLateSum += late;
+    if (late > pollLateMax) {
+        pollLateMax = late;
+    }
+    timer->last = now;
+}
+
+static void bench_polling_loop(void) {
+    resetMeter();
+    PollTimer led = { STATUS_LED_INTERVAL, 0 };
+    PollTimer status = { STATUS_PRINT_INTERVAL, 0 };
+    pollRuns = 0;
+    pollLateSum = 0;
+    pollLateMax = 0;
+
+    uint64_t endUs = (uint64_t)BENCH_SIM_HOURS * 3600 * 1000000ULL;
+    uint64_t wakeups = 0;
+    while (hal_native_now_us() < endUs) {
+        uint64_t tickEndUs = hal_native_now_us() + BENCH_POLL_PERIOD_MS * 1000;
+        while (nextPulse < pulseTimes.size() && pulseTimes[nextPulse] <= tickEndUs) {
+            firePulse(pulseTimes[nextPulse++]);
+        }
+        hal_native_set_micros(tickEndUs);
+        wakeups++;
+
+        calculateFlow();
+        periodicSave();
+        shouldReportFlow(flowRateMlMin, totalVolumeMl(), 100);
+        pollTimer(&led);
+        pollTimer(&status);
+        checkFlowStart();
+    }
+
+    printResult("delay(10)", wakeups, pollRuns, pollLateSum, pollLateMax);
+}
+
+// ============================================================================
+// Scheduler: sleep until the next deadline or a pulse notification
+// ============================================================================
+
+static void benchJob() {
+}
+
+static void schedulerPulseHook(uint64_t deadlineUs) {
+    while (nextPulse < pulseTimes.size() && pulseTimes[nextPulse] <= deadlineUs &&
+           !hal_native_notify_pending()) {
+        firePulse(pulseTimes[nextPulse++]);
+    }
+}
+
+static void bench_scheduler_loop(void) {
+    static uint8_t battery = 100;
+    resetMeter();
+
+    // Same jobs as setup() in main.cpp
+    scheduleFlowMeter(&battery);
+    schedulerAdd(benchJob, STATUS_LED_INTERVAL, STATUS_LED_INTERVAL);
+    schedulerAdd(benchJob, STATUS_PRINT_INTERVAL, STATUS_PRINT_INTERVAL);
+    hal_native_set_wait_hook(schedulerPulseHook);
+
+    uint64_t endUs = (uint64_t)BENCH_SIM_HOURS * 3600 * 1000000ULL;
+    while (hal_native_now_us() < endUs) {
+        schedulerRun();
+        checkFlowStart();
+    }
+
+    const SchedulerStats* stats = schedulerStats();
+    printResult("scheduler", stats->wakeups, stats->runs, stats->totalLateMs, stats->maxLateMs);
+    printf("  (%lu of the scheduler wake-ups were pulse notifications)\n\n",
+           (unsigned long)stats->notifications);
+}
+
+// Benchmark suite runner
+void SchedulerBenchmarks(void) {
+    buildPulseTimes();
+    printf("[bench] main loop wake-ups (%d h household day)\n", BENCH_SIM_HOURS);
+    printf("  %-10s %10s %9s %7s %10s %9s %9s\n", "", "wakeups/h", "late avg",
+           "max", "start avg", "max", "pulses");
+    printf("  %-10s %10s %9s %7s %10s %9s %9s\n", "", "", "(ms)", "(ms)", "(ms)", "(ms)", "");
+    bench_polling_loop();
+    bench_scheduler_loop();
+}
@@ -0,0 +1,139 @@
+/*
+ * Seqlock Benchmarks
+ * Cost of reading ISR-shared pulse state, and a reader/ISR stress race
+ */
+
+#include <atomic>
+#include <thread>
+#include "bench.h"
+#include "seqlock.h"
+
+#define BENCH_READS 100000000ULL          // Uncontended reads per method
+
+// Reads raced against the writer thread: a short run by default, the full
+// race (about 40 s) with -DBENCH_SEQLOCK_FULL_RACE in build_flags
+#ifdef BENCH_SEQLOCK_FULL_RACE
+#define BENCH_STRESS_READS 1000000000ULL
+#else
+#define BENCH_STRESS_READS 20000000ULL
+#endif
+
+struct BenchEdge {
+    uint64_t count;
+    uint64_t edgeUs;
+};
+
+static inline uint64_t benchEdgeUs(uint64_t count) {
+    return count * 83333 + 0xFFFFFFFFULL;
+}
+
+// Old layout: two independent volatile words
+static volatile uint32_t plainCount = 0;
+static volatile uint32_t plainEdgeUs = 0;
+
+// Critical section analog: the C6's portENTER_CRITICAL masks interrupts
+// and takes a spinlock - the host can only model the spinlock half
+static std::atomic_flag criticalLock = ATOMIC_FLAG_INIT;
+static BenchEdge criticalEdge = {};
+
+static Seqlock<BenchEdge> shared = {};
+
+static void printRead(const char* name, uint64_t cycles, uint64_t sum) {
+    printf("  %-26s %8.2f   (checksum %llu)\n", name, (double)cycles / BENCH_READS,
+           (unsigned long long)(sum & 0xFFFF));
+}
+
+static void uncontendedReads() {
+    uint64_t sum = 0;
+    uint64_t start = bench_cycles();
+    for (uint64_t i = 0; i < BENCH_READS; i++) {
+        sum += plainCount + plainEdgeUs;
+    }
+    printRead("two volatile loads (torn)", bench_cycles() - start, sum);
+
+    sum = 0;
+    start = bench_cycles();
+    for (uint64_t i = 0; i < BENCH_READS; i++) {
+        while (criticalLock.test_and_set(std::memory_order_acquire)) {
+        }
+        BenchEdge edge = criticalEdge;
+        criticalLock.clear(std::memory_order_release);
+        sum += edge.count + edge.edgeUs;
+    }
+    printRead("critical section (spinlock)", bench_cycles() - start, sum);
+
+    sum = 0;
+    start = bench_cycles();
+    for (uint64_t i = 0; i < BENCH_READS; i++) {
+        BenchEdge edge = seqlockRead(&shared);
+        sum += edge.count + edge.edgeUs;
+    }
+    printRead("seqlock", bench_cycles() - start, sum);
+    printf("  (on the C6 the seqlock replaces a critical section that masks interrupts;\n"
+           "   the host spinlock row leaves that half out and is not the device cost)\n");
+}
+
+/**
+ * Reader against a writer thread publishing as fast as it can - far more
+ * often than any pulse ISR - counting torn snapshots and retries
+ */
+static void stressRace() {
+    std::atomic<bool> stop(false);
+    uint64_t written = 0;
+    BenchEdge first = { 0xFFFF0000ULL, benchEdgeUs(0xFFFF0000ULL) };
+    seqlockWrite(&shared, first);
+
+    std::thread isr([&]() {
+        uint64_t count = first.count;
+        while (!stop.load(std::memory_order_relaxed)) {
+            count++;
+            BenchEdge edge = { count, benchEdgeUs(count) };
+            seqlockWrite(&shared, edge);
+        }
+        written = count - first.count;
+    });
+
+    uint64_t torn = 0;
+    uint64_t backwards = 0;
+    uint64_t retries = 0;
+    uint64_t previous = first.count;
+    uint64_t startNs = bench_now_ns();
+    for (uint64_t i = 0; i < BENCH_STRESS_READS; i++) {
+        BenchEdge edge;
+        uint32_t seq;
+        for (;;) {
+            seq = seqlockReadBegin(&shared);
+            seqlockCopy(&shared, &edge);
+            if (!seqlockReadRetry(&shared, seq)) {
+                break;
+            }
+            retries++;
+        }
+        torn += edge.edgeUs != benchEdgeUs(edge.count);
+        backwards += edge.count < previous;
+        previous = edge.count;
+    }
+    uint64_t elapsedNs = bench_now_ns() - startNs;
+    stop.store(true, std::memory_order_relaxed);
+    isr.join();
+
+    printf("  %llu reads vs %llu writes in %.1f s (count crossed 2^32: %s)\n",
+           (unsigned long long)BENCH_STRESS_READS, (unsigned long long)written,
+           elapsedNs / 1e9, previous > 0xFFFFFFFFULL ? "yes" : "no");
+    printf("  torn %llu, went backwards %llu, retried %llu (%.3f%%)\n",
+           (unsigned long long)torn, (unsigned long long)backwards,
+           (unsigned long long)retries, 100.0 * retries / BENCH_STRESS_READS);
+#ifndef BENCH_SEQLOCK_FULL_RACE
+    printf("  (short run; -DBENCH_SEQLOCK_FULL_RACE races a billion reads)\n");
+#endif
+}
+
+// Benchmark suite runner
+void SeqlockBenchmarks(void) {
+    printf("[bench] ISR-shared pulse state reads (host cycles/read, uncontended)\n");
+    uncontendedReads();
+    printf("[bench] seqlock stress race (writer thread vs reader, %u host CPUs)\n",
+           std::thread::hardware_concurrency());
+    stressRace();
+    printf("\n");
+}
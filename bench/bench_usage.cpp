@@ -0,0 +1,277 @@
+/*
+ * Usage Event Benchmarks
+ * Labelled synthetic draws replayed through the scheduled metering core:
+ * classifier accuracy, segmenter and classifier cost, and the frames a
+ * long shower costs streaming rate reports and with one event
+ */
+
+#include "bench.h"
+#include "hal_native.h"
+#include "flow_meter.h"
+#include "scheduler.h"
+#include "metering_cluster.h"
+#include "report_engine.h"
+#include "usage_events.h"
+#include "config_traits.h"
+#include <vector>
+
+#define BENCH_DRAWS_PER_CLASS 20
+#define BENCH_GAP_S 120              // Idle between draws (past FLOW_IDLE_TIMEOUT)
+#define BENCH_JITTER 0.15            // Second-to-second rate wobble (fraction)
+#define BENCH_WINDOWS 10000000ULL    // Segmenter updates timed
+
+static const char* const classNames[USAGE_CLASSES] = {
+    "other", "tap", "toilet", "shower", "appliance", "garden",
+};
+
+// Rate (L/min) and length (s) ranges a labelled draw is drawn from
+struct DrawProfile {
+    uint8_t usageClass;
+    float minLpm, maxLpm;
+    uint32_t minS, maxS;
+};
+
+static const DrawProfile profiles[] = {
+    { USAGE_TAP,        2.0f,  7.0f,   10,   60 },
+    { USAGE_TOILET,     6.0f, 10.0f,   30,   60 },
+    { USAGE_SHOWER,     6.0f, 10.5f,  240,  900 },
+    { USAGE_APPLIANCE,  1.0f,  2.8f,  180,  900 },
+    { USAGE_GARDEN,    12.0f, 20.0f,  300, 2400 },
+};
+
+// Deterministic pseudo-random numbers (same traces every run)
+static uint32_t seed = 12345;
+
+static float uniform(float lo, float hi) {
+    seed = seed * 1664525u + 1013904223u;
+    return lo + (hi - lo) * (float)(seed >> 8) / (float)(1u << 24);
+}
+
+// Trace: flow (L/min) second by second, the labels of its draws and the
+// classes of the events the replay made of them
+static std::vector<float> trace;
+static std::vector<uint8_t> labels;
+static std::vector<uint8_t> classes;
+
+static void addDraw(uint8_t usageClass, float lpm, uint32_t seconds) {
+    for (uint32_t s = 0; s < seconds; s++) {
+        trace.push_back(lpm * uniform(1.0f - BENCH_JITTER, 1.0f + BENCH_JITTER));
+    }
+    trace.insert(trace.end(), BENCH_GAP_S, 0.0f);
+    labels.push_back(usageClass);
+}
+
+static void buildTrace() {
+    trace.assign(BENCH_GAP_S, 0.0f);
+    labels.clear();
+    for (int n = 0; n < BENCH_DRAWS_PER_CLASS; n++) {
+        for (const DrawProfile& p : profiles) {
+            addDraw(p.usageClass, uniform(p.minLpm, p.maxLpm),
+                    (uint32_t)uniform((float)p.minS, (float)p.maxS));
+        }
+    }
+}
+
+// Edge generator: where the integrated flow reaches the next pulse
+static uint32_t edgeSecond = 0;
+static double secondPulses = 0.0;
+static uint64_t edgesFired = 0;
+static uint64_t nextEdgeUs = 0;
+
+static uint64_t edgeTime() {
+    double target = (double)(edgesFired + 1);
+    while (edgeSecond < trace.size()) {
+        double pps = trace[edgeSecond] * CALIBRATION_FACTOR / 60.0;
+        if (secondPulses + pps >= target) {
+            return (uint64_t)edgeSecond * 1000000ULL + (uint64_t)((target - secondPulses) / pps * 1e6);
+        }
+        secondPulses += pps;
+        edgeSecond++;
+    }
+    return UINT64_MAX;
+}
+
+static void fireEdges(uint64_t deadlineUs) {
+    while (nextEdgeUs <= deadlineUs && !hal_native_notify_pending()) {
+        hal_native_set_micros(nextEdgeUs);
+        hal_native_pulse();
+        edgesFired++;
+        nextEdgeUs = edgeTime();
+    }
+}
+
+struct FrameCount {
+    uint32_t metering;
+    uint32_t usage;
+    uint64_t bytes;
+};
+
+// Reporting the coordinator configures for the replay
+enum BenchReporting {
+    BENCH_STREAMING,         // Rate and volume change reports during draws (no hold)
+    BENCH_DEFAULTS,          // ... held during draws (USAGE_HOLD_REPORTS)
+    BENCH_DEMAND_OFF,        // Demand reports off
+    BENCH_EVENTS_ONLY,       // ... and the summation every BENCH_SUMMATION_S only
+};
+
+#define BENCH_SUMMATION_S 600
+
+static void configure(uint16_t attrId, uint8_t zclType, uint16_t maxS, uint64_t change) {
+    HalReportingConfig record = {};
+    record.endpoint = FLOW_ENDPOINT;
+    record.clusterId = METERING_CLUSTER_ID;
+    record.attrId = attrId;
+    record.zclType = zclType;
+    record.maxIntervalS = maxS;
+    record.reportableChange = change;
+    hal_native_radio_configure_reporting(&record);
+}
+
+/**
+ * Replay the trace, joined, with the jobs as on the device
+ */
+static FrameCount replay(uint8_t reporting) {
+    static uint8_t battery = 100;
+    hal_native_reset();
+    resetFlowMeter();
+    schedulerReset();
+    loadTotalVolume();
+    setupFlowSensor();
+    scheduleFlowMeter(&battery);
+    zigbeeConnected = true;
+    usageSetHoldReports(reporting != BENCH_STREAMING);
+    if (reporting >= BENCH_DEMAND_OFF) {
+        configure(METERING_DEMAND_ATTR, ZCL_TYPE_INT24, 0xFFFF, 0);
+    }
+    if (reporting >= BENCH_EVENTS_ONLY) {
+        configure(METERING_SUMMATION_ATTR, ZCL_TYPE_UINT48, BENCH_SUMMATION_S, UINT32_MAX);
+    }
+
+    edgeSecond = 0;
+    secondPulses = 0.0;
+    edgesFired = 0;
+    nextEdgeUs = edgeTime();
+    hal_native_set_wait_hook(fireEdges);
+
+    FrameCount count = {};
+    classes.clear();
+    uint64_t endUs = (uint64_t)trace.size() * 1000000ULL;
+    while (hal_native_now_us() < endUs) {
+        schedulerRun();
+        for (size_t i = 0; i < hal_native_radio_frame_count(); i++) {
+            const NativeRadioFrame* frame = hal_native_radio_frame(i);
+            count.metering += frame->clusterId == METERING_CLUSTER_ID;
+            count.usage += frame->clusterId == USAGE_CLUSTER_ID;
+            count.bytes += frame->bytesOnAir;
+        }
+        hal_native_radio_clear();
+        while (classes.size() < usageEventCount()) {
+            classes.push_back(usageEvent(usageEventCount() - 1 - classes.size())->usageClass);
+        }
+    }
+    hal_native_set_wait_hook(nullptr);
+    usageSetHoldReports(USAGE_HOLD_REPORTS);
+    return count;
+}
+
+static void accuracy() {
+    seed = 12345;
+    buildTrace();
+    replay(BENCH_DEFAULTS);
+
+    // One event per draw, in trace order
+    uint32_t confusion[USAGE_CLASSES][USAGE_CLASSES] = {};
+    uint32_t correct = 0;
+    for (size_t i = 0; i < classes.size() && i < labels.size(); i++) {
+        confusion[labels[i]][classes[i]]++;
+        correct += labels[i] == classes[i];
+    }
+
+    printf("  %u labelled draws (%lu pulses): %u events\n", (unsigned)labels.size(),
+           (unsigned long)edgesFired, (unsigned)classes.size());
+    printf("  %-10s", "label");
+    for (const char* name : classNames) {
+        printf(" %9s", name);
+    }
+    printf("\n");
+    for (const DrawProfile& p : profiles) {
+        printf("  %-10s", classNames[p.usageClass]);
+        for (uint8_t c = 0; c < USAGE_CLASSES; c++) {
+            printf(" %9lu", (unsigned long)confusion[p.usageClass][c]);
+        }
+        printf("\n");
+    }
+    printf("  accuracy: %.1f%%\n", 100.0 * correct / labels.size());
+}
+
+/**
+ * One long shower: frames streaming the rate and volume reports, with
+ * them held for the event (default), and with the coordinator trimming
+ * them further
+ */
+static void showerFrames() {
+    seed = 777;
+    trace.assign(BENCH_GAP_S, 0.0f);
+    labels.clear();
+    addDraw(USAGE_SHOWER, 9.0f, 480);
+    static const char* const names[] = {
+        "streaming (no hold)", "defaults (held in draws)", "Demand off",
+        "Demand off, volume every 10 min",
+    };
+    printf("  8 min shower at 9 L/min   %-32s %8s %6s %6s\n", "reporting", "metering", "usage",
+           "bytes");
+    for (uint8_t reporting = BENCH_STREAMING; reporting <= BENCH_EVENTS_ONLY; reporting++) {
+        FrameCount count = replay(reporting);
+        printf("  %-25s %-32s %8lu %6lu %6llu\n", "", names[reporting],
+               (unsigned long)count.metering, (unsigned long)count.usage,
+               (unsigned long long)count.bytes);
+    }
+}
+
+/**
+ * Cost of the segmenter per flow window while a draw runs (about a pulse
+ * per window at 8 L/min), and of classifying an event
+ */
+static void cost() {
+    UsageSegmenter segmenter;
+    usageSegmenterReset(&segmenter, 0);
+    UsageEvent event = {};
+    uint64_t ledger = 0;
+    uint32_t events = 0;
+    uint64_t start = bench_cycles();
+    for (uint64_t i = 1; i <= BENCH_WINDOWS; i++) {
+        bool idle = (i & 0xFF) == 0;         // A draw ends every 256 windows
+        ledger += idle ? 0 : 1;
+        events += usageSegmenterUpdate(&segmenter, ledger, idle ? 0 : 8000 + (uint32_t)(i & 0x3FF),
+                                       idle, (uint32_t)i * FLOW_CALC_INTERVAL, (uint32_t)i, &event);
+    }
+    uint64_t segmenterCycles = bench_cycles() - start;
+
+    const UsageTree* tree = usageTree();
+    uint32_t sum = 0;
+    start = bench_cycles();
+    for (uint64_t i = 0; i < BENCH_WINDOWS / 16; i++) {
+        event.durationS = (uint32_t)(i & 0xFFF);
+        event.volumeMl = (uint32_t)(i * 37 & 0x7FFFF);
+        event.peakMlMin = (uint32_t)(i * 101 & 0x7FFF);
+        sum += usageClassify(tree, &event);
+    }
+    uint64_t classifyCycles = bench_cycles() - start;
+
+    printf("  segmenter update:  %.1f cycles (host) per window/pulse, %u bytes of state per channel"
+           "  (%lu events)\n", (double)segmenterCycles / BENCH_WINDOWS, (unsigned)sizeof(UsageSegmenter),
+           (unsigned long)events);
+    printf("  classify event:    %.1f cycles (host), %u-node tree, %u bytes  (sum %lu)\n",
+           (double)classifyCycles / (BENCH_WINDOWS / 16), (unsigned)tree->count,
+           (unsigned)sizeof(UsageTree), (unsigned long)sum);
+}
+
+// Benchmark suite runner
+void UsageBenchmarks(void) {
+    printf("[bench] usage events (min %.2f L, %d-event ring, %.1f pulses/L)\n", USAGE_MIN_VOLUME,
+           USAGE_EVENT_RING, CALIBRATION_FACTOR);
+    accuracy();
+    showerFrames();
+    cost();
+    printf("\n");
+}
@@ -1,110 +1,186 @@
 /*
  * Calibration Test
  * Test sketch for calibrating YF-S201 flow sensor
- * 
+ *
  * This sketch:
- * - Measures known volume of water
- * - Calculates calibration factor
- * - Verifies accuracy
- * 
+ * - Measures a known volume of water at several flow rates
+ * - Calculates the K-factor (pulses/L) and pulse frequency of each run
+ * - Fits a calibration curve and prints it for config.h
+ *
  * Procedure:
- * 1. Flow exactly 10.0L through sensor
- * 2. Press any key to start measurement
- * 3. Flow water through sensor
- * 4. Results will be displayed
+ * 1. Prepare exactly TEST_VOLUME_LITERS of water (a measuring jug)
+ * 2. Flow it through the sensor - a run starts with the first pulse and
+ *    ends after RUN_END_IDLE_MS without pulses
+ * 3. Repeat with the tap opened differently each time, from a trickle
+ *    to full flow (CALIBRATION_RUNS runs, or press any key to finish)
+ * 4. Copy the printed CALIBRATION_CURVE line into include/config.h
  */
 
 #define FLOW_SENSOR_PIN 2
 #define TEST_VOLUME_LITERS 10.0  // Known test volume
+#define NOMINAL_FACTOR 7.5       // CALIBRATION_FACTOR in config.h
+#define CALIBRATION_RUNS 6       // Runs before the curve is fitted
+#define RUN_END_IDLE_MS 5000     // No pulses this long ends a run
+#define MERGE_TOLERANCE 0.10     // Runs within 10% of frequency are one point
 
-volatile uint32_t totalPulses = 0;
-bool testRunning = false;
-unsigned long testStartTime = 0;
+struct CalibrationRun {
+    uint32_t pulses;
+    float frequency;   // Hz
+    float factor;      // Pulses/L
+};
+
+volatile uint32_t runPulses = 0;
+volatile uint32_t firstPulseUs = 0;
+volatile uint32_t lastPulseUs = 0;
+
+CalibrationRun runs[CALIBRATION_RUNS];
+int runCount = 0;
+bool curvePrinted = false;
 
 void IRAM_ATTR pulseCounter() {
-    if (testRunning) {
-        totalPulses++;
+    uint32_t now = micros();
+    if (runPulses == 0) {
+        firstPulseUs = now;
     }
+    lastPulseUs = now;
+    runPulses++;
 }
 
 void setup() {
     Serial.begin(115200);
     delay(1000);
-    
+
     Serial.println("\n========================================");
     Serial.println("Flow Sensor Calibration Test");
     Serial.println("========================================");
-    Serial.println("Test Volume: " + String(TEST_VOLUME_LITERS) + " L");
+    Serial.println("Test Volume: " + String(TEST_VOLUME_LITERS) + " L per run");
+    Serial.println("Runs: " + String(CALIBRATION_RUNS));
     Serial.println();
-    
+
     pinMode(FLOW_SENSOR_PIN, INPUT_PULLUP);
-    attachInterrupt(digitalPinToInterrupt(FLOW_SENSOR_PIN), 
+    attachInterrupt(digitalPinToInterrupt(FLOW_SENSOR_PIN),
                     pulseCounter, RISING);
-    
-    Serial.println("Ready to start calibration!");
+
     Serial.println("Instructions:");
     Serial.println("1. Prepare exactly " + String(TEST_VOLUME_LITERS) + "L of water");
-    Serial.println("2. Press any key to start test");
-    Serial.println("3. Flow water through sensor");
-    Serial.println("4. Results will be displayed when test completes");
+    Serial.println("2. Flow it through the sensor - the run ends by itself " +
+                   String(RUN_END_IDLE_MS / 1000) + " s after the flow stops");
+    Serial.println("3. Repeat at a different flow rate each time, trickle to full");
+    Serial.println("4. Press any key to fit the curve early");
+    Serial.println();
+    Serial.println("Waiting for run 1...");
+}
+
+/**
+ * Close a run: K-factor for the known volume and the mean pulse frequency
+ */
+void finishRun(uint32_t pulses, uint32_t firstUs, uint32_t lastUs) {
+    CalibrationRun& run = runs[runCount++];
+    run.pulses = pulses;
+    run.factor = pulses / TEST_VOLUME_LITERS;
+    run.frequency = (pulses > 1 && lastUs != firstUs) ?
+                    (pulses - 1) * 1e6 / (float)(lastUs - firstUs) : 0.0;
+    float error = ((pulses / NOMINAL_FACTOR - TEST_VOLUME_LITERS) / TEST_VOLUME_LITERS) * 100.0;
+
+    Serial.println();
+    Serial.println("Run " + String(runCount) + ": " + String(pulses) + " pulses at " +
+                   String(run.frequency, 2) + " Hz (" +
+                   String(run.frequency * 60.0 / run.factor, 2) + " L/min)");
+    Serial.println("  K-factor: " + String(run.factor, 3) + " pulses/L, nominal factor error: " +
+                   String(error, 2) + "%");
+    if (runCount < CALIBRATION_RUNS) {
+        Serial.println();
+        Serial.println("Waiting for run " + String(runCount + 1) + "...");
+    }
+}
+
+/**
+ * Sort the runs by frequency, merge runs at nearly the same frequency
+ * (pulse-weighted) and print the curve
+ */
+void fitCurve() {
+    for (int i = 1; i < runCount; i++) {
+        for (int j = i; j > 0 && runs[j].frequency < runs[j - 1].frequency; j--) {
+            CalibrationRun tmp = runs[j];
+            runs[j] = runs[j - 1];
+            runs[j - 1] = tmp;
+        }
+    }
+
+    CalibrationRun points[CALIBRATION_RUNS];
+    int pointCount = 0;
+    for (int i = 0; i < runCount; i++) {
+        CalibrationRun* last = pointCount > 0 ? &points[pointCount - 1] : nullptr;
+        if (last && runs[i].frequency <= last->frequency * (1.0 + MERGE_TOLERANCE)) {
+            uint32_t pulses = last->pulses + runs[i].pulses;
+            last->frequency = (last->frequency * last->pulses +
+                               runs[i].frequency * runs[i].pulses) / pulses;
+            last->factor = (last->factor * last->pulses + runs[i].factor * runs[i].pulses) / pulses;
+            last->pulses = pulses;
+        } else {
+            points[pointCount++] = runs[i];
+        }
+    }
+
     Serial.println();
-    Serial.println("Press any key to start...");
-    
-    while (!Serial.available()) {
-        delay(100);
+    Serial.println("========================================");
+    Serial.println("Calibration Results");
+    Serial.println("========================================");
+    for (int i = 0; i < pointCount; i++) {
+        Serial.println(String(points[i].frequency, 2) + " Hz: " +
+                       String(points[i].factor, 3) + " pulses/L");
     }
-    Serial.read();  // Clear buffer
-    
     Serial.println();
-    Serial.println("Starting calibration test...");
-    Serial.println("Flow " + String(TEST_VOLUME_LITERS) + " L of water now!");
+    Serial.println("Update include/config.h:");
+    String curve = "#define CALIBRATION_CURVE {";
+    for (int i = 0; i < pointCount; i++) {
+        curve += String(i > 0 ? "," : "") + " { " + String(points[i].frequency, 3) + ", " +
+                 String(points[i].factor, 3) + " }";
+    }
+    Serial.println(curve + " }");
+    if (pointCount == 1) {
+        Serial.println("(one flow rate only - or: #define CALIBRATION_FACTOR " +
+                       String(points[0].factor, 2) + ")");
+    }
+    Serial.println("========================================");
     Serial.println();
-    
-    testRunning = true;
-    testStartTime = millis();
-    totalPulses = 0;
+    curvePrinted = true;
 }
 
 void loop() {
-    if (testRunning) {
-        // Calculate estimated volume with current calibration (7.5)
-        float estimatedVolume = totalPulses / 7.5;
-        
+    if (curvePrinted) {
+        delay(1000);
+        return;
+    }
+
+    noInterrupts();
+    uint32_t pulses = runPulses;
+    uint32_t firstUs = firstPulseUs;
+    uint32_t lastUs = lastPulseUs;
+    interrupts();
+
+    if (pulses > 0) {
         // Print progress
-        Serial.print("Pulses: " + String(totalPulses));
-        Serial.print(" | Time: " + String((millis() - testStartTime) / 1000) + "s");
-        Serial.print(" | Estimated: " + String(estimatedVolume, 2) + " L");
+        Serial.print("Pulses: " + String(pulses));
+        Serial.print(" | Time: " + String((lastUs - firstUs) / 1000000) + "s");
+        Serial.print(" | Estimated: " + String(pulses / NOMINAL_FACTOR, 2) + " L");
         Serial.println();
-        
-        // Stop test when volume reached (with margin)
-        if (estimatedVolume >= TEST_VOLUME_LITERS * 0.95) {
-            testRunning = false;
-            
-            // Calculate calibration factor
-            float calibrationFactor = totalPulses / TEST_VOLUME_LITERS;
-            float error = ((estimatedVolume - TEST_VOLUME_LITERS) / TEST_VOLUME_LITERS) * 100.0;
-            
-            Serial.println();
-            Serial.println("========================================");
-            Serial.println("Calibration Results");
-            Serial.println("========================================");
-            Serial.println("Test Volume: " + String(TEST_VOLUME_LITERS) + " L");
-            Serial.println("Total Pulses: " + String(totalPulses));
-            Serial.println("Measured Volume: " + String(estimatedVolume, 2) + " L");
-            Serial.println();
-            Serial.println("Calibration Factor: " + String(calibrationFactor, 2) + " pulses/L");
-            Serial.println("Error: " + String(error, 2) + "%");
-            Serial.println();
-            Serial.println("========================================");
-            Serial.println("Update CALIBRATION_FACTOR in config.h:");
-            Serial.println("#define CALIBRATION_FACTOR " + String(calibrationFactor, 2));
-            Serial.println("========================================");
-            Serial.println();
-            
-            delay(10000);  // Wait before restarting
+
+        // The run is over once the flow has stopped for a while
+        if ((micros() - lastUs) / 1000 >= RUN_END_IDLE_MS) {
+            noInterrupts();
+            runPulses = 0;
+            interrupts();
+            finishRun(pulses, firstUs, lastUs);
         }
-        
-        delay(500);
     }
-}
 
+    if (runCount == CALIBRATION_RUNS || (runCount > 0 && pulses == 0 && Serial.available())) {
+        while (Serial.available()) {
+            Serial.read();  // Clear buffer
+        }
+        fitCurve();
+    }
+
+    delay(500);
+}
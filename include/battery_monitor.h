@@ -0,0 +1,60 @@
+/*
+ * Water Flow Meter - Battery Monitor
+ * Incremental, non-blocking battery voltage sampling
+ *
+ * A check averages BATTERY_SAMPLES conversions spaced BATTERY_SAMPLE_INTERVAL
+ * apart, like the old blocking readBatteryVoltage(), but each conversion is
+ * its own scheduler job run: the main task never sleeps inside a check, so
+ * flow calculation and reports keep their deadlines while it is running.
+ *
+ * A check that changes the alarm state (below BATTERY_WARNING_LEVEL or
+ * BATTERY_CRITICAL_LEVEL) hands it to the alarm handler at once, with the
+ * time of the check's last sample.
+ */
+
+#ifndef BATTERY_MONITOR_H
+#define BATTERY_MONITOR_H
+
+#include <stdint.h>
+#include "config.h"
+#include "hal.h"
+
+// Power Configuration BatteryAlarmState bits
+#define BATTERY_ALARM_CRITICAL 0x01   // BatteryMinThreshold reached
+#define BATTERY_ALARM_WARNING 0x02    // BatteryPercentageThreshold1 reached
+
+// Latest completed check
+extern uint32_t batteryMillivolts;   // Battery voltage (after the divider)
+extern uint8_t batteryPercent;       // 0-100
+extern uint8_t batteryAlarms;        // BATTERY_ALARM_*
+
+/**
+ * Configure the ADC, register the check/sample jobs with the scheduler and
+ * start the first check
+ */
+void setupBatteryMonitor();
+
+/**
+ * Begin a new check (ignored if one is already running)
+ */
+void batteryStartCheck();
+
+bool batteryCheckInProgress();
+
+/**
+ * Handler run on the main task when a check changes batteryAlarms
+ * sampleUs: hal_micros64() of the check's last ADC sample
+ */
+void batteryOnAlarm(void (*handler)(uint8_t alarms, uint64_t sampleUs));
+
+/**
+ * Linear percentage between BATTERY_MIN_VOLTAGE and BATTERY_MAX_VOLTAGE
+ */
+uint8_t batteryPercentFromMillivolts(uint32_t millivolts);
+
+/**
+ * Reset battery state to power-on defaults (host tests/benchmarks)
+ */
+void resetBatteryMonitor();
+
+#endif // BATTERY_MONITOR_H
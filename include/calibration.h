@@ -0,0 +1,314 @@
+/*
+ * Water Flow Meter - Calibration Curve
+ * Sensor K-factor by pulse frequency, as a fixed-point lookup table
+ *
+ * A YF-S201 does not give the same number of pulses per litre at every
+ * flow: at a trickle the rotor slips and it under-reads by 10-20%. The
+ * curve gives the K-factor (pulses/L) at a few pulse frequencies, linear in
+ * between and flat beyond the end points - CALIBRATION_CURVE in config.h,
+ * or breakpoints stored in NVS.
+ *
+ * The ledger keeps counting in nominal pulses of 1/CALIBRATION_FACTOR L, so
+ * volumes, thresholds and everything already stored keep their meaning.
+ * Each batch of sensor pulses is scaled by CALIBRATION_FACTOR / K(f) at the
+ * current frequency on its way into the ledger, the fraction carried to
+ * the next batch, and the flow rate is scaled the same way.
+ *
+ * The curve is resampled onto CALIBRATION_TABLE_SIZE evenly spaced
+ * frequencies with a power-of-two step, so a lookup is a shift, a mask and
+ * one multiply. The config curve is resampled at compile time and checked
+ * by static_assert; an NVS curve goes through the same integer code once
+ * at boot.
+ *
+ * A calibration session fits and stores a new curve on the running meter:
+ * the same known volume is run through the sensor at a few flow rates, a
+ * run ending when the flow stops for CALIBRATION_RUN_IDLE_MS. The flow job
+ * feeds the session its pulse readings, so metering carries on meanwhile
+ * (with the old curve). After the last run the runs are sorted by pulse
+ * frequency, runs at nearly the same frequency merged, and the curve is
+ * applied and stored in NVS at once - no rebuild. Started from the console
+ * (calibrate auto) or by the coordinator through the calibration cluster.
+ *
+ * Every flow channel has a curve of its own, stored under its own NVS keys
+ * (flow_channels.h); the channel argument defaults to 0. A session
+ * calibrates one channel - the coordinator picks it by the endpoint it
+ * writes the calibration cluster on.
+ */
+
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <stdint.h>
+#include "config.h"
+#include "hal.h"
+#include "pulse_source.h"
+
+// ============================================================================
+// Curve and Table
+// ============================================================================
+
+struct CalibrationPoint {
+    uint32_t milliHz;        // Sensor pulse frequency (mHz)
+    uint32_t kMilli;         // K-factor there (pulses per 1000 L)
+};
+
+struct CalibrationCurve {
+    uint8_t count;           // Breakpoints used (1..CALIBRATION_MAX_POINTS)
+    CalibrationPoint points[CALIBRATION_MAX_POINTS];
+};
+
+struct CalibrationTable {
+    uint8_t shift;           // Grid step is 2^shift mHz
+    uint32_t scaleQ16[CALIBRATION_TABLE_SIZE];   // CALIBRATION_FACTOR / K, Q16
+};
+
+#define CALIBRATION_SCALE_ONE 0x10000UL
+
+// Nominal K-factor, the ledger unit (pulses per 1000 L)
+constexpr uint32_t CALIBRATION_NOMINAL_MILLI = (uint32_t)(CALIBRATION_FACTOR * 1000.0 + 0.5);
+
+// Sensor frequency (mHz) per mL/min of nominal flow rate, Q16
+constexpr uint32_t CALIBRATION_MHZ_PER_MLMIN_Q16 =
+    (uint32_t)(CALIBRATION_FACTOR / 60.0 * 65536.0 + 0.5);
+
+/**
+ * A usable curve: 1..CALIBRATION_MAX_POINTS breakpoints in rising
+ * frequency, each K within a factor of four of CALIBRATION_FACTOR (keeps
+ * the Q16 scale in range)
+ */
+constexpr bool calibrationValid(const CalibrationCurve& curve) {
+    if (curve.count < 1 || curve.count > CALIBRATION_MAX_POINTS) {
+        return false;
+    }
+    for (uint8_t i = 0; i < curve.count; i++) {
+        if (curve.points[i].kMilli < CALIBRATION_NOMINAL_MILLI / 4 ||
+            curve.points[i].kMilli > CALIBRATION_NOMINAL_MILLI * 4) {
+            return false;
+        }
+        if (i > 0 && curve.points[i].milliHz <= curve.points[i - 1].milliHz) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * K-factor at a frequency, interpolated between the breakpoints
+ */
+constexpr uint32_t calibrationK(const CalibrationCurve& curve, uint32_t milliHz) {
+    const CalibrationPoint* p = curve.points;
+    if (milliHz <= p[0].milliHz) {
+        return p[0].kMilli;
+    }
+    for (uint8_t i = 1; i < curve.count; i++) {
+        if (milliHz < p[i].milliHz) {
+            int64_t span = (int64_t)p[i].kMilli - p[i - 1].kMilli;
+            return (uint32_t)(p[i - 1].kMilli + span * (milliHz - p[i - 1].milliHz) /
+                                                    (p[i].milliHz - p[i - 1].milliHz));
+        }
+    }
+    return p[curve.count - 1].kMilli;
+}
+
+/**
+ * Resample a valid curve onto the lookup grid - the smallest power-of-two
+ * step that still reaches the last breakpoint
+ */
+constexpr CalibrationTable calibrationBuild(const CalibrationCurve& curve) {
+    CalibrationTable table{};
+    uint32_t lastMilliHz = curve.points[curve.count - 1].milliHz;
+    while (((uint64_t)(CALIBRATION_TABLE_SIZE - 1) << table.shift) < lastMilliHz) {
+        table.shift++;
+    }
+    for (uint32_t i = 0; i < CALIBRATION_TABLE_SIZE; i++) {
+        uint64_t k = calibrationK(curve, (uint32_t)((uint64_t)i << table.shift));
+        table.scaleQ16[i] =
+            (uint32_t)((((uint64_t)CALIBRATION_NOMINAL_MILLI << 16) + k / 2) / k);
+    }
+    return table;
+}
+
+/**
+ * Ledger pulses per sensor pulse (Q16) at a frequency
+ */
+static inline uint32_t calibrationScale(const CalibrationTable* table, uint32_t milliHz) {
+    uint32_t i = milliHz >> table->shift;
+    if (i >= CALIBRATION_TABLE_SIZE - 1) {
+        return table->scaleQ16[CALIBRATION_TABLE_SIZE - 1];
+    }
+    int64_t a = table->scaleQ16[i];
+    int64_t b = table->scaleQ16[i + 1];
+    uint32_t frac = milliHz & ((1UL << table->shift) - 1);
+    return (uint32_t)(a + (((b - a) * frac) >> table->shift));
+}
+
+/**
+ * The same at a nominal flow rate (mL/min, before calibration)
+ */
+static inline uint32_t calibrationScaleAt(const CalibrationTable* table, uint32_t nominalMlMin) {
+    uint64_t milliHz = ((uint64_t)nominalMlMin * CALIBRATION_MHZ_PER_MLMIN_Q16) >> 16;
+    return calibrationScale(table, milliHz > UINT32_MAX ? UINT32_MAX : (uint32_t)milliHz);
+}
+
+// ============================================================================
+// Compile-Time Curve (config.h)
+// ============================================================================
+
+struct CalibrationConfigPoint {
+    double hz;
+    double k;
+};
+
+constexpr CalibrationConfigPoint CALIBRATION_CONFIG_POINTS[] = CALIBRATION_CURVE;
+constexpr uint32_t CALIBRATION_CONFIG_COUNT =
+    sizeof(CALIBRATION_CONFIG_POINTS) / sizeof(CALIBRATION_CONFIG_POINTS[0]);
+static_assert(CALIBRATION_CONFIG_COUNT <= CALIBRATION_MAX_POINTS,
+              "CALIBRATION_CURVE has more than CALIBRATION_MAX_POINTS breakpoints");
+
+constexpr CalibrationCurve calibrationConfigCurve() {
+    CalibrationCurve curve{};
+    curve.count = (uint8_t)CALIBRATION_CONFIG_COUNT;
+    for (uint32_t i = 0; i < CALIBRATION_CONFIG_COUNT; i++) {
+        curve.points[i].milliHz = (uint32_t)(CALIBRATION_CONFIG_POINTS[i].hz * 1000.0 + 0.5);
+        curve.points[i].kMilli = (uint32_t)(CALIBRATION_CONFIG_POINTS[i].k * 1000.0 + 0.5);
+    }
+    return curve;
+}
+
+constexpr CalibrationCurve CALIBRATION_CONFIG_CURVE = calibrationConfigCurve();
+static_assert(calibrationValid(CALIBRATION_CONFIG_CURVE),
+              "CALIBRATION_CURVE needs rising frequencies and K-factors within 4x of "
+              "CALIBRATION_FACTOR");
+constexpr CalibrationTable CALIBRATION_CONFIG_TABLE = calibrationBuild(CALIBRATION_CONFIG_CURVE);
+
+// ============================================================================
+// Active Curve
+// ============================================================================
+
+/**
+ * Use the curve stored in NVS for each channel if there is a valid one,
+ * else the config curve (call before the first calculateFlow)
+ */
+void calibrationBegin();
+
+/**
+ * Switch a channel to a new curve at once (not stored) - false if it is
+ * not valid
+ */
+bool calibrationSetCurve(const CalibrationCurve* curve, uint8_t channel = 0);
+
+/**
+ * Store a channel's active curve in NVS, to be used from the next boot on
+ */
+void calibrationSave(uint8_t channel = 0);
+
+/**
+ * Forget a channel's stored curve and go back to the config curve (ends
+ * a session on the channel)
+ */
+void calibrationRestoreDefault(uint8_t channel = 0);
+
+const CalibrationCurve* calibrationCurve(uint8_t channel = 0);
+
+/**
+ * Lookup tables of all FLOW_CHANNELS channels, in channel order - what
+ * the flow job's per-tick update reads
+ */
+const CalibrationTable* calibrationTables();
+
+/**
+ * Ledger pulses per sensor pulse (Q16) at a nominal flow rate (mL/min,
+ * before calibration)
+ */
+uint32_t calibrationScaleAtRate(uint32_t nominalMlMin, uint8_t channel = 0);
+
+// ============================================================================
+// Calibration Session
+// ============================================================================
+
+#define CALIBRATION_IDLE 0           // No session
+#define CALIBRATION_WAITING 1        // Waiting for the next run's first pulse
+#define CALIBRATION_RUNNING 2        // Run in progress
+
+static_assert(CALIBRATION_RUN_IDLE_MS < FLOW_IDLE_TIMEOUT,
+              "a run must end while the flow job is still running");
+
+struct CalibrationRun {
+    uint32_t pulses;         // Sensor pulses for the reference volume
+    uint32_t milliHz;        // Mean pulse frequency
+};
+
+struct CalibrationSession {
+    uint8_t state;
+    uint8_t channel;         // Flow channel being calibrated
+    uint8_t runTarget;       // Runs before the curve is fitted
+    uint8_t runCount;        // Runs done
+    uint32_t referenceMl;    // Volume of every run
+    uint64_t lastCount;      // Sensor count at the last update
+    uint64_t startCount;     // Sensor count before the run's first pulse
+    uint64_t refEdgeCount;   // First timed edge of the run
+    uint64_t refEdgeUs;
+    CalibrationRun runs[CALIBRATION_MAX_POINTS];
+};
+
+/**
+ * Start a session of runs runs of referenceMl each on a channel - false if
+ * the values are out of range (runs 1..CALIBRATION_MAX_POINTS). Replaces a
+ * session in progress
+ */
+bool calibrationSessionStart(uint32_t referenceMl, uint8_t runs, uint8_t channel = 0);
+
+/**
+ * Flow job hook, with the session channel's reading: follow the sensor
+ * count, end a run once the flow has stopped, fit the curve after the
+ * last one
+ */
+void calibrationSessionUpdate(const PulseReading* reading, uint64_t nowUs);
+
+/**
+ * Fit and store the curve from the runs done so far (ends the session)
+ * False if there are none or they give no valid curve
+ */
+bool calibrationSessionFinish();
+
+void calibrationSessionCancel();
+const CalibrationSession* calibrationSession();
+
+// ============================================================================
+// Calibration Cluster (Zigbee)
+// ============================================================================
+
+// Manufacturer-specific cluster on every flow channel's endpoint: the
+// coordinator writes the volume and run count, then Control = START;
+// Control reads back as the session state of that channel
+#define CALIBRATION_CLUSTER_ID 0xFC00
+
+#define CALIBRATION_VOLUME_ATTR 0x0000   // uint32, mL per run (writable)
+#define CALIBRATION_RUNS_ATTR 0x0001     // uint8, runs per session (writable)
+#define CALIBRATION_CONTROL_ATTR 0x0002  // enum8, CALIBRATION_CONTROL_* (writable)
+#define CALIBRATION_DONE_ATTR 0x0003     // uint8, runs done
+#define CALIBRATION_POINTS_ATTR 0x0004   // uint8, breakpoints of the curve in use
+
+#define CALIBRATION_CONTROL_START 1
+#define CALIBRATION_CONTROL_FINISH 2
+#define CALIBRATION_CONTROL_CANCEL 3
+#define CALIBRATION_CONTROL_DEFAULT 4    // Back to the config curve
+
+/**
+ * Register the cluster and the Write Attributes handler with the radio
+ * (once - before the Zigbee stack starts)
+ */
+void calibrationClusterBegin();
+
+/**
+ * Write Attributes handler (returns the ZCL status)
+ */
+uint8_t calibrationWriteAttribute(uint8_t endpoint, uint16_t clusterId, const HalAttribute* attr);
+
+/**
+ * Back to the config curve without touching NVS, no session
+ * Used by host tests between runs
+ */
+void resetCalibration();
+
+#endif // CALIBRATION_H
@@ -14,6 +14,14 @@
 #define BATTERY_PIN A0          // GPIO4 (A0) - Battery voltage monitor (optional)
 #define LED_PIN LED_BUILTIN     // Built-in LED for status indication
 
+// Flow channels - one sensor each, with its own pulse counter, ledger,
+// calibration curve and Metering endpoint (FLOW_ENDPOINT + channel).
+// Channel 0 is the FLOW_SENSOR_PIN sensor; up to 4 (one PCNT unit each)
+#ifndef FLOW_CHANNELS
+#define FLOW_CHANNELS 1
+#endif
+#define FLOW_CHANNEL_PINS { FLOW_SENSOR_PIN, 3, 5, 6 }   // Sensor GPIO by channel
+
 // ============================================================================
 // Flow Sensor Configuration
 // ============================================================================
@@ -23,11 +31,61 @@
 // Adjust based on calibration testing
 #define CALIBRATION_FACTOR 7.5
 
+// Calibration curve: K-factor (pulses/L) by sensor pulse frequency (Hz)
+// { Hz, pulses/L } pairs in rising frequency order, linear in between and
+// flat beyond the ends (see calibration.h). The ledger keeps counting in
+// units of 1/CALIBRATION_FACTOR L; a single point is a constant factor.
+// A YF-S201 reading 15% low at a trickle would be, for example:
+//   #define CALIBRATION_CURVE { { 0.1, 6.4 }, { 0.5, 7.0 }, { 1.5, 7.5 } }
+// A curve stored in NVS (calibrationSave) replaces this one at boot.
+#ifndef CALIBRATION_CURVE
+#define CALIBRATION_CURVE { { 0.0, CALIBRATION_FACTOR } }
+#endif
+#define CALIBRATION_MAX_POINTS 8       // Breakpoints in a curve
+#define CALIBRATION_TABLE_SIZE 33      // Lookup table entries (32 segments)
+
+// In-firmware calibration: a known volume run through the sensor at a few
+// flow rates, each run ended by the flow stopping (console "calibrate
+// auto", or the Zigbee calibration cluster - see calibration.h)
+#define CALIBRATION_DEFAULT_RUNS 3     // Flow rates measured per session
+#define CALIBRATION_RUN_IDLE_MS 5000   // No pulses this long ends a run (longer at a trickle)
+#define CALIBRATION_MIN_RUN_PULSES 20  // Shorter runs are ignored (drips, mistakes)
+#define CALIBRATION_MERGE_PERMILLE 100 // Runs within 10% of frequency make one point
+
 // Flow calculation interval (milliseconds)
 #define FLOW_CALC_INTERVAL 1000    // Calculate flow every 1 second
 
 // Flow idle timeout (milliseconds)
-#define FLOW_IDLE_TIMEOUT 5000     // Consider idle if no pulses for 5 seconds
+// Also the longest pulse period the estimator can measure: at 7.5 pulses/L,
+// 30 s resolves flows down to ~0.27 L/min (a dripping tap)
+#define FLOW_IDLE_TIMEOUT 30000    // Consider idle if no pulses for 30 seconds
+
+// Rate estimator method switch (pulses per FLOW_CALC_INTERVAL)
+// Below this the rate comes from pulse edge timestamps (period method),
+// at or above it from the pulse count in the window (count method)
+#define FLOW_PERIOD_METHOD_MAX_PULSES 16
+
+// Pulse source (see pulse_source.h)
+#define PULSE_BACKEND_GPIO 0          // GPIO interrupt on every edge
+#define PULSE_BACKEND_PCNT 1          // Hardware pulse counter + glitch filter
+#ifndef PULSE_BACKEND
+#define PULSE_BACKEND PULSE_BACKEND_GPIO
+#endif
+#define PULSE_GLITCH_FILTER_NS 10000  // PCNT ignores pulses shorter than 10 us (max ~12.7 us)
+
+// Leak detection (see leak_detector.h) - every flow channel, alarms on the
+// Metering Status attribute. 0 turns a rule off
+#define LEAK_CONTINUOUS_FLOW 120      // Minutes of flow without a stop: leak (running toilet)
+#define LEAK_QUIET_PERIOD 60          // Minutes without a pulse that count as no flow
+#define LEAK_NEVER_QUIET 24           // Hours without such a quiet period: leak (slow drip)
+#define LEAK_BURST_VOLUME 250.0       // Litres in one draw: burst (pipe, hose left open)
+
+// Usage events (see usage_events.h) - every draw becomes one classified
+// event, reported in one frame
+#define USAGE_MIN_VOLUME 0.25         // Litres: smaller draws (a drip, one pulse) are not events
+#define USAGE_EVENT_RING 32           // Newest events kept in RAM
+#define USAGE_TREE_MAX_NODES 16       // Nodes of the classifier's decision tree (NVS)
+#define USAGE_HOLD_REPORTS 1          // Hold Demand and volume change reports during a draw (0: stream them)
 
 // ============================================================================
 // Battery Configuration (Optional)
@@ -43,6 +101,11 @@
 // Battery monitoring interval (milliseconds)
 #define BATTERY_CHECK_INTERVAL 60000  // Check battery every minute
 
+// Battery sampling - one ADC conversion per scheduler run, averaged per check
+#define BATTERY_SAMPLES 16            // Samples averaged per check
+#define BATTERY_SAMPLE_INTERVAL 10    // Milliseconds between samples
+#define BATTERY_DIVIDER_RATIO 2       // 1:2 voltage divider on BATTERY_PIN
+
 // Battery warning levels
 #define BATTERY_WARNING_LEVEL 25      // Warning at 25%
 #define BATTERY_CRITICAL_LEVEL 10     // Critical at 10%
@@ -55,18 +118,47 @@
 #define ZIGBEE_CHANNEL 11         // Zigbee channel (11-26, avoid WiFi channels)
 #define ZIGBEE_PAN_ID 0x1A62     // Personal Area Network ID (use your coordinator's PAN ID)
 
+// Network join (runs in the background, see zigbee_network.h)
+#define ZIGBEE_REJOIN_TIMEOUT 5000    // Rejoin from stored network state (ms)
+#define ZIGBEE_JOIN_TIMEOUT 60000     // Full join attempt (ms)
+#define ZIGBEE_REJOIN_ATTEMPTS 3      // Failed rejoins before a full join
+#define ZIGBEE_BACKOFF_MIN 1000       // First retry delay (ms), doubles per failure
+#define ZIGBEE_BACKOFF_MAX 300000     // Retry delay cap (ms)
+#define ZIGBEE_POLL_INTERVAL 100      // Join progress check while joining (ms)
+
+// Wall-clock time from the coordinator's Time cluster (see consumption.h)
+#define TIME_SYNC_INTERVAL 24         // Hours between reads of the coordinator's time
+#define TIME_SYNC_RETRY 60            // Seconds before asking again (not joined, no answer)
+#define TIME_ZONE_OFFSET 0            // Minutes east of UTC until the coordinator sends LocalTime
+
 // Device endpoints
 #define FLOW_ENDPOINT 10         // Flow measurement endpoint
 #define BATTERY_ENDPOINT 1       // Battery endpoint (optional)
 
+// Default reporting - the coordinator can replace it per attribute with
+// Configure Reporting at runtime (kept in NVS, see report_engine.h)
+
 // Zigbee report intervals (seconds)
 #define FLOW_REPORT_INTERVAL 30      // Report flow every 30 seconds
 #define BATTERY_REPORT_INTERVAL 600  // Report battery every 10 minutes
 
 // Report triggers
 #define FLOW_RATE_CHANGE_THRESHOLD 0.1  // Report if flow rate changes by >10%
+#define FLOW_RATE_MIN_CHANGE 0.25        // ... and by at least 0.25 L/min (near zero flow)
 #define VOLUME_MILESTONE 1.0             // Report every 1 liter
 #define BATTERY_CHANGE_THRESHOLD 5       // Report if battery changes by >5%
+#define REPORT_MIN_INTERVAL 5            // Seconds between change reports of an attribute
+
+// Report airtime budget (token bucket) for change-triggered reports
+// Interval reports always go out and spend from the same bucket
+#define REPORT_BUDGET_BYTES_PER_HOUR 12000  // Refill (about 3 frames a minute)
+#define REPORT_BUDGET_BURST_BYTES 1024      // Bucket depth
+#define REPORT_MAX_ATTRIBUTES 24            // Attributes the report engine tracks
+
+// Alarm reports (leak, low battery) skip the cadence and the budget, ask
+// for an APS acknowledgement and are sent again until it arrives
+#define REPORT_ACK_TIMEOUT 1000   // Milliseconds to wait for the acknowledgement
+#define REPORT_ALARM_TRIES 4      // Transmissions before an alarm is given up
 
 // ============================================================================
 // Data Persistence Configuration
@@ -79,6 +171,34 @@
 // EEPROM namespace
 #define EEPROM_NAMESPACE "flowmeter"
 
+// Counter journal - the pulse ledger is appended to a raw flash ring
+// instead of rewriting NVS keys (see docs/PARTITIONS.md)
+#define DATA_PARTITION_LABEL "spiffs"  // Raw data partition (no filesystem)
+#define DATA_PARTITION_BYTES 0xFB000   // Its size in the smaller table (partitions_zigbee_simple.csv)
+#define JOURNAL_OFFSET 0               // Journal start within the partition
+#define JOURNAL_SECTORS 16             // 4 KB sectors in the ring (64 KB)
+
+// Flow history - per-interval volume at three resolutions, delta + varint
+// encoded in RAM blocks that spill to flash rings after the journal
+// (see flow_history.h)
+#define HISTORY_OFFSET 0x10000         // First history sector within the partition
+#define HISTORY_SECTORS_10S 32         // 10 s intervals (128 KB, ~8 months)
+#define HISTORY_SECTORS_1MIN 32        // 1 min intervals (128 KB, ~1 year)
+#define HISTORY_SECTORS_1H 16          // 1 h intervals (64 KB, ~3 years)
+#define HISTORY_BLOCK_BYTES 256        // Encoded bytes per block (RAM per tier)
+#define HISTORY_FLUSH_INTERVAL 3600000 // Spill blocks holding flow to flash (ms)
+#define HISTORY_FLUSH_AGE_1H 86400     // ...but hourly blocks only once a day old (s)
+
+// Pulse trace - raw edge times captured after the history rings for
+// replay on the host, started from the serial console (see pulse_trace.h)
+#ifndef PULSE_TRACE_ENABLED
+#define PULSE_TRACE_ENABLED CONSOLE_ENABLED
+#endif
+#define TRACE_OFFSET 0x60000           // First trace sector within the partition
+#define TRACE_SECTORS 64               // 4 KB sectors (256 KB, ~1 month of household use)
+#define TRACE_CHUNK_BYTES 256          // Encoded bytes per chunk (RAM)
+#define TRACE_RING_EDGES 256           // Edges queued between flow jobs (power of two)
+
 // ============================================================================
 // Serial Configuration
 // ============================================================================
@@ -88,6 +208,39 @@
 #define DEBUG_ENABLED true           // Enable debug serial output
 #endif
 
+// Log levels - messages above LOG_LEVEL are compiled out (see deferred_log.h)
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL (DEBUG_ENABLED ? LOG_LEVEL_DEBUG : LOG_LEVEL_WARN)
+#endif
+
+// Deferred logger - call sites store binary records, a low priority task
+// formats them (or streams them raw for tools/log_decoder)
+#define LOG_BUFFER_WORDS 256         // Ring size in 32-bit words (1 KB, power of two)
+#ifndef LOG_BINARY_OUTPUT
+#define LOG_BINARY_OUTPUT false      // Stream binary records instead of text lines
+#endif
+
+// Latency histograms (cycle counter, see latency_stats.h) - [env:release]
+// builds with -DLATENCY_STATS_ENABLED=0 and compiles every probe out
+#ifndef LATENCY_STATS_ENABLED
+#define LATENCY_STATS_ENABLED true
+#endif
+#define SERIAL_POLL_INTERVAL 100     // Serial console poll (ms)
+
+// Serial console (see console.h) - built in whenever logging is
+#ifndef CONSOLE_ENABLED
+#define CONSOLE_ENABLED (LOG_LEVEL > LOG_LEVEL_NONE)
+#endif
+#define CONSOLE_LINE_MAX 64          // Longest command line (bytes, without newline)
+#define CONSOLE_MAX_WORDS 5          // Words per command line
+#define CONSOLE_DUMP_ROWS 8          // History rows logged per console poll
+
 // ============================================================================
 // System Configuration
 // ============================================================================
@@ -95,6 +248,13 @@
 // System status LED blink interval (milliseconds)
 #define STATUS_LED_INTERVAL 1000    // Blink LED every second when idle
 
+// Status print interval (milliseconds, LOG_LEVEL_INFO and above only)
+#define STATUS_PRINT_INTERVAL 60000  // Print system status every minute
+
+// Scheduler capacity (flow x3, battery x2, Zigbee, history, consumption x2,
+// LED, status, serial, diagnostics + spare)
+#define SCHEDULER_MAX_JOBS 16
+
 // Watchdog timeout (if implemented)
 // #define WATCHDOG_TIMEOUT 60000   // 60 seconds (optional)
 
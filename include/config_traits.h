@@ -0,0 +1,444 @@
+/*
+ * Water Flow Meter - Configuration Traits
+ * config.h as typed compile-time values: validated, with the constants
+ * the metering path derives from them
+ *
+ * config.h stays a list of plain #defines - easy to edit, easy to override
+ * with -D. This header gives every setting a type in one constexpr
+ * structure per subsystem and checks it with static_assert, so a value out
+ * of range, two things on one pin or overlapping flash areas fail the
+ * build (naming the #define) instead of shipping.
+ *
+ * It also derives, at compile time, the values the code needs in other
+ * units: ledger thresholds, microsecond and millisecond intervals, and
+ * Q32 reciprocals for the divisions the report and flow jobs would
+ * otherwise do at runtime. On the RV32 core a 64-bit division is a libgcc
+ * call of a few hundred cycles; a division by a 32-bit constant the
+ * compiler already turns into a multiply. Ledger <-> volume factors live
+ * in flow_math.h.
+ */
+
+#ifndef CONFIG_TRAITS_H
+#define CONFIG_TRAITS_H
+
+#include <stdint.h>
+#include "config.h"
+#include "hal.h"
+#include "flow_math.h"
+
+// ============================================================================
+// Typed Configuration
+// ============================================================================
+
+#define CONFIG_GPIO_COUNT 31           // ESP32-C6: GPIO0-30
+#define CONFIG_ADC_GPIO_COUNT 7        // ADC1 on GPIO0-6
+#define CONFIG_ADC_MAX_MV 3300         // ADC input range (11 dB attenuation)
+
+struct FlowConfig {
+    uint8_t sensorPin;
+    uint8_t channels;
+    double pulsesPerLitre;             // Nominal K-factor, the ledger unit
+    uint32_t calcIntervalMs;
+    uint32_t idleTimeoutMs;
+    uint32_t periodMethodMaxPulses;
+    uint8_t pulseBackend;
+    uint32_t glitchFilterNs;
+    double saveThresholdLitres;
+    uint32_t maxSaveIntervalMs;
+};
+
+constexpr FlowConfig FLOW_CONFIG = {
+    FLOW_SENSOR_PIN,
+    FLOW_CHANNELS,
+    CALIBRATION_FACTOR,
+    FLOW_CALC_INTERVAL,
+    FLOW_IDLE_TIMEOUT,
+    FLOW_PERIOD_METHOD_MAX_PULSES,
+    PULSE_BACKEND,
+    PULSE_GLITCH_FILTER_NS,
+    SAVE_THRESHOLD,
+    MAX_SAVE_INTERVAL,
+};
+
+// Sensor pin by flow channel - FLOW_CHANNEL_PINS may list more than are used
+constexpr uint8_t FLOW_CHANNEL_PIN[] = FLOW_CHANNEL_PINS;
+constexpr uint32_t FLOW_CHANNEL_PIN_COUNT = sizeof(FLOW_CHANNEL_PIN) / sizeof(FLOW_CHANNEL_PIN[0]);
+
+struct LeakConfig {
+    uint32_t continuousMinutes;
+    uint32_t quietMinutes;
+    uint32_t neverQuietHours;
+    double burstLitres;
+};
+
+constexpr LeakConfig LEAK_CONFIG = {
+    LEAK_CONTINUOUS_FLOW,
+    LEAK_QUIET_PERIOD,
+    LEAK_NEVER_QUIET,
+    LEAK_BURST_VOLUME,
+};
+
+struct UsageConfig {
+    double minVolumeLitres;
+    uint32_t ringEvents;
+    uint32_t treeMaxNodes;
+    bool holdReports;
+};
+
+constexpr UsageConfig USAGE_CONFIG = {
+    USAGE_MIN_VOLUME,
+    USAGE_EVENT_RING,
+    USAGE_TREE_MAX_NODES,
+    USAGE_HOLD_REPORTS,
+};
+
+struct BatteryConfig {
+    bool enabled;
+    uint8_t pin;
+    double minVolts;
+    double maxVolts;
+    uint32_t checkIntervalMs;
+    uint32_t samples;
+    uint32_t sampleIntervalMs;
+    uint32_t dividerRatio;
+    uint8_t warningPercent;
+    uint8_t criticalPercent;
+    uint32_t reportIntervalS;
+    uint8_t changePercent;
+};
+
+constexpr BatteryConfig BATTERY_CONFIG = {
+    BATTERY_ENABLED,
+    BATTERY_PIN,
+    BATTERY_MIN_VOLTAGE,
+    BATTERY_MAX_VOLTAGE,
+    BATTERY_CHECK_INTERVAL,
+    BATTERY_SAMPLES,
+    BATTERY_SAMPLE_INTERVAL,
+    BATTERY_DIVIDER_RATIO,
+    BATTERY_WARNING_LEVEL,
+    BATTERY_CRITICAL_LEVEL,
+    BATTERY_REPORT_INTERVAL,
+    BATTERY_CHANGE_THRESHOLD,
+};
+
+struct ZigbeeConfig {
+    uint8_t channel;
+    uint16_t panId;
+    uint8_t flowEndpoint;
+    uint8_t batteryEndpoint;
+    uint32_t rejoinTimeoutMs;
+    uint32_t joinTimeoutMs;
+    uint8_t rejoinAttempts;
+    uint32_t backoffMinMs;
+    uint32_t backoffMaxMs;
+    uint32_t pollIntervalMs;
+    uint32_t timeSyncHours;
+    uint32_t timeSyncRetryS;
+    int32_t timeZoneMinutes;
+};
+
+constexpr ZigbeeConfig ZIGBEE_CONFIG = {
+    ZIGBEE_CHANNEL,
+    ZIGBEE_PAN_ID,
+    FLOW_ENDPOINT,
+    BATTERY_ENDPOINT,
+    ZIGBEE_REJOIN_TIMEOUT,
+    ZIGBEE_JOIN_TIMEOUT,
+    ZIGBEE_REJOIN_ATTEMPTS,
+    ZIGBEE_BACKOFF_MIN,
+    ZIGBEE_BACKOFF_MAX,
+    ZIGBEE_POLL_INTERVAL,
+    TIME_SYNC_INTERVAL,
+    TIME_SYNC_RETRY,
+    TIME_ZONE_OFFSET,
+};
+
+struct ReportConfig {
+    uint32_t flowIntervalS;
+    uint32_t minIntervalS;
+    double rateChangeFraction;
+    double rateMinChangeLpm;           // L/min
+    double volumeMilestoneLitres;
+    uint32_t budgetBytesPerHour;
+    uint32_t budgetBurstBytes;
+    uint32_t ackTimeoutMs;
+    uint32_t alarmTries;
+};
+
+constexpr ReportConfig REPORT_CONFIG = {
+    FLOW_REPORT_INTERVAL,
+    REPORT_MIN_INTERVAL,
+    FLOW_RATE_CHANGE_THRESHOLD,
+    FLOW_RATE_MIN_CHANGE,
+    VOLUME_MILESTONE,
+    REPORT_BUDGET_BYTES_PER_HOUR,
+    REPORT_BUDGET_BURST_BYTES,
+    REPORT_ACK_TIMEOUT,
+    REPORT_ALARM_TRIES,
+};
+
+// Raw data partition areas, byte offsets within the partition
+struct StorageConfig {
+    uint32_t partitionBytes;
+    uint32_t journalOffset;
+    uint32_t journalSectors;
+    uint32_t historyOffset;
+    uint32_t historySectors;           // All three tiers
+    uint32_t traceOffset;
+    uint32_t traceSectors;
+};
+
+constexpr StorageConfig STORAGE_CONFIG = {
+    DATA_PARTITION_BYTES,
+    JOURNAL_OFFSET,
+    JOURNAL_SECTORS,
+    HISTORY_OFFSET,
+    HISTORY_SECTORS_10S + HISTORY_SECTORS_1MIN + HISTORY_SECTORS_1H,
+    TRACE_OFFSET,
+    TRACE_SECTORS,
+};
+
+struct SystemConfig {
+    uint8_t ledPin;
+    uint32_t ledIntervalMs;
+    uint32_t statusIntervalMs;
+    uint32_t serialPollMs;
+    uint32_t consoleLineMax;
+    uint32_t consoleMaxWords;
+};
+
+constexpr SystemConfig SYSTEM_CONFIG = {
+    LED_PIN,
+    STATUS_LED_INTERVAL,
+    STATUS_PRINT_INTERVAL,
+    SERIAL_POLL_INTERVAL,
+    CONSOLE_LINE_MAX,
+    CONSOLE_MAX_WORDS,
+};
+
+// ============================================================================
+// Validation
+// ============================================================================
+
+// Pins
+static_assert(FLOW_CONFIG.sensorPin < CONFIG_GPIO_COUNT, "FLOW_SENSOR_PIN is not a GPIO");
+static_assert(SYSTEM_CONFIG.ledPin < CONFIG_GPIO_COUNT, "LED_PIN is not a GPIO");
+static_assert(SYSTEM_CONFIG.ledPin != FLOW_CONFIG.sensorPin, "LED_PIN and FLOW_SENSOR_PIN clash");
+static_assert(!BATTERY_CONFIG.enabled || BATTERY_CONFIG.pin < CONFIG_ADC_GPIO_COUNT,
+              "BATTERY_PIN must be an ADC pin (GPIO0-6)");
+static_assert(!BATTERY_CONFIG.enabled || (BATTERY_CONFIG.pin != FLOW_CONFIG.sensorPin &&
+                                          BATTERY_CONFIG.pin != SYSTEM_CONFIG.ledPin),
+              "BATTERY_PIN clashes with FLOW_SENSOR_PIN or LED_PIN");
+
+// Flow channels: a GPIO each, none shared with another channel, the LED or
+// the battery monitor
+constexpr bool flowChannelPinsValid() {
+    for (uint32_t i = 0; i < FLOW_CONFIG.channels; i++) {
+        uint8_t pin = FLOW_CHANNEL_PIN[i];
+        if (pin >= CONFIG_GPIO_COUNT || pin == SYSTEM_CONFIG.ledPin ||
+            (BATTERY_CONFIG.enabled && pin == BATTERY_CONFIG.pin)) {
+            return false;
+        }
+        for (uint32_t j = 0; j < i; j++) {
+            if (FLOW_CHANNEL_PIN[j] == pin) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static_assert(FLOW_CONFIG.channels >= 1 && FLOW_CONFIG.channels <= HAL_PCNT_UNITS,
+              "FLOW_CHANNELS must be 1-4 (one pulse counter unit each)");
+static_assert(FLOW_CHANNEL_PIN_COUNT >= FLOW_CONFIG.channels,
+              "FLOW_CHANNEL_PINS needs a pin for every one of FLOW_CHANNELS");
+static_assert(FLOW_CHANNEL_PIN[0] == FLOW_CONFIG.sensorPin,
+              "FLOW_CHANNEL_PINS must start with FLOW_SENSOR_PIN (channel 0)");
+static_assert(flowChannelPinsValid(),
+              "FLOW_CHANNEL_PINS: a pin is not a GPIO, repeats or clashes with LED_PIN/BATTERY_PIN");
+
+// Flow sensor
+static_assert(FLOW_CONFIG.pulsesPerLitre > 0.0 && FLOW_CONFIG.pulsesPerLitre <= 10000.0,
+              "CALIBRATION_FACTOR must be 0-10000 pulses/L");
+static_assert(FLOW_CONFIG.calcIntervalMs >= 100 && FLOW_CONFIG.calcIntervalMs <= 60000,
+              "FLOW_CALC_INTERVAL must be 100-60000 ms");
+static_assert(FLOW_CONFIG.idleTimeoutMs > FLOW_CONFIG.calcIntervalMs,
+              "FLOW_IDLE_TIMEOUT must be longer than FLOW_CALC_INTERVAL");
+static_assert((uint64_t)FLOW_CONFIG.idleTimeoutMs * 1000 <= UINT32_MAX,
+              "FLOW_IDLE_TIMEOUT must fit a 32-bit pulse period in microseconds");
+static_assert(FLOW_CONFIG.periodMethodMaxPulses >= 1, "FLOW_PERIOD_METHOD_MAX_PULSES must be 1 or more");
+static_assert(FLOW_CONFIG.pulseBackend == PULSE_BACKEND_GPIO ||
+              FLOW_CONFIG.pulseBackend == PULSE_BACKEND_PCNT, "unknown PULSE_BACKEND");
+static_assert(FLOW_CONFIG.glitchFilterNs <= 12700, "PULSE_GLITCH_FILTER_NS is at most 12700 ns");
+static_assert(FLOW_CONFIG.saveThresholdLitres > 0.0, "SAVE_THRESHOLD must be positive");
+static_assert(FLOW_CONFIG.maxSaveIntervalMs >= FLOW_CONFIG.calcIntervalMs,
+              "MAX_SAVE_INTERVAL must be at least FLOW_CALC_INTERVAL");
+
+// In-firmware calibration (see calibration.h for the curve)
+static_assert(CALIBRATION_TABLE_SIZE >= 2, "CALIBRATION_TABLE_SIZE needs two entries or more");
+static_assert(CALIBRATION_DEFAULT_RUNS >= 1 && CALIBRATION_DEFAULT_RUNS <= CALIBRATION_MAX_POINTS,
+              "CALIBRATION_DEFAULT_RUNS must be 1..CALIBRATION_MAX_POINTS");
+static_assert(CALIBRATION_MIN_RUN_PULSES >= 2, "a run needs two pulses for a frequency");
+static_assert(CALIBRATION_MERGE_PERMILLE < 1000, "CALIBRATION_MERGE_PERMILLE must be below 1000");
+
+// Leak detection: detector clocks are hal_millis() differences, so every
+// rule must fit well inside its 49.7 day range
+static_assert(LEAK_CONFIG.continuousMinutes <= 30 * 24 * 60,
+              "LEAK_CONTINUOUS_FLOW must be 0-43200 minutes");
+static_assert(LEAK_CONFIG.neverQuietHours == 0 ||
+              (uint64_t)LEAK_CONFIG.quietMinutes * 60000 > FLOW_CONFIG.idleTimeoutMs,
+              "LEAK_QUIET_PERIOD must be longer than FLOW_IDLE_TIMEOUT");
+static_assert(LEAK_CONFIG.neverQuietHours <= 24 * 24,
+              "LEAK_NEVER_QUIET must be 0-576 hours");
+static_assert(LEAK_CONFIG.neverQuietHours == 0 ||
+              (uint64_t)LEAK_CONFIG.neverQuietHours * 60 > LEAK_CONFIG.quietMinutes,
+              "LEAK_NEVER_QUIET must be longer than LEAK_QUIET_PERIOD");
+static_assert(LEAK_CONFIG.burstLitres >= 0.0 && LEAK_CONFIG.burstLitres <= 100000.0,
+              "LEAK_BURST_VOLUME must be 0-100000 L");
+
+// Usage events
+static_assert(USAGE_CONFIG.minVolumeLitres > 0.0 && USAGE_CONFIG.minVolumeLitres <= 100.0,
+              "USAGE_MIN_VOLUME must be above 0 and at most 100 L");
+static_assert(USAGE_CONFIG.ringEvents >= 1 && USAGE_CONFIG.ringEvents <= 1024,
+              "USAGE_EVENT_RING must be 1-1024 events");
+static_assert(USAGE_CONFIG.treeMaxNodes >= 13 && USAGE_CONFIG.treeMaxNodes <= 64,
+              "USAGE_TREE_MAX_NODES must be 13-64 (the built-in tree has 13 nodes)");
+static_assert(USAGE_HOLD_REPORTS == 0 || USAGE_HOLD_REPORTS == 1, "USAGE_HOLD_REPORTS must be 0 or 1");
+
+// Battery
+static_assert(!BATTERY_CONFIG.enabled || BATTERY_CONFIG.minVolts < BATTERY_CONFIG.maxVolts,
+              "BATTERY_MIN_VOLTAGE must be below BATTERY_MAX_VOLTAGE");
+static_assert(!BATTERY_CONFIG.enabled || (BATTERY_CONFIG.dividerRatio >= 1 &&
+              BATTERY_CONFIG.maxVolts * 1000.0 / BATTERY_CONFIG.dividerRatio <= CONFIG_ADC_MAX_MV),
+              "a full battery exceeds the ADC range - check BATTERY_DIVIDER_RATIO");
+static_assert(BATTERY_CONFIG.samples >= 1 && (BATTERY_CONFIG.samples & (BATTERY_CONFIG.samples - 1)) == 0,
+              "BATTERY_SAMPLES must be a power of two (the average is a shift)");
+static_assert(BATTERY_CONFIG.samples * BATTERY_CONFIG.sampleIntervalMs < BATTERY_CONFIG.checkIntervalMs,
+              "a check's samples must finish before the next BATTERY_CHECK_INTERVAL");
+static_assert(BATTERY_CONFIG.criticalPercent < BATTERY_CONFIG.warningPercent &&
+              BATTERY_CONFIG.warningPercent <= 100,
+              "need BATTERY_CRITICAL_LEVEL < BATTERY_WARNING_LEVEL <= 100");
+static_assert(!BATTERY_CONFIG.enabled || (BATTERY_CONFIG.reportIntervalS >= 60 &&
+                                          BATTERY_CONFIG.reportIntervalS <= 3600),
+              "BATTERY_REPORT_INTERVAL must be 60-3600 s");
+static_assert(BATTERY_CONFIG.changePercent >= 1 && BATTERY_CONFIG.changePercent <= 100,
+              "BATTERY_CHANGE_THRESHOLD must be 1-100 %");
+
+// Zigbee
+static_assert(ZIGBEE_CONFIG.channel >= 11 && ZIGBEE_CONFIG.channel <= 26,
+              "ZIGBEE_CHANNEL must be 11-26");
+static_assert(ZIGBEE_CONFIG.panId != 0 && ZIGBEE_CONFIG.panId != 0xFFFF,
+              "ZIGBEE_PAN_ID must be 0x0001-0xFFFE");
+static_assert(ZIGBEE_CONFIG.flowEndpoint >= 1 &&
+              ZIGBEE_CONFIG.flowEndpoint + FLOW_CONFIG.channels - 1 <= 240,
+              "FLOW_ENDPOINT + channel must be 1-240 for every flow channel");
+static_assert(!BATTERY_CONFIG.enabled || (ZIGBEE_CONFIG.batteryEndpoint >= 1 &&
+                                          ZIGBEE_CONFIG.batteryEndpoint <= 240 &&
+                                          (ZIGBEE_CONFIG.batteryEndpoint < ZIGBEE_CONFIG.flowEndpoint ||
+                                           ZIGBEE_CONFIG.batteryEndpoint >=
+                                               ZIGBEE_CONFIG.flowEndpoint + FLOW_CONFIG.channels)),
+              "BATTERY_ENDPOINT must be 1-240 and differ from the flow channel endpoints");
+static_assert(ZIGBEE_CONFIG.rejoinTimeoutMs > 0 && ZIGBEE_CONFIG.joinTimeoutMs > 0,
+              "ZIGBEE_REJOIN_TIMEOUT and ZIGBEE_JOIN_TIMEOUT must be positive");
+static_assert(ZIGBEE_CONFIG.backoffMinMs >= 1 && ZIGBEE_CONFIG.backoffMinMs <= ZIGBEE_CONFIG.backoffMaxMs,
+              "need 1 <= ZIGBEE_BACKOFF_MIN <= ZIGBEE_BACKOFF_MAX");
+static_assert(ZIGBEE_CONFIG.backoffMaxMs <= UINT32_MAX / 2, "ZIGBEE_BACKOFF_MAX doubles in 32 bits");
+static_assert(ZIGBEE_CONFIG.pollIntervalMs >= 1 && ZIGBEE_CONFIG.pollIntervalMs < ZIGBEE_CONFIG.joinTimeoutMs,
+              "ZIGBEE_POLL_INTERVAL must be shorter than ZIGBEE_JOIN_TIMEOUT");
+static_assert(ZIGBEE_CONFIG.timeSyncHours >= 1 && ZIGBEE_CONFIG.timeSyncHours <= 168,
+              "TIME_SYNC_INTERVAL must be 1-168 hours");
+static_assert(ZIGBEE_CONFIG.timeSyncRetryS >= 5 && ZIGBEE_CONFIG.timeSyncRetryS <= 3600,
+              "TIME_SYNC_RETRY must be 5-3600 s");
+static_assert(ZIGBEE_CONFIG.timeZoneMinutes >= -720 && ZIGBEE_CONFIG.timeZoneMinutes <= 840,
+              "TIME_ZONE_OFFSET must be -720 to 840 minutes (UTC-12 to UTC+14)");
+
+// Reporting
+static_assert(REPORT_CONFIG.flowIntervalS >= 10 && REPORT_CONFIG.flowIntervalS <= 300,
+              "FLOW_REPORT_INTERVAL must be 10-300 s");
+static_assert(REPORT_CONFIG.minIntervalS <= REPORT_CONFIG.flowIntervalS,
+              "REPORT_MIN_INTERVAL must not exceed FLOW_REPORT_INTERVAL");
+static_assert(REPORT_CONFIG.rateChangeFraction >= 0.0 && REPORT_CONFIG.rateChangeFraction <= 1.0,
+              "FLOW_RATE_CHANGE_THRESHOLD must be 0-1");
+static_assert(REPORT_CONFIG.rateMinChangeLpm >= 0.0, "FLOW_RATE_MIN_CHANGE must not be negative");
+static_assert(REPORT_CONFIG.volumeMilestoneLitres > 0.0, "VOLUME_MILESTONE must be positive");
+static_assert(REPORT_CONFIG.budgetBytesPerHour >= 1, "REPORT_BUDGET_BYTES_PER_HOUR must be positive");
+static_assert((uint64_t)REPORT_CONFIG.budgetBurstBytes * 1000 <= UINT32_MAX,
+              "REPORT_BUDGET_BURST_BYTES must fit the milli-byte bucket");
+static_assert(REPORT_CONFIG.ackTimeoutMs >= 100 && REPORT_CONFIG.ackTimeoutMs <= 10000,
+              "REPORT_ACK_TIMEOUT must be 100-10000 ms");
+static_assert(REPORT_CONFIG.alarmTries >= 1 && REPORT_CONFIG.alarmTries <= 10,
+              "REPORT_ALARM_TRIES must be 1-10");
+static_assert(REPORT_MAX_ATTRIBUTES >= 3 * FLOW_CONFIG.channels + 7 + (BATTERY_CONFIG.enabled ? 2 : 0),
+              "REPORT_MAX_ATTRIBUTES must hold volume, rate and status of every flow channel, "
+              "the usage event's 7 attributes, plus battery level and alarms");
+
+// Raw data partition: sector-aligned areas, in order, inside the partition
+static_assert(STORAGE_CONFIG.journalOffset % HAL_FLASH_SECTOR_SIZE == 0 &&
+              STORAGE_CONFIG.historyOffset % HAL_FLASH_SECTOR_SIZE == 0 &&
+              STORAGE_CONFIG.traceOffset % HAL_FLASH_SECTOR_SIZE == 0,
+              "JOURNAL_OFFSET, HISTORY_OFFSET and TRACE_OFFSET must be sector aligned");
+static_assert(STORAGE_CONFIG.journalSectors >= 2,
+              "JOURNAL_SECTORS must be 2 or more (a torn erase keeps the other sector)");
+static_assert(STORAGE_CONFIG.journalOffset + STORAGE_CONFIG.journalSectors * HAL_FLASH_SECTOR_SIZE <=
+              STORAGE_CONFIG.historyOffset, "counter journal runs into HISTORY_OFFSET");
+static_assert(HISTORY_SECTORS_10S >= 2 && HISTORY_SECTORS_1MIN >= 2 && HISTORY_SECTORS_1H >= 2,
+              "each history ring needs 2 sectors or more");
+static_assert(STORAGE_CONFIG.historyOffset + STORAGE_CONFIG.historySectors * HAL_FLASH_SECTOR_SIZE <=
+              STORAGE_CONFIG.traceOffset, "history rings run into TRACE_OFFSET");
+static_assert(STORAGE_CONFIG.traceOffset + STORAGE_CONFIG.traceSectors * HAL_FLASH_SECTOR_SIZE <=
+              STORAGE_CONFIG.partitionBytes, "pulse trace runs past DATA_PARTITION_BYTES");
+static_assert(HISTORY_BLOCK_BYTES <= HAL_FLASH_SECTOR_SIZE / 2, "HISTORY_BLOCK_BYTES too big for a sector");
+
+// System
+static_assert(SYSTEM_CONFIG.ledIntervalMs > 0 && SYSTEM_CONFIG.statusIntervalMs > 0 &&
+              SYSTEM_CONFIG.serialPollMs > 0, "job intervals must be positive");
+static_assert(SYSTEM_CONFIG.consoleMaxWords >= 5,
+              "CONSOLE_MAX_WORDS must be 5 or more (usage node <i> <0xFFLLRR> <threshold>)");
+static_assert(SYSTEM_CONFIG.consoleLineMax >= 32 && SYSTEM_CONFIG.consoleLineMax <= 255,
+              "CONSOLE_LINE_MAX must be 32-255");
+
+// ============================================================================
+// Derived Constants
+// ============================================================================
+
+// Flow and persistence
+constexpr uint64_t FLOW_IDLE_TIMEOUT_US = (uint64_t)FLOW_CONFIG.idleTimeoutMs * 1000;
+constexpr uint32_t SAVE_THRESHOLD_PULSES = LITRES_TO_PULSES(FLOW_CONFIG.saveThresholdLitres);
+
+// Default reporting rules in attribute and engine units
+constexpr uint32_t REPORT_MIN_INTERVAL_MS = REPORT_CONFIG.minIntervalS * 1000;
+constexpr uint32_t FLOW_REPORT_INTERVAL_MS = REPORT_CONFIG.flowIntervalS * 1000;
+constexpr uint32_t REPORT_ACK_TIMEOUT_MS = REPORT_CONFIG.ackTimeoutMs;
+constexpr uint32_t BATTERY_REPORT_INTERVAL_MS = BATTERY_CONFIG.reportIntervalS * 1000;
+constexpr uint32_t VOLUME_MILESTONE_ML = LITRES_TO_ML(REPORT_CONFIG.volumeMilestoneLitres);
+constexpr uint16_t FLOW_CHANGE_PERMILLE = (uint16_t)(REPORT_CONFIG.rateChangeFraction * 1000 + 0.5);
+constexpr uint32_t DEMAND_MIN_CHANGE = LITRES_TO_ML(REPORT_CONFIG.rateMinChangeLpm) * 60;   // mL/h
+
+// Airtime budget token bucket, in milli-bytes: depth, refill per
+// millisecond and milliseconds per milli-byte (both Q32, rounded up so the
+// bucket never runs dry early nor waits too little)
+constexpr uint32_t REPORT_BUDGET_MAX = REPORT_CONFIG.budgetBurstBytes * 1000;
+constexpr uint64_t REPORT_BUDGET_PER_MS_Q32 = q32Ceil(REPORT_CONFIG.budgetBytesPerHour / 3600.0);
+constexpr uint64_t REPORT_BUDGET_MS_PER_Q32 = q32Ceil(3600.0 / REPORT_CONFIG.budgetBytesPerHour);
+
+// Leak detection rules in hal_millis() and ledger units (0: rule off)
+constexpr uint32_t LEAK_CONTINUOUS_MS = LEAK_CONFIG.continuousMinutes * 60000;
+constexpr uint32_t LEAK_QUIET_MS = LEAK_CONFIG.quietMinutes * 60000;
+constexpr uint32_t LEAK_NEVER_QUIET_MS = LEAK_CONFIG.neverQuietHours * 3600000;
+constexpr uint64_t LEAK_BURST_PULSES = LITRES_TO_PULSES(LEAK_CONFIG.burstLitres);
+constexpr uint64_t USAGE_MIN_PULSES = LITRES_TO_PULSES(USAGE_CONFIG.minVolumeLitres);
+
+// Battery
+constexpr uint32_t BATTERY_MIN_MV = (uint32_t)(BATTERY_CONFIG.minVolts * 1000 + 0.5);
+constexpr uint32_t BATTERY_MAX_MV = (uint32_t)(BATTERY_CONFIG.maxVolts * 1000 + 0.5);
+
+// Time sync (consumption.h)
+constexpr uint32_t TIME_SYNC_INTERVAL_MS = ZIGBEE_CONFIG.timeSyncHours * 3600000;
+constexpr uint32_t TIME_SYNC_RETRY_MS = ZIGBEE_CONFIG.timeSyncRetryS * 1000;
+constexpr int32_t TIME_ZONE_OFFSET_S = ZIGBEE_CONFIG.timeZoneMinutes * 60;
+
+// History flush age of the 10 s and 1 min tiers
+constexpr uint32_t HISTORY_FLUSH_INTERVAL_S = HISTORY_FLUSH_INTERVAL / 1000;
+
+#endif // CONFIG_TRAITS_H
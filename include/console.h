@@ -0,0 +1,57 @@
+/*
+ * Water Flow Meter - Serial Console
+ * Non-blocking command line on the debug serial port
+ *
+ * consolePoll() runs as a scheduler job. It takes whatever bytes the UART
+ * already holds (hal_serial_read() never waits) into a fixed line buffer,
+ * and when a line is complete splits it into words in place - separators
+ * become terminators, the words are pointers into the buffer - and looks
+ * the first word up in a constant command table. No heap, no copies.
+ *
+ * At most one command runs per poll and every command does a bounded
+ * amount of work: long output (dump history, trace export) is streamed
+ * CONSOLE_DUMP_ROWS rows per poll, and replies are deferred log records
+ * like every other line, so the console never holds up metering.
+ *
+ * Replies are output whenever the console is built in (CONSOLE_ENABLED),
+ * whatever LOG_LEVEL; status and latency output follow LOG_LEVEL_INFO.
+ *
+ * Commands: help, status, stats, calibrate, set, dump history, reset counters,
+ * trace
+ */
+
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <stdint.h>
+#include "config.h"
+#include "hal.h"
+
+/**
+ * Log the system status - one deferred record per line (status command
+ * and the periodic status job)
+ */
+void printSystemStatus();
+
+#if CONSOLE_ENABLED
+
+/**
+ * Read pending serial input and run at most one complete command line;
+ * continue a history dump or trace export in progress
+ */
+void consolePoll();
+
+/**
+ * Forget the partial line, calibration, dump and export in progress
+ * Used by host tests between runs
+ */
+void resetConsole();
+
+#else
+
+static inline void consolePoll() {}
+static inline void resetConsole() {}
+
+#endif // CONSOLE_ENABLED
+
+#endif // CONSOLE_H
@@ -0,0 +1,145 @@
+/*
+ * Water Flow Meter - Consumption Buckets
+ * Wall-clock time from the coordinator, and every flow channel's
+ * consumption by calendar period
+ *
+ * Time: once joined, and every TIME_SYNC_INTERVAL hours after, the device
+ * reads Time and LocalTime from the coordinator's Time cluster (asking
+ * again every TIME_SYNC_RETRY seconds until it answers) and sets the
+ * device clock to Time (historySetClock): device time becomes ZCL
+ * UTCTime, seconds since 2000-01-01 UTC. LocalTime - Time is the zone
+ * offset, daylight saving included, so periods start at local midnight;
+ * TIME_ZONE_OFFSET stands in until a coordinator sends LocalTime. The
+ * device's own clock rolls the periods until then, but the first sync
+ * since boot credits the water counted since boot to the synced day
+ * rather than to the days its jump skips.
+ *
+ * Buckets: per channel, the ledger at the start of today, of this week
+ * (Monday) and of this month, yesterday's pulses and the pulses of the 11
+ * months before this one. Each bucket is a subtraction from the live
+ * ledger, so the flow job does no work for them; a job wakes at local
+ * midnight and rolls the periods over in O(1) (at most 11 months closed
+ * after a long gap). Water counted in the flow window that crosses
+ * midnight lands in the new day.
+ *
+ * The state only changes at a rollover (or a new zone offset), so it goes
+ * to NVS with the next ledger save after one (saveTotalVolume) - once a
+ * day at most, every channel in one blob. Water counted between a
+ * rollover and a power loss before that save lands in the old period at
+ * the next boot.
+ *
+ * The buckets are server attributes of each channel's Metering cluster
+ * (metering_cluster.h), refreshed on every report pass and at each
+ * rollover: the coordinator reads one value instead of scanning history.
+ *
+ * Runs on the main task only.
+ */
+
+#ifndef CONSUMPTION_H
+#define CONSUMPTION_H
+
+#include <stdint.h>
+#include "config.h"
+#include "hal.h"
+
+#define CONSUMPTION_MONTHS 12        // Months in the rolling year, this one included
+
+// Consumption of one channel by period (mL)
+struct ConsumptionTotals {
+    uint64_t todayMl;
+    uint64_t yesterdayMl;
+    uint64_t weekMl;
+    uint64_t monthMl;
+    uint64_t yearMl;         // Last CONSUMPTION_MONTHS months, this one included
+};
+
+// Bucket state of one channel, in ledger pulses
+struct ConsumptionBuckets {
+    uint64_t dayLedger;      // Ledger at the start of today
+    uint64_t weekLedger;     // ... of this week
+    uint64_t monthLedger;    // ... of this month
+    uint64_t yesterdayPulses;
+    uint64_t yearPulses;     // Sum of monthPulses
+    uint32_t monthPulses[CONSUMPTION_MONTHS - 1];   // By month index % 11
+};
+
+// Calendar periods, counted from 2000-01-01 in local time
+struct ConsumptionPeriod {
+    int32_t day;
+    int32_t week;            // Weeks start on Monday
+    int32_t month;           // (year - 2000) * 12 + month - 1
+};
+
+// ============================================================================
+// Calendar
+// ============================================================================
+
+/**
+ * Periods of local day number day (days since 2000-01-01, a Saturday)
+ */
+ConsumptionPeriod consumptionPeriod(int32_t day);
+
+/**
+ * Local day number of a device time with a zone offset (s east of UTC)
+ */
+int32_t consumptionDay(uint32_t deviceTime, int32_t zoneOffsetS);
+
+/**
+ * Milliseconds from device time to the end of period day in local time -
+ * at most a day (a clock far behind the day checks again daily), at least
+ * a second
+ */
+uint32_t consumptionRolloverMs(int32_t day, uint32_t deviceTime, int32_t zoneOffsetS);
+
+/**
+ * Move a channel's buckets from period from to period to (later), with
+ * ledger the channel's ledger at the boundary
+ */
+void consumptionRoll(ConsumptionBuckets* buckets, uint64_t ledger, const ConsumptionPeriod* from,
+                     const ConsumptionPeriod* to);
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+/**
+ * Load the buckets of every channel from NVS, roll them over to today and
+ * start the rollover and time sync jobs (ledgers loaded, history begun)
+ */
+void consumptionBegin(const uint64_t* ledgers);
+
+/**
+ * Roll the periods over if the local day changed, and arm the rollover job
+ * for the next midnight - after anything that moves the device clock
+ */
+void consumptionUpdate();
+
+/**
+ * A channel's consumption by period, from its live ledger
+ */
+void consumptionTotals(uint8_t channel, ConsumptionTotals* totals);
+
+/**
+ * Refresh the Metering cluster attributes of every channel (report path)
+ */
+void consumptionPublish();
+
+/**
+ * Write the buckets to NVS if they changed since the last save (ledger
+ * save path)
+ */
+void consumptionSave();
+
+/**
+ * Zone offset in use (s east of UTC), and whether the coordinator has
+ * answered a time read since boot
+ */
+int32_t consumptionZoneOffset();
+bool consumptionTimeSynced();
+
+/**
+ * Forget the buckets, time sync and jobs; NVS is kept (host tests)
+ */
+void resetConsumption();
+
+#endif // CONSUMPTION_H
@@ -0,0 +1,57 @@
+/*
+ * Water Flow Meter - Counter Journal
+ * Wear-leveled, append-only journal for the pulse ledger on raw flash
+ *
+ * Each save appends one 16-byte CRC-protected record to the current 4 KB
+ * sector; when a sector fills, the journal moves to the next sector in the
+ * ring and erases it. Every sector is erased once per trip round the ring,
+ * so wear is spread evenly and each save programs 16 bytes instead of
+ * rewriting NVS entries.
+ *
+ * At boot the active sector is the one whose first record has the highest
+ * sequence number; the last record in it is found by binary search on
+ * "slot erased" (records are only ever appended), then checked by CRC.
+ */
+
+#ifndef COUNTER_JOURNAL_H
+#define COUNTER_JOURNAL_H
+
+#include <stdint.h>
+#include "hal.h"
+
+// On-flash record (16 bytes, no padding)
+struct JournalRecord {
+    uint64_t value;          // Pulse ledger
+    uint32_t seq;            // Increments with every append
+    uint32_t crc;            // CRC-32 over value and seq
+};
+
+#define JOURNAL_RECORD_SIZE sizeof(JournalRecord)
+#define JOURNAL_SLOTS_PER_SECTOR (HAL_FLASH_SECTOR_SIZE / JOURNAL_RECORD_SIZE)
+
+// Journal cursor
+struct CounterJournal {
+    uint32_t baseOffset;     // Partition offset of sector 0
+    uint16_t sectors;        // Sectors in the ring
+    uint16_t sector;         // Active sector
+    uint16_t slot;           // Next free slot in the active sector
+    uint32_t seq;            // Sequence of the last record written
+};
+
+/**
+ * Bind a journal to sectors of the data partition (must be open)
+ */
+void journalBegin(CounterJournal* journal, uint32_t offset, uint16_t sectors);
+
+/**
+ * Find the latest valid record and position the write cursor after it
+ * Returns false if the journal holds no valid record (fresh partition)
+ */
+bool journalRecover(CounterJournal* journal, uint64_t* value);
+
+/**
+ * Append a new value - erases the next sector when the current one is full
+ */
+bool journalAppend(CounterJournal* journal, uint64_t value);
+
+#endif // COUNTER_JOURNAL_H
@@ -0,0 +1,200 @@
+/*
+ * Water Flow Meter - Deferred Logger
+ * Zero-allocation binary log records, formatted off the hot path
+ *
+ * LOG(NAME, args...) stores a record - message id from log_messages.h,
+ * hal_millis() timestamp and the raw integer arguments - in a fixed ring of
+ * 32-bit words. That is a handful of stores: no formatting, no heap, no
+ * serial I/O. A low priority drain task (hal_drain_task_begin) later turns
+ * records into text lines, or with LOG_BINARY_OUTPUT streams them as
+ * compact frames for tools/log_decoder on the host.
+ *
+ * Messages above LOG_LEVEL are removed at compile time, arguments and all,
+ * so a release build with LOG_LEVEL 0 contains no logging code.
+ *
+ * Single producer: LOG() may only be called from the main task (not from
+ * ISRs). If the ring is full the record is dropped and counted - logging
+ * never blocks the caller.
+ */
+
+#ifndef DEFERRED_LOG_H
+#define DEFERRED_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <type_traits>
+#include "config.h"
+#include "hal.h"
+#include "log_messages.h"
+
+static_assert((LOG_BUFFER_WORDS & (LOG_BUFFER_WORDS - 1)) == 0,
+              "LOG_BUFFER_WORDS must be a power of two");
+
+#define LOG_MAX_ARG_WORDS 8      // Argument words per record (64-bit args use two)
+#define LOG_HEADER_WORDS 2       // id/length word + timestamp
+#define LOG_LINE_MAX 160         // Longest formatted line
+
+// ============================================================================
+// Message Table
+// ============================================================================
+
+#define LOG_X_ID(name, level, format) LOG_ID_##name,
+enum LogMsgId : uint16_t {
+    LOG_MESSAGES(LOG_X_ID)
+    LOG_MSG_COUNT
+};
+#undef LOG_X_ID
+
+#define LOG_X_LEVEL(name, level, format) static constexpr uint8_t LOG_LEVEL_OF_##name = level;
+LOG_MESSAGES(LOG_X_LEVEL)
+#undef LOG_X_LEVEL
+
+#define LOG_X_FORMAT(name, level, format) static constexpr char LOG_FORMAT_##name[] = format;
+LOG_MESSAGES(LOG_X_FORMAT)
+#undef LOG_X_FORMAT
+
+/**
+ * Format string and level of a message id (nullptr / 0 if out of range)
+ */
+const char* logMessageFormat(uint16_t id);
+uint8_t logMessageLevel(uint16_t id);
+
+// ============================================================================
+// Records
+// ============================================================================
+
+struct LogRecord {
+    uint16_t id;                          // LogMsgId
+    uint8_t wordCount;                    // Argument words used
+    uint32_t timestampMs;                 // hal_millis() at the call site
+    uint32_t words[LOG_MAX_ARG_WORDS];    // Raw arguments, 64-bit as lo, hi
+};
+
+struct LogStats {
+    uint32_t records;        // Records stored
+    uint32_t dropped;        // Records lost to a full ring
+    uint32_t drained;        // Records taken out by the drain
+    uint32_t maxUsedWords;   // High-water mark of the ring
+};
+
+/**
+ * Store a record - O(1), no allocation. Prefer the LOG() macro, which
+ * also applies the compile-time level filter and checks the format
+ */
+void logWriteWords(uint16_t id, const uint32_t* words, uint8_t wordCount);
+
+// Argument packing: everything is a 32-bit word except long long, which
+// matches the ll length modifier (the only 64-bit conversion allowed)
+static inline uint8_t logPack(uint32_t* words, uint8_t n) {
+    (void)words;
+    return n;
+}
+
+template <typename T, typename... Rest>
+static inline uint8_t logPack(uint32_t* words, uint8_t n, T value, Rest... rest) {
+    static_assert(std::is_integral<T>::value || std::is_enum<T>::value,
+                  "log arguments must be integers");
+    words[n++] = (uint32_t)value;
+    if (std::is_same<T, long long>::value || std::is_same<T, unsigned long long>::value) {
+        words[n++] = (uint32_t)((unsigned long long)value >> 32);
+    }
+    return logPack(words, n, rest...);
+}
+
+static inline void logWrite(LogMsgId id) {
+    logWriteWords(id, nullptr, 0);
+}
+
+template <typename... Args>
+static inline void logWrite(LogMsgId id, Args... args) {
+    static_assert(sizeof...(Args) <= LOG_MAX_ARG_WORDS, "too many log arguments");
+    uint32_t words[sizeof...(Args) * 2];
+    uint8_t count = logPack(words, 0, args...);
+    logWriteWords(id, words, count);
+}
+
+// Never called - lets the compiler check arguments against the format
+static inline void logFormatCheck(const char* format, ...) __attribute__((format(printf, 1, 2)));
+static inline void logFormatCheck(const char* format, ...) {
+    (void)format;
+}
+
+// Blank lines (SYSTEM_BLANK) have an empty format on purpose - only the
+// check inside LOG() is exempt from -Wformat-zero-length
+#define LOG_FORMAT_CHECK(...) \
+    _Pragma("GCC diagnostic push") \
+    _Pragma("GCC diagnostic ignored \"-Wformat-zero-length\"") \
+    if (false) { \
+        logFormatCheck(__VA_ARGS__); \
+    } \
+    _Pragma("GCC diagnostic pop")
+
+/**
+ * Log a message from log_messages.h: LOG(FLOW_RATE, a, b, c, d)
+ * Compiles to nothing when the message level is above LOG_LEVEL
+ */
+#define LOG(name, ...) \
+    do { \
+        if constexpr (LOG_LEVEL_OF_##name <= LOG_LEVEL) { \
+            LOG_FORMAT_CHECK(LOG_FORMAT_##name, ##__VA_ARGS__); \
+            logWrite(LOG_ID_##name, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+// ============================================================================
+// Drain
+// ============================================================================
+
+/**
+ * Start the drain task - records are output whenever the main task sleeps
+ */
+void logBegin();
+
+/**
+ * Take the oldest record out of the ring - false if empty
+ */
+bool logRead(LogRecord* record);
+
+/**
+ * Output up to maxRecords records (0 = until empty), returns the number
+ * output. Text lines or binary frames depending on LOG_BINARY_OUTPUT
+ */
+uint32_t logDrain(uint32_t maxRecords);
+
+/**
+ * Format a record's message into out (always terminated, no newline)
+ * Returns the length written
+ */
+size_t logFormat(const LogRecord* record, char* out, size_t len);
+
+const LogStats* logStats();
+
+// ============================================================================
+// Binary Frames
+// ============================================================================
+//
+// 0xA5 | id (2) | wordCount (1) | timestamp (4) | words (4 each) | checksum
+// Little endian; checksum = ~(sum of the bytes between sync and checksum)
+
+#define LOG_FRAME_SYNC 0xA5
+#define LOG_FRAME_OVERHEAD 9
+#define LOG_FRAME_MAX (LOG_FRAME_OVERHEAD + LOG_MAX_ARG_WORDS * 4)
+
+/**
+ * Encode a record into out (at least LOG_FRAME_MAX bytes), returns its size
+ */
+size_t logEncodeFrame(const LogRecord* record, uint8_t* out);
+
+/**
+ * Decode the frame starting at data[0] - returns its size, or 0 if data
+ * does not start with a complete, valid frame (caller skips a byte)
+ */
+size_t logDecodeFrame(const uint8_t* data, size_t len, LogRecord* record);
+
+/**
+ * Empty the ring and clear the stats
+ * Used by host tests and benchmarks between runs
+ */
+void resetDeferredLog();
+
+#endif // DEFERRED_LOG_H
@@ -0,0 +1,118 @@
+/*
+ * Water Flow Meter - Flow Channels
+ * Per-channel metering state as a struct of arrays, and the flow window
+ * update that walks it
+ *
+ * One board meters up to FLOW_CHANNELS sensors - hot and cold water,
+ * garden lines. Every channel has its own pulse source (pulse_source.h,
+ * PCNT unit = channel), calibration curve (calibration.h), ledger, NVS
+ * keys and Metering endpoint FLOW_ENDPOINT + channel.
+ *
+ * The state the flow job touches every window is one array per field, not
+ * one structure per channel: the update is a single loop over contiguous
+ * counts, ledgers and scales, and adding a channel adds one element to
+ * each array rather than another copy of the code path. The channel count
+ * is a template parameter - the firmware uses FlowChannels<FLOW_CHANNELS>,
+ * bench_channels other sizes.
+ *
+ * Channel 0 doubles as the single-sensor interface of flow_meter.h
+ * (totalPulses, flowRateMlMin, lastSavedPulses) and is the channel the
+ * flash journal, flow history and pulse trace record. The ledgers of the
+ * other channels are saved to NVS and mirrored in retained memory.
+ */
+
+#ifndef FLOW_CHANNELS_H
+#define FLOW_CHANNELS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "config.h"
+#include "calibration.h"
+#include "flow_estimator.h"
+#include "pulse_source.h"
+
+template <uint8_t N>
+struct FlowChannels {
+    uint64_t lastCount[N];        // Sensor count at the last update
+    uint64_t ledger[N];           // Pulse ledger, nominal pulses (persisted)
+    uint64_t savedLedger[N];      // Ledger value last saved
+    uint32_t rateMlMin[N];        // Calibrated flow rate (mL/min)
+    uint32_t scale[N];            // Ledger pulses per sensor pulse last applied, Q16
+    uint32_t carry[N];            // Fraction of a ledger pulse not yet counted, Q16
+    FlowEstimator estimator[N];
+};
+
+// What an update did, one bit per channel
+struct FlowChannelsTick {
+    uint32_t updated;        // Estimator ran (window end, or a starting flow)
+    uint32_t counted;        // New pulses reached the ledger
+    uint32_t stopped;        // Rate fell to 0
+};
+
+/**
+ * All channels idle at ledger 0, uncalibrated scale
+ */
+template <uint8_t N>
+constexpr FlowChannels<N> flowChannelsInit() {
+    FlowChannels<N> channels{};
+    for (uint8_t i = 0; i < N; i++) {
+        channels.scale[i] = CALIBRATION_SCALE_ONE;
+    }
+    return channels;
+}
+
+/**
+ * One flow window for every channel: readings[i] and tables[i] are channel
+ * i's pulse reading and calibration table. A channel updates at the end of
+ * the window, or early when its flow starts
+ */
+template <uint8_t N>
+FlowChannelsTick flowChannelsUpdate(FlowChannels<N>* channels, const PulseReading* readings,
+                                    const CalibrationTable* tables, uint64_t nowUs,
+                                    bool windowComplete) {
+    FlowChannelsTick tick = {};
+    for (uint8_t i = 0; i < N; i++) {
+        const PulseReading* reading = &readings[i];
+        if (!windowComplete && !flowEstimatorStarting(&channels->estimator[i], reading->edgeCount)) {
+            continue;
+        }
+
+        uint64_t newPulses = reading->count - channels->lastCount[i];
+        uint32_t previousRate = channels->rateMlMin[i];
+        uint32_t nominalRate = flowEstimatorUpdate(&channels->estimator[i], reading->edgeCount,
+                                                   reading->edgeUs, nowUs, windowComplete);
+
+        // Ledger is the only accumulator - volume is derived from it. Sensor
+        // pulses count at the K-factor of the current pulse frequency
+        uint32_t scale = calibrationScaleAt(&tables[i], nominalRate);
+        uint64_t scaled = newPulses * scale + channels->carry[i];
+        channels->ledger[i] += scaled >> 16;
+        channels->carry[i] = (uint32_t)(scaled & 0xFFFF);
+        channels->scale[i] = scale;
+        channels->rateMlMin[i] = (uint32_t)(((uint64_t)nominalRate * scale) >> 16);
+        channels->lastCount[i] = reading->count;
+
+        uint32_t bit = 1UL << i;
+        tick.updated |= bit;
+        if (newPulses > 0) {
+            tick.counted |= bit;
+        } else if (previousRate > 0 && channels->rateMlMin[i] == 0) {
+            tick.stopped |= bit;
+        }
+    }
+    return tick;
+}
+
+/**
+ * NVS key of a per-channel value: channel 0 keeps the single-sensor name,
+ * channel n appends ".n" (NVS keys are at most 15 characters)
+ */
+static inline void flowChannelKey(char* key, size_t size, const char* name, uint8_t channel) {
+    if (channel == 0) {
+        snprintf(key, size, "%s", name);
+    } else {
+        snprintf(key, size, "%s.%u", name, (unsigned)channel);
+    }
+}
+
+#endif // FLOW_CHANNELS_H
@@ -0,0 +1,48 @@
+/*
+ * Water Flow Meter - Flow Rate Estimator
+ * Adaptive period/count flow rate estimation from pulse edge timestamps
+ *
+ * With 7.5 pulses/L, counting pulses in a 1 s window can only express flow
+ * in 8 L/min steps. At low frequency the estimator instead measures the
+ * time between pulse edges (reciprocal/period method), stretching its
+ * measurement window across polls until a new edge arrives. Once there are
+ * enough pulses per window for counting to be precise, it switches to the
+ * cheaper count method.
+ */
+
+#ifndef FLOW_ESTIMATOR_H
+#define FLOW_ESTIMATOR_H
+
+#include <stdint.h>
+#include "config.h"
+#include "flow_math.h"
+
+// Estimator state - one per flow sensor
+struct FlowEstimator {
+    uint64_t refCount;       // Pulse count at the reference edge
+    uint64_t refEdgeUs;      // Timestamp of the reference edge (hal_micros64)
+    uint32_t rateMlMin;      // Current estimate (mL/min)
+    bool hasReference;       // A reference edge has been seen since idle
+    bool partialWindow;      // Reference taken mid-window (flow start)
+};
+
+void flowEstimatorReset(FlowEstimator* est);
+
+/**
+ * Fast path for flow starts: returns true when a new pulse arrived while
+ * the estimator was idle, so the caller can update before the window ends
+ */
+static inline bool flowEstimatorStarting(const FlowEstimator* est, uint64_t count) {
+    return est->rateMlMin == 0 && count != est->refCount;
+}
+
+/**
+ * Update the estimate from the ISR's pulse count and last edge timestamp
+ * (64-bit monotonic: neither wraps, so the differences below never do)
+ * windowComplete: a full FLOW_CALC_INTERVAL elapsed since the last update
+ * Returns the new rate in mL/min
+ */
+uint32_t flowEstimatorUpdate(FlowEstimator* est, uint64_t count, uint64_t lastEdgeUs,
+                             uint64_t nowUs, bool windowComplete);
+
+#endif // FLOW_ESTIMATOR_H
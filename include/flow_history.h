@@ -0,0 +1,124 @@
+/*
+ * Water Flow Meter - Flow History
+ * Compressed per-interval consumption history at three resolutions
+ *
+ * Every tier records the pulses counted in each of its intervals (10 s,
+ * 1 min, 1 h) - the delta of the pulse ledger across the interval. Deltas
+ * are varint encoded, zero intervals collapse into run-length tokens:
+ *   count > 0      : varint(count << 1)
+ *   n idle intervals: varint((n << 1) | 1)
+ * so an idle day costs a few bytes and a flowing 10 s interval one or two.
+ *
+ * Each tier fills a HISTORY_BLOCK_BYTES block in RAM. Full blocks, and
+ * blocks holding flow once HISTORY_FLUSH_INTERVAL passes (hourly tier:
+ * HISTORY_FLUSH_AGE_1H), spill to the tier's sector ring on the raw data
+ * partition (oldest sector erased when the ring wraps, like the counter
+ * journal). Blocks carry their start time and start ledger, so every
+ * block decodes on its own.
+ *
+ * Intervals are closed lazily: the flow job calls historyUpdate() before
+ * it moves new pulses into the ledger, and a whole idle stretch becomes
+ * one zero run the next time anything runs - no extra wake-ups while idle.
+ *
+ * Time is device time in seconds. Until historySetClock() supplies real
+ * time, it continues after a reboot from the end of the newest stored
+ * block (time the device was off is not counted).
+ */
+
+#ifndef FLOW_HISTORY_H
+#define FLOW_HISTORY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+#include "hal.h"
+
+enum HistoryTier {
+    HISTORY_10S,
+    HISTORY_1MIN,
+    HISTORY_1H,
+    HISTORY_TIERS
+};
+
+// On-flash block header (followed by length encoded bytes)
+struct HistoryBlockHeader {
+    uint16_t magic;          // HISTORY_BLOCK_MAGIC
+    uint8_t tier;
+    uint8_t reserved;
+    uint16_t length;         // Encoded bytes after the header
+    uint16_t intervals;      // Intervals covered
+    uint32_t startTime;      // Device time of the first interval (s)
+    uint32_t seq;            // Increments with every block of the tier
+    uint64_t startLedger;    // Pulse ledger at startTime
+    uint32_t crc;            // CRC-32 over the header fields above + data
+};
+
+#define HISTORY_BLOCK_MAGIC 0x4846   // "FH"
+#define HISTORY_HEADER_SIZE sizeof(HistoryBlockHeader)
+
+struct HistoryStats {
+    uint32_t blocksWritten;  // Blocks spilled to flash
+    uint64_t bytesWritten;   // Header + data bytes programmed
+    uint64_t tierBytes[HISTORY_TIERS];   // ... split by tier
+    uint32_t sectorErases;
+};
+
+/**
+ * Stream callback: intervals consecutive intervals starting at startTime
+ * each counted pulses (runs of idle intervals arrive as one call)
+ * Return false to stop the query
+ */
+typedef bool (*HistoryCallback)(uint32_t startTime, uint32_t intervals,
+                                uint32_t pulses, void* context);
+
+/**
+ * Recover the newest block of each tier and start recording from ledger
+ * (call after loadTotalVolume). The ledger is read on every update
+ */
+void historyBegin(const uint64_t* ledger);
+
+/**
+ * Close every interval that has ended since the last update
+ * Cheap when nothing has ended; does nothing before historyBegin()
+ */
+void historyUpdate();
+
+/**
+ * Spill the RAM blocks that hold flow to flash
+ */
+void historyFlush();
+
+/**
+ * Device time in seconds
+ */
+uint32_t historyNow();
+
+/**
+ * Set device time (e.g. from Zigbee Time). Closes and spills the current
+ * blocks first; ignored (returns false) if it would move time backwards
+ */
+bool historySetClock(uint32_t seconds);
+
+uint32_t historyIntervalSeconds(HistoryTier tier);
+
+/**
+ * Stream the intervals of tier that start in [from, to), oldest first,
+ * from flash and then the RAM block - one block is decoded at a time and
+ * nothing is buffered. Returns the number of intervals delivered
+ */
+uint32_t historyQuery(HistoryTier tier, uint32_t from, uint32_t to,
+                      HistoryCallback callback, void* context);
+
+const HistoryStats* historyStats();
+
+// Varint helpers (LEB128, 7 bits per byte)
+size_t historyPutVarint(uint8_t* out, uint64_t value);
+size_t historyGetVarint(const uint8_t* data, size_t len, uint64_t* value);
+
+/**
+ * Forget all RAM state (flash is left as is, like a reboot)
+ * Used by host tests and benchmarks between runs
+ */
+void resetFlowHistory();
+
+#endif // FLOW_HISTORY_H
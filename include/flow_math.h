@@ -0,0 +1,101 @@
+/*
+ * Water Flow Meter - Fixed-Point Flow Math
+ * Integer conversions from the pulse ledger to volume and flow rate
+ *
+ * The ESP32C6 RISC-V core has no FPU, so nothing on the metering path
+ * touches float. Calibration-derived multipliers are computed once at
+ * compile time; at runtime every conversion is a handful of integer
+ * multiplies and shifts (no division).
+ */
+
+#ifndef FLOW_MATH_H
+#define FLOW_MATH_H
+
+#include <stdint.h>
+#include "config.h"
+
+// ============================================================================
+// Compile-Time Constants
+// ============================================================================
+
+// Round a positive value up to 32.32 fixed point at compile time. Rounding
+// up (rather than truncating) keeps whole-litre pulse counts exact.
+constexpr uint64_t q32Ceil(double value) {
+    return (double)(uint64_t)(value * 4294967296.0) < value * 4294967296.0 ?
+           (uint64_t)(value * 4294967296.0) + 1 :
+           (uint64_t)(value * 4294967296.0);
+}
+
+// Volume per pulse as 32.32 fixed point (integer part . fraction)
+constexpr uint64_t UL_PER_PULSE_Q32 = q32Ceil(1000000.0 / CALIBRATION_FACTOR);
+constexpr uint64_t ML_PER_PULSE_Q32 = q32Ceil(1000.0 / CALIBRATION_FACTOR);
+
+// mL/min represented by one pulse in a FLOW_CALC_INTERVAL window, Q16
+static_assert(1000.0 / CALIBRATION_FACTOR * 60000.0 / FLOW_CALC_INTERVAL < 65536.0,
+              "one pulse per FLOW_CALC_INTERVAL overflows the Q16 rate - raise the interval");
+constexpr uint32_t MLMIN_PER_WINDOW_PULSE_Q16 =
+    (uint32_t)(1000.0 / CALIBRATION_FACTOR * 60000.0 / FLOW_CALC_INTERVAL * 65536.0 + 0.5);
+
+// mL/min times microseconds for one pulse per microsecond period
+constexpr uint64_t MLMIN_US_PER_PULSE =
+    (uint64_t)(1000.0 / CALIBRATION_FACTOR * 60000000.0 + 0.5);
+
+// Pulse count equivalent of a volume threshold in litres (rounded up)
+#define LITRES_TO_PULSES(litres) \
+    ((uint32_t)((litres) * CALIBRATION_FACTOR + 0.999))
+
+// Volume threshold in litres as integer millilitres
+#define LITRES_TO_ML(litres) ((uint32_t)((litres) * 1000.0 + 0.5))
+
+// ============================================================================
+// Conversions
+// ============================================================================
+
+/**
+ * Multiply a 64-bit count by a 32.32 fixed-point factor, truncating
+ * Split into 32-bit halves so no intermediate product overflows
+ */
+static inline uint64_t mulQ32(uint64_t count, uint64_t factorQ32) {
+    uint64_t countHi = count >> 32;
+    uint64_t countLo = count & 0xFFFFFFFFULL;
+    uint64_t factorInt = factorQ32 >> 32;
+    uint64_t factorFrac = factorQ32 & 0xFFFFFFFFULL;
+    return count * factorInt
+         + countHi * factorFrac
+         + ((countLo * factorFrac) >> 32);
+}
+
+/**
+ * Volume for a 64-bit pulse count
+ * Error stays below one unit for any count under 2^32 pulses (~570,000 m3
+ * at 7.5 pulses/L) - there is no per-tick accumulation, so no drift
+ */
+static inline uint64_t pulsesToMicrolitres(uint64_t pulses) {
+    return mulQ32(pulses, UL_PER_PULSE_Q32);
+}
+
+static inline uint64_t pulsesToMillilitres(uint64_t pulses) {
+    return mulQ32(pulses, ML_PER_PULSE_Q32);
+}
+
+/**
+ * Flow rate in mL/min from the pulses counted in one FLOW_CALC_INTERVAL
+ */
+static inline uint32_t windowPulsesToFlowRate(uint32_t pulses) {
+    return (uint32_t)(((uint64_t)pulses * MLMIN_PER_WINDOW_PULSE_Q16) >> 16);
+}
+
+/**
+ * Flow rate in mL/min from pulses spread over a measured period
+ * Used by the period estimator only - costs one 64-bit division.
+ * Saturates at UINT32_MAX (edges microseconds apart: contact bounce)
+ */
+static inline uint32_t periodToFlowRate(uint32_t pulses, uint32_t periodUs) {
+    if (periodUs == 0) {
+        return 0;
+    }
+    uint64_t rate = (uint64_t)pulses * MLMIN_US_PER_PULSE / periodUs;
+    return rate > UINT32_MAX ? UINT32_MAX : (uint32_t)rate;
+}
+
+#endif // FLOW_MATH_H
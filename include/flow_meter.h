@@ -0,0 +1,147 @@
+/*
+ * Water Flow Meter - Metering Core
+ * Flow calculation, report triggering and persistence logic
+ *
+ * Platform independent: everything hardware related goes through hal.h,
+ * so the same code runs on the ESP32C6 and in [env:native] host builds.
+ */
+
+#ifndef FLOW_METER_H
+#define FLOW_METER_H
+
+#include <stdint.h>
+#include "config.h"
+#include "hal.h"
+#include "flow_math.h"
+#include "flow_channels.h"
+#include "pulse_source.h"
+
+// ============================================================================
+// Zigbee Report Identifiers
+// ============================================================================
+
+// Volume and rate: Metering cluster on FLOW_ENDPOINT + channel (metering_cluster.h)
+#define BATTERY_CLUSTER_ID 0x0001    // Power Configuration cluster
+#define BATTERY_PERCENT_ATTR 0x0021  // BatteryPercentageRemaining
+#define BATTERY_ALARM_STATE_ATTR 0x003E  // BatteryAlarmState
+
+// ============================================================================
+// Shared State
+// ============================================================================
+
+// Pulse ledgers of all channels - single source of truth for volume and
+// rate (flow_channels.h)
+extern FlowChannels<FLOW_CHANNELS> flowChannels;
+
+// Channel 0 - the single-sensor names
+extern uint64_t& totalPulses;    // All pulses ever counted (persisted)
+extern uint32_t& flowRateMlMin;  // Current flow rate (mL/min)
+
+// Zigbee
+extern bool zigbeeConnected;
+
+// Boot timing - hal_millis() when the first pulse reached the ledger and
+// when the first report went out (BOOT_TIME_UNSET until then)
+#define BOOT_TIME_UNSET 0xFFFFFFFFUL
+extern uint32_t firstPulseMs;
+extern uint32_t firstReportMs;
+
+// Data Persistence
+extern uint64_t& lastSavedPulses;   // Channel 0 ledger last saved
+extern uint32_t lastSaveTime;
+extern uint32_t bootCount;       // Power-on boots (NVS)
+extern uint32_t resetCount;      // Warm resets since power on (retained memory)
+
+// ============================================================================
+// Flow Sensor
+// ============================================================================
+
+/**
+ * Start the pulse sources of all FLOW_CHANNELS sensors
+ */
+void setupFlowSensor();
+
+/**
+ * Switch every channel's pulse source backend (PULSE_BACKEND_GPIO / _PCNT)
+ * at runtime. Counts carry on; rates are measured afresh. Returns the
+ * backend of channel 0 (GPIO if the pulse counter is unavailable)
+ */
+uint8_t selectPulseBackend(uint8_t backend);
+
+/**
+ * Update the rate, ledger and leak detector of every channel whose window
+ * is complete or whose flow is starting
+ */
+void calculateFlow();
+
+/**
+ * True when no channel measures a flow and no pulses are pending
+ */
+bool flowMeterIdle();
+
+/**
+ * Leak alarms raised on a channel (LEAK_ALARM_*, leak_detector.h)
+ */
+uint8_t leakAlarms(uint8_t channel = 0);
+
+/**
+ * Ledger including the pulses in reading (from pulseSourceRead) that the
+ * flow job has not folded in yet
+ */
+uint64_t ledgerAt(const PulseReading* reading);
+
+// Reporting-edge conversions (float only for display/legacy attributes)
+uint64_t channelVolumeMl(uint8_t channel);
+uint64_t totalVolumeMl();
+float totalVolumeLitres();
+float flowRateLitresPerMin();
+
+// ============================================================================
+// Data Persistence
+// ============================================================================
+
+void loadTotalVolume();
+void saveTotalVolume();
+void periodicSave();
+
+// ============================================================================
+// Reporting
+// ============================================================================
+
+void sendFlowReport(uint32_t flowMlMin, uint64_t volumeMl, uint8_t batteryPercent);
+bool shouldReportFlow(uint32_t currentFlowMlMin, uint64_t currentVolumeMl, uint8_t currentBattery);
+
+/**
+ * Send a full report at the next opportunity, regardless of thresholds
+ */
+void requestFlowReport();
+
+/**
+ * Report a change of the battery alarms (BATTERY_ALARM_*) in the urgent
+ * lane, sampleUs being the ADC sample that raised it
+ * (battery monitor alarm handler)
+ */
+void reportBatteryAlarm(uint8_t alarms, uint64_t sampleUs);
+
+// ============================================================================
+// Scheduling
+// ============================================================================
+
+/**
+ * Register the flow, save and report jobs with the scheduler
+ * (call after loadTotalVolume and setupFlowSensor)
+ */
+void scheduleFlowMeter(const uint8_t* batteryLevel);
+
+/**
+ * Scheduler notify handler for pulse ISR wake-ups
+ */
+void flowMeterWake();
+
+/**
+ * Reset all metering state to power-on defaults
+ * Used by host tests and benchmarks between runs
+ */
+void resetFlowMeter();
+
+#endif // FLOW_METER_H
@@ -0,0 +1,372 @@
+/*
+ * Water Flow Meter - Hardware Abstraction Layer
+ * Thin interface between the metering core and the platform
+ *
+ * The flow/report/persistence logic in flow_meter.cpp only talks to the
+ * hardware through these functions. Two implementations exist:
+ * - src/hal_esp32.cpp  : Arduino ESP32 (XIAO ESP32C6) - built when ARDUINO is defined
+ * - src/hal_native.cpp : Linux host simulation for [env:native] tests/benchmarks
+ */
+
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// IRAM_ATTR only means something on the ESP32 toolchain
+#ifdef ARDUINO
+#include <esp_attr.h>
+#endif
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+
+// Arduino pin aliases used in config.h (host builds only)
+#ifndef ARDUINO
+#define A0 4
+#define LED_BUILTIN 15
+#endif
+
+// ============================================================================
+// Clock
+// ============================================================================
+
+uint32_t hal_millis();
+uint32_t hal_micros();
+
+/**
+ * Microseconds since boot, 64-bit (wraps after 584 000 years) - ISR safe
+ */
+uint64_t hal_micros64();
+
+#define HAL_CPU_MHZ 160              // ESP32-C6 core clock
+
+/**
+ * CPU cycle counter (wraps every 26.8 s at HAL_CPU_MHZ) - ISR safe, a
+ * single register read
+ */
+uint32_t hal_cycles();
+
+// ============================================================================
+// Main Task Sleep / Wake-up
+// ============================================================================
+
+#define HAL_WAIT_FOREVER 0xFFFFFFFFUL
+
+/**
+ * Block the main task until timeoutMs elapses or an ISR calls
+ * hal_notify_from_isr() - returns true if woken by a notification
+ * Notifications raised while the task is running are not lost
+ */
+bool hal_wait_event(uint32_t timeoutMs);
+
+/**
+ * Wake the main task from interrupt context
+ * (the task that attached the pulse interrupt or last waited)
+ */
+void hal_notify_from_isr();
+
+// ============================================================================
+// GPIO / Interrupts
+// ============================================================================
+
+/**
+ * Configure pin as pull-up input and call isr() on every rising edge
+ */
+void hal_attach_pulse_interrupt(uint8_t pin, void (*isr)());
+void hal_detach_pulse_interrupt(uint8_t pin);
+
+/**
+ * Mask or unmask the attached interrupt of pin without detaching it -
+ * edges while masked are dropped, not delivered on unmasking (ISR safe)
+ */
+void hal_pulse_interrupt_enable(uint8_t pin, bool enable);
+
+// ============================================================================
+// Pulse Counter Peripheral
+// ============================================================================
+
+#define HAL_PCNT_UNITS 4         // Counter units (ESP32-C6), one per sensor
+#define HAL_PCNT_LIMIT 32767     // Count returns to 0 on reaching this (overflow event)
+
+enum HalPcntEvent : uint8_t {
+    HAL_PCNT_OVERFLOW    // Count reached HAL_PCNT_LIMIT and restarted at 0
+};
+
+/**
+ * Count rising edges on pin (pull-up input) in counter unit
+ * (0 .. HAL_PCNT_UNITS - 1); its glitch filter drops pulses shorter than
+ * filterNs. isr(event) runs in interrupt context - the only interrupt is
+ * the overflow (the limit watch point is set before the unit starts: one
+ * added while it runs takes effect only after a count clear)
+ * Returns false if the counter unit is not available
+ */
+bool hal_pcnt_begin(uint8_t unit, uint8_t pin, uint32_t filterNs, void (*isr)(HalPcntEvent event));
+void hal_pcnt_end(uint8_t unit);
+
+/**
+ * Current count of a unit, 0 .. HAL_PCNT_LIMIT - 1 (main task context)
+ */
+uint32_t hal_pcnt_count(uint8_t unit);
+
+// ============================================================================
+// ADC
+// ============================================================================
+
+/**
+ * Configure pin as an analog input
+ */
+void hal_adc_begin(uint8_t pin);
+
+/**
+ * One calibrated conversion in millivolts (tens of microseconds, no delay)
+ */
+uint32_t hal_adc_read_mv(uint8_t pin);
+
+// ============================================================================
+// Non-Volatile Storage (Preferences-style key/value)
+// ============================================================================
+
+bool hal_nvs_begin(const char* ns, bool readOnly);
+void hal_nvs_end();
+
+float hal_nvs_get_float(const char* key, float defaultValue);
+uint32_t hal_nvs_get_u32(const char* key, uint32_t defaultValue);
+uint64_t hal_nvs_get_u64(const char* key, uint64_t defaultValue);
+
+void hal_nvs_put_float(const char* key, float value);
+void hal_nvs_put_u32(const char* key, uint32_t value);
+void hal_nvs_put_u64(const char* key, uint64_t value);
+
+/**
+ * Blobs, written in one atomic NVS write. get is false (data untouched)
+ * unless the key holds exactly len bytes
+ */
+bool hal_nvs_get_blob(const char* key, void* data, size_t len);
+void hal_nvs_put_blob(const char* key, const void* data, size_t len);
+
+// ============================================================================
+// Raw Flash (data partition, no filesystem)
+// ============================================================================
+
+#define HAL_FLASH_SECTOR_SIZE 4096
+
+/**
+ * Open the raw data partition by label - safe to call more than once
+ * Offsets below are relative to the start of the partition
+ */
+bool hal_flash_begin(const char* label);
+uint32_t hal_flash_size();
+
+bool hal_flash_read(uint32_t offset, void* data, size_t len);
+
+/**
+ * Program bytes (NOR semantics: can only clear bits - erase first)
+ */
+bool hal_flash_write(uint32_t offset, const void* data, size_t len);
+
+/**
+ * Erase whole sectors back to 0xFF (offset and len sector aligned)
+ */
+bool hal_flash_erase(uint32_t offset, size_t len);
+
+// ============================================================================
+// Reset Reason / Retained Memory
+// ============================================================================
+
+enum HalResetReason {
+    HAL_RESET_POWER_ON,  // Cold boot: retained memory holds garbage
+    HAL_RESET_SOFTWARE,  // Restart requested by the firmware
+    HAL_RESET_PANIC,     // Exception or abort
+    HAL_RESET_WATCHDOG,  // Interrupt/task watchdog
+    HAL_RESET_BROWNOUT,  // Supply dipped: retained memory is not trusted
+    HAL_RESET_OTHER
+};
+
+HalResetReason hal_reset_reason();
+
+#define HAL_RETAINED_WORDS 64
+
+/**
+ * HAL_RETAINED_WORDS of RAM that no reset initializes (RTC no-init memory)
+ * Survives soft, panic and watchdog resets; garbage after a power loss,
+ * so whatever is kept here needs its own checksum. Main task only
+ */
+uint32_t* hal_retained_memory();
+
+// ============================================================================
+// Radio (Zigbee network and attribute reports)
+// ============================================================================
+
+enum HalNetworkState {
+    HAL_NET_IDLE,        // Not on a network, nothing in progress
+    HAL_NET_JOINING,     // Join or rejoin in progress
+    HAL_NET_JOINED,      // On the network - reports can be sent
+    HAL_NET_FAILED       // Last join/rejoin attempt failed
+};
+
+/**
+ * Initialize and start the Zigbee stack (does not join)
+ */
+bool hal_radio_begin();
+
+/**
+ * True if zb_storage holds network parameters from a previous join
+ */
+bool hal_radio_has_stored_network();
+
+/**
+ * Rejoin from the stored network parameters (no scan or association)
+ */
+void hal_radio_rejoin();
+
+/**
+ * Full join: scan channels and associate with an open network
+ */
+void hal_radio_join();
+
+/**
+ * Progress of the last rejoin/join - never blocks
+ */
+HalNetworkState hal_radio_network_state();
+
+uint16_t hal_radio_short_address();
+
+// One attribute record of a ZCL Report Attributes frame
+#define HAL_ATTRIBUTE_MAX_LEN 8
+struct HalAttribute {
+    uint16_t attrId;
+    uint8_t zclType;         // ZCL data type id
+    uint8_t len;
+    uint8_t value[HAL_ATTRIBUTE_MAX_LEN];   // Little endian, as sent
+};
+
+// Bytes on air for a Report Attributes frame: PHY (6), MAC (11), NWK with
+// security (26), APS (8) and ZCL (3) headers, then id + type per record
+#define HAL_RADIO_FRAME_OVERHEAD 54
+#define HAL_RADIO_RECORD_OVERHEAD 3
+#define HAL_RADIO_MAX_ATTRIBUTES 8
+
+static inline uint32_t hal_radio_frame_bytes(const HalAttribute* attrs, uint8_t count) {
+    uint32_t bytes = HAL_RADIO_FRAME_OVERHEAD;
+    for (uint8_t i = 0; i < count; i++) {
+        bytes += HAL_RADIO_RECORD_OVERHEAD + attrs[i].len;
+    }
+    return bytes;
+}
+
+/**
+ * Report count attributes of one cluster to the coordinator in a single
+ * Report Attributes frame (count <= HAL_RADIO_MAX_ATTRIBUTES)
+ * Returns false if the frame could not be queued
+ */
+bool hal_radio_report_attributes(uint8_t endpoint, uint16_t clusterId,
+                                 const HalAttribute* attrs, uint8_t count);
+
+enum HalReportStatus {
+    HAL_REPORT_PENDING,      // Sent, no APS acknowledgement yet
+    HAL_REPORT_DELIVERED,    // Acknowledged by the coordinator
+    HAL_REPORT_FAILED        // The stack gave up (no route, no acknowledgement)
+};
+
+/**
+ * Like hal_radio_report_attributes, but requesting an APS acknowledgement
+ * (alarms). Returns a handle for hal_radio_report_status, or -1 if the
+ * frame could not be queued
+ */
+int hal_radio_report_attributes_acked(uint8_t endpoint, uint16_t clusterId,
+                                      const HalAttribute* attrs, uint8_t count);
+
+/**
+ * Delivery of an acknowledged frame - never blocks
+ */
+HalReportStatus hal_radio_report_status(int handle);
+
+/**
+ * Declare a server cluster on endpoint with its attributes and initial
+ * values (call before hal_radio_begin). The stack answers Read
+ * Attributes from these values
+ */
+bool hal_radio_add_cluster(uint8_t endpoint, uint16_t clusterId,
+                           const HalAttribute* attrs, uint8_t count);
+
+/**
+ * Update the value the stack answers Read Attributes with (does not report)
+ */
+void hal_radio_set_attribute(uint8_t endpoint, uint16_t clusterId, const HalAttribute* attr);
+
+// One attribute record of a ZCL Configure Reporting command
+struct HalReportingConfig {
+    uint8_t endpoint;
+    uint16_t clusterId;
+    uint16_t attrId;
+    uint8_t zclType;
+    uint16_t minIntervalS;       // 0xFFFF with max 0: back to defaults
+    uint16_t maxIntervalS;       // 0: no periodic reports, 0xFFFF: none at all
+    uint64_t reportableChange;
+};
+
+/**
+ * Handler for Configure Reporting records from the coordinator - runs on
+ * the main task, returns the ZCL status sent back for the record
+ */
+void hal_radio_on_configure_reporting(uint8_t (*handler)(const HalReportingConfig* record));
+
+/**
+ * Handler for Write Attributes records from the coordinator - runs on the
+ * main task, returns the ZCL status sent back for the record. The handler
+ * updates the server attribute itself (hal_radio_set_attribute) if it
+ * takes the value
+ */
+void hal_radio_on_write_attribute(uint8_t (*handler)(uint8_t endpoint, uint16_t clusterId,
+                                                     const HalAttribute* attr));
+
+// The coordinator's clock, read from its Time cluster (0x000A) server, in
+// ZCL UTCTime: seconds since 2000-01-01 00:00 UTC
+#define HAL_TIME_INVALID 0xFFFFFFFFUL
+struct HalTime {
+    uint32_t utcTime;        // Time
+    uint32_t localTime;      // LocalTime, HAL_TIME_INVALID if not supported
+};
+
+/**
+ * Ask the coordinator for its time (Read Attributes Time and LocalTime);
+ * the answer goes to the hal_radio_on_time handler
+ * Returns false if the request could not be queued
+ */
+bool hal_radio_read_time();
+
+/**
+ * Handler for the coordinator's time - runs on the main task
+ */
+void hal_radio_on_time(void (*handler)(const HalTime* time));
+
+// ============================================================================
+// Debug Output
+// ============================================================================
+
+/**
+ * Write raw bytes to the debug serial port (may block until sent)
+ */
+void hal_debug_write(const void* data, size_t len);
+
+/**
+ * Next byte received on the debug serial port, or -1 if none is waiting
+ * (never blocks)
+ */
+int hal_serial_read();
+
+/**
+ * Start a low priority background task that calls drain() after every
+ * hal_drain_task_wake() - used by the deferred logger so formatting and
+ * serial output only run while the main task sleeps
+ */
+void hal_drain_task_begin(void (*drain)());
+
+/**
+ * Wake the drain task (main task context, cheap, never blocks)
+ */
+void hal_drain_task_wake();
+
+#endif // HAL_H
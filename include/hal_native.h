@@ -0,0 +1,200 @@
+/*
+ * Water Flow Meter - Native HAL Simulation Controls
+ * Only available in host builds ([env:native], [env:bench])
+ *
+ * Lets tests and benchmarks drive simulated time, fire sensor pulses and
+ * inspect what the firmware wrote to NVS or sent over the radio.
+ */
+
+#ifndef HAL_NATIVE_H
+#define HAL_NATIVE_H
+
+#include "hal.h"
+
+// Recorded radio frame (one Report Attributes command)
+struct NativeRadioFrame {
+    uint64_t timeUs;
+    uint8_t endpoint;
+    uint16_t clusterId;
+    uint8_t count;
+    uint16_t bytesOnAir;
+    bool acked;              // APS acknowledgement requested
+    HalAttribute attrs[HAL_RADIO_MAX_ATTRIBUTES];
+};
+
+/**
+ * Reset clock, ADC, NVS contents, flash, radio capture, debug output, serial input,
+ * attached ISR, pulse counter, wait hook and drain task - and lose power
+ */
+void hal_native_reset();
+
+/**
+ * Reason hal_reset_reason() reports from now on (a warm reset keeps the
+ * retained memory as it is)
+ */
+void hal_native_set_reset_reason(HalResetReason reason);
+
+/**
+ * Cold boot: fill the retained memory with noise, reason HAL_RESET_POWER_ON
+ */
+void hal_native_power_loss();
+
+// Simulated clock
+void hal_native_set_micros(uint64_t us);
+void hal_native_advance_ms(uint32_t ms);
+void hal_native_advance_us(uint64_t us);
+uint64_t hal_native_now_us();
+
+/**
+ * Called by hal_wait_event() while the main task "sleeps": should fire any
+ * simulated interrupts due before deadlineUs (advancing the clock) and
+ * return early once a notification is pending
+ */
+typedef void (*NativeWaitHook)(uint64_t deadlineUs);
+
+void hal_native_set_wait_hook(NativeWaitHook hook);
+bool hal_native_notify_pending();
+uint32_t hal_native_wait_count();     // hal_wait_event() calls (wake-ups)
+
+/**
+ * Fire the pulse ISR attached to FLOW_SENSOR_PIN once at the current
+ * simulated time
+ */
+void hal_native_pulse();
+
+/**
+ * The same on any pin (sensors of the other flow channels)
+ */
+void hal_native_pulse_pin(uint8_t pin);
+
+/**
+ * Fire count pulses on FLOW_SENSOR_PIN spaced periodUs apart, advancing
+ * the clock
+ */
+void hal_native_pulses(uint32_t count, uint32_t periodUs);
+
+#define NATIVE_GPIO_COUNT 32             // Pins that can take a pulse ISR
+
+// Pulse counter simulation: a pulse also counts in the PCNT unit running
+// on its pin (overflow events included)
+#define NATIVE_PULSE_WIDTH_NS 10000000   // Sensor pulse high time (ms range)
+
+/**
+ * A noise spike of widthNs on FLOW_SENSOR_PIN: fires the GPIO interrupt,
+ * counts in the PCNT unit only if it is not shorter than its glitch filter
+ */
+void hal_native_glitch(uint32_t widthNs);
+
+/**
+ * Interrupts taken by the pulse ISRs and the PCNT units together
+ */
+uint32_t hal_native_isr_count();
+
+/**
+ * Make hal_pcnt_begin() fail on every unit (no free counter unit)
+ */
+void hal_native_set_pcnt_available(bool available);
+
+/**
+ * Hold PCNT interrupts (counting goes on) - e.g. to read the counter
+ * between its overflow and the overflow interrupt. Releasing delivers
+ * the held events in order
+ */
+void hal_native_pcnt_hold_interrupts(bool hold);
+
+/**
+ * Fire edges on the pin of the next hal_pulse_interrupt_enable(pin, true)
+ * just before it unmasks - edges landing between a count read and the
+ * arming of a timed edge
+ */
+void hal_native_edges_before_unmask(uint32_t edges);
+
+// ADC input (same value on every pin)
+void hal_native_set_adc_mv(uint32_t mv);
+uint32_t hal_native_adc_read_count();
+
+// NVS inspection
+uint32_t hal_native_nvs_write_count();
+bool hal_native_nvs_has_key(const char* key);
+
+// Flash simulation (NOR: erase to 0xFF, program clears bits)
+struct NativeFlashStats {
+    uint32_t reads;            // hal_flash_read() calls
+    uint64_t bytesRead;
+    uint64_t bytesWritten;     // Bytes programmed
+    uint32_t erases;           // Sector erases
+    uint32_t maxSectorErases;  // Wear of the most-erased sector
+};
+
+#define NATIVE_FLASH_DEFAULT_SIZE 0x100000   // 1 MB data partition
+
+void hal_native_flash_reset(uint32_t size);
+const NativeFlashStats* hal_native_flash_stats();
+void hal_native_flash_clear_stats();
+
+/**
+ * Simulate power loss: after budget more bytes are programmed, further
+ * writes are dropped (the write in progress is torn). 0 disables
+ */
+void hal_native_flash_fail_after(uint32_t budget);
+
+// Simulated Zigbee network
+struct NativeNetworkConfig {
+    bool storedNetwork = false;   // zb_storage holds a previous join
+    uint32_t rejoinMs = 250;      // Rejoin from stored parameters
+    uint32_t joinMs = 4000;       // Full scan + association
+    uint32_t failAttempts = 0;    // Next attempts that fail (after their latency)
+    uint32_t ackMs = 20;          // APS acknowledgement of an acked frame
+    uint32_t lostAcks = 0;        // Next acked frames that are never acknowledged
+};
+
+struct NativeRadioStats {
+    uint32_t joins;
+    uint32_t rejoins;
+    uint32_t frames;         // Report frames sent (counted with capture off too)
+    uint64_t bytesOnAir;     // ... and their size on air
+    uint32_t ackedFrames;    // ... of which requested an acknowledgement
+    uint32_t lostAcks;       // ... of which were never acknowledged
+};
+
+void hal_native_radio_set_network(const NativeNetworkConfig* config);
+void hal_native_radio_leave();                    // Coordinator drops us
+const NativeRadioStats* hal_native_radio_stats();
+
+// Radio capture
+size_t hal_native_radio_frame_count();
+const NativeRadioFrame* hal_native_radio_frame(size_t index);
+void hal_native_radio_clear();
+void hal_native_radio_set_capture(bool enabled);
+
+// Coordinator side: Read Attributes, Configure Reporting and Write
+// Attributes (ZCL status)
+bool hal_native_radio_read_attribute(uint8_t endpoint, uint16_t clusterId, uint16_t attrId,
+                                     HalAttribute* attr);
+uint8_t hal_native_radio_configure_reporting(const HalReportingConfig* record);
+uint8_t hal_native_radio_write_attribute(uint8_t endpoint, uint16_t clusterId,
+                                         const HalAttribute* attr);
+
+// Coordinator side: Time cluster reads the device sent, and the answer
+// (handed to the hal_radio_on_time handler)
+uint32_t hal_native_radio_time_requests();
+void hal_native_radio_time_response(const HalTime* time);
+
+// Debug output - always captured, echoed to stdout only when enabled
+// (off by default to keep benchmarks quiet)
+void hal_native_set_log_enabled(bool enabled);
+const char* hal_native_debug_output(size_t* len);
+void hal_native_debug_clear();
+
+// Serial input - bytes typed by the host, read by hal_serial_read()
+void hal_native_serial_input(const char* text);
+size_t hal_native_serial_pending();
+
+/**
+ * Drain task simulation: hal_drain_task_wake() only counts, the host
+ * program runs the registered drain when it chooses to
+ */
+uint32_t hal_native_drain_wake_count();
+void hal_native_run_drain_task();
+
+#endif // HAL_NATIVE_H
@@ -0,0 +1,121 @@
+/*
+ * Water Flow Meter - Latency Statistics
+ * Cycle-counter latency histograms for the main loop, the pulse ISR,
+ * saves, reports and scheduler lateness
+ *
+ * Each section keeps a log2-bucketed histogram of its durations in CPU
+ * cycles (bucket b holds [2^(b-1), 2^b), bucket 0 holds 0) plus the
+ * maximum. A probe is two cycle counter reads, a count leading zeros and
+ * an increment; with LATENCY_STATS_ENABLED false ([env:release]) the
+ * probes compile to nothing and this module is empty.
+ *
+ * Each section is written from one context only (the pulse ISR, or the
+ * main task), so recording takes no lock. Readers may see a histogram
+ * one sample behind its maximum - good enough for diagnostics.
+ *
+ * Exposed by latencyPrint() (serial command) and as read-only attributes
+ * of the Diagnostics cluster on FLOW_ENDPOINT.
+ */
+
+#ifndef LATENCY_STATS_H
+#define LATENCY_STATS_H
+
+#include <stdint.h>
+#include "config.h"
+#include "hal.h"
+
+enum LatencySection : uint8_t {
+    LATENCY_LOOP,            // Main task awake per wake-up (jobs + notify handler)
+    LATENCY_PULSE_ISR,       // Pulse source interrupt handler
+    LATENCY_SAVE,            // saveTotalVolume()
+    LATENCY_REPORT,          // Report engine poll and frame send
+    LATENCY_JOB_LATE,        // Scheduled job start past its deadline
+    LATENCY_SECTIONS
+};
+
+#define LATENCY_BUCKETS 32
+
+struct LatencyHistogram {
+    uint32_t counts[LATENCY_BUCKETS];
+    uint32_t max;            // Cycles
+};
+
+// Diagnostics cluster: per section, manufacturer-specific uint32 attributes
+// at LATENCY_ATTR_BASE + section * LATENCY_ATTR_STRIDE + LATENCY_ATTR_*
+#define DIAGNOSTICS_CLUSTER_ID 0x0B05
+#define LATENCY_ATTR_BASE 0xF000
+#define LATENCY_ATTR_STRIDE 0x10
+#define LATENCY_ATTR_SAMPLES 0   // Samples recorded
+#define LATENCY_ATTR_P50 1       // Median bucket upper bound (cycles)
+#define LATENCY_ATTR_P99 2       // 99th percentile bucket upper bound (cycles)
+#define LATENCY_ATTR_MAX 3       // Maximum (cycles)
+
+#if LATENCY_STATS_ENABLED
+
+// Probes: uint32_t start = LATENCY_START(); ...; LATENCY_RECORD(section, start);
+#define LATENCY_START() hal_cycles()
+#define LATENCY_RECORD(section, start) latencyRecord((section), hal_cycles() - (start))
+
+/**
+ * Add one sample (cycles) - ISR safe
+ */
+void latencyRecord(uint8_t section, uint32_t cycles);
+
+/**
+ * Histogram bucket of a sample
+ */
+static inline uint8_t latencyBucket(uint32_t cycles) {
+    if (cycles == 0) {
+        return 0;
+    }
+    uint8_t bucket = 32 - __builtin_clz(cycles);
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+const LatencyHistogram* latencyHistogram(uint8_t section);
+uint32_t latencySamples(uint8_t section);
+
+/**
+ * Upper bound (cycles) of the bucket holding the given per-mille of samples
+ */
+uint32_t latencyPercentile(uint8_t section, uint16_t permille);
+
+/**
+ * Register the Diagnostics cluster with the radio (before the stack starts)
+ */
+void latencyBegin();
+
+/**
+ * Update the Diagnostics attributes from the histograms
+ */
+void latencyPublish();
+
+/**
+ * Log samples, p50, p99 and maximum of every section
+ */
+void latencyPrint();
+
+/**
+ * Log the non-empty buckets of one section
+ */
+void latencyPrintHistogram(uint8_t section);
+
+/**
+ * Clear every histogram (serial command, host tests)
+ */
+void resetLatencyStats();
+
+#else
+
+#define LATENCY_START() 0
+#define LATENCY_RECORD(section, start) ((void)(start))
+
+static inline void latencyBegin() {}
+static inline void latencyPublish() {}
+static inline void latencyPrint() {}
+static inline void latencyPrintHistogram(uint8_t) {}
+static inline void resetLatencyStats() {}
+
+#endif // LATENCY_STATS_ENABLED
+
+#endif // LATENCY_STATS_H
@@ -0,0 +1,69 @@
+/*
+ * Water Flow Meter - Leak Detector
+ * Streaming leak and burst rules on a flow channel's ledger and rate
+ *
+ * Three rules, each a few words of state and a compare per update:
+ * - Continuous flow: the rate has not dropped to 0 for LEAK_CONTINUOUS_FLOW
+ *   (a running toilet, a stuck valve)
+ * - Never quiet: no stretch of LEAK_QUIET_PERIOD without a single pulse in
+ *   LEAK_NEVER_QUIET (a drip too slow for the rate to stay above 0, which
+ *   the continuous rule never sees)
+ * - Burst: one draw - flow start to stop - used LEAK_BURST_VOLUME (a burst
+ *   pipe, a hose left open)
+ *
+ * The flow job updates each channel's detector after its flow window. A
+ * flowing channel updates every FLOW_CALC_INTERVAL; an idle one at its
+ * next pulse, which is when a pulse-free stretch is measured. A raised
+ * never-quiet alarm also asks for an update when the quiet period would
+ * end (leakDetectorWakeMs), so it clears once the drip stops even if no
+ * pulse ever comes.
+ *
+ * Alarms are states, not events: the continuous and burst alarms clear
+ * when the draw ends, the never-quiet alarm when a quiet period is seen.
+ * They are exposed on the channel's Metering Status attribute (metering
+ * cluster), which is reported at once when they change. The state lives in
+ * RAM - after a reboot every rule starts over.
+ */
+
+#ifndef LEAK_DETECTOR_H
+#define LEAK_DETECTOR_H
+
+#include <stdint.h>
+#include "config.h"
+
+// Alarms raised, a bitmap
+#define LEAK_ALARM_CONTINUOUS 0x01   // Flow never stopped for LEAK_CONTINUOUS_FLOW
+#define LEAK_ALARM_NEVER_QUIET 0x02  // No quiet period in LEAK_NEVER_QUIET
+#define LEAK_ALARM_BURST 0x04        // One draw used LEAK_BURST_VOLUME
+
+#define LEAK_NO_WAKE UINT32_MAX      // leakDetectorWakeMs(): no update needed
+
+// Detector state - one per flow channel
+struct LeakDetector {
+    uint64_t ledger;         // Ledger at the last update
+    uint64_t drawLedger;     // Ledger when the current draw started
+    uint32_t drawStartMs;    // hal_millis() when it started
+    uint32_t lastPulseMs;    // Last update that saw new pulses
+    uint32_t quietMs;        // Last update at which LEAK_QUIET_PERIOD had passed without a pulse
+    bool drawing;            // Rate above 0 at the last update
+    uint8_t alarms;          // LEAK_ALARM_*
+};
+
+/**
+ * Start over from the current ledger - every clock starts at nowMs
+ */
+void leakDetectorReset(LeakDetector* leak, uint64_t ledger, uint32_t nowMs);
+
+/**
+ * Apply the rules to the channel's ledger and calibrated rate after a flow
+ * window. Returns the alarms raised (LEAK_ALARM_*)
+ */
+uint8_t leakDetectorUpdate(LeakDetector* leak, uint64_t ledger, uint32_t rateMlMin, uint32_t nowMs);
+
+/**
+ * Milliseconds from nowMs until an update without new pulses would clear
+ * the never-quiet alarm, or LEAK_NO_WAKE if it is not raised
+ */
+uint32_t leakDetectorWakeMs(const LeakDetector* leak, uint32_t nowMs);
+
+#endif // LEAK_DETECTOR_H
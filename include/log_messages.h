@@ -0,0 +1,189 @@
+/*
+ * Water Flow Meter - Log Message Table
+ * Every log line the firmware can emit, with its level and format
+ *
+ * Records in the deferred log carry only the index into this table plus
+ * the raw arguments, so the firmware and tools/log_decoder must be built
+ * from the same table. Append new messages at the end - reordering
+ * changes the ids of binary logs already captured.
+ *
+ * Formats take integer arguments only (no %s, no floats): %d %i %u %x %X
+ * %o %c with optional flags/width/precision, h/hh/l modifiers for 32-bit
+ * values and ll for 64-bit values (pass unsigned long long).
+ */
+
+#ifndef LOG_MESSAGES_H
+#define LOG_MESSAGES_H
+
+#define LOG_MESSAGES(X) \
+    /* Logger */ \
+    X(LOG_DROPPED,             LOG_LEVEL_WARN,  "[Log] %lu records dropped") \
+    \
+    /* Flow sensor and ledger */ \
+    X(FLOW_SENSOR_INIT,        LOG_LEVEL_INFO,  "[Flow Sensor] Initialized on pin %d") \
+    X(FLOW_SENSOR_ACTIVE,      LOG_LEVEL_INFO,  "[Flow Sensor] Interrupt attached - ALWAYS ACTIVE") \
+    X(FLOW_RATE,               LOG_LEVEL_DEBUG, "[Flow] Rate: %lu mL/min, Volume: %llu mL") \
+    X(FLOW_STOPPED,            LOG_LEVEL_DEBUG, "[Flow] Flow stopped - rate set to 0") \
+    X(LEDGER_LOADED_JOURNAL,   LOG_LEVEL_INFO,  "[EEPROM] Loaded total volume: %llu mL (journal)") \
+    X(LEDGER_LOADED_NVS,       LOG_LEVEL_INFO,  "[EEPROM] Loaded total volume: %llu mL (NVS)") \
+    X(LEDGER_PULSES,           LOG_LEVEL_INFO,  "[EEPROM] Total pulses: %llu") \
+    X(LEDGER_BOOT_COUNT,       LOG_LEVEL_INFO,  "[EEPROM] Boot count: %lu") \
+    X(LEDGER_SAVED,            LOG_LEVEL_DEBUG, "[EEPROM] Saved total volume: %llu mL") \
+    X(FLOW_REPORT,             LOG_LEVEL_DEBUG, "[Zigbee] Reporting flow data: %lu mL/min, %llu mL, battery %u%%") \
+    \
+    /* Battery */ \
+    X(BATTERY_INIT,            LOG_LEVEL_INFO,  "[Battery] Monitor initialized") \
+    X(BATTERY_LEVEL,           LOG_LEVEL_DEBUG, "[Battery] Voltage: %lu mV, Percentage: %u%%") \
+    X(BATTERY_WARNING,         LOG_LEVEL_WARN,  "[Battery] WARNING: Battery at %u%%") \
+    X(BATTERY_CRITICAL,        LOG_LEVEL_WARN,  "[Battery] CRITICAL: Battery at %u%%") \
+    \
+    /* Zigbee network */ \
+    X(ZIGBEE_INIT,             LOG_LEVEL_INFO,  "[Zigbee] Initializing Zigbee stack...") \
+    X(ZIGBEE_INIT_FAILED,      LOG_LEVEL_ERROR, "[Zigbee] ERROR: Stack initialization failed!") \
+    X(ZIGBEE_REJOINING,        LOG_LEVEL_INFO,  "[Zigbee] Rejoining from stored network...") \
+    X(ZIGBEE_JOINING,          LOG_LEVEL_INFO,  "[Zigbee] Joining network...") \
+    X(ZIGBEE_PAIRING_HINT,     LOG_LEVEL_INFO,  "[Zigbee] Ensure coordinator is in pairing mode!") \
+    X(ZIGBEE_REJOIN_FAILED,    LOG_LEVEL_INFO,  "[Zigbee] Rejoin failed - retry in %lu ms") \
+    X(ZIGBEE_JOIN_FAILED,      LOG_LEVEL_INFO,  "[Zigbee] Join failed - retry in %lu ms") \
+    X(ZIGBEE_CONNECTED,        LOG_LEVEL_INFO,  "[Zigbee] Connected after %lu ms - short address 0x%04X") \
+    X(ZIGBEE_LOST,             LOG_LEVEL_INFO,  "[Zigbee] Network lost - rejoining") \
+    \
+    /* System (main.cpp) */ \
+    X(SYSTEM_RULE,             LOG_LEVEL_INFO,  "========================================") \
+    X(SYSTEM_BLANK,            LOG_LEVEL_INFO,  "") \
+    X(SYSTEM_STARTING,         LOG_LEVEL_INFO,  "Water Flow Meter Starting") \
+    X(SYSTEM_READY,            LOG_LEVEL_INFO,  "[System] Setup complete - System ready!") \
+    X(SYSTEM_ALWAYS_ON,        LOG_LEVEL_INFO,  "[System] Always-on operation - no sleep modes") \
+    X(STATUS_TITLE,            LOG_LEVEL_INFO,  "Water Flow Meter - System Status") \
+    X(STATUS_BOOT,             LOG_LEVEL_INFO,  "Boot #%lu") \
+    X(STATUS_UPTIME,           LOG_LEVEL_INFO,  "Uptime: %lu seconds") \
+    X(STATUS_WAKEUPS,          LOG_LEVEL_INFO,  "Wake-ups: %lu (max late %lu ms, longest job %lu us)") \
+    X(STATUS_FLOW_HEADER,      LOG_LEVEL_INFO,  "Flow Sensor:") \
+    X(STATUS_FLOW_RATE,        LOG_LEVEL_INFO,  "  Flow Rate: %lu.%03lu L/min") \
+    X(STATUS_VOLUME,           LOG_LEVEL_INFO,  "  Total Volume: %llu.%03lu L") \
+    X(STATUS_PULSES,           LOG_LEVEL_INFO,  "  Total Pulses: %llu") \
+    X(STATUS_FLOWING,          LOG_LEVEL_INFO,  "  Status: FLOWING") \
+    X(STATUS_IDLE,             LOG_LEVEL_INFO,  "  Status: IDLE") \
+    X(STATUS_BATTERY_HEADER,   LOG_LEVEL_INFO,  "Battery:") \
+    X(STATUS_BATTERY_VOLTAGE,  LOG_LEVEL_INFO,  "  Voltage: %lu.%03lu V") \
+    X(STATUS_BATTERY_PERCENT,  LOG_LEVEL_INFO,  "  Percentage: %u %%") \
+    X(STATUS_BOOT_HEADER,      LOG_LEVEL_INFO,  "Boot:") \
+    X(STATUS_FIRST_PULSE,      LOG_LEVEL_INFO,  "  First pulse counted: %lu ms") \
+    X(STATUS_FIRST_PULSE_NONE, LOG_LEVEL_INFO,  "  First pulse counted: -") \
+    X(STATUS_FIRST_REPORT,     LOG_LEVEL_INFO,  "  First report: %lu ms") \
+    X(STATUS_FIRST_REPORT_NONE, LOG_LEVEL_INFO, "  First report: -") \
+    X(STATUS_ZIGBEE_HEADER,    LOG_LEVEL_INFO,  "Zigbee:") \
+    X(STATUS_ZIGBEE_CONNECTED, LOG_LEVEL_INFO,  "  Status: CONNECTED") \
+    X(STATUS_ZIGBEE_DISCONNECTED, LOG_LEVEL_INFO, "  Status: DISCONNECTED") \
+    X(STATUS_SHORT_ADDRESS,    LOG_LEVEL_INFO,  "  Short Address: 0x%X") \
+    \
+    /* Pulse source */ \
+    X(PULSE_SOURCE_PCNT,       LOG_LEVEL_INFO,  "[Flow Sensor] Hardware pulse counter, glitch filter %lu ns") \
+    X(PULSE_SOURCE_FALLBACK,   LOG_LEVEL_WARN,  "[Flow Sensor] No pulse counter unit - using GPIO interrupt") \
+    \
+    /* Retained ledger */ \
+    X(LEDGER_RESUMED,          LOG_LEVEL_INFO,  "[EEPROM] Resumed total volume: %llu mL (RTC memory, reset reason %u)") \
+    X(STATUS_RESETS,           LOG_LEVEL_INFO,  "Resets since power on: %lu") \
+    \
+    /* Latency statistics */ \
+    X(LATENCY_NAME_LOOP,       LOG_LEVEL_INFO,  "[Latency] Main task awake per wake-up:") \
+    X(LATENCY_NAME_PULSE_ISR,  LOG_LEVEL_INFO,  "[Latency] Pulse interrupt:") \
+    X(LATENCY_NAME_SAVE,       LOG_LEVEL_INFO,  "[Latency] Ledger save:") \
+    X(LATENCY_NAME_REPORT,     LOG_LEVEL_INFO,  "[Latency] Zigbee report:") \
+    X(LATENCY_NAME_JOB_LATE,   LOG_LEVEL_INFO,  "[Latency] Job start past deadline:") \
+    X(LATENCY_SUMMARY,         LOG_LEVEL_INFO,  "  %lu samples, p50 < %lu, p99 < %lu, max %lu cycles (%lu us)") \
+    X(LATENCY_BUCKET,          LOG_LEVEL_INFO,  "  >= %lu cycles: %lu") \
+    \
+    /* Serial console */ \
+    X(CONSOLE_UNKNOWN,         LOG_LEVEL_INFO,  "[Console] Unknown command - type help") \
+    X(CONSOLE_USAGE,           LOG_LEVEL_INFO,  "[Console] Usage:") \
+    X(CONSOLE_TOO_LONG,        LOG_LEVEL_INFO,  "[Console] Line too long - at most %u characters") \
+    X(CONSOLE_HELP_HELP,       LOG_LEVEL_INFO,  "  help - list commands") \
+    X(CONSOLE_HELP_STATUS,     LOG_LEVEL_INFO,  "  status - system status") \
+    X(CONSOLE_HELP_STATS,      LOG_LEVEL_INFO,  "  stats [latency section 0-4] - counters and latency histograms") \
+    X(CONSOLE_HELP_CALIBRATE,  LOG_LEVEL_INFO,  "  calibrate [start | stop <mL> | auto <mL> [runs] | done | cancel | default] - measure K-factors, fit the curve") \
+    X(CONSOLE_HELP_SET,        LOG_LEVEL_INFO,  "  set backend <0 gpio | 1 pcnt> | set clock <seconds>") \
+    X(CONSOLE_HELP_DUMP,       LOG_LEVEL_INFO,  "  dump history <10s | 1m | 1h> - stored consumption intervals") \
+    X(CONSOLE_HELP_RESET,      LOG_LEVEL_INFO,  "  reset counters - clear latency, scheduler and report counters") \
+    X(CONSOLE_SET_BACKEND,     LOG_LEVEL_INFO,  "[Console] Pulse backend: %u") \
+    X(CONSOLE_SET_CLOCK,       LOG_LEVEL_INFO,  "[Console] Device time: %lu s") \
+    X(CONSOLE_SET_REJECTED,    LOG_LEVEL_INFO,  "[Console] Value rejected") \
+    X(CONSOLE_COUNTERS_RESET,  LOG_LEVEL_INFO,  "[Console] Counters cleared") \
+    X(STATS_SCHEDULER,         LOG_LEVEL_INFO,  "[Stats] Scheduler: %lu wake-ups (%lu by pulses), %lu job runs, max late %lu ms, longest job %lu us") \
+    X(STATS_REPORTS,           LOG_LEVEL_INFO,  "[Stats] Reports: %lu frames (%lu forced), %llu bytes on air, %lu budget deferrals") \
+    X(STATS_PULSES,            LOG_LEVEL_INFO,  "[Stats] Pulse source %u: %lu interrupts, %lu overflows") \
+    X(STATS_LOG,               LOG_LEVEL_INFO,  "[Stats] Log: %lu records, %lu dropped, high-water %lu words") \
+    X(STATS_HISTORY,           LOG_LEVEL_INFO,  "[Stats] History: %lu blocks, %llu bytes written, %lu sector erases") \
+    X(CALIBRATE_IDLE,          LOG_LEVEL_INFO,  "[Calibrate] Not running - calibrate start, flow a known volume, calibrate stop <mL>") \
+    X(CALIBRATE_STARTED,       LOG_LEVEL_INFO,  "[Calibrate] Started at pulse %llu") \
+    X(CALIBRATE_PROGRESS,      LOG_LEVEL_INFO,  "[Calibrate] %lu pulses in %lu s (%lu mL at the current calibration)") \
+    X(CALIBRATE_RESULT,        LOG_LEVEL_INFO,  "[Calibrate] %lu pulses for %lu mL: %lu.%03lu pulses/L (current calibration off by %ld permille)") \
+    X(HISTORY_DUMP_START,      LOG_LEVEL_INFO,  "[History] %lu s intervals (start s: intervals x pulses):") \
+    X(HISTORY_DUMP_ROW,        LOG_LEVEL_INFO,  "  %lu: %lu x %lu") \
+    X(HISTORY_DUMP_END,        LOG_LEVEL_INFO,  "[History] %lu intervals") \
+    \
+    /* Pulse trace */ \
+    X(TRACE_STARTED,           LOG_LEVEL_INFO,  "[Trace] Capture started at ledger %llu") \
+    X(TRACE_STOPPED,           LOG_LEVEL_INFO,  "[Trace] Capture stopped: %lu edges, %lu bytes, %lu dropped") \
+    X(TRACE_START_FAILED,      LOG_LEVEL_INFO,  "[Trace] No data partition - capture not started") \
+    X(TRACE_CAPTURING,         LOG_LEVEL_INFO,  "[Trace] Capturing: %lu edges, %lu bytes written, %lu dropped") \
+    X(TRACE_STORED,            LOG_LEVEL_INFO,  "[Trace] Stored trace: %lu bytes") \
+    X(TRACE_EXPORT_START,      LOG_LEVEL_INFO,  "[Trace] Export of %lu bytes:") \
+    X(TRACE_EXPORT_ROW,        LOG_LEVEL_INFO,  "[Trace %05lx] %08lx %08lx %08lx %08lx %08lx %08lx") \
+    X(TRACE_EXPORT_END,        LOG_LEVEL_INFO,  "[Trace] Export done") \
+    X(CONSOLE_HELP_TRACE,      LOG_LEVEL_INFO,  "  trace [start | stop | export] - capture sensor edges for host replay") \
+    \
+    /* Calibration curve */ \
+    X(CALIBRATION_STORED,      LOG_LEVEL_INFO,  "[Calibration] %u-point curve from NVS") \
+    X(CALIBRATION_CONFIG,      LOG_LEVEL_INFO,  "[Calibration] %u-point curve from config") \
+    X(CALIBRATION_INVALID,     LOG_LEVEL_WARN,  "[Calibration] Stored curve invalid - using config curve") \
+    X(CALIBRATION_POINT,       LOG_LEVEL_INFO,  "  %lu mHz: %lu.%03lu pulses/L") \
+    X(CALIBRATION_DEFAULT,     LOG_LEVEL_INFO,  "[Calibration] Stored curve removed - config curve in use") \
+    X(CALIBRATION_SESSION_STARTED, LOG_LEVEL_INFO, "[Calibration] Run %lu mL through the sensor at %u flow rates - a run ends %lu s or more after the flow stops") \
+    X(CALIBRATION_RUN_STARTED, LOG_LEVEL_INFO,  "[Calibration] Run %u started") \
+    X(CALIBRATION_RUN,         LOG_LEVEL_INFO,  "[Calibration] Run %u: %lu pulses at %lu mHz = %lu.%03lu pulses/L") \
+    X(CALIBRATION_RUN_IGNORED, LOG_LEVEL_INFO,  "[Calibration] Run ignored - only %lu pulses") \
+    X(CALIBRATION_FITTED,      LOG_LEVEL_INFO,  "[Calibration] %u-point curve from %u runs applied and stored:") \
+    X(CALIBRATION_FIT_FAILED,  LOG_LEVEL_WARN,  "[Calibration] %u runs give no valid curve - current curve kept") \
+    X(CALIBRATION_CANCELLED,   LOG_LEVEL_INFO,  "[Calibration] Session cancelled") \
+    X(CALIBRATE_SESSION,       LOG_LEVEL_INFO,  "[Calibrate] Session: %u of %u runs of %lu mL done, %lu pulses in the current run") \
+    X(CALIBRATE_CURVE,         LOG_LEVEL_INFO,  "[Calibrate] Curve in use, %u points:") \
+    X(CALIBRATE_NO_CURVE,      LOG_LEVEL_INFO,  "[Calibrate] No session, or its %u runs give no valid curve") \
+    /* Flow channels */ \
+    X(CHANNEL_SENSOR_INIT,     LOG_LEVEL_INFO,  "[Flow Sensor] Channel %u on pin %d") \
+    X(CHANNEL_FLOW_RATE,       LOG_LEVEL_DEBUG, "[Flow] Channel %u rate: %lu mL/min, Volume: %llu mL") \
+    X(CHANNEL_FLOW_STOPPED,    LOG_LEVEL_DEBUG, "[Flow] Channel %u flow stopped - rate set to 0") \
+    X(CHANNEL_LEDGER_LOADED,   LOG_LEVEL_INFO,  "[EEPROM] Channel %u total volume: %llu mL") \
+    X(CALIBRATION_CHANNEL,     LOG_LEVEL_INFO,  "[Calibration] Channel %u:") \
+    X(STATUS_CHANNEL,          LOG_LEVEL_INFO,  "  Channel %u: %lu.%03lu L/min, %llu.%03lu L") \
+    /* Leak detection */ \
+    X(LEAK_ALARM,              LOG_LEVEL_WARN,  "[Leak] Channel %u ALARM: 0x%02x (continuous 1, never quiet 2, burst 4)") \
+    X(LEAK_CLEARED,            LOG_LEVEL_INFO,  "[Leak] Channel %u alarms cleared") \
+    X(STATUS_LEAK,             LOG_LEVEL_INFO,  "  Leak alarms: channel %u 0x%02x") \
+    /* Alarm reports */ \
+    X(REPORT_ALARM_LOST,       LOG_LEVEL_WARN,  "[Zigbee] Alarm not acknowledged, given up: endpoint %u cluster 0x%04x attribute 0x%04x") \
+    X(STATS_ALARMS,            LOG_LEVEL_INFO,  "[Stats] Alarms: %lu frames, %lu retries, %lu lost, latency %lu us (max %lu us)") \
+    /* Usage events */ \
+    X(USAGE_TREE_STORED,       LOG_LEVEL_INFO,  "[Usage] %u-node tree from NVS") \
+    X(USAGE_TREE_DEFAULT,      LOG_LEVEL_INFO,  "[Usage] Built-in %u-node tree") \
+    X(USAGE_TREE_INVALID,      LOG_LEVEL_WARN,  "[Usage] Stored tree invalid - using built-in tree") \
+    X(USAGE_EVENT,             LOG_LEVEL_INFO,  "[Usage] #%lu channel %u class %u: %lu mL in %lu s, peak %lu mL/min") \
+    X(USAGE_NODE,              LOG_LEVEL_INFO,  "  %u: feature %u, left %u, right %u, threshold %lu") \
+    X(USAGE_LIST,              LOG_LEVEL_INFO,  "[Usage] %lu events since boot (classes: 0 other, 1 tap, 2 toilet, 3 shower, 4 appliance, 5 garden)") \
+    X(USAGE_LIST_ROW,          LOG_LEVEL_INFO,  "  #%lu at %lu s: channel %u class %u, %lu mL in %lu s, peak %lu mL/min") \
+    X(USAGE_TREE,              LOG_LEVEL_INFO,  "[Usage] Tree in use, %u nodes (features: 0 s, 1 mL, 2 peak mL/min, 3 mean mL/min; 255 leaf):") \
+    X(USAGE_TREE_EDIT,         LOG_LEVEL_INFO,  "[Usage] Edited tree: %u nodes - usage store to apply") \
+    X(USAGE_TREE_APPLIED,      LOG_LEVEL_INFO,  "[Usage] %u-node tree applied and stored") \
+    X(CONSOLE_HELP_USAGE,      LOG_LEVEL_INFO,  "  usage [tree | node <i> <0xFFLLRR> <threshold> | store | default] - usage events and their classifier") \
+    /* Time sync and consumption buckets */ \
+    X(TIME_SYNCED,             LOG_LEVEL_INFO,  "[Time] Coordinator time %lu s (since 2000 UTC), zone %ld min") \
+    X(TIME_SYNC_BEHIND,        LOG_LEVEL_WARN,  "[Time] Coordinator time %lu s is behind the device clock %lu s - clock kept") \
+    X(TIME_SYNC_INVALID,       LOG_LEVEL_WARN,  "[Time] Coordinator time not set - asking again") \
+    X(CONSUMPTION_LOADED,      LOG_LEVEL_INFO,  "[Consumption] Buckets from NVS, day %ld") \
+    X(CONSUMPTION_NEW,         LOG_LEVEL_INFO,  "[Consumption] No stored buckets - starting on day %ld") \
+    X(CONSUMPTION_ROLLOVER,    LOG_LEVEL_INFO,  "[Consumption] Day %ld -> %ld") \
+    X(CONSUMPTION_SAVED,       LOG_LEVEL_DEBUG, "[Consumption] Buckets saved (day %ld)") \
+    X(STATUS_TIME,             LOG_LEVEL_INFO,  "  Time: %lu s since 2000 UTC, zone %ld min, synced %u") \
+    X(STATUS_CONSUMPTION,      LOG_LEVEL_INFO,  "  Channel %u: today %llu.%03lu L, yesterday %llu.%03lu L, week %llu L, month %llu L, 12 months %llu L")
+
+#endif // LOG_MESSAGES_H
@@ -0,0 +1,121 @@
+/*
+ * Water Flow Meter - Metering Cluster
+ * ZCL Metering (0x0702) server on FLOW_ENDPOINT + channel, one endpoint
+ * per flow channel
+ *
+ * Volume and rate are exposed as integers in ledger units, scaled for the
+ * coordinator by the Multiplier/Divisor attributes:
+ * - CurrentSummationDelivered: uint48, mL
+ * - InstantaneousDemand: int24, mL/h
+ * - UnitOfMeasure m3 (m3/h), Multiplier 1, Divisor 1000000
+ *
+ * Both reported attributes go through the report engine, so the
+ * coordinator tunes their cadence with Configure Reporting; the config.h
+ * report settings are only the defaults until it does.
+ *
+ * While a channel's draw is open (usage_events.h) its Demand and
+ * summation change reports are held with USAGE_HOLD_REPORTS: the draw's
+ * usage event reports its shape in one frame, the deadlines keep the
+ * values fresh, and the volume it added is reported once it ends.
+ *
+ * The leak detector's alarms (leak_detector.h) set the water meter bits of
+ * Status - LeakDetect for the continuous and never-quiet rules,
+ * BurstDetect for the burst rule - and appear in full in the
+ * manufacturer-specific LeakAlarms attribute. A change of Status is an
+ * alarm report (urgent lane, acknowledged), with no deadline otherwise.
+ *
+ * Consumption by period (consumption.h) fills the historical consumption
+ * attributes - today and yesterday, this week and this month, in mL like
+ * the summation - plus the manufacturer-specific last 12 months. They are
+ * read, not reported; day and week are uint24 and stop at 16.7 m3.
+ */
+
+#ifndef METERING_CLUSTER_H
+#define METERING_CLUSTER_H
+
+#include <stdint.h>
+#include "config.h"
+#include "hal.h"
+
+struct ConsumptionTotals;
+
+#define METERING_CLUSTER_ID 0x0702
+
+// Attributes
+#define METERING_SUMMATION_ATTR 0x0000       // CurrentSummationDelivered
+#define METERING_STATUS_ATTR 0x0200          // Status
+#define METERING_UNIT_ATTR 0x0300            // UnitOfMeasure
+#define METERING_MULTIPLIER_ATTR 0x0301      // Multiplier
+#define METERING_DIVISOR_ATTR 0x0302         // Divisor
+#define METERING_SUMMATION_FORMAT_ATTR 0x0303  // SummationFormatting
+#define METERING_DEMAND_FORMAT_ATTR 0x0304   // DemandFormatting
+#define METERING_DEVICE_TYPE_ATTR 0x0308     // MeteringDeviceType
+#define METERING_DEMAND_ATTR 0x0400          // InstantaneousDemand
+#define METERING_DAY_ATTR 0x0401             // CurrentDayConsumptionDelivered
+#define METERING_PREVIOUS_DAY_ATTR 0x0403    // PreviousDayConsumptionDelivered
+#define METERING_WEEK_ATTR 0x0420            // CurrentWeekConsumptionDelivered
+#define METERING_MONTH_ATTR 0x0430           // CurrentMonthConsumptionDelivered
+#define METERING_LEAK_ALARMS_ATTR 0xF000     // LeakAlarms, bitmap8 of LEAK_ALARM_* (manufacturer-specific)
+#define METERING_YEAR_ATTR 0xF001            // Last12MonthsConsumption, uint32 (manufacturer-specific)
+
+// Attribute values
+#define METERING_UNIT_M3 0x01                // m3 and m3/h
+#define METERING_MULTIPLIER 1
+#define METERING_DIVISOR 1000000UL           // mL -> m3
+#define METERING_FORMAT 0xAB                 // 5 integer, 3 decimal digits, no leading zeros
+#define METERING_DEVICE_WATER 0x02           // Water metering
+#define METERING_DEMAND_MAX 0x7FFFFF         // int24 limit (mL/h)
+#define METERING_UINT24_MAX 0xFFFFFF         // Day and week consumption limit (mL)
+
+// Status bits of a water meter
+#define METERING_STATUS_BURST 0x08           // BurstDetect
+#define METERING_STATUS_LEAK 0x20            // LeakDetect
+
+/**
+ * Register every channel's cluster with the radio and its reported
+ * attributes with the report engine (once - must run before the Zigbee
+ * stack starts)
+ */
+void meteringBegin();
+
+/**
+ * Feed a channel's current ledger values - updates the server attributes
+ * the coordinator reads and the report engine's values
+ */
+void meteringUpdate(uint64_t volumeMl, uint32_t flowMlMin, uint8_t channel = 0);
+
+/**
+ * Hold or release a channel's Demand and summation change reports
+ * (reportHoldChanges)
+ */
+void meteringHoldChanges(bool hold, uint8_t channel = 0);
+
+/**
+ * Feed a channel's leak alarms (LEAK_ALARM_*) - updates Status and
+ * LeakAlarms; a change goes to the report engine's urgent lane, with
+ * originUs the sample that raised it (reportAlarm)
+ */
+void meteringSetAlarms(uint8_t alarms, uint64_t originUs, uint8_t channel = 0);
+
+/**
+ * Feed a channel's consumption by period - updates the server attributes
+ * that changed (saturated to their type)
+ */
+void meteringSetConsumption(const ConsumptionTotals* totals, uint8_t channel = 0);
+
+/**
+ * Status bits for a set of leak alarms
+ */
+uint8_t meteringStatus(uint8_t alarms);
+
+/**
+ * InstantaneousDemand for a flow rate: mL/h, clamped to int24
+ */
+uint32_t meteringDemand(uint32_t flowMlMin);
+
+/**
+ * Forget the registration (host tests/benchmarks)
+ */
+void resetMeteringCluster();
+
+#endif // METERING_CLUSTER_H
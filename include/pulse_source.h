@@ -0,0 +1,98 @@
+/*
+ * Water Flow Meter - Pulse Source
+ * Where the flow meter's pulse count and edge timestamps come from
+ *
+ * Two backends behind one interface (PulseSource):
+ * - PULSE_BACKEND_GPIO: pulseCounter() interrupts on every rising edge.
+ *   Interrupts scale with flow rate, and every noise spike on the line is
+ *   both counted and paid for with an interrupt.
+ * - PULSE_BACKEND_PCNT: the pulse counter peripheral counts edges behind
+ *   its hardware glitch filter. The 15-bit hardware count is extended to
+ *   64 bits on overflow events. The period method of the rate estimator
+ *   still needs edge timestamps: each read unmasks a one-shot GPIO
+ *   interrupt on the same pin for the next edge, so at most one edge
+ *   interrupt is taken per read whatever the flow rate. It also wakes an
+ *   idle meter. (Counter watch points cannot do this: one added while the
+ *   unit runs only takes effect after a count clear.)
+ *
+ * Both fill the same PulseReading; the flow meter does not know which one
+ * is running. On the host the PCNT unit is simulated by hal_native.
+ *
+ * Every flow channel (FLOW_CHANNELS) is a source of its own: its own pin,
+ * backend and count, a GPIO interrupt handler instantiated for it and PCNT
+ * unit number channel. The channel argument defaults to 0, the single
+ * sensor of a one-channel build.
+ *
+ * Each interrupt handler publishes its count and edge timestamp together
+ * through a Seqlock (seqlock.h), so a read never pairs the count of one
+ * edge with the time of another and never masks interrupts. Counts and
+ * times are 64-bit and never wrap.
+ */
+
+#ifndef PULSE_SOURCE_H
+#define PULSE_SOURCE_H
+
+#include <stdint.h>
+#include "config.h"
+#include "hal.h"
+
+// One consistent view of the sensor
+struct PulseReading {
+    uint64_t count;          // Pulses since boot (never wraps)
+    uint64_t edgeCount;      // count at the newest timed edge
+    uint64_t edgeUs;         // hal_micros64() at that edge
+};
+
+// Backend interface - counts are relative to begin(), pulseSourceRead()
+// adds the total of earlier backends
+struct PulseSource {
+    bool (*begin)(uint8_t channel, uint8_t pin);
+    void (*end)(uint8_t channel, uint8_t pin);
+    void (*read)(uint8_t channel, PulseReading* reading);   // Main task only
+};
+
+extern const PulseSource pulseSourceGpio;
+extern const PulseSource pulseSourcePcnt;
+
+struct PulseSourceStats {
+    uint32_t interrupts;     // Pulse ISR / PCNT event interrupts taken (all channels)
+    uint32_t overflows;      // PCNT hardware count overflows (all channels)
+};
+
+/**
+ * GPIO backend interrupt handler of channel 0
+ * MUST remain active at all times while the GPIO backend is selected
+ */
+void pulseCounter();
+
+/**
+ * Count channel's pulses on pin with backend (PULSE_BACKEND_GPIO / _PCNT),
+ * continuing from the channel's current count. onEdge(channel) runs in
+ * interrupt context after every timed edge. Falls back to GPIO if the
+ * channel's counter unit is not free
+ * Returns the backend in use
+ */
+uint8_t pulseSourceBegin(uint8_t channel, uint8_t backend, uint8_t pin,
+                         void (*onEdge)(uint8_t channel));
+
+uint8_t pulseSourceBackend(uint8_t channel = 0);
+
+void pulseSourceRead(PulseReading* reading, uint8_t channel = 0);
+
+uint64_t pulseSourceCount(uint8_t channel = 0);
+
+const PulseSourceStats* pulseSourceStats();
+
+/**
+ * As if the GPIO backend had counted pulses more edges, the last one now
+ * Used by host tests and benchmarks to skip ahead without an ISR per pulse
+ */
+void pulseSourceInject(uint64_t pulses, uint8_t channel = 0);
+
+/**
+ * Back to unstarted GPIO sources at count 0
+ * Used by host tests and benchmarks between runs
+ */
+void resetPulseSource();
+
+#endif // PULSE_SOURCE_H
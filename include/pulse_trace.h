@@ -0,0 +1,129 @@
+/*
+ * Water Flow Meter - Pulse Trace
+ * Raw sensor edge times captured to flash for deterministic host replay
+ *
+ * While a capture runs, pulseCounter() pushes the low 32 bits of every
+ * edge time into a small RAM ring (traceEdge, ISR side). The flow job
+ * drains the ring (traceUpdate) and delta-encodes the edges into chunks:
+ *   edge            : varint(deltaUs << 1)
+ *   time, no edge   : varint((deltaUs << 1) | 1)   (marks the capture end)
+ * so a pulse costs three bytes at tap flow rates. Chunks of up to
+ * TRACE_CHUNK_BYTES are written to the trace area of the raw data
+ * partition with a CRC-checked header; a chunk never spans sectors. Each
+ * header carries its base time and the ledger at that time, so a trace
+ * replays from the pulse ledger the device had when it was captured.
+ *
+ * The pulse counter peripheral does not time individual edges, so a
+ * capture switches to the GPIO backend and restores the backend after.
+ *
+ * tools/trace_replay feeds an exported trace (console "trace export")
+ * through the metering core on the host, faster than real time, and
+ * prints every report frame - byte for byte the same on every run.
+ */
+
+#ifndef PULSE_TRACE_H
+#define PULSE_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+#include "hal.h"
+
+// On-flash chunk header (followed by length encoded bytes)
+struct TraceChunkHeader {
+    uint16_t magic;          // TRACE_CHUNK_MAGIC
+    uint16_t length;         // Encoded bytes after the header
+    uint32_t seq;            // Chunk number within the capture (0 = first)
+    uint64_t baseUs;         // Time the first delta counts from (hal_micros64)
+    uint64_t baseLedger;     // Pulse ledger at baseUs
+    uint32_t edges;          // Edges encoded in this chunk
+    uint32_t crc;            // CRC-32 over the header fields above + data
+};
+
+#define TRACE_CHUNK_MAGIC 0x5450   // "PT"
+#define TRACE_HEADER_SIZE sizeof(TraceChunkHeader)
+#define TRACE_AREA_BYTES (TRACE_SECTORS * HAL_FLASH_SECTOR_SIZE)
+
+struct TraceStats {
+    uint32_t edges;          // Edges captured
+    uint32_t dropped;        // Edges lost to a full ring (trace not exact)
+    uint32_t chunks;         // Chunks written
+    uint32_t bytes;          // Trace area used (headers, data, sector tails)
+};
+
+/**
+ * Sequential reader over the trace in flash - one chunk in RAM at a time
+ */
+struct TraceReader {
+    uint32_t offset;         // Next chunk within the trace area
+    uint32_t seq;            // Next chunk number
+    uint64_t startUs;        // Capture start time
+    uint64_t startLedger;    // Pulse ledger at the capture start
+    uint64_t timeUs;         // Time of the last token read
+    uint64_t edges;          // Edges read
+    uint32_t length;
+    uint32_t pos;
+    bool done;
+    uint8_t data[TRACE_CHUNK_BYTES];
+};
+
+/**
+ * Open the first chunk - false if there is no trace in flash
+ */
+bool traceReaderBegin(TraceReader* reader);
+
+/**
+ * Time of the next edge - false at the end of the trace, when
+ * reader->timeUs is the time the capture stopped
+ */
+bool traceReaderNext(TraceReader* reader, uint64_t* edgeUs);
+
+/**
+ * Bytes of the trace area holding the last trace (0 if none) - the range
+ * to export
+ */
+uint32_t traceLength();
+
+#if PULSE_TRACE_ENABLED
+
+/**
+ * Pulse ISR hook - queue one edge time if a capture is running
+ */
+void traceEdge(uint32_t edgeUs);
+
+/**
+ * Erase the trace area and start capturing from the current ledger
+ * (switches to the GPIO backend). False if flash is unavailable
+ */
+bool traceStart();
+
+/**
+ * Encode the queued edges, writing chunks as they fill (flow job)
+ * Stops the capture when the trace area is full
+ */
+void traceUpdate();
+
+/**
+ * Mark the end time, write the last chunk and restore the pulse backend
+ */
+void traceStop();
+
+bool traceCapturing();
+const TraceStats* traceStats();
+
+/**
+ * Stop any capture and forget all RAM state (flash is left as is)
+ * Used by host tests between runs
+ */
+void resetPulseTrace();
+
+#else
+
+static inline void traceEdge(uint32_t) {}
+static inline void traceUpdate() {}
+static inline bool traceCapturing() { return false; }
+static inline void resetPulseTrace() {}
+
+#endif // PULSE_TRACE_ENABLED
+
+#endif // PULSE_TRACE_H
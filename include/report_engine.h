@@ -0,0 +1,179 @@
+/*
+ * Water Flow Meter - Report Engine
+ * Coalesced, rate-limited Zigbee attribute reporting
+ *
+ * Each reported attribute is registered once with ZCL-style reporting
+ * rules and then fed its current value (integer, ledger units):
+ * - it becomes due when it moves further from its last reported value
+ *   than its reportable change - an absolute floor or a per-mille of the
+ *   last reported value, whichever is larger - but not before
+ *   minIntervalMs since its last report (hysteresis in value and time)
+ * - maxIntervalMs after its last report it is due whatever its value
+ *
+ * Whenever an attribute is due, one Report Attributes frame carries
+ * every attribute of its cluster that changed at all or whose own
+ * deadline is less than half an interval away, so the attributes of a
+ * cluster share frames and deadlines instead of costing a frame each.
+ *
+ * Frames sent only because of a change spend their bytes on air from a
+ * token bucket (REPORT_BUDGET_*). If the bucket cannot pay, the change
+ * waits until it can. Deadline and requested frames always go out; they
+ * drain the bucket instead.
+ *
+ * Alarms take the urgent lane (reportAlarm): their cluster's frame goes
+ * out at the next reportPoll or reportPollUrgent, ahead of every other
+ * frame and regardless of minimum interval and budget, with an APS
+ * acknowledgement requested. Without the acknowledgement after
+ * REPORT_ACK_TIMEOUT it is sent again with the current value, up to
+ * REPORT_ALARM_TRIES times in all.
+ *
+ * An attribute's change reports can be held (reportHoldChanges) while
+ * another report stands in for them - a usage event for the rates of a
+ * draw. Its deadline still reports it, and a change still rides along in
+ * frames that go out anyway; once released, a change waiting is due.
+ *
+ * The coordinator can replace an attribute's rules at runtime with ZCL
+ * Configure Reporting (reportConfigure). Its settings are kept in NVS and
+ * win over the compiled-in defaults from then on, until it sends the
+ * "back to defaults" record (min 0xFFFF, max 0).
+ *
+ * Runs on the main task only.
+ */
+
+#ifndef REPORT_ENGINE_H
+#define REPORT_ENGINE_H
+
+#include <stdint.h>
+#include "config.h"
+#include "hal.h"
+
+// ZCL data types (integers are sent little endian)
+#define ZCL_TYPE_BITMAP8 0x18
+#define ZCL_TYPE_UINT8 0x20
+#define ZCL_TYPE_UINT24 0x22
+#define ZCL_TYPE_BITMAP32 0x1B
+#define ZCL_TYPE_UINT32 0x23
+#define ZCL_TYPE_UINT48 0x25
+#define ZCL_TYPE_INT24 0x2A
+#define ZCL_TYPE_ENUM8 0x30
+
+// ZCL status codes
+#define ZCL_STATUS_SUCCESS 0x00
+#define ZCL_STATUS_UNSUPPORTED_ATTRIBUTE 0x86
+#define ZCL_STATUS_INVALID_VALUE 0x87
+#define ZCL_STATUS_READ_ONLY 0x88
+#define ZCL_STATUS_INVALID_DATA_TYPE 0x8D
+
+#define REPORT_NO_ATTRIBUTE -1
+#define REPORT_INTERVAL_OFF 0xFFFFFFFFUL   // maxIntervalMs: never reported
+
+struct ReportAttributeConfig {
+    uint8_t endpoint;
+    uint16_t clusterId;
+    uint16_t attrId;
+    uint8_t zclType;
+    uint32_t minIntervalMs;  // Earliest change report after the last report
+    uint32_t maxIntervalMs;  // Report deadline (0: none, REPORT_INTERVAL_OFF)
+    uint64_t minChange;      // Absolute reportable change (value units)
+    uint16_t changePermille; // Relative reportable change (of the last report)
+    bool onRequest;          // Event: sent by reportRequestCluster, not by reportRequestAll
+};
+
+struct ReportEngineStats {
+    uint32_t frames;         // Frames sent
+    uint32_t deadlineFrames; // ... of which were forced by a deadline or request
+    uint64_t bytesOnAir;     // Bytes on air of all frames sent
+    uint32_t budgetDeferrals;// Change frames held back by the airtime budget
+    uint32_t alarmFrames;    // Urgent lane frames (retries included)
+    uint32_t alarmRetries;   // ... sent again for want of an acknowledgement
+    uint32_t alarmsLost;     // Alarms given up after REPORT_ALARM_TRIES
+    uint32_t alarmLatencyUs; // Trigger sample to radio, last alarm
+    uint32_t alarmLatencyMaxUs;
+};
+
+void reportEngineReset();
+
+/**
+ * Register an attribute, last reported at boot as value 0
+ * config holds the defaults; rules stored by reportConfigure replace them
+ * Returns its id, or REPORT_NO_ATTRIBUTE if REPORT_MAX_ATTRIBUTES are in use
+ * or its cluster already has HAL_RADIO_MAX_ATTRIBUTES (one frame)
+ */
+int reportAttributeAdd(const ReportAttributeConfig* config);
+
+void reportAttributeSet(int attr, uint64_t value);
+
+/**
+ * Hold or release an attribute's change reports (deadlines and requests
+ * still report it)
+ */
+void reportHoldChanges(int attr, bool hold);
+
+/**
+ * Set an alarm attribute and send its cluster in the urgent lane
+ * originUs: hal_micros64() of the sample that raised it - the alarm
+ * latency is measured from there to the radio
+ */
+void reportAlarm(int attr, uint64_t value, uint64_t originUs);
+
+/**
+ * Send the urgent lane only: alarm frames and due retries (radioUp as for
+ * reportPoll). Returns the number of frames
+ */
+uint8_t reportPollUrgent(bool radioUp);
+
+/**
+ * Report every attribute at the next poll, regardless of thresholds
+ */
+void reportRequestAll();
+
+/**
+ * Report every attribute of attr's cluster at the next poll, regardless
+ * of thresholds - one frame carrying all of them (events)
+ */
+void reportRequestCluster(int attr);
+
+/**
+ * True while a requested report of attr has not gone out
+ */
+bool reportPending(int attr);
+
+/**
+ * Apply one Configure Reporting record from the coordinator and store it
+ * Returns the ZCL status for the record
+ */
+uint8_t reportConfigure(const HalReportingConfig* record);
+
+/**
+ * Current rules of an attribute (defaults or as configured)
+ */
+const ReportAttributeConfig* reportAttributeConfig(int attr);
+
+/**
+ * Encode value as a ZCL attribute record of the given type
+ */
+void reportEncode(uint16_t attrId, uint8_t zclType, uint64_t value, HalAttribute* record);
+
+/**
+ * Send every frame that is due, the urgent lane first
+ * radioUp = false: due frames are dropped as if sent (a join requests a
+ * full report anyway) and cost no budget
+ * Returns the number of frames that were due
+ */
+uint8_t reportPoll(bool radioUp);
+
+/**
+ * Milliseconds until the next deadline, alarm acknowledgement timeout,
+ * or until a held back change report can go out - when to poll next if
+ * no value changes meanwhile
+ */
+uint32_t reportNextMs();
+
+const ReportEngineStats* reportEngineStats();
+
+/**
+ * Zero the frame and airtime counters (rules and budget are kept)
+ */
+void reportClearStats();
+
+#endif // REPORT_ENGINE_H
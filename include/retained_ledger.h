@@ -0,0 +1,46 @@
+/*
+ * Water Flow Meter - Retained Ledger
+ * Mirror of the live pulse ledger in RTC no-init memory
+ *
+ * The ledger is mirrored after every change, so a soft, panic or
+ * watchdog reset resumes exactly where the ledger stood - no flash read,
+ * nothing lost since the last journal save. Only a power loss (or a
+ * brownout) falls back to the flash copy.
+ *
+ * The record is written to two slots in turn, each with a sequence number
+ * and CRC-32: a reset in the middle of a store leaves the other slot, and
+ * power-on garbage never passes the checksum.
+ */
+
+#ifndef RETAINED_LEDGER_H
+#define RETAINED_LEDGER_H
+
+#include <stdint.h>
+#include "config.h"
+#include "hal.h"
+
+// Flow channels after channel 0 (at least one slot, unused in a
+// one-channel build)
+#define RETAINED_EXTRA_CHANNELS (FLOW_CHANNELS > 1 ? FLOW_CHANNELS - 1 : 1)
+
+struct RetainedLedger {
+    uint64_t pulses;         // Pulse ledger
+    uint64_t savedPulses;    // Ledger value last saved to flash
+    uint32_t bootCount;      // Power-on boots (NVS)
+    uint32_t resetCount;     // Warm resets since power on
+    uint64_t channelPulses[RETAINED_EXTRA_CHANNELS];   // Ledgers of channels 1..
+    uint64_t channelSaved[RETAINED_EXTRA_CHANNELS];    // ... and their values in NVS
+};
+
+/**
+ * Latest valid mirror - false after a power loss or brownout, or if
+ * neither slot passes its checksum
+ */
+bool retainedLedgerRecover(RetainedLedger* ledger);
+
+/**
+ * Mirror the ledger into the older slot (main task only)
+ */
+void retainedLedgerStore(const RetainedLedger* ledger);
+
+#endif // RETAINED_LEDGER_H
@@ -0,0 +1,82 @@
+/*
+ * Water Flow Meter - Job Scheduler
+ * Deadline-ordered timer jobs for the main task
+ *
+ * Each subsystem registers its own periodic or one-shot job. Pending jobs
+ * are kept in a binary min-heap ordered by deadline, so the main task can
+ * sleep in hal_wait_event() until exactly the next deadline instead of
+ * waking every 10 ms to poll every timer. ISRs wake the task early with
+ * hal_notify_from_isr(); the registered notify handler then runs.
+ *
+ * All functions except the ISR wake-up run on the main task only.
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+#include "config.h"
+#include "hal.h"
+
+typedef void (*SchedulerJobFn)();
+
+#define SCHEDULER_NO_JOB -1
+
+// Wake-up accounting (for status output and benchmarks)
+struct SchedulerStats {
+    uint32_t wakeups;        // Returns from hal_wait_event()
+    uint32_t notifications;  // ... of which were ISR notifications
+    uint32_t runs;           // Job executions
+    uint32_t maxLateMs;      // Worst start time past deadline
+    uint64_t totalLateMs;    // Sum of start times past deadline
+    uint32_t maxRunUs;       // Longest single job run (main task stall)
+};
+
+void schedulerReset();
+
+/**
+ * Register a job, first run after delayMs
+ * periodMs = 0 makes a one-shot job (stays registered, re-arm with
+ * schedulerArm). Periodic deadlines advance by periodMs from the previous
+ * deadline, so lateness does not accumulate as drift
+ * Returns the job id, or SCHEDULER_NO_JOB if SCHEDULER_MAX_JOBS are in use
+ */
+int schedulerAdd(SchedulerJobFn fn, uint32_t periodMs, uint32_t delayMs);
+
+/**
+ * (Re)schedule a job to run delayMs from now
+ */
+void schedulerArm(int job, uint32_t delayMs);
+
+/**
+ * Remove a job from the timer queue (it stays registered)
+ */
+void schedulerCancel(int job);
+
+bool schedulerArmed(int job);
+
+/**
+ * Handler run on the main task after an ISR notification
+ */
+void schedulerOnNotify(SchedulerJobFn handler);
+
+/**
+ * Run every job whose deadline has passed, earliest first
+ * Returns milliseconds until the next deadline (HAL_WAIT_FOREVER if none)
+ */
+uint32_t schedulerRunDue();
+
+/**
+ * One main task iteration: run due jobs, then sleep until the next
+ * deadline or an ISR notification
+ */
+void schedulerRun();
+
+const SchedulerStats* schedulerStats();
+
+/**
+ * Zero the wake-up accounting (jobs stay registered)
+ */
+void schedulerClearStats();
+
+#endif // SCHEDULER_H
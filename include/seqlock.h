@@ -0,0 +1,104 @@
+/*
+ * Water Flow Meter - Sequence Lock
+ * Lock-free snapshots of state written by an interrupt handler
+ *
+ * The writer (one ISR) makes the sequence odd, stores the value and makes
+ * it even again. A reader copies the value between two loads of the
+ * sequence and retries if they differ or were odd - it never sees half of
+ * one update and half of another, and never masks interrupts. Readers
+ * only retry when an interrupt lands inside their copy; on the
+ * single-core C6 the writer can never be seen mid-update at all.
+ *
+ * Values are stored as 32-bit words with relaxed atomic accesses, so T
+ * must be trivially copyable and a whole number of words.
+ */
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <type_traits>
+#include "hal.h"
+
+template <typename T>
+struct Seqlock {
+    static_assert(std::is_trivially_copyable<T>::value, "seqlock values must be trivially copyable");
+    static_assert(sizeof(T) % sizeof(uint32_t) == 0, "seqlock values must be whole 32-bit words");
+    static const size_t WORDS = sizeof(T) / sizeof(uint32_t);
+
+    uint32_t seq;            // Even: stable, odd: write in progress
+    uint32_t words[WORDS];   // The value
+};
+
+// ============================================================================
+// Writer (single writer - one ISR, or the main task while the ISR is off)
+// ============================================================================
+
+template <typename T>
+static inline void IRAM_ATTR seqlockWrite(Seqlock<T>* lock, const T& value) {
+    uint32_t words[Seqlock<T>::WORDS];
+    memcpy(words, &value, sizeof(T));
+
+    uint32_t seq = __atomic_load_n(&lock->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&lock->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (size_t i = 0; i < Seqlock<T>::WORDS; i++) {
+        __atomic_store_n(&lock->words[i], words[i], __ATOMIC_RELAXED);
+    }
+
+    __atomic_store_n(&lock->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+// ============================================================================
+// Reader
+// ============================================================================
+
+/**
+ * Start of a read section: waits out a write in progress
+ */
+template <typename T>
+static inline uint32_t seqlockReadBegin(const Seqlock<T>* lock) {
+    uint32_t seq;
+    while ((seq = __atomic_load_n(&lock->seq, __ATOMIC_ACQUIRE)) & 1) {
+    }
+    return seq;
+}
+
+/**
+ * Copy the value inside a read section (may be torn until validated)
+ */
+template <typename T>
+static inline void seqlockCopy(const Seqlock<T>* lock, T* out) {
+    uint32_t words[Seqlock<T>::WORDS];
+    for (size_t i = 0; i < Seqlock<T>::WORDS; i++) {
+        words[i] = __atomic_load_n(&lock->words[i], __ATOMIC_RELAXED);
+    }
+    memcpy(out, words, sizeof(T));
+}
+
+/**
+ * End of a read section: true if a write overlapped it (read again)
+ */
+template <typename T>
+static inline bool seqlockReadRetry(const Seqlock<T>* lock, uint32_t seq) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&lock->seq, __ATOMIC_RELAXED) != seq;
+}
+
+/**
+ * Consistent copy of the value
+ */
+template <typename T>
+static inline T seqlockRead(const Seqlock<T>* lock) {
+    T value;
+    uint32_t seq;
+    do {
+        seq = seqlockReadBegin(lock);
+        seqlockCopy(lock, &value);
+    } while (seqlockReadRetry(lock, seq));
+    return value;
+}
+
+#endif // SEQLOCK_H
@@ -0,0 +1,220 @@
+/*
+ * Water Flow Meter - Usage Events
+ * Draws segmented into events and classified on the device
+ *
+ * A segmenter per flow channel follows its ledger and calibrated rate
+ * after every flow window, like the leak detector: a draw starts with the
+ * first new pulse and ends when the channel's estimator goes idle
+ * (FLOW_IDLE_TIMEOUT without a pulse). The event keeps
+ * its start (device time, flow_history.h), duration (first to last
+ * pulse), volume and peak rate - the shape the rate reports smear over
+ * many frames. Draws under USAGE_MIN_VOLUME (a drip, a single pulse) are
+ * not events.
+ *
+ * Each event is classified (tap, toilet, shower, ...) by a small decision
+ * tree in integers: a node compares one feature of the event with its
+ * threshold and goes left if the feature is less or equal, right
+ * otherwise, until it reaches a leaf holding the class. Children always
+ * come after their parent, so evaluation ends within USAGE_TREE_MAX_NODES
+ * steps. The tree is stored in NVS (console: usage node / store) and falls
+ * back to a built-in one tuned for a typical household.
+ *
+ * Events go into a RAM ring of the USAGE_EVENT_RING newest, and out one
+ * frame each on the Usage Events cluster of FLOW_ENDPOINT, oldest first,
+ * through the report engine - the report job hands over one per pass.
+ * The event stands in for the Demand and volume change reports the draw
+ * would have streamed: they are held while it is open
+ * (USAGE_HOLD_REPORTS, metering_cluster.h).
+ *
+ * Runs on the main task only.
+ */
+
+#ifndef USAGE_EVENTS_H
+#define USAGE_EVENTS_H
+
+#include <stdint.h>
+#include "config.h"
+#include "hal.h"
+
+enum UsageClass : uint8_t {
+    USAGE_OTHER,
+    USAGE_TAP,
+    USAGE_TOILET,
+    USAGE_SHOWER,
+    USAGE_APPLIANCE,         // Dishwasher, washing machine: long, slow fills
+    USAGE_GARDEN,            // Hose, sprinkler: long and strong
+    USAGE_CLASSES
+};
+
+// Event features the tree tests (all integers)
+enum UsageFeature : uint8_t {
+    USAGE_FEATURE_DURATION,  // Seconds
+    USAGE_FEATURE_VOLUME,    // mL
+    USAGE_FEATURE_PEAK,      // Peak rate, mL/min
+    USAGE_FEATURE_MEAN,      // Volume over duration, mL/min
+    USAGE_FEATURES,
+    USAGE_LEAF = 0xFF        // Leaf node: threshold is the class
+};
+
+struct UsageEvent {
+    uint32_t seq;            // Events since boot, from 1
+    uint32_t startTime;      // Device time (s)
+    uint32_t durationS;
+    uint32_t volumeMl;
+    uint32_t peakMlMin;
+    uint8_t channel;
+    uint8_t usageClass;      // UsageClass
+};
+
+// Segmenter state - one per flow channel
+struct UsageSegmenter {
+    uint64_t ledger;         // Ledger at the last update
+    uint64_t startLedger;    // Ledger before the draw's first pulse
+    uint32_t startMs;        // hal_millis() of the update that saw it
+    uint32_t lastPulseMs;    // Last update that saw new pulses
+    uint32_t startTime;      // Device time of the start (s)
+    uint32_t peakMlMin;
+    bool drawing;
+};
+
+// ============================================================================
+// Segmenter and Classifier
+// ============================================================================
+
+void usageSegmenterReset(UsageSegmenter* segmenter, uint64_t ledger);
+
+/**
+ * Follow the channel's ledger and calibrated rate after a flow window
+ * idle: the rate estimator has no reference edge (flow stopped)
+ * Returns true when a draw of at least USAGE_MIN_VOLUME ended; *event then
+ * holds its shape (seq, channel and class not set)
+ */
+bool usageSegmenterUpdate(UsageSegmenter* segmenter, uint64_t ledger, uint32_t rateMlMin, bool idle,
+                          uint32_t nowMs, uint32_t nowTime, UsageEvent* event);
+
+struct UsageTreeNode {
+    uint8_t feature;         // UsageFeature, or USAGE_LEAF
+    uint8_t left;            // Node if feature <= threshold
+    uint8_t right;           // Node otherwise
+    uint32_t threshold;      // Leaf: UsageClass
+};
+
+struct UsageTree {
+    uint8_t count;           // Nodes used, the root is node 0
+    UsageTreeNode nodes[USAGE_TREE_MAX_NODES];
+};
+
+/**
+ * A usable tree: 1..USAGE_TREE_MAX_NODES nodes, known features and
+ * classes, children after their parent and inside the tree
+ */
+constexpr bool usageTreeValid(const UsageTree& tree) {
+    if (tree.count < 1 || tree.count > USAGE_TREE_MAX_NODES) {
+        return false;
+    }
+    for (uint8_t i = 0; i < tree.count; i++) {
+        const UsageTreeNode& node = tree.nodes[i];
+        if (node.feature == USAGE_LEAF) {
+            if (node.threshold >= USAGE_CLASSES) {
+                return false;
+            }
+        } else if (node.feature >= USAGE_FEATURES || node.left <= i || node.right <= i ||
+                   node.left >= tree.count || node.right >= tree.count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t usageFeature(const UsageEvent* event, uint8_t feature);
+
+uint8_t usageClassify(const UsageTree* tree, const UsageEvent* event);
+
+// ============================================================================
+// Events and Tree
+// ============================================================================
+
+/**
+ * Use the tree stored in NVS if there is a valid one, else the built-in one
+ */
+void usageBegin();
+
+/**
+ * Start every channel's segmenter over from its ledger (ledger loaded)
+ */
+void usageStart(const uint64_t* ledgers);
+
+/**
+ * Feed one channel's flow window (flow job) - classifies and keeps an
+ * event that ends. Returns the event, or nullptr
+ */
+const UsageEvent* usageUpdate(uint8_t channel, uint64_t ledger, uint32_t rateMlMin, bool idle,
+                              uint32_t nowMs);
+
+/**
+ * True while a channel's draw is open (first pulse seen, not idle yet)
+ */
+bool usageDrawing(uint8_t channel);
+
+/**
+ * True while a channel's Demand and volume change reports should be held
+ * (its draw is open, reports held - USAGE_HOLD_REPORTS by default)
+ */
+bool usageHoldsReports(uint8_t channel);
+void usageSetHoldReports(bool hold);
+
+/**
+ * Events since boot, and the back-th newest still in the ring (0: newest)
+ */
+uint32_t usageEventCount();
+const UsageEvent* usageEvent(uint32_t back);
+
+const UsageTree* usageTree();
+
+/**
+ * Validate, apply and store a tree. False if it is not valid
+ */
+bool usageStoreTree(const UsageTree* tree);
+
+/**
+ * Back to the built-in tree, NVS copy erased
+ */
+void usageRestoreDefault();
+
+// ============================================================================
+// Usage Events Cluster (Zigbee)
+// ============================================================================
+
+// Manufacturer-specific cluster on FLOW_ENDPOINT: the newest reported
+// event, every attribute in each report
+#define USAGE_CLUSTER_ID 0xFC01
+
+#define USAGE_SEQ_ATTR 0x0000        // uint32, event number since boot
+#define USAGE_CHANNEL_ATTR 0x0001    // uint8, flow channel
+#define USAGE_CLASS_ATTR 0x0002      // enum8, UsageClass
+#define USAGE_START_ATTR 0x0003      // uint32, device time (s)
+#define USAGE_DURATION_ATTR 0x0004   // uint24, s
+#define USAGE_VOLUME_ATTR 0x0005     // uint32, mL
+#define USAGE_PEAK_ATTR 0x0006       // uint24, mL/min
+#define USAGE_ATTRIBUTES 7
+
+/**
+ * Register the cluster with the radio and its attributes with the report
+ * engine (reportBegin)
+ */
+void usageClusterBegin();
+
+/**
+ * Hand the oldest event not yet reported to the report engine, once the
+ * one before it has gone out - from the report job only, so each pass
+ * sends one event at most. Returns true while events are waiting
+ */
+bool usageReportNext();
+
+/**
+ * Built-in tree, USAGE_HOLD_REPORTS, empty ring, segmenters at ledger 0, cluster unregistered
+ * (host tests, with the report engine)
+ */
+void resetUsageEvents();
+
+#endif // USAGE_EVENTS_H
@@ -0,0 +1,52 @@
+/*
+ * Water Flow Meter - Zigbee Network
+ * Background join/rejoin state machine with exponential backoff
+ *
+ * On a warm boot (network parameters in zb_storage) the device rejoins
+ * directly from the stored state, which takes a fraction of a second; a
+ * factory-new device, or one whose rejoins keep failing, does a full join.
+ * Failed attempts are retried after an exponentially growing delay. The
+ * state machine is a scheduler job, so metering runs from the first
+ * millisecond whether or not the network is up.
+ */
+
+#ifndef ZIGBEE_NETWORK_H
+#define ZIGBEE_NETWORK_H
+
+#include <stdint.h>
+#include "config.h"
+#include "hal.h"
+
+enum ZigbeeJoinState {
+    ZB_STATE_IDLE,           // Not started
+    ZB_STATE_REJOINING,      // Rejoin from stored parameters in progress
+    ZB_STATE_JOINING,        // Full join in progress
+    ZB_STATE_BACKOFF,        // Waiting before the next attempt
+    ZB_STATE_CONNECTED
+};
+
+extern uint16_t zigbeeShortAddr;
+
+/**
+ * Start the Zigbee stack and the first join attempt - returns immediately
+ */
+void zigbeeNetworkBegin();
+
+/**
+ * Stack callback: the device left or lost the network - rejoin
+ */
+void zigbeeNetworkLost();
+
+ZigbeeJoinState zigbeeJoinState();
+
+/**
+ * Delay before retry number 'failures' (1 = first retry)
+ */
+uint32_t zigbeeBackoffMs(uint8_t failures);
+
+/**
+ * Reset join state (host tests/benchmarks)
+ */
+void resetZigbeeNetwork();
+
+#endif // ZIGBEE_NETWORK_H
@@ -0,0 +1,134 @@
+/*
+ * Water Flow Meter - Battery Monitor
+ * Battery check state machine driven by scheduler jobs
+ */
+
+#include "battery_monitor.h"
+#include "config_traits.h"
+#include "scheduler.h"
+#include "deferred_log.h"
+
+// ============================================================================
+// Global Variables
+// ============================================================================
+
+uint32_t batteryMillivolts = 0;
+uint8_t batteryPercent = 100;
+uint8_t batteryAlarms = 0;
+
+static void (*alarmHandler)(uint8_t alarms, uint64_t sampleUs) = nullptr;
+
+// Check in progress
+static uint32_t sampleSum = 0;
+static uint8_t samplesTaken = 0;
+static bool checkRunning = false;
+
+static int checkJob = SCHEDULER_NO_JOB;
+static int sampleJob = SCHEDULER_NO_JOB;
+
+// ============================================================================
+// Battery Functions
+// ============================================================================
+
+uint8_t batteryPercentFromMillivolts(uint32_t millivolts) {
+    if (millivolts <= BATTERY_MIN_MV) {
+        return 0;
+    }
+    if (millivolts >= BATTERY_MAX_MV) {
+        return 100;
+    }
+    return (uint8_t)((millivolts - BATTERY_MIN_MV) * 100 / (BATTERY_MAX_MV - BATTERY_MIN_MV));
+}
+
+/**
+ * Check battery level and raise or clear the alarms - a critical battery
+ * has reached the warning threshold too
+ */
+static void checkBatteryLevel(uint64_t sampleUs) {
+    uint8_t alarms = 0;
+    if (batteryPercent < BATTERY_CRITICAL_LEVEL) {
+        LOG(BATTERY_CRITICAL, batteryPercent);
+        alarms = BATTERY_ALARM_CRITICAL | BATTERY_ALARM_WARNING;
+    } else if (batteryPercent < BATTERY_WARNING_LEVEL) {
+        LOG(BATTERY_WARNING, batteryPercent);
+        alarms = BATTERY_ALARM_WARNING;
+    }
+
+    if (alarms != batteryAlarms) {
+        batteryAlarms = alarms;
+        if (alarmHandler) {
+            alarmHandler(alarms, sampleUs);
+        }
+    }
+}
+
+/**
+ * Sample job - one ADC conversion per run, finishes the check after
+ * BATTERY_SAMPLES runs
+ */
+static void sampleJobRun() {
+    sampleSum += hal_adc_read_mv(BATTERY_PIN);
+    samplesTaken++;
+    uint64_t sampleUs = hal_micros64();
+
+    if (samplesTaken < BATTERY_SAMPLES) {
+        schedulerArm(sampleJob, BATTERY_SAMPLE_INTERVAL);
+        return;
+    }
+
+    // Average and compensate for the voltage divider
+    batteryMillivolts = sampleSum / BATTERY_SAMPLES * BATTERY_DIVIDER_RATIO;
+    batteryPercent = batteryPercentFromMillivolts(batteryMillivolts);
+    checkRunning = false;
+
+    LOG(BATTERY_LEVEL, (unsigned long)batteryMillivolts, batteryPercent);
+    checkBatteryLevel(sampleUs);
+}
+
+void batteryStartCheck() {
+    if (checkRunning) {
+        return;
+    }
+    sampleSum = 0;
+    samplesTaken = 0;
+    checkRunning = true;
+    schedulerArm(sampleJob, 0);
+}
+
+bool batteryCheckInProgress() {
+    return checkRunning;
+}
+
+void batteryOnAlarm(void (*handler)(uint8_t alarms, uint64_t sampleUs)) {
+    alarmHandler = handler;
+}
+
+/**
+ * Initialize battery monitoring
+ */
+void setupBatteryMonitor() {
+    hal_adc_begin(BATTERY_PIN);
+
+    checkJob = schedulerAdd(batteryStartCheck, BATTERY_CHECK_INTERVAL, BATTERY_CHECK_INTERVAL);
+    sampleJob = schedulerAdd(sampleJobRun, 0, 0);
+    schedulerCancel(sampleJob);
+    batteryStartCheck();
+
+    LOG(BATTERY_INIT);
+}
+
+// ============================================================================
+// Test Support
+// ============================================================================
+
+void resetBatteryMonitor() {
+    batteryMillivolts = 0;
+    batteryPercent = 100;
+    batteryAlarms = 0;
+    alarmHandler = nullptr;
+    sampleSum = 0;
+    samplesTaken = 0;
+    checkRunning = false;
+    checkJob = SCHEDULER_NO_JOB;
+    sampleJob = SCHEDULER_NO_JOB;
+}
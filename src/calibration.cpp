@@ -0,0 +1,446 @@
+/*
+ * Water Flow Meter - Calibration Curve
+ * Active curve and lookup table, NVS storage, calibration sessions
+ */
+
+#include "calibration.h"
+#include "config_traits.h"
+#include "deferred_log.h"
+#include "flow_channels.h"
+#include "report_engine.h"
+#include <stdio.h>
+
+// NVS keys: point count, then one u64 per point (mHz << 32 | K milli), with
+// the channel suffix of flowChannelKey()
+#define CALIBRATION_KEY_COUNT "calPoints"
+#define CALIBRATION_KEY_POINT "cal%u"
+
+#define RUN_END_PERIODS 3    // A trickle run ends after this many missed pulses
+
+// Active curves and their tables, by channel - the tables side by side
+// for the flow job
+struct ChannelCurves {
+    CalibrationCurve curve[FLOW_CHANNELS];
+    CalibrationTable table[FLOW_CHANNELS];
+};
+
+static constexpr ChannelCurves configCurves() {
+    ChannelCurves config{};
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        config.curve[i] = CALIBRATION_CONFIG_CURVE;
+        config.table[i] = CALIBRATION_CONFIG_TABLE;
+    }
+    return config;
+}
+
+static ChannelCurves curves = configCurves();
+static CalibrationSession session;
+
+// Calibration cluster: registered, and the values written by the
+// coordinator on each channel's endpoint
+struct ClusterSettings {
+    uint32_t volumeMl = 0;
+    uint8_t runs = CALIBRATION_DEFAULT_RUNS;
+};
+static bool clusterReady = false;
+static ClusterSettings clusterSettings[FLOW_CHANNELS];
+
+static void clusterUpdate();
+
+static void logCurve(uint8_t channel) {
+    const CalibrationCurve* curve = &curves.curve[channel];
+    for (uint8_t i = 0; i < curve->count; i++) {
+        LOG(CALIBRATION_POINT, (unsigned long)curve->points[i].milliHz,
+            (unsigned long)(curve->points[i].kMilli / 1000),
+            (unsigned long)(curve->points[i].kMilli % 1000));
+    }
+}
+
+static void pointKey(char* key, size_t size, uint8_t point, uint8_t channel) {
+    char name[8];
+    snprintf(name, sizeof(name), CALIBRATION_KEY_POINT, (unsigned)point);
+    flowChannelKey(key, size, name, channel);
+}
+
+static void loadCurve(uint8_t channel) {
+    CalibrationCurve stored{};
+    char key[16];
+    hal_nvs_begin(EEPROM_NAMESPACE, true);
+    flowChannelKey(key, sizeof(key), CALIBRATION_KEY_COUNT, channel);
+    uint32_t count = hal_nvs_get_u32(key, 0);
+    if (count <= CALIBRATION_MAX_POINTS) {
+        stored.count = (uint8_t)count;
+        for (uint8_t i = 0; i < stored.count; i++) {
+            pointKey(key, sizeof(key), i, channel);
+            uint64_t raw = hal_nvs_get_u64(key, 0);
+            stored.points[i].milliHz = (uint32_t)(raw >> 32);
+            stored.points[i].kMilli = (uint32_t)raw;
+        }
+    }
+    hal_nvs_end();
+
+    if (channel > 0) {
+        LOG(CALIBRATION_CHANNEL, (unsigned)channel);
+    }
+    if (count > 0 && calibrationSetCurve(&stored, channel)) {
+        LOG(CALIBRATION_STORED, (unsigned)stored.count);
+    } else {
+        if (count > 0) {
+            LOG(CALIBRATION_INVALID);
+        }
+        calibrationSetCurve(&CALIBRATION_CONFIG_CURVE, channel);
+        LOG(CALIBRATION_CONFIG, (unsigned)CALIBRATION_CONFIG_CURVE.count);
+    }
+    logCurve(channel);
+}
+
+void calibrationBegin() {
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        loadCurve(i);
+    }
+}
+
+bool calibrationSetCurve(const CalibrationCurve* newCurve, uint8_t channel) {
+    if (channel >= FLOW_CHANNELS || !calibrationValid(*newCurve)) {
+        return false;
+    }
+    curves.curve[channel] = *newCurve;
+    curves.table[channel] = calibrationBuild(*newCurve);
+    clusterUpdate();
+    return true;
+}
+
+void calibrationSave(uint8_t channel) {
+    // No count while the points change: a save cut short reads as no curve
+    const CalibrationCurve* curve = &curves.curve[channel];
+    char countKey[16];
+    char key[16];
+    flowChannelKey(countKey, sizeof(countKey), CALIBRATION_KEY_COUNT, channel);
+    hal_nvs_begin(EEPROM_NAMESPACE, false);
+    hal_nvs_put_u32(countKey, 0);
+    for (uint8_t i = 0; i < curve->count; i++) {
+        pointKey(key, sizeof(key), i, channel);
+        hal_nvs_put_u64(key, ((uint64_t)curve->points[i].milliHz << 32) | curve->points[i].kMilli);
+    }
+    hal_nvs_put_u32(countKey, curve->count);
+    hal_nvs_end();
+}
+
+void calibrationRestoreDefault(uint8_t channel) {
+    if (session.channel == channel) {
+        calibrationSessionCancel();
+    }
+    char key[16];
+    flowChannelKey(key, sizeof(key), CALIBRATION_KEY_COUNT, channel);
+    hal_nvs_begin(EEPROM_NAMESPACE, false);
+    hal_nvs_put_u32(key, 0);
+    hal_nvs_end();
+    calibrationSetCurve(&CALIBRATION_CONFIG_CURVE, channel);
+    LOG(CALIBRATION_DEFAULT);
+}
+
+const CalibrationCurve* calibrationCurve(uint8_t channel) {
+    return &curves.curve[channel];
+}
+
+const CalibrationTable* calibrationTables() {
+    return curves.table;
+}
+
+uint32_t calibrationScaleAtRate(uint32_t nominalMlMin, uint8_t channel) {
+    return calibrationScaleAt(&curves.table[channel], nominalMlMin);
+}
+
+// ============================================================================
+// Calibration Session
+// ============================================================================
+
+bool calibrationSessionStart(uint32_t referenceMl, uint8_t runs, uint8_t channel) {
+    if (referenceMl == 0 || runs < 1 || runs > CALIBRATION_MAX_POINTS || channel >= FLOW_CHANNELS) {
+        return false;
+    }
+    session = CalibrationSession();
+    session.state = CALIBRATION_WAITING;
+    session.channel = channel;
+    session.runTarget = runs;
+    session.referenceMl = referenceMl;
+    session.lastCount = pulseSourceCount(channel);
+    clusterUpdate();
+    LOG(CALIBRATION_SESSION_STARTED, (unsigned long)referenceMl, (unsigned)runs,
+        (unsigned long)(CALIBRATION_RUN_IDLE_MS / 1000));
+    return true;
+}
+
+/**
+ * Pause that ends the run: CALIBRATION_RUN_IDLE_MS, or a few of the run's
+ * own pulse periods at a trickle - but never past FLOW_IDLE_TIMEOUT, when
+ * the flow job stops calling (also the wait while the period is unknown)
+ */
+static uint64_t runIdleUs(const PulseReading* reading) {
+    uint64_t maxUs = FLOW_IDLE_TIMEOUT_US;
+    uint64_t edges = reading->edgeCount - session.refEdgeCount;
+    if (edges == 0) {
+        return maxUs;
+    }
+    uint64_t idleUs = (reading->edgeUs - session.refEdgeUs) / edges * RUN_END_PERIODS;
+    if (idleUs < (uint64_t)CALIBRATION_RUN_IDLE_MS * 1000) {
+        idleUs = (uint64_t)CALIBRATION_RUN_IDLE_MS * 1000;
+    }
+    return idleUs < maxUs ? idleUs : maxUs;
+}
+
+/**
+ * Close the run on the last edge: pulses for the reference volume and the
+ * mean frequency between its first and last timed edges
+ */
+static void endRun(const PulseReading* reading) {
+    uint32_t pulses = (uint32_t)(session.lastCount - session.startCount);
+    session.state = CALIBRATION_WAITING;
+    if (pulses < CALIBRATION_MIN_RUN_PULSES) {
+        LOG(CALIBRATION_RUN_IGNORED, (unsigned long)pulses);
+        clusterUpdate();
+        return;
+    }
+
+    uint64_t edges = reading->edgeCount - session.refEdgeCount;
+    uint64_t spanUs = reading->edgeUs - session.refEdgeUs;
+    CalibrationRun* run = &session.runs[session.runCount++];
+    run->pulses = pulses;
+    run->milliHz = spanUs > 0 ? (uint32_t)((edges * 1000000000ULL + spanUs / 2) / spanUs) : 0;
+
+    uint64_t kMilli = ((uint64_t)pulses * 1000000 + session.referenceMl / 2) / session.referenceMl;
+    LOG(CALIBRATION_RUN, (unsigned)session.runCount, (unsigned long)pulses,
+        (unsigned long)run->milliHz, (unsigned long)(kMilli / 1000),
+        (unsigned long)(kMilli % 1000));
+
+    if (session.runCount >= session.runTarget) {
+        calibrationSessionFinish();
+    } else {
+        clusterUpdate();
+    }
+}
+
+void calibrationSessionUpdate(const PulseReading* reading, uint64_t nowUs) {
+    if (session.state == CALIBRATION_IDLE) {
+        return;
+    }
+
+    if (reading->count != session.lastCount) {
+        if (session.state == CALIBRATION_WAITING) {
+            // First pulses of a run - frequency counts from the newest edge
+            session.state = CALIBRATION_RUNNING;
+            session.startCount = session.lastCount;
+            session.refEdgeCount = reading->edgeCount;
+            session.refEdgeUs = reading->edgeUs;
+            LOG(CALIBRATION_RUN_STARTED, (unsigned)(session.runCount + 1));
+            clusterUpdate();
+        }
+        session.lastCount = reading->count;
+    } else if (session.state == CALIBRATION_RUNNING &&
+               nowUs - reading->edgeUs >= runIdleUs(reading)) {
+        endRun(reading);
+    }
+}
+
+bool calibrationSessionFinish() {
+    if (session.state == CALIBRATION_IDLE) {
+        return false;
+    }
+    session.state = CALIBRATION_IDLE;
+
+    // Runs in rising frequency
+    CalibrationRun* runs = session.runs;
+    for (uint8_t i = 1; i < session.runCount; i++) {
+        for (uint8_t j = i; j > 0 && runs[j].milliHz < runs[j - 1].milliHz; j--) {
+            CalibrationRun tmp = runs[j];
+            runs[j] = runs[j - 1];
+            runs[j - 1] = tmp;
+        }
+    }
+
+    // One point per group of runs at nearly the same frequency: all their
+    // pulses over all their volume, frequency weighted by pulses
+    CalibrationCurve fitted{};
+    uint64_t groupPulses = 0;
+    uint64_t groupWeightedHz = 0;
+    uint32_t groupRuns = 0;
+    for (uint8_t i = 0; i <= session.runCount; i++) {
+        bool close = i < session.runCount && groupRuns > 0 &&
+                     (uint64_t)runs[i].milliHz * 1000 <=
+                         (uint64_t)runs[i - 1].milliHz * (1000 + CALIBRATION_MERGE_PERMILLE);
+        if (groupRuns > 0 && !close) {
+            CalibrationPoint* point = &fitted.points[fitted.count++];
+            uint64_t volumeMl = (uint64_t)session.referenceMl * groupRuns;
+            point->milliHz = (uint32_t)(groupWeightedHz / groupPulses);
+            point->kMilli = (uint32_t)((groupPulses * 1000000 + volumeMl / 2) / volumeMl);
+            groupPulses = 0;
+            groupWeightedHz = 0;
+            groupRuns = 0;
+        }
+        if (i < session.runCount) {
+            groupPulses += runs[i].pulses;
+            groupWeightedHz += (uint64_t)runs[i].milliHz * runs[i].pulses;
+            groupRuns++;
+        }
+    }
+
+    if (!calibrationSetCurve(&fitted, session.channel)) {
+        LOG(CALIBRATION_FIT_FAILED, (unsigned)session.runCount);
+        clusterUpdate();
+        return false;
+    }
+    calibrationSave(session.channel);
+    if (session.channel > 0) {
+        LOG(CALIBRATION_CHANNEL, (unsigned)session.channel);
+    }
+    LOG(CALIBRATION_FITTED, (unsigned)fitted.count, (unsigned)session.runCount);
+    logCurve(session.channel);
+    return true;
+}
+
+void calibrationSessionCancel() {
+    if (session.state != CALIBRATION_IDLE) {
+        session.state = CALIBRATION_IDLE;
+        LOG(CALIBRATION_CANCELLED);
+        clusterUpdate();
+    }
+}
+
+const CalibrationSession* calibrationSession() {
+    return &session;
+}
+
+// ============================================================================
+// Calibration Cluster
+// ============================================================================
+
+static void setAttribute(uint8_t channel, uint16_t attrId, uint8_t zclType, uint64_t value) {
+    HalAttribute attr;
+    reportEncode(attrId, zclType, value, &attr);
+    hal_radio_set_attribute(FLOW_ENDPOINT + channel, CALIBRATION_CLUSTER_ID, &attr);
+}
+
+// Session state and runs done as a channel's cluster shows them
+static uint8_t channelState(uint8_t channel) {
+    return session.channel == channel ? session.state : CALIBRATION_IDLE;
+}
+
+static uint8_t channelRunsDone(uint8_t channel) {
+    return session.channel == channel ? session.runCount : 0;
+}
+
+// Read-back values: session state, runs done, curve in use
+static void clusterUpdate() {
+    if (!clusterReady) {
+        return;
+    }
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        setAttribute(i, CALIBRATION_CONTROL_ATTR, ZCL_TYPE_ENUM8, channelState(i));
+        setAttribute(i, CALIBRATION_DONE_ATTR, ZCL_TYPE_UINT8, channelRunsDone(i));
+        setAttribute(i, CALIBRATION_POINTS_ATTR, ZCL_TYPE_UINT8, curves.curve[i].count);
+    }
+}
+
+void calibrationClusterBegin() {
+    if (clusterReady) {
+        return;
+    }
+    clusterReady = true;
+
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        HalAttribute attrs[5];
+        reportEncode(CALIBRATION_VOLUME_ATTR, ZCL_TYPE_UINT32, clusterSettings[i].volumeMl, &attrs[0]);
+        reportEncode(CALIBRATION_RUNS_ATTR, ZCL_TYPE_UINT8, clusterSettings[i].runs, &attrs[1]);
+        reportEncode(CALIBRATION_CONTROL_ATTR, ZCL_TYPE_ENUM8, channelState(i), &attrs[2]);
+        reportEncode(CALIBRATION_DONE_ATTR, ZCL_TYPE_UINT8, channelRunsDone(i), &attrs[3]);
+        reportEncode(CALIBRATION_POINTS_ATTR, ZCL_TYPE_UINT8, curves.curve[i].count, &attrs[4]);
+        hal_radio_add_cluster(FLOW_ENDPOINT + i, CALIBRATION_CLUSTER_ID, attrs, 5);
+    }
+    hal_radio_on_write_attribute(calibrationWriteAttribute);
+}
+
+static uint32_t attributeValue(const HalAttribute* attr) {
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < attr->len && i < 4; i++) {
+        value |= (uint32_t)attr->value[i] << (8 * i);
+    }
+    return value;
+}
+
+static uint8_t writeControl(uint8_t channel, uint32_t control) {
+    const ClusterSettings* settings = &clusterSettings[channel];
+    switch (control) {
+        case CALIBRATION_CONTROL_START:
+            return calibrationSessionStart(settings->volumeMl, settings->runs, channel) ?
+                   ZCL_STATUS_SUCCESS : ZCL_STATUS_INVALID_VALUE;
+        case CALIBRATION_CONTROL_FINISH:
+            if (session.channel == channel) {
+                calibrationSessionFinish();
+            }
+            return ZCL_STATUS_SUCCESS;
+        case CALIBRATION_CONTROL_CANCEL:
+            if (session.channel == channel) {
+                calibrationSessionCancel();
+            }
+            return ZCL_STATUS_SUCCESS;
+        case CALIBRATION_CONTROL_DEFAULT:
+            calibrationRestoreDefault(channel);
+            return ZCL_STATUS_SUCCESS;
+        default:
+            return ZCL_STATUS_INVALID_VALUE;
+    }
+}
+
+uint8_t calibrationWriteAttribute(uint8_t endpoint, uint16_t clusterId, const HalAttribute* attr) {
+    uint8_t channel = (uint8_t)(endpoint - FLOW_ENDPOINT);
+    if (endpoint < FLOW_ENDPOINT || channel >= FLOW_CHANNELS || clusterId != CALIBRATION_CLUSTER_ID) {
+        return ZCL_STATUS_UNSUPPORTED_ATTRIBUTE;
+    }
+
+    uint32_t value = attributeValue(attr);
+    switch (attr->attrId) {
+        case CALIBRATION_VOLUME_ATTR:
+            if (attr->zclType != ZCL_TYPE_UINT32) {
+                return ZCL_STATUS_INVALID_DATA_TYPE;
+            }
+            if (value == 0) {
+                return ZCL_STATUS_INVALID_VALUE;
+            }
+            clusterSettings[channel].volumeMl = value;
+            setAttribute(channel, CALIBRATION_VOLUME_ATTR, ZCL_TYPE_UINT32, value);
+            return ZCL_STATUS_SUCCESS;
+        case CALIBRATION_RUNS_ATTR:
+            if (attr->zclType != ZCL_TYPE_UINT8) {
+                return ZCL_STATUS_INVALID_DATA_TYPE;
+            }
+            if (value < 1 || value > CALIBRATION_MAX_POINTS) {
+                return ZCL_STATUS_INVALID_VALUE;
+            }
+            clusterSettings[channel].runs = (uint8_t)value;
+            setAttribute(channel, CALIBRATION_RUNS_ATTR, ZCL_TYPE_UINT8, value);
+            return ZCL_STATUS_SUCCESS;
+        case CALIBRATION_CONTROL_ATTR:
+            if (attr->zclType != ZCL_TYPE_ENUM8) {
+                return ZCL_STATUS_INVALID_DATA_TYPE;
+            }
+            return writeControl(channel, value);
+        case CALIBRATION_DONE_ATTR:
+        case CALIBRATION_POINTS_ATTR:
+            return ZCL_STATUS_READ_ONLY;
+        default:
+            return ZCL_STATUS_UNSUPPORTED_ATTRIBUTE;
+    }
+}
+
+// ============================================================================
+// Test Support
+// ============================================================================
+
+void resetCalibration() {
+    curves = configCurves();
+    session = CalibrationSession();
+    clusterReady = false;
+    for (ClusterSettings& settings : clusterSettings) {
+        settings = ClusterSettings();
+    }
+}
@@ -0,0 +1,790 @@
+/*
+ * Water Flow Meter - Serial Console
+ * Line buffer, in-place tokenizer and command table
+ */
+
+#include "console.h"
+
+#include <string.h>
+#include "deferred_log.h"
+#include "flow_meter.h"
+#include "scheduler.h"
+#include "battery_monitor.h"
+#include "zigbee_network.h"
+#include "flow_history.h"
+#include "consumption.h"
+
+// ============================================================================
+// System Status
+// ============================================================================
+
+void printSystemStatus() {
+    const SchedulerStats* sched = schedulerStats();
+    uint64_t volumeMl = totalVolumeMl();
+
+    LOG(SYSTEM_BLANK);
+    LOG(SYSTEM_RULE);
+    LOG(STATUS_TITLE);
+    LOG(SYSTEM_RULE);
+    LOG(STATUS_BOOT, (unsigned long)bootCount);
+    LOG(STATUS_RESETS, (unsigned long)resetCount);
+    LOG(STATUS_UPTIME, (unsigned long)(hal_micros64() / 1000000));
+    LOG(STATUS_WAKEUPS, (unsigned long)sched->wakeups, (unsigned long)sched->maxLateMs,
+        (unsigned long)sched->maxRunUs);
+    LOG(SYSTEM_BLANK);
+    LOG(STATUS_FLOW_HEADER);
+    LOG(STATUS_FLOW_RATE, (unsigned long)(flowRateMlMin / 1000), (unsigned long)(flowRateMlMin % 1000));
+    LOG(STATUS_VOLUME, (unsigned long long)(volumeMl / 1000), (unsigned long)(volumeMl % 1000));
+    LOG(STATUS_PULSES, (unsigned long long)totalPulses);
+    if (flowRateMlMin > 100) {
+        LOG(STATUS_FLOWING);
+    } else {
+        LOG(STATUS_IDLE);
+    }
+    for (uint8_t i = 1; i < FLOW_CHANNELS; i++) {
+        uint32_t rate = flowChannels.rateMlMin[i];
+        uint64_t channelMl = channelVolumeMl(i);
+        LOG(STATUS_CHANNEL, (unsigned)i, (unsigned long)(rate / 1000), (unsigned long)(rate % 1000),
+            (unsigned long long)(channelMl / 1000), (unsigned long)(channelMl % 1000));
+    }
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        if (leakAlarms(i) != 0) {
+            LOG(STATUS_LEAK, (unsigned)i, (unsigned)leakAlarms(i));
+        }
+    }
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        ConsumptionTotals totals;
+        consumptionTotals(i, &totals);
+        LOG(STATUS_CONSUMPTION, (unsigned)i, (unsigned long long)(totals.todayMl / 1000),
+            (unsigned long)(totals.todayMl % 1000), (unsigned long long)(totals.yesterdayMl / 1000),
+            (unsigned long)(totals.yesterdayMl % 1000), (unsigned long long)(totals.weekMl / 1000),
+            (unsigned long long)(totals.monthMl / 1000), (unsigned long long)(totals.yearMl / 1000));
+    }
+    LOG(SYSTEM_BLANK);
+
+    #if BATTERY_ENABLED
+    LOG(STATUS_BATTERY_HEADER);
+    LOG(STATUS_BATTERY_VOLTAGE, (unsigned long)(batteryMillivolts / 1000),
+        (unsigned long)(batteryMillivolts % 1000));
+    LOG(STATUS_BATTERY_PERCENT, batteryPercent);
+    LOG(SYSTEM_BLANK);
+    #endif
+
+    LOG(STATUS_BOOT_HEADER);
+    if (firstPulseMs == BOOT_TIME_UNSET) {
+        LOG(STATUS_FIRST_PULSE_NONE);
+    } else {
+        LOG(STATUS_FIRST_PULSE, (unsigned long)firstPulseMs);
+    }
+    if (firstReportMs == BOOT_TIME_UNSET) {
+        LOG(STATUS_FIRST_REPORT_NONE);
+    } else {
+        LOG(STATUS_FIRST_REPORT, (unsigned long)firstReportMs);
+    }
+    LOG(SYSTEM_BLANK);
+
+    LOG(STATUS_ZIGBEE_HEADER);
+    if (zigbeeConnected) {
+        LOG(STATUS_ZIGBEE_CONNECTED);
+        LOG(STATUS_SHORT_ADDRESS, zigbeeShortAddr);
+    } else {
+        LOG(STATUS_ZIGBEE_DISCONNECTED);
+    }
+    LOG(STATUS_TIME, (unsigned long)historyNow(), (long)(consumptionZoneOffset() / 60),
+        (unsigned)consumptionTimeSynced());
+    LOG(SYSTEM_RULE);
+    LOG(SYSTEM_BLANK);
+}
+
+#if CONSOLE_ENABLED
+
+#include "latency_stats.h"
+#include "report_engine.h"
+#include "pulse_source.h"
+#include "pulse_trace.h"
+#include "calibration.h"
+#include "usage_events.h"
+
+// Replies go out whatever LOG_LEVEL - the user asked for them
+#define REPLY(name, ...) \
+    do { \
+        if (false) { \
+            logFormatCheck(LOG_FORMAT_##name, ##__VA_ARGS__); \
+        } \
+        logWrite(LOG_ID_##name, ##__VA_ARGS__); \
+    } while (0)
+
+// Line being typed - words are split in place when it is complete
+static char line[CONSOLE_LINE_MAX + 1];
+static uint8_t lineLength = 0;
+static bool lineOverflow = false;    // Dropping input until the next newline
+
+// Calibration run (calibrate start / stop)
+static bool calibrating = false;
+static uint64_t calibrateStartPulses = 0;
+static uint64_t calibrateStartLedger = 0;
+static uint32_t calibrateStartMs = 0;
+
+// History dump streamed over several polls
+static bool dumping = false;
+static uint8_t dumpTier = 0;
+static uint32_t dumpFrom = 0;        // Next interval start to log
+static uint32_t dumpTo = 0;          // End of the dump (device time when it began)
+static uint32_t dumpIntervals = 0;
+
+// Usage tree being edited (usage node), applied by usage store
+static bool usageEditing = false;
+static UsageTree usageEdit;
+
+// Trace export streamed over several polls
+static bool exporting = false;
+static uint32_t exportOffset = 0;    // Next byte of the trace area to send
+static uint32_t exportEnd = 0;
+
+// ============================================================================
+// Argument Parsing
+// ============================================================================
+
+/**
+ * Whole-word unsigned decimal (or 0x hex) - false on anything else,
+ * including overflow
+ */
+static bool parseNumber(const char* word, uint32_t* value) {
+    uint32_t base = 10;
+    if (word[0] == '0' && (word[1] == 'x' || word[1] == 'X')) {
+        base = 16;
+        word += 2;
+    }
+    if (*word == '\0') {
+        return false;
+    }
+
+    uint64_t result = 0;
+    for (; *word != '\0'; word++) {
+        uint32_t digit;
+        if (*word >= '0' && *word <= '9') {
+            digit = *word - '0';
+        } else if (base == 16 && *word >= 'a' && *word <= 'f') {
+            digit = *word - 'a' + 10;
+        } else if (base == 16 && *word >= 'A' && *word <= 'F') {
+            digit = *word - 'A' + 10;
+        } else {
+            return false;
+        }
+        result = result * base + digit;
+        if (result > UINT32_MAX) {
+            return false;
+        }
+    }
+    *value = (uint32_t)result;
+    return true;
+}
+
+// ============================================================================
+// Commands
+// ============================================================================
+
+// Handlers return false on bad arguments (the console prints the usage)
+typedef bool (*ConsoleHandler)(uint8_t argc, char** argv);
+
+struct ConsoleCommand {
+    const char* name;
+    ConsoleHandler run;
+    LogMsgId help;
+};
+
+static bool cmdHelp(uint8_t argc, char** argv);
+
+static bool cmdStatus(uint8_t argc, char** argv) {
+    (void)argv;
+    if (argc != 1) {
+        return false;
+    }
+    printSystemStatus();
+    return true;
+}
+
+/**
+ * stats            every counter and the latency summary
+ * stats <section>  buckets of one latency histogram (LatencySection)
+ */
+static bool cmdStats(uint8_t argc, char** argv) {
+    uint32_t section;
+    if (argc == 2 && parseNumber(argv[1], &section) && section < LATENCY_SECTIONS) {
+        latencyPrintHistogram((uint8_t)section);
+        return true;
+    }
+    if (argc != 1) {
+        return false;
+    }
+
+    const SchedulerStats* sched = schedulerStats();
+    REPLY(STATS_SCHEDULER, (unsigned long)sched->wakeups, (unsigned long)sched->notifications,
+          (unsigned long)sched->runs, (unsigned long)sched->maxLateMs,
+          (unsigned long)sched->maxRunUs);
+
+    const ReportEngineStats* reports = reportEngineStats();
+    REPLY(STATS_REPORTS, (unsigned long)reports->frames, (unsigned long)reports->deadlineFrames,
+          (unsigned long long)reports->bytesOnAir, (unsigned long)reports->budgetDeferrals);
+    REPLY(STATS_ALARMS, (unsigned long)reports->alarmFrames, (unsigned long)reports->alarmRetries,
+          (unsigned long)reports->alarmsLost, (unsigned long)reports->alarmLatencyUs,
+          (unsigned long)reports->alarmLatencyMaxUs);
+
+    const PulseSourceStats* pulses = pulseSourceStats();
+    REPLY(STATS_PULSES, (unsigned)pulseSourceBackend(), (unsigned long)pulses->interrupts,
+          (unsigned long)pulses->overflows);
+
+    const LogStats* log = logStats();
+    REPLY(STATS_LOG, (unsigned long)log->records, (unsigned long)log->dropped,
+          (unsigned long)log->maxUsedWords);
+
+    const HistoryStats* history = historyStats();
+    REPLY(STATS_HISTORY, (unsigned long)history->blocksWritten,
+          (unsigned long long)history->bytesWritten, (unsigned long)history->sectorErases);
+
+    latencyPrint();
+    return true;
+}
+
+static void replyCurve() {
+    const CalibrationCurve* curve = calibrationCurve();
+    REPLY(CALIBRATE_CURVE, (unsigned)curve->count);
+    for (uint8_t i = 0; i < curve->count; i++) {
+        REPLY(CALIBRATION_POINT, (unsigned long)curve->points[i].milliHz,
+              (unsigned long)(curve->points[i].kMilli / 1000),
+              (unsigned long)(curve->points[i].kMilli % 1000));
+    }
+}
+
+static void replySession() {
+    const CalibrationSession* session = calibrationSession();
+    uint64_t current = session->state == CALIBRATION_RUNNING ?
+                       pulseSourceCount(session->channel) - session->startCount : 0;
+    REPLY(CALIBRATE_SESSION, (unsigned)session->runCount, (unsigned)session->runTarget,
+          (unsigned long)session->referenceMl, (unsigned long)current);
+}
+
+/**
+ * Automatic multi-point session (calibration.h):
+ * calibrate auto <mL> [runs]  run mL at each of runs flow rates
+ * calibrate done              fit and store the curve from the runs so far
+ * calibrate cancel            drop the session
+ * calibrate default           back to the config curve
+ */
+static bool calibrateSession(uint8_t argc, char** argv) {
+    uint32_t referenceMl;
+    uint32_t runs = CALIBRATION_DEFAULT_RUNS;
+    if (strcmp(argv[1], "auto") == 0 && argc >= 3 && parseNumber(argv[2], &referenceMl) &&
+        (argc == 3 || parseNumber(argv[3], &runs))) {
+        if (runs > CALIBRATION_MAX_POINTS ||
+            !calibrationSessionStart(referenceMl, (uint8_t)runs)) {
+            return false;
+        }
+        replySession();
+        return true;
+    }
+    if (argc != 2) {
+        return false;
+    }
+    if (strcmp(argv[1], "done") == 0) {
+        uint8_t runCount = calibrationSession()->runCount;
+        if (!calibrationSessionFinish()) {
+            REPLY(CALIBRATE_NO_CURVE, (unsigned)runCount);
+            return true;
+        }
+        replyCurve();
+        return true;
+    }
+    if (strcmp(argv[1], "cancel") == 0) {
+        calibrationSessionCancel();
+        return true;
+    }
+    if (strcmp(argv[1], "default") == 0) {
+        calibrationRestoreDefault();
+        replyCurve();
+        return true;
+    }
+    return false;
+}
+
+/**
+ * calibrate            progress of the run or session, curve in use
+ * calibrate start      count from the next pulse
+ * calibrate stop <mL>  pulses per litre for the volume that flowed
+ * anything else        a session command (calibrateSession)
+ */
+static bool cmdCalibrate(uint8_t argc, char** argv) {
+    if (argc == 1) {
+        bool sessionActive = calibrationSession()->state != CALIBRATION_IDLE;
+        if (sessionActive) {
+            replySession();
+        }
+        if (!calibrating) {
+            if (!sessionActive) {
+                REPLY(CALIBRATE_IDLE);
+            }
+            replyCurve();
+            return true;
+        }
+        PulseReading reading;
+        pulseSourceRead(&reading);
+        REPLY(CALIBRATE_PROGRESS, (unsigned long)(reading.count - calibrateStartPulses),
+              (unsigned long)((hal_millis() - calibrateStartMs) / 1000),
+              (unsigned long)pulsesToMillilitres(ledgerAt(&reading) - calibrateStartLedger));
+        return true;
+    }
+
+    if (argc == 2 && strcmp(argv[1], "start") == 0) {
+        PulseReading reading;
+        pulseSourceRead(&reading);
+        calibrating = true;
+        calibrateStartPulses = reading.count;
+        calibrateStartLedger = ledgerAt(&reading);
+        calibrateStartMs = hal_millis();
+        REPLY(CALIBRATE_STARTED, (unsigned long long)calibrateStartPulses);
+        return true;
+    }
+
+    uint32_t referenceMl;
+    if (argc == 3 && strcmp(argv[1], "stop") == 0 && parseNumber(argv[2], &referenceMl) &&
+        referenceMl > 0) {
+        if (!calibrating) {
+            REPLY(CALIBRATE_IDLE);
+            return true;
+        }
+        calibrating = false;
+
+        // Pulses per litre in thousandths, and how far the calibration
+        // curve in use misses the reference volume
+        PulseReading reading;
+        pulseSourceRead(&reading);
+        uint64_t pulses = reading.count - calibrateStartPulses;
+        uint64_t measuredMl = pulsesToMillilitres(ledgerAt(&reading) - calibrateStartLedger);
+        uint64_t perLitreMilli = (pulses * 1000000 + referenceMl / 2) / referenceMl;
+        int64_t errorPermille =
+            ((int64_t)measuredMl - referenceMl) * 1000 / (int64_t)referenceMl;
+        REPLY(CALIBRATE_RESULT, (unsigned long)pulses, (unsigned long)referenceMl,
+              (unsigned long)(perLitreMilli / 1000), (unsigned long)(perLitreMilli % 1000),
+              (long)errorPermille);
+        return true;
+    }
+    return argc >= 2 && calibrateSession(argc, argv);
+}
+
+// set <name> <value> - runtime settings, applied at once
+struct ConsoleSetting {
+    const char* name;
+    uint32_t max;
+    bool (*apply)(uint32_t value);
+};
+
+static bool setBackend(uint32_t value) {
+    REPLY(CONSOLE_SET_BACKEND, (unsigned)selectPulseBackend((uint8_t)value));
+    return true;
+}
+
+static bool setClock(uint32_t value) {
+    if (!historySetClock(value)) {
+        return false;
+    }
+    consumptionUpdate();
+    REPLY(CONSOLE_SET_CLOCK, (unsigned long)historyNow());
+    return true;
+}
+
+static constexpr ConsoleSetting SETTINGS[] = {
+    {"backend", PULSE_BACKEND_PCNT, setBackend},
+    {"clock",   UINT32_MAX,         setClock},
+};
+
+static bool cmdSet(uint8_t argc, char** argv) {
+    uint32_t value;
+    if (argc != 3 || !parseNumber(argv[2], &value)) {
+        return false;
+    }
+    for (const ConsoleSetting& setting : SETTINGS) {
+        if (strcmp(argv[1], setting.name) == 0) {
+            if (value > setting.max || !setting.apply(value)) {
+                REPLY(CONSOLE_SET_REJECTED);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Stream callback of the history dump - stops after CONSOLE_DUMP_ROWS
+ * rows, the next poll carries on where it stopped
+ */
+static bool dumpRow(uint32_t startTime, uint32_t intervals, uint32_t pulses, void* context) {
+    uint8_t* rows = (uint8_t*)context;
+    REPLY(HISTORY_DUMP_ROW, (unsigned long)startTime, (unsigned long)intervals,
+          (unsigned long)pulses);
+    dumpFrom = startTime + intervals * historyIntervalSeconds((HistoryTier)dumpTier);
+    dumpIntervals += intervals;
+    return ++*rows < CONSOLE_DUMP_ROWS;
+}
+
+static void dumpContinue() {
+    uint8_t rows = 0;
+    historyQuery((HistoryTier)dumpTier, dumpFrom, dumpTo, dumpRow, &rows);
+    if (rows < CONSOLE_DUMP_ROWS) {
+        REPLY(HISTORY_DUMP_END, (unsigned long)dumpIntervals);
+        dumping = false;
+    }
+}
+
+static bool cmdDump(uint8_t argc, char** argv) {
+    static constexpr const char* TIER_NAMES[HISTORY_TIERS] = {"10s", "1m", "1h"};
+
+    if (argc != 3 || strcmp(argv[1], "history") != 0) {
+        return false;
+    }
+    for (uint8_t tier = 0; tier < HISTORY_TIERS; tier++) {
+        if (strcmp(argv[2], TIER_NAMES[tier]) == 0) {
+            dumping = true;
+            dumpTier = tier;
+            dumpFrom = 0;
+            dumpTo = historyNow() + 1;
+            dumpIntervals = 0;
+            REPLY(HISTORY_DUMP_START, (unsigned long)historyIntervalSeconds((HistoryTier)tier));
+            return true;
+        }
+    }
+    return false;
+}
+
+#if PULSE_TRACE_ENABLED
+
+#define TRACE_ROW_WORDS 6
+
+/**
+ * Send CONSOLE_DUMP_ROWS rows of the trace area as hex words, each with
+ * its offset so the host can tell a row lost to a full log ring
+ */
+static void exportContinue() {
+    for (uint8_t rows = 0; rows < CONSOLE_DUMP_ROWS; rows++) {
+        if (exportOffset >= exportEnd) {
+            REPLY(TRACE_EXPORT_END);
+            exporting = false;
+            return;
+        }
+        uint32_t words[TRACE_ROW_WORDS];
+        hal_flash_read(TRACE_OFFSET + exportOffset, words, sizeof(words));
+        REPLY(TRACE_EXPORT_ROW, (unsigned long)exportOffset, (unsigned long)words[0],
+              (unsigned long)words[1], (unsigned long)words[2], (unsigned long)words[3],
+              (unsigned long)words[4], (unsigned long)words[5]);
+        exportOffset += sizeof(words);
+    }
+}
+
+/**
+ * trace          capture state, or the size of the stored trace
+ * trace start    capture sensor edges (erases the stored trace)
+ * trace stop     end the capture
+ * trace export   send the stored trace for tools/trace_replay
+ */
+static bool cmdTrace(uint8_t argc, char** argv) {
+    if (argc == 1) {
+        const TraceStats* trace = traceStats();
+        if (traceCapturing()) {
+            REPLY(TRACE_CAPTURING, (unsigned long)trace->edges, (unsigned long)trace->bytes,
+                  (unsigned long)trace->dropped);
+        } else {
+            REPLY(TRACE_STORED, (unsigned long)traceLength());
+        }
+        return true;
+    }
+    if (argc != 2) {
+        return false;
+    }
+
+    if (strcmp(argv[1], "start") == 0) {
+        exporting = false;
+        if (!traceStart()) {
+            REPLY(TRACE_START_FAILED);
+        }
+        return true;
+    }
+    if (strcmp(argv[1], "stop") == 0) {
+        traceStop();
+        return true;
+    }
+    if (strcmp(argv[1], "export") == 0) {
+        traceStop();
+        exporting = true;
+        exportOffset = 0;
+        exportEnd = traceLength();
+        REPLY(TRACE_EXPORT_START, (unsigned long)exportEnd);
+        return true;
+    }
+    return false;
+}
+
+#endif // PULSE_TRACE_ENABLED
+
+static void replyTree(const UsageTree* tree) {
+    REPLY(USAGE_TREE, (unsigned)tree->count);
+    for (uint8_t i = 0; i < tree->count; i++) {
+        const UsageTreeNode* node = &tree->nodes[i];
+        REPLY(USAGE_NODE, (unsigned)i, (unsigned)node->feature, (unsigned)node->left,
+              (unsigned)node->right, (unsigned long)node->threshold);
+    }
+}
+
+/**
+ * usage                                   newest events (usage_events.h)
+ * usage tree                              classifier tree in use (or being edited)
+ * usage node <i> <0xFFLLRR> <threshold>   edit node i: feature, left, right
+ * usage store                             validate, apply and store the edit
+ * usage default                           back to the built-in tree
+ */
+static bool cmdUsage(uint8_t argc, char** argv) {
+    if (argc == 1) {
+        REPLY(USAGE_LIST, (unsigned long)usageEventCount());
+        const UsageEvent* event;
+        for (uint8_t back = 0; back < CONSOLE_DUMP_ROWS && (event = usageEvent(back)) != nullptr; back++) {
+            REPLY(USAGE_LIST_ROW, (unsigned long)event->seq, (unsigned long)event->startTime,
+                  (unsigned)event->channel, (unsigned)event->usageClass,
+                  (unsigned long)event->volumeMl, (unsigned long)event->durationS,
+                  (unsigned long)event->peakMlMin);
+        }
+        return true;
+    }
+
+    uint32_t node;
+    uint32_t links;
+    uint32_t threshold;
+    if (argc == 5 && strcmp(argv[1], "node") == 0 && parseNumber(argv[2], &node) &&
+        parseNumber(argv[3], &links) && parseNumber(argv[4], &threshold) &&
+        node < USAGE_TREE_MAX_NODES && links <= 0xFFFFFF) {
+        // Edits start from the tree in use and may add nodes at its end
+        if (!usageEditing) {
+            usageEdit = *usageTree();
+            usageEditing = true;
+        }
+        if (node > usageEdit.count) {
+            return false;
+        }
+        usageEdit.nodes[node] = { (uint8_t)(links >> 16), (uint8_t)(links >> 8), (uint8_t)links,
+                                  threshold };
+        if (node == usageEdit.count) {
+            usageEdit.count++;
+        }
+        REPLY(USAGE_TREE_EDIT, (unsigned)usageEdit.count);
+        return true;
+    }
+    if (argc != 2) {
+        return false;
+    }
+    if (strcmp(argv[1], "tree") == 0) {
+        replyTree(usageEditing ? &usageEdit : usageTree());
+        return true;
+    }
+    if (strcmp(argv[1], "store") == 0) {
+        if (!usageEditing || !usageStoreTree(&usageEdit)) {
+            REPLY(CONSOLE_SET_REJECTED);
+            return true;
+        }
+        usageEditing = false;
+        REPLY(USAGE_TREE_APPLIED, (unsigned)usageTree()->count);
+        return true;
+    }
+    if (strcmp(argv[1], "default") == 0) {
+        usageEditing = false;
+        usageRestoreDefault();
+        replyTree(usageTree());
+        return true;
+    }
+    return false;
+}
+
+/**
+ * reset counters - diagnostics only; the pulse ledger is never touched
+ * (pulse source counters are written by the ISR and stay as they are)
+ */
+static bool cmdReset(uint8_t argc, char** argv) {
+    if (argc != 2 || strcmp(argv[1], "counters") != 0) {
+        return false;
+    }
+    resetLatencyStats();
+    schedulerClearStats();
+    reportClearStats();
+    REPLY(CONSOLE_COUNTERS_RESET);
+    return true;
+}
+
+static constexpr ConsoleCommand COMMANDS[] = {
+    {"help",      cmdHelp,      LOG_ID_CONSOLE_HELP_HELP},
+    {"status",    cmdStatus,    LOG_ID_CONSOLE_HELP_STATUS},
+    {"stats",     cmdStats,     LOG_ID_CONSOLE_HELP_STATS},
+    {"calibrate", cmdCalibrate, LOG_ID_CONSOLE_HELP_CALIBRATE},
+    {"set",       cmdSet,       LOG_ID_CONSOLE_HELP_SET},
+    {"dump",      cmdDump,      LOG_ID_CONSOLE_HELP_DUMP},
+    {"reset",     cmdReset,     LOG_ID_CONSOLE_HELP_RESET},
+    {"usage",     cmdUsage,     LOG_ID_CONSOLE_HELP_USAGE},
+    #if PULSE_TRACE_ENABLED
+    {"trace",     cmdTrace,     LOG_ID_CONSOLE_HELP_TRACE},
+    #endif
+};
+
+// Checked at compile time: names are unique and fit on a line
+static constexpr bool sameName(const char* a, const char* b) {
+    while (*a != '\0' && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+static constexpr size_t nameLength(const char* name) {
+    size_t length = 0;
+    while (name[length] != '\0') {
+        length++;
+    }
+    return length;
+}
+
+static constexpr bool commandTableValid() {
+    for (const ConsoleCommand& command : COMMANDS) {
+        if (nameLength(command.name) == 0 || nameLength(command.name) > CONSOLE_LINE_MAX) {
+            return false;
+        }
+        size_t matches = 0;
+        for (const ConsoleCommand& other : COMMANDS) {
+            matches += sameName(command.name, other.name);
+        }
+        if (matches != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(commandTableValid(), "console command names must be unique and fit CONSOLE_LINE_MAX");
+
+static bool cmdHelp(uint8_t argc, char** argv) {
+    (void)argv;
+    if (argc != 1) {
+        return false;
+    }
+    for (const ConsoleCommand& command : COMMANDS) {
+        logWrite(command.help);
+    }
+    return true;
+}
+
+// ============================================================================
+// Line Handling
+// ============================================================================
+
+/**
+ * Split the line into words in place and run its command
+ */
+static void execute() {
+    char* argv[CONSOLE_MAX_WORDS];
+    uint8_t argc = 0;
+    bool tooMany = false;
+
+    char* p = line;
+    for (;;) {
+        while (*p == ' ' || *p == '\t') {
+            *p++ = '\0';
+        }
+        if (*p == '\0') {
+            break;
+        }
+        if (argc == CONSOLE_MAX_WORDS) {
+            tooMany = true;
+            break;
+        }
+        argv[argc++] = p;
+        while (*p != '\0' && *p != ' ' && *p != '\t') {
+            p++;
+        }
+    }
+
+    if (argc == 0) {
+        return;
+    }
+    for (const ConsoleCommand& command : COMMANDS) {
+        if (strcmp(argv[0], command.name) == 0) {
+            if (tooMany || !command.run(argc, argv)) {
+                REPLY(CONSOLE_USAGE);
+                logWrite(command.help);
+            }
+            return;
+        }
+    }
+    REPLY(CONSOLE_UNKNOWN);
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+void consolePoll() {
+    if (dumping) {
+        dumpContinue();
+    }
+    #if PULSE_TRACE_ENABLED
+    if (exporting) {
+        exportContinue();
+    }
+    #endif
+
+    // Bytes up to and including the first line end - the rest waits in
+    // the UART for the next poll
+    int c;
+    while ((c = hal_serial_read()) >= 0) {
+        if (c == '\r' || c == '\n') {
+            bool overflow = lineOverflow;
+            bool complete = lineLength > 0;
+            line[lineLength] = '\0';
+            lineLength = 0;
+            lineOverflow = false;
+
+            if (overflow) {
+                REPLY(CONSOLE_TOO_LONG, (unsigned)CONSOLE_LINE_MAX);
+                return;
+            }
+            if (complete) {
+                execute();
+                return;
+            }
+        } else if (c == '\b' || c == 0x7F) {
+            if (lineLength > 0) {
+                lineLength--;
+            }
+        } else if (lineLength < CONSOLE_LINE_MAX) {
+            line[lineLength++] = (char)c;
+        } else {
+            lineOverflow = true;
+        }
+    }
+}
+
+// ============================================================================
+// Test Support
+// ============================================================================
+
+void resetConsole() {
+    lineLength = 0;
+    lineOverflow = false;
+    calibrating = false;
+    calibrateStartPulses = 0;
+    calibrateStartLedger = 0;
+    calibrateStartMs = 0;
+    dumping = false;
+    dumpTier = 0;
+    dumpFrom = 0;
+    dumpTo = 0;
+    dumpIntervals = 0;
+    exporting = false;
+    exportOffset = 0;
+    exportEnd = 0;
+    usageEditing = false;
+}
+
+#endif // CONSOLE_ENABLED
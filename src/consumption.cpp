@@ -0,0 +1,349 @@
+/*
+ * Water Flow Meter - Consumption Buckets
+ * Zigbee Time sync, calendar periods and per-channel consumption buckets
+ */
+
+#include "consumption.h"
+#include "config_traits.h"
+#include "deferred_log.h"
+#include "flow_history.h"
+#include "flow_math.h"
+#include "flow_meter.h"
+#include "metering_cluster.h"
+#include "scheduler.h"
+
+// NVS key of the whole state, one blob: a save is a single atomic write,
+// and a blob of another size (FLOW_CHANNELS changed) is not loaded
+#define CONSUMPTION_KEY "consState"
+
+struct StoredConsumption {
+    int32_t day;             // Local day of the buckets
+    int32_t zoneOffsetS;
+    ConsumptionBuckets buckets[FLOW_CHANNELS];
+};
+
+#define SECONDS_PER_DAY 86400
+
+// Zone offsets LocalTime - Time may give (UTC-12 to UTC+14)
+#define ZONE_OFFSET_MIN (-12 * 3600)
+#define ZONE_OFFSET_MAX (14 * 3600)
+
+// Live ledgers by channel (consumptionBegin) and their values at boot,
+// buckets and their period
+static const uint64_t* ledgers = nullptr;
+static uint64_t bootLedgers[FLOW_CHANNELS];
+static ConsumptionBuckets buckets[FLOW_CHANNELS];
+static ConsumptionPeriod period = {};
+static bool dirty = false;               // Changed since the last NVS save
+
+static int32_t zoneOffsetS = TIME_ZONE_OFFSET_S;
+static bool timeSynced = false;
+
+static int rolloverJob = SCHEDULER_NO_JOB;
+static int syncJob = SCHEDULER_NO_JOB;
+
+// ============================================================================
+// Calendar
+// ============================================================================
+
+static int32_t floorDiv(int64_t a, int32_t b) {
+    int64_t q = a / b;
+    return (int32_t)(a % b != 0 && (a < 0) != (b < 0) ? q - 1 : q);
+}
+
+ConsumptionPeriod consumptionPeriod(int32_t day) {
+    ConsumptionPeriod p;
+    p.day = day;
+    // Day 2 (2000-01-03) is the first Monday
+    p.week = floorDiv((int64_t)day + 5, 7);
+
+    // Civil date from days since 0000-03-01, in 400-year eras (H. Hinnant)
+    int32_t z = day + 730425;
+    int32_t era = floorDiv(z, 146097);
+    int32_t doe = z - era * 146097;
+    int32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int32_t mp = (5 * doy + 2) / 153;
+    int32_t month = mp < 10 ? mp + 3 : mp - 9;
+    int32_t year = yoe + era * 400 + (month <= 2 ? 1 : 0);
+    p.month = (year - 2000) * 12 + month - 1;
+    return p;
+}
+
+int32_t consumptionDay(uint32_t deviceTime, int32_t zoneOffsetSeconds) {
+    return floorDiv((int64_t)deviceTime + zoneOffsetSeconds, SECONDS_PER_DAY);
+}
+
+uint32_t consumptionRolloverMs(int32_t day, uint32_t deviceTime, int32_t zoneOffsetSeconds) {
+    int64_t nextDay = ((int64_t)day + 1) * SECONDS_PER_DAY - zoneOffsetSeconds;
+    int64_t seconds = nextDay - deviceTime;
+    if (seconds < 1) {
+        seconds = 1;
+    } else if (seconds > SECONDS_PER_DAY) {
+        seconds = SECONDS_PER_DAY;
+    }
+    return (uint32_t)seconds * 1000;
+}
+
+// Previous month slot of a month index: the slot of month m is reused by
+// month m + 11, so the slots hold the 11 months before the current one
+static uint32_t monthSlot(int32_t month) {
+    return (uint32_t)(((month % (CONSUMPTION_MONTHS - 1)) + (CONSUMPTION_MONTHS - 1)) %
+                      (CONSUMPTION_MONTHS - 1));
+}
+
+static void closeMonth(ConsumptionBuckets* b, int32_t month, uint64_t pulses) {
+    uint32_t* slot = &b->monthPulses[monthSlot(month)];
+    b->yearPulses -= *slot;
+    *slot = pulses > UINT32_MAX ? UINT32_MAX : (uint32_t)pulses;
+    b->yearPulses += *slot;
+}
+
+// Pulses since a period started - none if the ledger went back (a ledger
+// restored from an older save than the buckets)
+static uint64_t pulsesSince(uint64_t ledger, uint64_t start) {
+    return ledger > start ? ledger - start : 0;
+}
+
+void consumptionRoll(ConsumptionBuckets* b, uint64_t ledger, const ConsumptionPeriod* from,
+                     const ConsumptionPeriod* to) {
+    b->yesterdayPulses = to->day == from->day + 1 ? pulsesSince(ledger, b->dayLedger) : 0;
+    b->dayLedger = ledger;
+    if (to->week != from->week) {
+        b->weekLedger = ledger;
+    }
+    if (to->month != from->month) {
+        closeMonth(b, from->month, pulsesSince(ledger, b->monthLedger));
+        // Months without a rollover (device off) used nothing we counted;
+        // only the last 11 have a slot
+        int32_t first = from->month + 1;
+        if (first < to->month - (CONSUMPTION_MONTHS - 1)) {
+            first = to->month - (CONSUMPTION_MONTHS - 1);
+        }
+        for (int32_t month = first; month < to->month; month++) {
+            closeMonth(b, month, 0);
+        }
+        b->monthLedger = ledger;
+    }
+}
+
+// ============================================================================
+// Persistence
+// ============================================================================
+
+static void startBuckets(ConsumptionBuckets* b, uint64_t ledger) {
+    *b = ConsumptionBuckets();
+    b->dayLedger = ledger;
+    b->weekLedger = ledger;
+    b->monthLedger = ledger;
+}
+
+/**
+ * Load the stored state - false if there is none
+ */
+static bool loadBuckets() {
+    StoredConsumption stored;
+    hal_nvs_begin(EEPROM_NAMESPACE, true);
+    bool found = hal_nvs_get_blob(CONSUMPTION_KEY, &stored, sizeof(stored));
+    hal_nvs_end();
+    if (!found) {
+        return false;
+    }
+    zoneOffsetS = stored.zoneOffsetS;
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        buckets[i] = stored.buckets[i];
+        // The year is the sum of the month slots, whatever was stored
+        buckets[i].yearPulses = 0;
+        for (uint32_t pulses : buckets[i].monthPulses) {
+            buckets[i].yearPulses += pulses;
+        }
+    }
+    period = consumptionPeriod(stored.day);
+    return true;
+}
+
+void consumptionSave() {
+    if (!dirty || !ledgers) {
+        return;
+    }
+    StoredConsumption stored = {};
+    stored.day = period.day;
+    stored.zoneOffsetS = zoneOffsetS;
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        stored.buckets[i] = buckets[i];
+    }
+    hal_nvs_begin(EEPROM_NAMESPACE, false);
+    hal_nvs_put_blob(CONSUMPTION_KEY, &stored, sizeof(stored));
+    hal_nvs_end();
+
+    dirty = false;
+    LOG(CONSUMPTION_SAVED, (long)period.day);
+}
+
+// ============================================================================
+// Time Sync
+// ============================================================================
+
+/**
+ * Ask the coordinator for its time; its answer re-arms the job for the
+ * next sync, no answer repeats the request after TIME_SYNC_RETRY
+ */
+static void syncJobRun() {
+    if (zigbeeConnected) {
+        hal_radio_read_time();
+    }
+    schedulerArm(syncJob, TIME_SYNC_RETRY_MS);
+}
+
+/**
+ * First sync since boot: the clock before it is not wall-clock time (the
+ * 2000 epoch on a first boot, the newest history after a power cut), so
+ * the water counted since boot belongs to the synced day. Roll to it at
+ * the ledger of boot - or of the last rollover since - not at the live one
+ */
+static void rollToSyncedDay() {
+    int32_t day = consumptionDay(historyNow(), zoneOffsetS);
+    if (day <= period.day) {
+        return;
+    }
+    ConsumptionPeriod next = consumptionPeriod(day);
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        uint64_t boundary = bootLedgers[i] > buckets[i].dayLedger ? bootLedgers[i]
+                                                                  : buckets[i].dayLedger;
+        consumptionRoll(&buckets[i], boundary, &period, &next);
+    }
+    LOG(CONSUMPTION_ROLLOVER, (long)period.day, (long)day);
+    period = next;
+    dirty = true;
+    consumptionPublish();
+}
+
+static void onTime(const HalTime* time) {
+    if (time->utcTime == HAL_TIME_INVALID || time->utcTime == 0) {
+        LOG(TIME_SYNC_INVALID);
+        return;
+    }
+
+    if (time->localTime != HAL_TIME_INVALID) {
+        int64_t offset = (int64_t)time->localTime - time->utcTime;
+        if (offset >= ZONE_OFFSET_MIN && offset <= ZONE_OFFSET_MAX && offset != zoneOffsetS) {
+            zoneOffsetS = (int32_t)offset;
+            dirty = true;
+        }
+    }
+
+    uint32_t now = historyNow();
+    if (historySetClock(time->utcTime)) {
+        if (!timeSynced) {
+            rollToSyncedDay();
+        }
+        LOG(TIME_SYNCED, (unsigned long)time->utcTime, (long)(zoneOffsetS / 60));
+    } else {
+        LOG(TIME_SYNC_BEHIND, (unsigned long)time->utcTime, (unsigned long)now);
+    }
+    timeSynced = true;
+    schedulerArm(syncJob, TIME_SYNC_INTERVAL_MS);
+    consumptionUpdate();
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+void consumptionBegin(const uint64_t* ledgerSource) {
+    ledgers = ledgerSource;
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        bootLedgers[i] = ledgers[i];
+    }
+
+    zoneOffsetS = TIME_ZONE_OFFSET_S;
+    if (loadBuckets()) {
+        LOG(CONSUMPTION_LOADED, (long)period.day);
+    } else {
+        period = consumptionPeriod(consumptionDay(historyNow(), zoneOffsetS));
+        for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+            startBuckets(&buckets[i], ledgers[i]);
+        }
+        dirty = true;
+        LOG(CONSUMPTION_NEW, (long)period.day);
+    }
+
+    hal_radio_on_time(onTime);
+    rolloverJob = schedulerAdd(consumptionUpdate, 0, 0);
+    syncJob = schedulerAdd(syncJobRun, 0, 0);
+    consumptionUpdate();
+}
+
+void consumptionUpdate() {
+    if (!ledgers) {
+        return;
+    }
+    uint32_t now = historyNow();
+    int32_t day = consumptionDay(now, zoneOffsetS);
+    if (day > period.day) {
+        ConsumptionPeriod next = consumptionPeriod(day);
+        for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+            consumptionRoll(&buckets[i], ledgers[i], &period, &next);
+        }
+        LOG(CONSUMPTION_ROLLOVER, (long)period.day, (long)day);
+        period = next;
+        dirty = true;
+        consumptionPublish();
+    }
+
+    // Next local midnight (a zone offset that moved back keeps today; a
+    // clock behind the stored day waits for it a day at a time)
+    schedulerArm(rolloverJob, consumptionRolloverMs(period.day, now, zoneOffsetS));
+}
+
+void consumptionTotals(uint8_t channel, ConsumptionTotals* totals) {
+    if (!ledgers) {
+        *totals = ConsumptionTotals();
+        return;
+    }
+    const ConsumptionBuckets* b = &buckets[channel];
+    uint64_t ledger = ledgers[channel];
+    uint64_t month = pulsesSince(ledger, b->monthLedger);
+    totals->todayMl = pulsesToMillilitres(pulsesSince(ledger, b->dayLedger));
+    totals->yesterdayMl = pulsesToMillilitres(b->yesterdayPulses);
+    totals->weekMl = pulsesToMillilitres(pulsesSince(ledger, b->weekLedger));
+    totals->monthMl = pulsesToMillilitres(month);
+    totals->yearMl = pulsesToMillilitres(b->yearPulses + month);
+}
+
+void consumptionPublish() {
+    if (!ledgers) {
+        return;
+    }
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        ConsumptionTotals totals;
+        consumptionTotals(i, &totals);
+        meteringSetConsumption(&totals, i);
+    }
+}
+
+int32_t consumptionZoneOffset() {
+    return zoneOffsetS;
+}
+
+bool consumptionTimeSynced() {
+    return timeSynced;
+}
+
+// ============================================================================
+// Test Support
+// ============================================================================
+
+void resetConsumption() {
+    ledgers = nullptr;
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        buckets[i] = ConsumptionBuckets();
+        bootLedgers[i] = 0;
+    }
+    period = ConsumptionPeriod();
+    dirty = false;
+    zoneOffsetS = TIME_ZONE_OFFSET_S;
+    timeSynced = false;
+    rolloverJob = SCHEDULER_NO_JOB;
+    syncJob = SCHEDULER_NO_JOB;
+}
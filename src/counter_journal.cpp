@@ -0,0 +1,124 @@
+/*
+ * Water Flow Meter - Counter Journal
+ * Wear-leveled, append-only journal for the pulse ledger on raw flash
+ */
+
+#include "counter_journal.h"
+#include "crc32.h"
+#include <string.h>
+
+static uint32_t slotOffset(const CounterJournal* journal, uint16_t sector, uint16_t slot) {
+    return journal->baseOffset + (uint32_t)sector * HAL_FLASH_SECTOR_SIZE
+         + (uint32_t)slot * JOURNAL_RECORD_SIZE;
+}
+
+static uint32_t recordCrc(const JournalRecord* record) {
+    return crc32(record, offsetof(JournalRecord, crc));
+}
+
+/**
+ * Read a slot; returns true only for a record with a valid CRC
+ * erased is set when the slot still reads as all 0xFF
+ */
+static bool readSlot(const CounterJournal* journal, uint16_t sector, uint16_t slot,
+                     JournalRecord* record, bool* erased) {
+    if (!hal_flash_read(slotOffset(journal, sector, slot), record, sizeof(*record))) {
+        *erased = false;
+        return false;
+    }
+
+    static const uint8_t blank[JOURNAL_RECORD_SIZE] = {
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+    };
+    *erased = memcmp(record, blank, sizeof(*record)) == 0;
+    return !*erased && record->crc == recordCrc(record);
+}
+
+void journalBegin(CounterJournal* journal, uint32_t offset, uint16_t sectors) {
+    journal->baseOffset = offset;
+    journal->sectors = sectors;
+    journal->seq = 0;
+
+    // Until recovered, the next append starts a fresh sector 0
+    journal->sector = sectors - 1;
+    journal->slot = JOURNAL_SLOTS_PER_SECTOR;
+}
+
+bool journalRecover(CounterJournal* journal, uint64_t* value) {
+    JournalRecord record;
+    bool erased;
+
+    // 1. Active sector = highest sequence number in slot 0
+    bool found = false;
+    uint16_t active = 0;
+    uint32_t activeSeq = 0;
+
+    for (uint16_t sector = 0; sector < journal->sectors; sector++) {
+        if (readSlot(journal, sector, 0, &record, &erased) &&
+            (!found || (int32_t)(record.seq - activeSeq) > 0)) {
+            found = true;
+            active = sector;
+            activeSeq = record.seq;
+        }
+    }
+
+    if (!found) {
+        journalBegin(journal, journal->baseOffset, journal->sectors);
+        return false;
+    }
+
+    // 2. Binary search for the first erased slot (slot 0 is known written)
+    uint16_t lo = 1;
+    uint16_t hi = JOURNAL_SLOTS_PER_SECTOR;
+    while (lo < hi) {
+        uint16_t mid = lo + (hi - lo) / 2;
+        readSlot(journal, active, mid, &record, &erased);
+        if (erased) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    // 3. Walk back past any torn record to the newest valid one
+    uint16_t slot = lo;
+    while (slot > 0) {
+        slot--;
+        if (readSlot(journal, active, slot, &record, &erased)) {
+            break;
+        }
+    }
+
+    journal->sector = active;
+    journal->slot = lo;
+    journal->seq = record.seq;
+    *value = record.value;
+    return true;
+}
+
+bool journalAppend(CounterJournal* journal, uint64_t value) {
+    if (journal->slot >= JOURNAL_SLOTS_PER_SECTOR) {
+        // Current sector full - move round the ring and erase the oldest
+        journal->sector = (journal->sector + 1) % journal->sectors;
+        journal->slot = 0;
+        if (!hal_flash_erase(slotOffset(journal, journal->sector, 0), HAL_FLASH_SECTOR_SIZE)) {
+            return false;
+        }
+    }
+
+    JournalRecord record;
+    record.value = value;
+    record.seq = journal->seq + 1;
+    record.crc = recordCrc(&record);
+
+    // Slot is consumed even if the write fails - never program it twice
+    uint32_t offset = slotOffset(journal, journal->sector, journal->slot);
+    journal->slot++;
+    if (!hal_flash_write(offset, &record, sizeof(record))) {
+        return false;
+    }
+
+    journal->seq = record.seq;
+    return true;
+}
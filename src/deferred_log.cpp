@@ -0,0 +1,314 @@
+/*
+ * Water Flow Meter - Deferred Logger
+ * Lock-free single producer / single consumer ring of binary log records
+ */
+
+#include "deferred_log.h"
+#include <stdio.h>
+#include <string.h>
+
+// ============================================================================
+// Message Table
+// ============================================================================
+
+#define LOG_X_ENTRY(name, level, format) { level, format },
+static const struct {
+    uint8_t level;
+    const char* format;
+} messages[LOG_MSG_COUNT] = {
+    LOG_MESSAGES(LOG_X_ENTRY)
+};
+#undef LOG_X_ENTRY
+
+const char* logMessageFormat(uint16_t id) {
+    return id < LOG_MSG_COUNT ? messages[id].format : nullptr;
+}
+
+uint8_t logMessageLevel(uint16_t id) {
+    return id < LOG_MSG_COUNT ? messages[id].level : 0;
+}
+
+// ============================================================================
+// Ring Buffer
+// ============================================================================
+
+// Free-running word counters: head is only written by the producer (main
+// task), tail only by the consumer (drain task)
+static uint32_t ring[LOG_BUFFER_WORDS];
+static uint32_t head = 0;
+static uint32_t tail = 0;
+static LogStats stats;
+static uint32_t droppedReported = 0;
+
+#define RING_MASK (LOG_BUFFER_WORDS - 1)
+
+void logWriteWords(uint16_t id, const uint32_t* words, uint8_t wordCount) {
+    if (wordCount > LOG_MAX_ARG_WORDS) {
+        wordCount = LOG_MAX_ARG_WORDS;
+    }
+
+    uint32_t start = head;
+    uint32_t used = start - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+    uint32_t size = LOG_HEADER_WORDS + wordCount;
+    if (LOG_BUFFER_WORDS - used < size) {
+        stats.dropped++;
+        return;
+    }
+
+    ring[start & RING_MASK] = id | ((uint32_t)wordCount << 16);
+    ring[(start + 1) & RING_MASK] = hal_millis();
+    for (uint8_t i = 0; i < wordCount; i++) {
+        ring[(start + LOG_HEADER_WORDS + i) & RING_MASK] = words[i];
+    }
+
+    // Publish, then wake the drain if it may have seen the ring empty -
+    // one wake-up per burst, and none can be lost between the two checks
+    __atomic_store_n(&head, start + size, __ATOMIC_SEQ_CST);
+    stats.records++;
+    if (used + size > stats.maxUsedWords) {
+        stats.maxUsedWords = used + size;
+    }
+    if (__atomic_load_n(&tail, __ATOMIC_SEQ_CST) == start) {
+        hal_drain_task_wake();
+    }
+}
+
+bool logRead(LogRecord* record) {
+    uint32_t start = tail;
+    if (__atomic_load_n(&head, __ATOMIC_SEQ_CST) == start) {
+        return false;
+    }
+
+    uint32_t header = ring[start & RING_MASK];
+    record->id = header & 0xFFFF;
+    record->wordCount = (header >> 16) & 0xFF;
+    record->timestampMs = ring[(start + 1) & RING_MASK];
+    for (uint8_t i = 0; i < record->wordCount; i++) {
+        record->words[i] = ring[(start + LOG_HEADER_WORDS + i) & RING_MASK];
+    }
+
+    __atomic_store_n(&tail, start + LOG_HEADER_WORDS + record->wordCount, __ATOMIC_SEQ_CST);
+    stats.drained++;
+    return true;
+}
+
+const LogStats* logStats() {
+    return &stats;
+}
+
+// ============================================================================
+// Formatting
+// ============================================================================
+
+static size_t append(char* out, size_t len, size_t pos, const char* text, size_t n) {
+    if (pos + 1 >= len) {
+        return pos;
+    }
+    if (n > len - 1 - pos) {
+        n = len - 1 - pos;
+    }
+    memcpy(out + pos, text, n);
+    return pos + n;
+}
+
+size_t logFormat(const LogRecord* record, char* out, size_t len) {
+    if (len == 0) {
+        return 0;
+    }
+    const char* fmt = logMessageFormat(record->id);
+    if (!fmt) {
+        int n = snprintf(out, len, "[Log] unknown message %u", record->id);
+        return n < 0 ? 0 : ((size_t)n < len ? (size_t)n : len - 1);
+    }
+
+    size_t pos = 0;
+    uint8_t word = 0;
+
+    while (*fmt) {
+        if (*fmt != '%') {
+            const char* literal = fmt;
+            while (*fmt && *fmt != '%') {
+                fmt++;
+            }
+            pos = append(out, len, pos, literal, fmt - literal);
+            continue;
+        }
+
+        if (fmt[1] == '%') {
+            pos = append(out, len, pos, "%", 1);
+            fmt += 2;
+            continue;
+        }
+
+        // Rebuild the conversion spec: flags, width, precision, length
+        char spec[16];
+        size_t s = 0;
+        spec[s++] = *fmt++;
+        while (*fmt && strchr("-+ #0123456789.", *fmt) && s < sizeof(spec) - 5) {
+            spec[s++] = *fmt++;
+        }
+        bool wide = false;
+        if (fmt[0] == 'l' && fmt[1] == 'l') {
+            wide = true;
+            fmt += 2;
+        } else if (fmt[0] == 'h' && fmt[1] == 'h') {
+            spec[s++] = 'h';
+            spec[s++] = 'h';
+            fmt += 2;
+        } else if (*fmt == 'h') {
+            spec[s++] = *fmt++;
+        } else if (*fmt && strchr("lzjt", *fmt)) {
+            fmt++;   // 32-bit on the target
+        }
+        if (wide) {
+            spec[s++] = 'l';
+            spec[s++] = 'l';
+        }
+
+        char conv = *fmt;
+        if (conv) {
+            fmt++;
+        }
+        spec[s++] = conv;
+        spec[s] = '\0';
+
+        uint8_t need = wide ? 2 : 1;
+        if (!strchr("diuxXoc", conv) || conv == '\0' || word + need > record->wordCount) {
+            pos = append(out, len, pos, "?", 1);
+            continue;
+        }
+
+        char value[24];
+        int n;
+        bool isSigned = conv == 'd' || conv == 'i';
+        if (wide) {
+            uint64_t v = record->words[word] | ((uint64_t)record->words[word + 1] << 32);
+            n = isSigned ? snprintf(value, sizeof(value), spec, (long long)v)
+                         : snprintf(value, sizeof(value), spec, (unsigned long long)v);
+        } else {
+            uint32_t v = record->words[word];
+            n = isSigned ? snprintf(value, sizeof(value), spec, (int)(int32_t)v)
+                         : snprintf(value, sizeof(value), spec, (unsigned int)v);
+        }
+        word += need;
+        if (n > 0) {
+            pos = append(out, len, pos, value, (size_t)n < sizeof(value) ? n : sizeof(value) - 1);
+        }
+    }
+
+    out[pos] = '\0';
+    return pos;
+}
+
+// ============================================================================
+// Binary Frames
+// ============================================================================
+
+static void putU32(uint8_t* out, uint32_t value) {
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+    out[2] = (value >> 16) & 0xFF;
+    out[3] = (value >> 24) & 0xFF;
+}
+
+static uint32_t getU32(const uint8_t* data) {
+    return data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static uint8_t frameChecksum(const uint8_t* data, size_t len) {
+    uint8_t sum = 0;
+    for (size_t i = 0; i < len; i++) {
+        sum += data[i];
+    }
+    return ~sum;
+}
+
+size_t logEncodeFrame(const LogRecord* record, uint8_t* out) {
+    out[0] = LOG_FRAME_SYNC;
+    out[1] = record->id & 0xFF;
+    out[2] = record->id >> 8;
+    out[3] = record->wordCount;
+    putU32(out + 4, record->timestampMs);
+    for (uint8_t i = 0; i < record->wordCount; i++) {
+        putU32(out + 8 + i * 4, record->words[i]);
+    }
+    size_t body = 8 + record->wordCount * 4;
+    out[body] = frameChecksum(out + 1, body - 1);
+    return body + 1;
+}
+
+size_t logDecodeFrame(const uint8_t* data, size_t len, LogRecord* record) {
+    if (len < LOG_FRAME_OVERHEAD || data[0] != LOG_FRAME_SYNC || data[3] > LOG_MAX_ARG_WORDS) {
+        return 0;
+    }
+    size_t body = 8 + data[3] * 4;
+    if (len < body + 1 || data[body] != frameChecksum(data + 1, body - 1)) {
+        return 0;
+    }
+
+    record->id = data[1] | (data[2] << 8);
+    record->wordCount = data[3];
+    record->timestampMs = getU32(data + 4);
+    for (uint8_t i = 0; i < record->wordCount; i++) {
+        record->words[i] = getU32(data + 8 + i * 4);
+    }
+    return body + 1;
+}
+
+// ============================================================================
+// Drain
+// ============================================================================
+
+static void outputRecord(const LogRecord* record) {
+    #if LOG_BINARY_OUTPUT
+    uint8_t frame[LOG_FRAME_MAX];
+    hal_debug_write(frame, logEncodeFrame(record, frame));
+    #else
+    char line[LOG_LINE_MAX + 1];
+    size_t len = logFormat(record, line, LOG_LINE_MAX);
+    line[len++] = '\n';
+    hal_debug_write(line, len);
+    #endif
+}
+
+uint32_t logDrain(uint32_t maxRecords) {
+    uint32_t output = 0;
+    LogRecord record;
+
+    while ((maxRecords == 0 || output < maxRecords) && logRead(&record)) {
+        outputRecord(&record);
+        output++;
+    }
+
+    // Report losses once the ring has room to spare again
+    uint32_t dropped = stats.dropped;
+    if (dropped != droppedReported) {
+        record.id = LOG_ID_LOG_DROPPED;
+        record.wordCount = 1;
+        record.timestampMs = hal_millis();
+        record.words[0] = dropped - droppedReported;
+        outputRecord(&record);
+        droppedReported = dropped;
+    }
+
+    return output;
+}
+
+static void drainTask() {
+    logDrain(0);
+}
+
+void logBegin() {
+    hal_drain_task_begin(drainTask);
+}
+
+// ============================================================================
+// Test Support
+// ============================================================================
+
+void resetDeferredLog() {
+    head = 0;
+    tail = 0;
+    stats = LogStats();
+    droppedReported = 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * Water Flow Meter - Flow Rate Estimator
+ * Adaptive period/count flow rate estimation from pulse edge timestamps
+ */
+
+#include "flow_estimator.h"
+#include "config_traits.h"
+
+void flowEstimatorReset(FlowEstimator* est) {
+    est->refCount = 0;
+    est->refEdgeUs = 0;
+    est->rateMlMin = 0;
+    est->hasReference = false;
+    est->partialWindow = false;
+}
+
+// Periods beyond 2^32 us (71 min) are far past the idle timeout anyway
+static inline uint32_t clampUs(uint64_t us) {
+    return us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+}
+
+uint32_t flowEstimatorUpdate(FlowEstimator* est, uint64_t count, uint64_t lastEdgeUs,
+                             uint64_t nowUs, bool windowComplete) {
+    uint64_t pulses = count - est->refCount;
+
+    // First edge after idle only sets the reference - a rate needs two edges
+    if (!est->hasReference) {
+        if (pulses > 0) {
+            est->refCount = count;
+            est->refEdgeUs = lastEdgeUs;
+            est->hasReference = true;
+            est->partialWindow = !windowComplete;
+        }
+        return est->rateMlMin;
+    }
+
+    if (pulses == 0) {
+        uint64_t sinceEdgeUs = nowUs - est->refEdgeUs;
+
+        if (sinceEdgeUs > FLOW_IDLE_TIMEOUT_US) {
+            // Flow stopped - next edge starts a new measurement
+            est->rateMlMin = 0;
+            est->hasReference = false;
+        } else {
+            // No edge for sinceEdgeUs means the rate is at most one pulse
+            // per that long - lets the estimate fall smoothly when flow stops
+            uint32_t bound = periodToFlowRate(1, clampUs(sinceEdgeUs));
+            if (bound < est->rateMlMin) {
+                est->rateMlMin = bound;
+            }
+        }
+        return est->rateMlMin;
+    }
+
+    if (pulses >= FLOW_PERIOD_METHOD_MAX_PULSES && windowComplete && !est->partialWindow) {
+        // Count method: enough pulses in a full window for 1-pulse resolution
+        est->rateMlMin = windowPulsesToFlowRate((uint32_t)pulses);
+    } else {
+        // Period method: pulses over the exact time between reference edges
+        est->rateMlMin = periodToFlowRate((uint32_t)pulses, clampUs(lastEdgeUs - est->refEdgeUs));
+    }
+
+    est->refCount = count;
+    est->refEdgeUs = lastEdgeUs;
+    est->partialWindow = !windowComplete;
+    return est->rateMlMin;
+}
@@ -0,0 +1,578 @@
+/*
+ * Water Flow Meter - Flow History
+ * Delta + varint interval history in RAM blocks spilling to flash rings
+ */
+
+#include "flow_history.h"
+#include "config_traits.h"
+#include "crc32.h"
+#include "scheduler.h"
+#include <string.h>
+
+#define HISTORY_MAX_INTERVALS 0xFFFF   // Per block (uint16 in the header)
+
+struct HistoryTierState {
+    // Flash ring
+    uint32_t baseOffset;
+    uint16_t sectors;
+    uint16_t sector;                   // Sector holding the newest block
+    uint32_t offset;                   // Next free byte in that sector
+    uint32_t seq;                      // Sequence of the newest block
+    bool hasBlocks;                    // Anything in flash at all
+
+    // Current (still open) interval
+    uint32_t intervalStart;
+    uint64_t intervalLedger;
+
+    // RAM block: closed intervals from blockStart up to intervalStart
+    uint32_t blockStart;
+    uint64_t blockLedger;
+    uint16_t intervals;
+    uint16_t length;
+    uint32_t pendingZeros;             // Idle run not yet encoded
+    bool hasFlow;                      // Any non-zero interval in the block
+    uint8_t data[HISTORY_BLOCK_BYTES];
+};
+
+static const uint32_t intervalSeconds[HISTORY_TIERS] = { 10, 60, 3600 };
+static const uint16_t tierSectors[HISTORY_TIERS] = {
+    HISTORY_SECTORS_10S, HISTORY_SECTORS_1MIN, HISTORY_SECTORS_1H
+};
+
+// Age (s) at which the flush job spills a block holding flow - the hourly
+// tier would otherwise pay a block header for every hour or two of data
+static const uint32_t tierFlushAge[HISTORY_TIERS] = {
+    HISTORY_FLUSH_INTERVAL_S, HISTORY_FLUSH_INTERVAL_S, HISTORY_FLUSH_AGE_1H
+};
+
+static HistoryTierState tiers[HISTORY_TIERS];
+static const uint64_t* ledger = nullptr;
+static bool flashReady = false;
+static HistoryStats stats;
+static int flushJob = SCHEDULER_NO_JOB;
+
+// Device clock: whole seconds in clockBase, plus the milliseconds since
+// the last whole second (wrap-safe, folded in on every read)
+static uint32_t clockBase = 0;
+static uint32_t clockLastMs = 0;
+static uint32_t clockElapsedMs = 0;
+
+// ============================================================================
+// Varint Encoding
+// ============================================================================
+
+size_t historyPutVarint(uint8_t* out, uint64_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+size_t historyGetVarint(const uint8_t* data, size_t len, uint64_t* value) {
+    uint64_t result = 0;
+    for (size_t i = 0; i < len && i < 10; i++) {
+        result |= (uint64_t)(data[i] & 0x7F) << (7 * i);
+        if (!(data[i] & 0x80)) {
+            *value = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+static size_t varintLength(uint64_t value) {
+    size_t n = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        n++;
+    }
+    return n;
+}
+
+// ============================================================================
+// Flash Blocks
+// ============================================================================
+
+static uint32_t blockCrc(const HistoryBlockHeader* header, const uint8_t* data) {
+    return crc32Update(crc32(header, offsetof(HistoryBlockHeader, crc)), data, header->length);
+}
+
+/**
+ * Read and check the block at offset - data receives the encoded bytes
+ * erased is set when the header still reads as all 0xFF
+ */
+static bool readBlock(const HistoryTierState* t, uint8_t tier, uint16_t sector, uint32_t offset,
+                      HistoryBlockHeader* header, uint8_t* data, bool* erased) {
+    *erased = false;
+    if (offset + HISTORY_HEADER_SIZE > HAL_FLASH_SECTOR_SIZE) {
+        return false;
+    }
+    uint32_t base = t->baseOffset + (uint32_t)sector * HAL_FLASH_SECTOR_SIZE + offset;
+    if (!hal_flash_read(base, header, sizeof(*header))) {
+        return false;
+    }
+    if (header->magic == 0xFFFF) {
+        *erased = true;
+        return false;
+    }
+    if (header->magic != HISTORY_BLOCK_MAGIC || header->tier != tier ||
+        header->length > HISTORY_BLOCK_BYTES ||
+        offset + HISTORY_HEADER_SIZE + header->length > HAL_FLASH_SECTOR_SIZE) {
+        return false;
+    }
+    return hal_flash_read(base + HISTORY_HEADER_SIZE, data, header->length) &&
+           header->crc == blockCrc(header, data);
+}
+
+static void writeBlock(HistoryTierState* t, uint8_t tier) {
+    uint32_t size = HISTORY_HEADER_SIZE + t->length;
+    if (t->offset + size > HAL_FLASH_SECTOR_SIZE) {
+        // Sector full - move round the ring and erase the oldest
+        t->sector = (t->sector + 1) % t->sectors;
+        t->offset = 0;
+        hal_flash_erase(t->baseOffset + (uint32_t)t->sector * HAL_FLASH_SECTOR_SIZE,
+                        HAL_FLASH_SECTOR_SIZE);
+        stats.sectorErases++;
+    }
+
+    HistoryBlockHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = HISTORY_BLOCK_MAGIC;
+    header.tier = tier;
+    header.length = t->length;
+    header.intervals = t->intervals;
+    header.startTime = t->blockStart;
+    header.seq = t->seq + 1;
+    header.startLedger = t->blockLedger;
+    header.crc = blockCrc(&header, t->data);
+
+    // Space is consumed even if the write fails - never program it twice
+    uint32_t base = t->baseOffset + (uint32_t)t->sector * HAL_FLASH_SECTOR_SIZE + t->offset;
+    t->offset += size;
+    if (hal_flash_write(base, &header, sizeof(header)) &&
+        hal_flash_write(base + HISTORY_HEADER_SIZE, t->data, t->length)) {
+        t->seq = header.seq;
+        t->hasBlocks = true;
+        stats.blocksWritten++;
+        stats.bytesWritten += size;
+        stats.tierBytes[tier] += size;
+    }
+}
+
+/**
+ * Find the newest block of a tier: the sector whose first block has the
+ * highest sequence, then walk that sector's blocks
+ * Returns the end time of the newest block (0 if none)
+ */
+static uint32_t recoverTier(uint8_t tier) {
+    HistoryTierState* t = &tiers[tier];
+    HistoryBlockHeader header;
+    uint8_t data[HISTORY_BLOCK_BYTES];
+    bool erased;
+
+    // Until something is found, the first block goes to a fresh sector 0
+    t->sector = t->sectors - 1;
+    t->offset = HAL_FLASH_SECTOR_SIZE;
+    t->seq = 0;
+    t->hasBlocks = false;
+
+    for (uint16_t sector = 0; sector < t->sectors; sector++) {
+        if (readBlock(t, tier, sector, 0, &header, data, &erased) &&
+            (!t->hasBlocks || (int32_t)(header.seq - t->seq) > 0)) {
+            t->hasBlocks = true;
+            t->sector = sector;
+            t->seq = header.seq;
+        }
+    }
+    if (!t->hasBlocks) {
+        return 0;
+    }
+
+    uint32_t endTime = 0;
+    uint32_t offset = 0;
+    while (offset < HAL_FLASH_SECTOR_SIZE) {
+        if (readBlock(t, tier, t->sector, offset, &header, data, &erased)) {
+            t->seq = header.seq;
+            endTime = header.startTime + header.intervals * intervalSeconds[tier];
+            offset += HISTORY_HEADER_SIZE + header.length;
+        } else if (erased) {
+            break;
+        } else {
+            // Torn or unreadable block of unknown size - start the next
+            // block in a fresh sector rather than program over it
+            offset = HAL_FLASH_SECTOR_SIZE;
+        }
+    }
+    t->offset = offset;
+    return endTime;
+}
+
+// ============================================================================
+// RAM Blocks
+// ============================================================================
+
+static void emitPendingZeros(HistoryTierState* t) {
+    if (t->pendingZeros > 0) {
+        t->length += historyPutVarint(t->data + t->length, ((uint64_t)t->pendingZeros << 1) | 1);
+        t->pendingZeros = 0;
+    }
+}
+
+/**
+ * Close the RAM block (spilling it to flash) and open the next one where
+ * it ended
+ */
+static void sealBlock(uint8_t tier) {
+    HistoryTierState* t = &tiers[tier];
+    if (t->intervals == 0) {
+        return;
+    }
+    emitPendingZeros(t);
+    if (flashReady) {
+        writeBlock(t, tier);
+    }
+
+    // Ledger at the block end = start + every count encoded in it
+    uint64_t endLedger = t->blockLedger;
+    size_t pos = 0;
+    while (pos < t->length) {
+        uint64_t token = 0;
+        size_t used = historyGetVarint(t->data + pos, t->length - pos, &token);
+        if (used == 0) {
+            break;
+        }
+        pos += used;
+        if (!(token & 1)) {
+            endLedger += token >> 1;
+        }
+    }
+
+    t->blockStart += t->intervals * intervalSeconds[tier];
+    t->blockLedger = endLedger;
+    t->intervals = 0;
+    t->length = 0;
+    t->hasFlow = false;
+}
+
+static void appendZeros(uint8_t tier, uint32_t count) {
+    HistoryTierState* t = &tiers[tier];
+    while (count > 0) {
+        uint32_t room = HISTORY_MAX_INTERVALS - t->intervals;
+        uint32_t take = count < room ? count : room;
+        if (take == 0 ||
+            t->length + varintLength(((uint64_t)(t->pendingZeros + take) << 1) | 1) > HISTORY_BLOCK_BYTES) {
+            sealBlock(tier);
+            continue;
+        }
+        t->pendingZeros += take;
+        t->intervals += take;
+        count -= take;
+    }
+}
+
+static void appendCount(uint8_t tier, uint32_t pulses) {
+    if (pulses == 0) {
+        appendZeros(tier, 1);
+        return;
+    }
+
+    HistoryTierState* t = &tiers[tier];
+    uint64_t token = (uint64_t)pulses << 1;
+    size_t zeroLength = t->pendingZeros ? varintLength(((uint64_t)t->pendingZeros << 1) | 1) : 0;
+    if (t->length + zeroLength + varintLength(token) > HISTORY_BLOCK_BYTES ||
+        t->intervals == HISTORY_MAX_INTERVALS) {
+        sealBlock(tier);
+    }
+
+    emitPendingZeros(t);
+    t->length += historyPutVarint(t->data + t->length, token);
+    t->intervals++;
+    t->hasFlow = true;
+}
+
+/**
+ * Close the intervals of a tier that ended by now - the first gets every
+ * pulse since it started, any further ones were idle
+ */
+static void closeIntervals(uint8_t tier, uint32_t now) {
+    HistoryTierState* t = &tiers[tier];
+    uint32_t seconds = intervalSeconds[tier];
+    if (now - t->intervalStart < seconds) {
+        return;
+    }
+
+    uint32_t ended = (now - t->intervalStart) / seconds;
+    uint64_t pulses = *ledger - t->intervalLedger;
+    appendCount(tier, pulses > 0xFFFFFFFFULL ? 0xFFFFFFFFUL : (uint32_t)pulses);
+    appendZeros(tier, ended - 1);
+
+    t->intervalStart += ended * seconds;
+    t->intervalLedger = *ledger;
+}
+
+/**
+ * Start all tiers at the interval containing now
+ */
+static void openTiers(uint32_t now) {
+    for (uint8_t tier = 0; tier < HISTORY_TIERS; tier++) {
+        HistoryTierState* t = &tiers[tier];
+        t->intervalStart = now - now % intervalSeconds[tier];
+        t->blockStart = t->intervalStart;
+        t->blockLedger = t->intervalLedger;
+        t->intervals = 0;
+        t->length = 0;
+        t->pendingZeros = 0;
+        t->hasFlow = false;
+    }
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+uint32_t historyNow() {
+    uint32_t nowMs = hal_millis();
+    clockElapsedMs += nowMs - clockLastMs;
+    clockLastMs = nowMs;
+    // 32-bit division by a constant - a multiply, not a 64-bit libcall
+    uint32_t seconds = clockElapsedMs / 1000;
+    clockBase += seconds;
+    clockElapsedMs -= seconds * 1000;
+    return clockBase;
+}
+
+uint32_t historyIntervalSeconds(HistoryTier tier) {
+    return intervalSeconds[tier];
+}
+
+static void flushJobRun() {
+    historyUpdate();
+    uint32_t now = historyNow();
+    for (uint8_t tier = 0; tier < HISTORY_TIERS; tier++) {
+        if (tiers[tier].hasFlow && now - tiers[tier].blockStart >= tierFlushAge[tier]) {
+            sealBlock(tier);
+        }
+    }
+}
+
+void historyBegin(const uint64_t* ledgerSource) {
+    ledger = ledgerSource;
+    flashReady = hal_flash_begin(DATA_PARTITION_LABEL);
+
+    uint32_t offset = HISTORY_OFFSET;
+    uint32_t resumeTime = 0;
+    for (uint8_t tier = 0; tier < HISTORY_TIERS; tier++) {
+        tiers[tier].baseOffset = offset;
+        tiers[tier].sectors = tierSectors[tier];
+        tiers[tier].intervalLedger = *ledger;
+        offset += tierSectors[tier] * HAL_FLASH_SECTOR_SIZE;
+
+        uint32_t endTime = flashReady ? recoverTier(tier) : 0;
+        if (endTime > resumeTime) {
+            resumeTime = endTime;
+        }
+    }
+
+    clockLastMs = hal_millis();
+    clockElapsedMs = 0;
+    clockBase = resumeTime;
+    openTiers(historyNow());
+
+    flushJob = schedulerAdd(flushJobRun, HISTORY_FLUSH_INTERVAL, HISTORY_FLUSH_INTERVAL);
+}
+
+void historyUpdate() {
+    if (!ledger) {
+        return;
+    }
+    uint32_t now = historyNow();
+    for (uint8_t tier = 0; tier < HISTORY_TIERS; tier++) {
+        closeIntervals(tier, now);
+    }
+}
+
+void historyFlush() {
+    for (uint8_t tier = 0; tier < HISTORY_TIERS; tier++) {
+        if (tiers[tier].hasFlow) {
+            sealBlock(tier);
+        }
+    }
+}
+
+bool historySetClock(uint32_t seconds) {
+    if (!ledger) {
+        return false;
+    }
+    historyUpdate();
+    uint32_t now = historyNow();
+    if (seconds < now) {
+        return false;
+    }
+
+    for (uint8_t tier = 0; tier < HISTORY_TIERS; tier++) {
+        sealBlock(tier);
+    }
+    clockBase += seconds - now;
+    openTiers(seconds);
+    return true;
+}
+
+// ============================================================================
+// Range Queries
+// ============================================================================
+
+struct QueryState {
+    uint32_t from;
+    uint32_t to;
+    uint32_t seconds;
+    HistoryCallback callback;
+    void* context;
+    uint32_t delivered;
+    bool stopped;
+};
+
+/**
+ * Deliver the part of a run of equal intervals that starts in [from, to)
+ */
+static void emitRun(QueryState* q, uint32_t start, uint32_t count, uint32_t pulses) {
+    uint64_t first = 0;
+    if (q->from > start) {
+        first = ((uint64_t)q->from - start + q->seconds - 1) / q->seconds;
+    }
+    uint64_t last = 0;
+    if (q->to > start) {
+        last = ((uint64_t)q->to - start + q->seconds - 1) / q->seconds;
+    }
+    if (last > count) {
+        last = count;
+    }
+    if (last <= first) {
+        return;
+    }
+
+    uint32_t n = (uint32_t)(last - first);
+    q->delivered += n;
+    if (!q->callback((uint32_t)(start + first * q->seconds), n, pulses, q->context)) {
+        q->stopped = true;
+    }
+}
+
+static void emitBlock(QueryState* q, uint32_t start, const uint8_t* data, size_t length,
+                      uint32_t trailingZeros) {
+    size_t pos = 0;
+    while (pos < length && !q->stopped) {
+        uint64_t token;
+        size_t used = historyGetVarint(data + pos, length - pos, &token);
+        if (used == 0) {
+            return;
+        }
+        pos += used;
+
+        uint32_t count = token & 1 ? (uint32_t)(token >> 1) : 1;
+        emitRun(q, start, count, token & 1 ? 0 : (uint32_t)(token >> 1));
+        start += count * q->seconds;
+    }
+    if (trailingZeros > 0 && !q->stopped) {
+        emitRun(q, start, trailingZeros, 0);
+    }
+}
+
+/**
+ * First block start of the k-th oldest sector (0 for an unused sector,
+ * which only ever precedes the used ones in ring order)
+ */
+static uint32_t sectorStartTime(uint8_t tier, uint16_t k) {
+    HistoryTierState* t = &tiers[tier];
+    HistoryBlockHeader header;
+    uint8_t data[HISTORY_BLOCK_BYTES];
+    bool erased;
+    uint16_t sector = (t->sector + 1 + k) % t->sectors;
+    return readBlock(t, tier, sector, 0, &header, data, &erased) ? header.startTime : 0;
+}
+
+static void queryFlash(uint8_t tier, QueryState* q) {
+    HistoryTierState* t = &tiers[tier];
+    if (!flashReady || !t->hasBlocks) {
+        return;
+    }
+
+    // Binary search for the newest sector starting at or before from
+    uint16_t lo = 0;
+    uint16_t hi = t->sectors - 1;
+    while (lo < hi) {
+        uint16_t mid = lo + (hi - lo + 1) / 2;
+        if (sectorStartTime(tier, mid) <= q->from) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    HistoryBlockHeader header;
+    uint8_t data[HISTORY_BLOCK_BYTES];
+    bool erased;
+
+    for (uint16_t k = lo; k < t->sectors && !q->stopped; k++) {
+        uint16_t sector = (t->sector + 1 + k) % t->sectors;
+        uint32_t offset = 0;
+        while (offset < HAL_FLASH_SECTOR_SIZE && !q->stopped) {
+            if (!readBlock(t, tier, sector, offset, &header, data, &erased)) {
+                break;
+            }
+            offset += HISTORY_HEADER_SIZE + header.length;
+
+            uint32_t end = header.startTime + header.intervals * q->seconds;
+            if (end <= q->from) {
+                continue;
+            }
+            if (header.startTime >= q->to) {
+                return;
+            }
+            emitBlock(q, header.startTime, data, header.length, 0);
+        }
+    }
+}
+
+uint32_t historyQuery(HistoryTier tier, uint32_t from, uint32_t to,
+                      HistoryCallback callback, void* context) {
+    QueryState q;
+    q.from = from;
+    q.to = to;
+    q.seconds = intervalSeconds[tier];
+    q.callback = callback;
+    q.context = context;
+    q.delivered = 0;
+    q.stopped = false;
+
+    historyUpdate();
+    queryFlash(tier, &q);
+
+    // Then the intervals still in RAM
+    HistoryTierState* t = &tiers[tier];
+    if (!q.stopped && t->intervals > 0) {
+        emitBlock(&q, t->blockStart, t->data, t->length, t->pendingZeros);
+    }
+    return q.delivered;
+}
+
+const HistoryStats* historyStats() {
+    return &stats;
+}
+
+// ============================================================================
+// Test Support
+// ============================================================================
+
+void resetFlowHistory() {
+    memset(tiers, 0, sizeof(tiers));
+    ledger = nullptr;
+    flashReady = false;
+    stats = HistoryStats();
+    flushJob = SCHEDULER_NO_JOB;
+    clockBase = 0;
+    clockLastMs = 0;
+    clockElapsedMs = 0;
+}
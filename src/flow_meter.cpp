@@ -0,0 +1,751 @@
+/*
+ * Water Flow Meter - Metering Core
+ * Flow calculation, report triggering and persistence logic
+ */
+
+#include "flow_meter.h"
+#include "config_traits.h"
+#include "flow_estimator.h"
+#include "leak_detector.h"
+#include "usage_events.h"
+#include "consumption.h"
+#include "calibration.h"
+#include "counter_journal.h"
+#include "scheduler.h"
+#include "deferred_log.h"
+#include "flow_history.h"
+#include "report_engine.h"
+#include "metering_cluster.h"
+#include "retained_ledger.h"
+#include "latency_stats.h"
+#include "pulse_trace.h"
+
+// ============================================================================
+// Global Variables
+// ============================================================================
+
+// Pulse Ledgers (flow_channels.h), channel 0 also under its single-sensor names
+FlowChannels<FLOW_CHANNELS> flowChannels = flowChannelsInit<FLOW_CHANNELS>();
+uint64_t& totalPulses = flowChannels.ledger[0];        // All pulses ever counted (persisted)
+uint32_t& flowRateMlMin = flowChannels.rateMlMin[0];   // Current flow rate (mL/min)
+
+// Zigbee
+bool zigbeeConnected = false;
+
+// Data Persistence
+uint64_t& lastSavedPulses = flowChannels.savedLedger[0];
+uint32_t lastSaveTime = 0;
+uint32_t bootCount = 0;
+uint32_t resetCount = 0;
+
+// Boot timing (hal_millis() of the first counted pulse / first report)
+uint32_t firstPulseMs = BOOT_TIME_UNSET;
+uint32_t firstReportMs = BOOT_TIME_UNSET;
+
+// NVS ledger key: channel 0's fallback when the journal is unavailable,
+// the other channels' store (with the suffix of flowChannelKey)
+#define LEDGER_KEY "ledger"
+
+// Channel 0 ledger journal on the raw data partition
+static CounterJournal journal;
+static bool journalReady = false;
+static bool journalScanned = false;   // Write cursor found (deferred on a warm resume)
+
+// calculateFlow() window, shared by all channels
+static uint32_t lastCheck = 0;
+
+// Leak rules by channel, fed after each flow window
+static LeakDetector leaks[FLOW_CHANNELS];
+
+// Battery report engine attribute (registered with the metering cluster, see reportBegin)
+static bool reportReady = false;
+static int batteryAttr = REPORT_NO_ATTRIBUTE;
+static int batteryAlarmAttr = REPORT_NO_ATTRIBUTE;
+
+// Scheduler jobs (see scheduleFlowMeter)
+static int flowJob = SCHEDULER_NO_JOB;
+static int saveJob = SCHEDULER_NO_JOB;
+static int reportJob = SCHEDULER_NO_JOB;
+static int leakJob = SCHEDULER_NO_JOB;
+static const uint8_t* reportBattery = nullptr;
+static bool usageWaiting = false;    // Usage events for the report job to send
+
+/**
+ * Mirror the ledgers into retained memory - a warm reset resumes from here
+ */
+static void mirrorLedger() {
+    RetainedLedger ledger = {};
+    ledger.pulses = totalPulses;
+    ledger.savedPulses = lastSavedPulses;
+    ledger.bootCount = bootCount;
+    ledger.resetCount = resetCount;
+    for (uint8_t i = 1; i < FLOW_CHANNELS; i++) {
+        ledger.channelPulses[i - 1] = flowChannels.ledger[i];
+        ledger.channelSaved[i - 1] = flowChannels.savedLedger[i];
+    }
+    retainedLedgerStore(&ledger);
+}
+
+// ============================================================================
+// Flow Sensor Functions
+// ============================================================================
+
+/**
+ * Timed pulse edge of a channel (interrupt context, either pulse source
+ * backend)
+ */
+static void IRAM_ATTR pulseEdge(uint8_t channel) {
+    // Wake the main task only while the channel measures no flow - once
+    // the rate is known the periodic flow job picks pulses up on its own
+    if (flowChannels.rateMlMin[channel] == 0) {
+        hal_notify_from_isr();
+    }
+}
+
+/**
+ * Initialize the flow sensors on the configured pulse source
+ */
+void setupFlowSensor() {
+    LOG(FLOW_SENSOR_INIT, FLOW_SENSOR_PIN);
+    for (uint8_t i = 1; i < FLOW_CHANNELS; i++) {
+        LOG(CHANNEL_SENSOR_INIT, (unsigned)i, FLOW_CHANNEL_PIN[i]);
+    }
+    selectPulseBackend(PULSE_BACKEND);
+}
+
+uint8_t selectPulseBackend(uint8_t backend) {
+    uint8_t selected = backend;
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        uint8_t channelBackend = pulseSourceBegin(i, backend, FLOW_CHANNEL_PIN[i], pulseEdge);
+        if (i == 0) {
+            selected = channelBackend;
+        } else if (channelBackend != backend) {
+            LOG(PULSE_SOURCE_FALLBACK);
+        }
+        flowEstimatorReset(&flowChannels.estimator[i]);
+        flowChannels.rateMlMin[i] = 0;
+    }
+    lastCheck = hal_millis();   // First window starts with the count
+
+    if (selected == PULSE_BACKEND_PCNT) {
+        LOG(PULSE_SOURCE_PCNT, (unsigned long)PULSE_GLITCH_FILTER_NS);
+    } else {
+        if (backend == PULSE_BACKEND_PCNT) {
+            LOG(PULSE_SOURCE_FALLBACK);
+        }
+        LOG(FLOW_SENSOR_ACTIVE);
+    }
+    return selected;
+}
+
+/**
+ * Log what a flow window changed - the rate of channels that counted
+ * pulses, the channels whose flow stopped
+ */
+static void logTick(const FlowChannelsTick* tick) {
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        uint32_t bit = 1UL << i;
+        uint32_t rate = flowChannels.rateMlMin[i];
+        if ((tick->counted & bit) && i == 0) {
+            LOG(FLOW_RATE, (unsigned long)rate, (unsigned long long)totalVolumeMl());
+        } else if (tick->counted & bit) {
+            LOG(CHANNEL_FLOW_RATE, (unsigned)i, (unsigned long)rate,
+                (unsigned long long)channelVolumeMl(i));
+        } else if ((tick->stopped & bit) && i == 0) {
+            LOG(FLOW_STOPPED);
+        } else if (tick->stopped & bit) {
+            LOG(CHANNEL_FLOW_STOPPED, (unsigned)i);
+        }
+    }
+}
+
+/**
+ * Start every channel's leak rules and usage segmenter over from its ledger
+ */
+static void startLeakDetection() {
+    uint32_t now = hal_millis();
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        leakDetectorReset(&leaks[i], flowChannels.ledger[i], now);
+    }
+    usageStart(flowChannels.ledger);
+}
+
+static void sendAlarms();
+
+/**
+ * A changed alarm of channel goes on air right away in the urgent lane
+ */
+static void leakAlarmsChanged(uint8_t channel, uint8_t alarms, uint64_t originUs) {
+    meteringSetAlarms(alarms, originUs, channel);
+    sendAlarms();
+    if (alarms != 0) {
+        LOG(LEAK_ALARM, (unsigned)channel, (unsigned)alarms);
+    } else {
+        LOG(LEAK_CLEARED, (unsigned)channel);
+    }
+}
+
+/**
+ * Arm the leak job for when the first raised never-quiet alarm would clear
+ * - an idle channel has no flow window to run its rules until a pulse
+ */
+static void armLeakJob(uint32_t now) {
+    uint32_t wake = LEAK_NO_WAKE;
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        uint32_t channelWake = leakDetectorWakeMs(&leaks[i], now);
+        if (channelWake < wake) {
+            wake = channelWake;
+        }
+    }
+    if (wake == LEAK_NO_WAKE) {
+        schedulerCancel(leakJob);
+    } else {
+        schedulerArm(leakJob, wake);
+    }
+}
+
+/**
+ * Run the leak rules of the channels this window updated. A raised alarm
+ * is timed from the newest pulse of its channel, a cleared one from now
+ */
+static void updateLeaks(const FlowChannelsTick* tick, const PulseReading* pulses,
+                        uint32_t now, uint64_t nowUs) {
+    if (tick->updated == 0) {
+        return;
+    }
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        if (!(tick->updated & (1UL << i))) {
+            continue;
+        }
+        uint8_t before = leaks[i].alarms;
+        uint8_t alarms = leakDetectorUpdate(&leaks[i], flowChannels.ledger[i],
+                                            flowChannels.rateMlMin[i], now);
+        if (alarms != before) {
+            leakAlarmsChanged(i, alarms,
+                              alarms != 0 && pulses[i].edgeUs != 0 ? pulses[i].edgeUs : nowUs);
+        }
+    }
+    armLeakJob(now);
+}
+
+/**
+ * Leak job - runs the rules of the channels whose quiet period has ended
+ * without a pulse, so a never-quiet alarm clears once the drip stops
+ */
+static void leakJobRun() {
+    uint32_t now = hal_millis();
+    uint64_t nowUs = hal_micros64();
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        if (leakDetectorWakeMs(&leaks[i], now) != 0) {
+            continue;
+        }
+        uint8_t before = leaks[i].alarms;
+        uint8_t alarms = leakDetectorUpdate(&leaks[i], flowChannels.ledger[i],
+                                            flowChannels.rateMlMin[i], now);
+        if (alarms != before) {
+            leakAlarmsChanged(i, alarms, nowUs);
+        }
+    }
+    armLeakJob(now);
+}
+
+/**
+ * Close the draws of the channels this window updated into usage events;
+ * the report job sends them
+ */
+static void updateUsage(const FlowChannelsTick* tick, uint32_t now) {
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        if (!(tick->updated & (1UL << i))) {
+            continue;
+        }
+        const UsageEvent* event = usageUpdate(i, flowChannels.ledger[i], flowChannels.rateMlMin[i],
+                                              !flowChannels.estimator[i].hasReference, now);
+        meteringHoldChanges(usageHoldsReports(i), i);
+        if (event != nullptr) {
+            LOG(USAGE_EVENT, (unsigned long)event->seq, (unsigned)i, (unsigned)event->usageClass,
+                (unsigned long)event->volumeMl, (unsigned long)event->durationS,
+                (unsigned long)event->peakMlMin);
+            usageWaiting = true;
+        }
+    }
+}
+
+/**
+ * Calculate flow rates and update the pulse ledgers
+ * Called by the flow job once per FLOW_CALC_INTERVAL, and on pulse
+ * wake-ups so a starting flow is measured at its second edge
+ */
+void calculateFlow() {
+    uint32_t now = hal_millis();
+    PulseReading pulses[FLOW_CHANNELS];
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        pulseSourceRead(&pulses[i], i);
+    }
+    bool windowComplete = (now - lastCheck >= FLOW_CALC_INTERVAL);
+    uint64_t nowUs = hal_micros64();
+
+    // A calibration session follows its channel's updates, and a curve it
+    // fits applies to the pulses of this window already
+    uint8_t sessionChannel = calibrationSession()->channel;
+    const PulseReading* sessionPulses = &pulses[sessionChannel];
+    if (windowComplete ||
+        flowEstimatorStarting(&flowChannels.estimator[sessionChannel], sessionPulses->edgeCount)) {
+        calibrationSessionUpdate(sessionPulses, nowUs);
+    }
+
+    FlowChannelsTick tick =
+        flowChannelsUpdate(&flowChannels, pulses, calibrationTables(), nowUs, windowComplete);
+    updateLeaks(&tick, pulses, now, nowUs);
+    updateUsage(&tick, now);
+    if (tick.counted != 0) {
+        mirrorLedger();
+        if (firstPulseMs == BOOT_TIME_UNSET) {
+            firstPulseMs = now;
+        }
+    }
+    logTick(&tick);
+
+    if (windowComplete) {
+        lastCheck = now;
+    }
+}
+
+bool flowMeterIdle() {
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        if (flowChannels.rateMlMin[i] != 0 || flowChannels.estimator[i].hasReference ||
+            pulseSourceCount(i) != flowChannels.lastCount[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint8_t leakAlarms(uint8_t channel) {
+    return leaks[channel].alarms;
+}
+
+uint64_t ledgerAt(const PulseReading* reading) {
+    uint64_t pending = reading->count - flowChannels.lastCount[0];
+    return totalPulses + ((pending * flowChannels.scale[0] + flowChannels.carry[0]) >> 16);
+}
+
+uint64_t channelVolumeMl(uint8_t channel) {
+    return pulsesToMillilitres(flowChannels.ledger[channel]);
+}
+
+uint64_t totalVolumeMl() {
+    return channelVolumeMl(0);
+}
+
+float totalVolumeLitres() {
+    return totalVolumeMl() / 1000.0f;
+}
+
+float flowRateLitresPerMin() {
+    return flowRateMlMin / 1000.0f;
+}
+
+// ============================================================================
+// Data Persistence Functions
+// ============================================================================
+
+/**
+ * Load the ledgers of channels 1.. from NVS (open read-write by the caller)
+ */
+static void loadChannels() {
+    for (uint8_t i = 1; i < FLOW_CHANNELS; i++) {
+        char key[16];
+        flowChannelKey(key, sizeof(key), LEDGER_KEY, i);
+        flowChannels.ledger[i] = hal_nvs_get_u64(key, 0);
+        flowChannels.savedLedger[i] = flowChannels.ledger[i];
+        LOG(CHANNEL_LEDGER_LOADED, (unsigned)i, (unsigned long long)channelVolumeMl(i));
+    }
+}
+
+/**
+ * Save the ledgers of channels 1.. that moved by at least minPulses - one
+ * NVS open for all of them, none when nothing moved
+ */
+static void saveChannels(uint64_t minPulses) {
+    bool open = false;
+    for (uint8_t i = 1; i < FLOW_CHANNELS; i++) {
+        if (flowChannels.ledger[i] - flowChannels.savedLedger[i] < minPulses) {
+            continue;
+        }
+        if (!open) {
+            hal_nvs_begin(EEPROM_NAMESPACE, false);
+            open = true;
+        }
+        char key[16];
+        flowChannelKey(key, sizeof(key), LEDGER_KEY, i);
+        hal_nvs_put_u64(key, flowChannels.ledger[i]);
+        flowChannels.savedLedger[i] = flowChannels.ledger[i];
+    }
+    if (open) {
+        hal_nvs_end();
+        mirrorLedger();
+    }
+}
+
+/**
+ * Load the pulse ledger at boot
+ * After a soft, panic or watchdog reset the ledger resumes from retained
+ * memory: exact, and without touching NVS or flash. After a power loss the
+ * newest journal record wins; on the first boot after an upgrade the NVS
+ * "ledger" key (or the legacy float "totalVolume") seeds the journal
+ */
+void loadTotalVolume() {
+    journalReady = hal_flash_begin(DATA_PARTITION_LABEL);
+    if (journalReady) {
+        journalBegin(&journal, JOURNAL_OFFSET, JOURNAL_SECTORS);
+    }
+    journalScanned = false;
+
+    RetainedLedger retained;
+    if (retainedLedgerRecover(&retained)) {
+        totalPulses = retained.pulses;
+        lastSavedPulses = retained.savedPulses;
+        bootCount = retained.bootCount;
+        resetCount = retained.resetCount + 1;
+        for (uint8_t i = 1; i < FLOW_CHANNELS; i++) {
+            flowChannels.ledger[i] = retained.channelPulses[i - 1];
+            flowChannels.savedLedger[i] = retained.channelSaved[i - 1];
+        }
+        mirrorLedger();
+        startLeakDetection();
+
+        LOG(LEDGER_RESUMED, (unsigned long long)totalVolumeMl(), (unsigned)hal_reset_reason());
+        LOG(LEDGER_PULSES, (unsigned long long)totalPulses);
+        return;
+    }
+
+    // Single read-write open: boot count (once per power on) plus any
+    // migration source
+    hal_nvs_begin(EEPROM_NAMESPACE, false);
+
+    bootCount = hal_nvs_get_u32("bootCount", 0) + 1;
+    hal_nvs_put_u32("bootCount", bootCount);
+    resetCount = 0;
+
+    bool recovered = journalReady && journalRecover(&journal, &totalPulses);
+    journalScanned = journalReady;
+    if (!recovered) {
+        totalPulses = hal_nvs_get_u64(LEDGER_KEY, UINT64_MAX);
+        if (totalPulses == UINT64_MAX) {
+            // The float firmware added pulses / (CALIBRATION_FACTOR * 60)
+            // each second: "litres" in name, 1/60 L in fact. Multiplying
+            // back recovers the pulses it counted (double: once per device)
+            float legacyVolume = hal_nvs_get_float("totalVolume", 0.0);
+            totalPulses = (uint64_t)(legacyVolume * (CALIBRATION_FACTOR * 60.0) + 0.5);
+        }
+        if (journalReady) {
+            journalAppend(&journal, totalPulses);
+        }
+    }
+    loadChannels();
+
+    hal_nvs_end();
+
+    if (recovered) {
+        LOG(LEDGER_LOADED_JOURNAL, (unsigned long long)totalVolumeMl());
+    } else {
+        LOG(LEDGER_LOADED_NVS, (unsigned long long)totalVolumeMl());
+    }
+    LOG(LEDGER_PULSES, (unsigned long long)totalPulses);
+    LOG(LEDGER_BOOT_COUNT, (unsigned long)bootCount);
+
+    lastSavedPulses = totalPulses;
+    mirrorLedger();
+    startLeakDetection();
+}
+
+/**
+ * Save the pulse ledger - one journal append, no NVS round trip (the
+ * consumption buckets join it once after each rollover)
+ */
+void saveTotalVolume() {
+    uint32_t start = LATENCY_START();
+    if (journalReady) {
+        if (!journalScanned) {
+            // Resumed from retained memory: find the write cursor now
+            uint64_t flashPulses;
+            journalRecover(&journal, &flashPulses);
+            journalScanned = true;
+        }
+        journalAppend(&journal, totalPulses);
+    } else {
+        hal_nvs_begin(EEPROM_NAMESPACE, false);
+        hal_nvs_put_u64(LEDGER_KEY, totalPulses);
+        hal_nvs_end();
+    }
+    saveChannels(1);
+    consumptionSave();
+
+    LOG(LEDGER_SAVED, (unsigned long long)totalVolumeMl());
+
+    lastSavedPulses = totalPulses;
+    lastSaveTime = hal_millis();
+    mirrorLedger();
+    LATENCY_RECORD(LATENCY_SAVE, start);
+}
+
+/**
+ * Periodic save - saves data periodically to reduce EEPROM wear
+ */
+void periodicSave() {
+    uint32_t now = hal_millis();
+
+    // Save if volume changed significantly (ledger only grows)
+    if (totalPulses - lastSavedPulses >= SAVE_THRESHOLD_PULSES) {
+        saveTotalVolume();
+    }
+    saveChannels(SAVE_THRESHOLD_PULSES);
+
+    // Or save periodically even if volume hasn't changed much
+    if ((now - lastSaveTime) >= MAX_SAVE_INTERVAL) {
+        saveTotalVolume();
+    }
+}
+
+// ============================================================================
+// Reporting Functions
+// ============================================================================
+
+/**
+ * Register the reported clusters (Metering, Usage Events) and the
+ * calibration cluster, and hand Configure Reporting from the coordinator
+ * to the report engine
+ * Volume and rate stay integers (Metering cluster) all the way to the frame
+ */
+static void reportBegin() {
+    if (reportReady) {
+        return;
+    }
+    reportReady = true;
+
+    meteringBegin();
+    calibrationClusterBegin();
+    usageClusterBegin();
+    hal_radio_on_configure_reporting(reportConfigure);
+
+    #if BATTERY_ENABLED
+    ReportAttributeConfig battery = {};
+    battery.endpoint = BATTERY_ENDPOINT;
+    battery.clusterId = BATTERY_CLUSTER_ID;
+    battery.attrId = BATTERY_PERCENT_ATTR;
+    battery.zclType = ZCL_TYPE_UINT8;
+    battery.minIntervalMs = REPORT_MIN_INTERVAL_MS;
+    battery.maxIntervalMs = BATTERY_REPORT_INTERVAL_MS;
+    battery.minChange = BATTERY_CHANGE_THRESHOLD;
+    batteryAttr = reportAttributeAdd(&battery);
+
+    // Alarm state changes go in the urgent lane only
+    battery.attrId = BATTERY_ALARM_STATE_ATTR;
+    battery.zclType = ZCL_TYPE_BITMAP32;
+    battery.minIntervalMs = 0;
+    battery.maxIntervalMs = 0;
+    battery.minChange = 1;
+    batteryAlarmAttr = reportAttributeAdd(&battery);
+    #endif
+}
+
+static void reportValues(uint32_t flowMlMin, uint64_t volumeMl, uint8_t batteryPercent) {
+    reportBegin();
+    meteringUpdate(volumeMl, flowMlMin);
+    for (uint8_t i = 1; i < FLOW_CHANNELS; i++) {
+        meteringUpdate(channelVolumeMl(i), flowChannels.rateMlMin[i], i);
+    }
+    consumptionPublish();
+    reportAttributeSet(batteryAttr, batteryPercent);
+}
+
+// Send whatever the report engine has due (dropped while disconnected)
+static bool reportDue(uint32_t flowMlMin, uint64_t volumeMl, uint8_t batteryPercent) {
+    uint32_t start = LATENCY_START();
+    uint8_t due = reportPoll(zigbeeConnected);
+    LATENCY_RECORD(LATENCY_REPORT, start);
+    if (due == 0) {
+        return false;
+    }
+
+    if (zigbeeConnected) {
+        LOG(FLOW_REPORT, (unsigned long)flowMlMin, (unsigned long long)volumeMl, batteryPercent);
+        if (firstReportMs == BOOT_TIME_UNSET) {
+            firstReportMs = hal_millis();
+        }
+    }
+    return true;
+}
+
+/**
+ * Send a full flow data report to the Zigbee coordinator now
+ */
+void sendFlowReport(uint32_t flowMlMin, uint64_t volumeMl, uint8_t batteryPercent) {
+    reportValues(flowMlMin, volumeMl, batteryPercent);
+    reportRequestAll();
+    reportDue(flowMlMin, volumeMl, batteryPercent);
+}
+
+/**
+ * Check if flow data should be reported, and report it
+ * Hands the values to the report engine: changes beyond the hysteresis
+ * are coalesced into one frame per cluster within the airtime budget,
+ * interval deadlines always report. Returns true if anything was due
+ */
+bool shouldReportFlow(uint32_t currentFlowMlMin, uint64_t currentVolumeMl, uint8_t currentBattery) {
+    reportValues(currentFlowMlMin, currentVolumeMl, currentBattery);
+    return reportDue(currentFlowMlMin, currentVolumeMl, currentBattery);
+}
+
+// ============================================================================
+// Scheduler Jobs
+// ============================================================================
+
+// Time left until interval has passed since the given timestamp
+// (a full interval if it already has, so a stale timestamp cannot spin)
+static uint32_t remainingMs(uint32_t since, uint32_t interval) {
+    uint32_t elapsed = hal_millis() - since;
+    return elapsed < interval ? interval - elapsed : interval;
+}
+
+/**
+ * Report what is due, then arm the report job for the next deadline,
+ * held back change or usage event - nothing else polls the engine while
+ * flow is idle
+ */
+static void reportFlow() {
+    if (!zigbeeConnected) {
+        return;
+    }
+
+    shouldReportFlow(flowRateMlMin, totalVolumeMl(), reportBattery ? *reportBattery : 100);
+    uint32_t next = usageWaiting ? 0 : reportNextMs();
+    if (next != HAL_WAIT_FOREVER) {
+        schedulerArm(reportJob, next > 0 ? next : 1);
+    }
+}
+
+/**
+ * Flow window job - suspends itself while idle, pulses restart it
+ */
+static void flowJobRun() {
+    // Close history intervals before this window's pulses reach the ledger
+    historyUpdate();
+    traceUpdate();
+    calculateFlow();
+    periodicSave();
+    reportFlow();
+
+    if (flowMeterIdle()) {
+        schedulerCancel(flowJob);
+    }
+}
+
+static void saveJobRun() {
+    periodicSave();
+    schedulerArm(saveJob, remainingMs(lastSaveTime, MAX_SAVE_INTERVAL));
+}
+
+/**
+ * Report job - the only sender of usage events: the oldest waiting goes
+ * out with this pass's frames, and the job comes back for the next
+ */
+static void reportJobRun() {
+    usageWaiting = zigbeeConnected && usageReportNext();
+    reportFlow();
+}
+
+/**
+ * Register flow calculation, save, report and leak jobs with the
+ * scheduler, and the reported clusters with the radio (before the Zigbee
+ * stack starts)
+ * batteryLevel is read whenever a report is built
+ */
+void scheduleFlowMeter(const uint8_t* batteryLevel) {
+    reportBattery = batteryLevel;
+    reportBegin();
+    flowJob = schedulerAdd(flowJobRun, FLOW_CALC_INTERVAL, FLOW_CALC_INTERVAL);
+    saveJob = schedulerAdd(saveJobRun, 0, remainingMs(lastSaveTime, MAX_SAVE_INTERVAL));
+    reportJob = schedulerAdd(reportJobRun, 0, 0);
+    leakJob = schedulerAdd(leakJobRun, 0, 0);
+    schedulerOnNotify(flowMeterWake);
+}
+
+/**
+ * Send a full report at the next opportunity, regardless of thresholds
+ */
+void requestFlowReport() {
+    reportRequestAll();
+    schedulerArm(reportJob, 0);
+}
+
+/**
+ * Put a changed alarm on air now, ahead of telemetry and of the save the
+ * flow job does next, and arm the report job for its acknowledgement
+ */
+static void sendAlarms() {
+    uint32_t start = LATENCY_START();
+    reportPollUrgent(zigbeeConnected);
+    LATENCY_RECORD(LATENCY_REPORT, start);
+    if (zigbeeConnected) {
+        uint32_t next = reportNextMs();
+        if (next != HAL_WAIT_FOREVER) {
+            schedulerArm(reportJob, next > 0 ? next : 1);
+        }
+    }
+}
+
+void reportBatteryAlarm(uint8_t alarms, uint64_t sampleUs) {
+    reportBegin();
+    reportAlarm(batteryAlarmAttr, alarms, sampleUs);
+    sendAlarms();
+}
+
+/**
+ * Pulse ISR notification - measures a starting flow without waiting for
+ * the window, and restarts the flow job if it was suspended
+ */
+void flowMeterWake() {
+    historyUpdate();
+    traceUpdate();
+    calculateFlow();
+    reportFlow();
+
+    if (!schedulerArmed(flowJob)) {
+        schedulerArm(flowJob, FLOW_CALC_INTERVAL);
+    }
+}
+
+// ============================================================================
+// Test Support
+// ============================================================================
+
+void resetFlowMeter() {
+    resetPulseSource();
+    flowChannels = flowChannelsInit<FLOW_CHANNELS>();
+    zigbeeConnected = false;
+    lastSaveTime = 0;
+    bootCount = 0;
+    resetCount = 0;
+    journalReady = false;
+    journalScanned = false;
+
+    lastCheck = 0;
+    resetUsageEvents();
+    startLeakDetection();
+
+    reportEngineReset();
+    resetMeteringCluster();
+    reportReady = false;
+    batteryAttr = REPORT_NO_ATTRIBUTE;
+    batteryAlarmAttr = REPORT_NO_ATTRIBUTE;
+    firstPulseMs = BOOT_TIME_UNSET;
+    firstReportMs = BOOT_TIME_UNSET;
+
+    flowJob = SCHEDULER_NO_JOB;
+    saveJob = SCHEDULER_NO_JOB;
+    reportJob = SCHEDULER_NO_JOB;
+    leakJob = SCHEDULER_NO_JOB;
+    reportBattery = nullptr;
+    usageWaiting = false;
+}
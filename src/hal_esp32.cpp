@@ -0,0 +1,511 @@
+/*
+ * Water Flow Meter - ESP32 HAL
+ * Arduino ESP32 implementation of the hardware abstraction layer
+ */
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <esp_partition.h>
+#include <esp_system.h>
+#include <esp_attr.h>
+#include <esp_timer.h>
+#include <esp_cpu.h>
+#include <driver/pulse_cnt.h>
+#include <driver/gpio.h>
+#include <hal/gpio_ll.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "hal.h"
+
+// ============================================================================
+// Clock
+// ============================================================================
+
+uint32_t hal_millis() {
+    return millis();
+}
+
+uint32_t hal_micros() {
+    return micros();
+}
+
+uint64_t IRAM_ATTR hal_micros64() {
+    return (uint64_t)esp_timer_get_time();
+}
+
+uint32_t IRAM_ATTR hal_cycles() {
+    return (uint32_t)esp_cpu_get_cycle_count();
+}
+
+// ============================================================================
+// Main Task Sleep / Wake-up
+// ============================================================================
+
+// Task blocked in hal_wait_event() (the Arduino loop task)
+static TaskHandle_t waitingTask = nullptr;
+
+bool hal_wait_event(uint32_t timeoutMs) {
+    if (!waitingTask) {
+        waitingTask = xTaskGetCurrentTaskHandle();
+    }
+    TickType_t ticks = timeoutMs == HAL_WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
+    return ulTaskNotifyTake(pdTRUE, ticks) > 0;
+}
+
+void IRAM_ATTR hal_notify_from_isr() {
+    if (!waitingTask) {
+        return;
+    }
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(waitingTask, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+// ============================================================================
+// GPIO / Interrupts
+// ============================================================================
+
+void hal_attach_pulse_interrupt(uint8_t pin, void (*isr)()) {
+    // The attaching task is the one the ISR wakes - capture it now so
+    // pulses before the first hal_wait_event() are not lost
+    waitingTask = xTaskGetCurrentTaskHandle();
+    pinMode(pin, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(pin), isr, RISING);
+}
+
+void hal_detach_pulse_interrupt(uint8_t pin) {
+    detachInterrupt(digitalPinToInterrupt(pin));
+}
+
+void IRAM_ATTR hal_pulse_interrupt_enable(uint8_t pin, bool enable) {
+    // Register access only (gpio_intr_enable() is not in IRAM); a stale
+    // edge latched while masked is cleared before unmasking
+    if (enable) {
+        gpio_ll_clear_intr_status_bit(&GPIO, pin);
+        gpio_ll_intr_enable_on_core(&GPIO, 0, pin);
+    } else {
+        gpio_ll_intr_disable(&GPIO, pin);
+    }
+}
+
+// ============================================================================
+// Pulse Counter Peripheral
+// ============================================================================
+
+// Counter units by index - each calls back with its own index as context
+static pcnt_unit_handle_t pcntUnits[HAL_PCNT_UNITS] = {};
+static pcnt_channel_handle_t pcntChannels[HAL_PCNT_UNITS] = {};
+static void (*pcntIsrs[HAL_PCNT_UNITS])(HalPcntEvent event) = {};
+
+static bool IRAM_ATTR pcntOnReach(pcnt_unit_handle_t unit, const pcnt_watch_event_data_t* event,
+                                  void* context) {
+    (void)unit;
+    (void)event;    // The limit is the only watch point
+    uint8_t index = (uint8_t)(uintptr_t)context;
+    pcntIsrs[index](HAL_PCNT_OVERFLOW);
+    return false;   // hal_notify_from_isr() requests its own yield
+}
+
+bool hal_pcnt_begin(uint8_t unit, uint8_t pin, uint32_t filterNs, void (*isr)(HalPcntEvent event)) {
+    if (unit >= HAL_PCNT_UNITS || pcntUnits[unit]) {
+        return false;
+    }
+
+    // Count up only; the unit clears itself at the high limit watch point
+    pcnt_unit_config_t unitConfig = {};
+    unitConfig.low_limit = -1;
+    unitConfig.high_limit = HAL_PCNT_LIMIT;
+    if (pcnt_new_unit(&unitConfig, &pcntUnits[unit]) != ESP_OK) {
+        pcntUnits[unit] = nullptr;
+        return false;
+    }
+    pcnt_unit_handle_t handle = pcntUnits[unit];
+
+    // Filter width is limited to 1023 APB cycles (~12.7 us)
+    pcnt_glitch_filter_config_t filter = {};
+    filter.max_glitch_ns = filterNs;
+    pcnt_unit_set_glitch_filter(handle, &filter);
+
+    pcnt_chan_config_t channelConfig = {};
+    channelConfig.edge_gpio_num = pin;
+    channelConfig.level_gpio_num = -1;
+    pcnt_new_channel(handle, &channelConfig, &pcntChannels[unit]);
+    pcnt_channel_set_edge_action(pcntChannels[unit], PCNT_CHANNEL_EDGE_ACTION_INCREASE,
+                                 PCNT_CHANNEL_EDGE_ACTION_HOLD);
+    gpio_pullup_en((gpio_num_t)pin);
+
+    // Watch points only take effect after a count clear - add the limit
+    // before the clear below and none while the unit runs
+    pcntIsrs[unit] = isr;
+    pcnt_unit_add_watch_point(handle, HAL_PCNT_LIMIT);
+    pcnt_event_callbacks_t callbacks = {};
+    callbacks.on_reach = pcntOnReach;
+    pcnt_unit_register_event_callbacks(handle, &callbacks, (void*)(uintptr_t)unit);
+
+    // Overflow events wake the task that set the counter up
+    waitingTask = xTaskGetCurrentTaskHandle();
+    pcnt_unit_enable(handle);
+    pcnt_unit_clear_count(handle);
+    return pcnt_unit_start(handle) == ESP_OK;
+}
+
+void hal_pcnt_end(uint8_t unit) {
+    if (unit >= HAL_PCNT_UNITS || !pcntUnits[unit]) {
+        return;
+    }
+    pcnt_unit_stop(pcntUnits[unit]);
+    pcnt_unit_disable(pcntUnits[unit]);
+    pcnt_del_channel(pcntChannels[unit]);
+    pcnt_del_unit(pcntUnits[unit]);
+    pcntUnits[unit] = nullptr;
+    pcntChannels[unit] = nullptr;
+}
+
+uint32_t hal_pcnt_count(uint8_t unit) {
+    int value = 0;
+    pcnt_unit_get_count(pcntUnits[unit], &value);
+    return value < 0 ? 0 : (uint32_t)value;
+}
+
+// ============================================================================
+// ADC
+// ============================================================================
+
+void hal_adc_begin(uint8_t pin) {
+    pinMode(pin, INPUT);
+}
+
+uint32_t hal_adc_read_mv(uint8_t pin) {
+    return analogReadMilliVolts(pin);
+}
+
+// ============================================================================
+// Non-Volatile Storage
+// ============================================================================
+
+static Preferences prefs;
+
+bool hal_nvs_begin(const char* ns, bool readOnly) {
+    return prefs.begin(ns, readOnly);
+}
+
+void hal_nvs_end() {
+    prefs.end();
+}
+
+float hal_nvs_get_float(const char* key, float defaultValue) {
+    return prefs.getFloat(key, defaultValue);
+}
+
+uint32_t hal_nvs_get_u32(const char* key, uint32_t defaultValue) {
+    return prefs.getUInt(key, defaultValue);
+}
+
+uint64_t hal_nvs_get_u64(const char* key, uint64_t defaultValue) {
+    return prefs.getULong64(key, defaultValue);
+}
+
+void hal_nvs_put_float(const char* key, float value) {
+    prefs.putFloat(key, value);
+}
+
+void hal_nvs_put_u32(const char* key, uint32_t value) {
+    prefs.putUInt(key, value);
+}
+
+void hal_nvs_put_u64(const char* key, uint64_t value) {
+    prefs.putULong64(key, value);
+}
+
+bool hal_nvs_get_blob(const char* key, void* data, size_t len) {
+    return prefs.getBytesLength(key) == len && prefs.getBytes(key, data, len) == len;
+}
+
+void hal_nvs_put_blob(const char* key, const void* data, size_t len) {
+    prefs.putBytes(key, data, len);
+}
+
+// ============================================================================
+// Raw Flash
+// ============================================================================
+
+static const esp_partition_t* dataPartition = nullptr;
+
+bool hal_flash_begin(const char* label) {
+    if (!dataPartition) {
+        dataPartition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                 ESP_PARTITION_SUBTYPE_ANY, label);
+    }
+    return dataPartition != nullptr;
+}
+
+uint32_t hal_flash_size() {
+    return dataPartition ? dataPartition->size : 0;
+}
+
+bool hal_flash_read(uint32_t offset, void* data, size_t len) {
+    return dataPartition &&
+           esp_partition_read(dataPartition, offset, data, len) == ESP_OK;
+}
+
+bool hal_flash_write(uint32_t offset, const void* data, size_t len) {
+    return dataPartition &&
+           esp_partition_write(dataPartition, offset, data, len) == ESP_OK;
+}
+
+bool hal_flash_erase(uint32_t offset, size_t len) {
+    return dataPartition &&
+           esp_partition_erase_range(dataPartition, offset, len) == ESP_OK;
+}
+
+// ============================================================================
+// Reset Reason / Retained Memory
+// ============================================================================
+
+HalResetReason hal_reset_reason() {
+    switch (esp_reset_reason()) {
+        case ESP_RST_POWERON:
+            return HAL_RESET_POWER_ON;
+        case ESP_RST_SW:
+            return HAL_RESET_SOFTWARE;
+        case ESP_RST_PANIC:
+            return HAL_RESET_PANIC;
+        case ESP_RST_INT_WDT:
+        case ESP_RST_TASK_WDT:
+        case ESP_RST_WDT:
+            return HAL_RESET_WATCHDOG;
+        case ESP_RST_BROWNOUT:
+            return HAL_RESET_BROWNOUT;
+        default:
+            return HAL_RESET_OTHER;
+    }
+}
+
+// RTC slow memory, skipped by the startup code's zero/copy passes
+RTC_NOINIT_ATTR static uint32_t retainedMemory[HAL_RETAINED_WORDS];
+
+uint32_t* hal_retained_memory() {
+    return retainedMemory;
+}
+
+// ============================================================================
+// Radio
+// ============================================================================
+
+/**
+ * NOTE: This is a template - actual API depends on ESP32 Zigbee SDK version
+ * The stack reports join progress through its signal handler, which should
+ * update networkState/shortAddress, e.g. (conceptual):
+ *
+ *   void esp_zb_app_signal_handler(esp_zb_app_signal_t* signal) {
+ *       switch (*signal->p_app_signal) {
+ *       case ESP_ZB_BDB_SIGNAL_DEVICE_REBOOT:     // Rejoin from zb_storage
+ *       case ESP_ZB_BDB_SIGNAL_STEERING:          // Full join
+ *           networkState = signal->esp_err_status == ESP_OK ? HAL_NET_JOINED : HAL_NET_FAILED;
+ *           shortAddress = esp_zb_get_short_address();
+ *           break;
+ *       case ESP_ZB_ZDO_SIGNAL_LEAVE:
+ *           networkState = HAL_NET_IDLE;
+ *           break;
+ *       }
+ *   }
+ */
+static volatile HalNetworkState networkState = HAL_NET_IDLE;
+static volatile uint16_t shortAddress = 0xFFFF;
+
+bool hal_radio_begin() {
+    // TODO: Initialize Zigbee stack based on your SDK
+    // Example (conceptual - adjust for your SDK):
+    // esp_zb_init(&zb_cfg);
+    // esp_zb_set_primary_network_channel_set(1 << ZIGBEE_CHANNEL);
+    // esp_zb_start(false);   // Don't auto-commission, we drive it
+    return true;
+}
+
+bool hal_radio_has_stored_network() {
+    // TODO: return !esp_zb_bdb_is_factory_new();
+    return false;
+}
+
+void hal_radio_rejoin() {
+    networkState = HAL_NET_JOINING;
+    // TODO: esp_zb_bdb_start_top_level_commissioning(ESP_ZB_BDB_MODE_INITIALIZATION);
+}
+
+void hal_radio_join() {
+    networkState = HAL_NET_JOINING;
+    // TODO: esp_zb_bdb_start_top_level_commissioning(ESP_ZB_BDB_MODE_NETWORK_STEERING);
+}
+
+HalNetworkState hal_radio_network_state() {
+    return networkState;
+}
+
+uint16_t hal_radio_short_address() {
+    return shortAddress;
+}
+
+/**
+ * NOTE: This is a template - actual API depends on ESP32 Zigbee SDK version
+ */
+bool hal_radio_report_attributes(uint8_t endpoint, uint16_t clusterId,
+                                 const HalAttribute* attrs, uint8_t count) {
+    // TODO: Send one Report Attributes command based on your SDK
+    // Example (conceptual):
+    // esp_zb_zcl_report_attr_cmd_t cmd = { endpoint, clusterId, ... };
+    // for each record: append attrs[i].attrId, attrs[i].zclType, attrs[i].value
+    (void)endpoint;
+    (void)clusterId;
+    (void)attrs;
+    (void)count;
+    return true;
+}
+
+/**
+ * NOTE: This is a template - actual API depends on ESP32 Zigbee SDK version
+ * The same command with ESP_ZB_APS_ACK_REQUEST set in its tx options. The
+ * template send has no APS data confirm to wait for, so a frame the stack
+ * accepted is reported delivered and the alarm is not resent; a refused
+ * frame is resent by the report engine. With the SDK's confirm
+ * (esp_zb_aps_data_confirm_handler_register, on the loop task) the slot
+ * stays HAL_REPORT_PENDING here and the confirm sets it, conceptually:
+ *
+ *   reportStatus[handle] = confirm.status == ESP_OK ? HAL_REPORT_DELIVERED
+ *                                                   : HAL_REPORT_FAILED;
+ */
+#define ACKED_REPORT_SLOTS 8
+static volatile HalReportStatus reportStatus[ACKED_REPORT_SLOTS];
+static uint8_t nextReportSlot = 0;
+
+int hal_radio_report_attributes_acked(uint8_t endpoint, uint16_t clusterId,
+                                      const HalAttribute* attrs, uint8_t count) {
+    int handle = nextReportSlot;
+    nextReportSlot = (nextReportSlot + 1) % ACKED_REPORT_SLOTS;
+    if (!hal_radio_report_attributes(endpoint, clusterId, attrs, count)) {
+        reportStatus[handle] = HAL_REPORT_FAILED;
+        return -1;
+    }
+    reportStatus[handle] = HAL_REPORT_DELIVERED;
+    return handle;
+}
+
+HalReportStatus hal_radio_report_status(int handle) {
+    if (handle < 0 || handle >= ACKED_REPORT_SLOTS) {
+        return HAL_REPORT_FAILED;
+    }
+    return reportStatus[handle];
+}
+
+/**
+ * NOTE: This is a template - actual API depends on ESP32 Zigbee SDK version
+ * Conceptually: build the cluster's attribute list with
+ * esp_zb_zcl_attr_list_create(clusterId) + esp_zb_cluster_add_attr() and
+ * add it to the endpoint's cluster list before esp_zb_device_register()
+ */
+bool hal_radio_add_cluster(uint8_t endpoint, uint16_t clusterId,
+                           const HalAttribute* attrs, uint8_t count) {
+    (void)endpoint;
+    (void)clusterId;
+    (void)attrs;
+    (void)count;
+    return true;
+}
+
+void hal_radio_set_attribute(uint8_t endpoint, uint16_t clusterId, const HalAttribute* attr) {
+    // TODO: esp_zb_zcl_set_attribute_val(endpoint, clusterId,
+    //           ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, attr->attrId, (void*)attr->value, false);
+    (void)endpoint;
+    (void)clusterId;
+    (void)attr;
+}
+
+/**
+ * The stack's own reporting is left unconfigured - Configure Reporting
+ * records are handed to the report engine instead, e.g. (conceptual)
+ * from the ESP_ZB_CORE_CMD_CUSTOM_CLUSTER_REQ_CB_ID / report config
+ * action callback, which runs in esp_zb_process() on the loop task
+ */
+static uint8_t (*configureReportingHandler)(const HalReportingConfig* record) = nullptr;
+
+void hal_radio_on_configure_reporting(uint8_t (*handler)(const HalReportingConfig* record)) {
+    configureReportingHandler = handler;
+}
+
+/**
+ * Write Attributes to writable application attributes are handed over the
+ * same way, e.g. (conceptual) from the ESP_ZB_CORE_SET_ATTR_VALUE_CB_ID
+ * action callback: status = writeAttributeHandler(message->info.dst_endpoint,
+ * message->info.cluster, &record) with record built from message->attribute
+ */
+static uint8_t (*writeAttributeHandler)(uint8_t endpoint, uint16_t clusterId,
+                                        const HalAttribute* attr) = nullptr;
+
+void hal_radio_on_write_attribute(uint8_t (*handler)(uint8_t endpoint, uint16_t clusterId,
+                                                     const HalAttribute* attr)) {
+    writeAttributeHandler = handler;
+}
+
+/**
+ * NOTE: This is a template - actual API depends on ESP32 Zigbee SDK version
+ * Conceptually: esp_zb_zcl_read_attr_cmd_req() to the coordinator (short
+ * address 0x0000, endpoint 1) for ESP_ZB_ZCL_CLUSTER_ID_TIME attributes
+ * 0x0000 and 0x0007, with the ESP_ZB_CORE_CMD_READ_ATTR_RESP_CB_ID action
+ * callback filling a HalTime (HAL_TIME_INVALID for an unsupported record)
+ * and calling timeHandler on the loop task
+ */
+static void (*timeHandler)(const HalTime* time) = nullptr;
+
+bool hal_radio_read_time() {
+    // TODO: Send the Read Attributes request based on your SDK
+    return true;
+}
+
+void hal_radio_on_time(void (*handler)(const HalTime* time)) {
+    timeHandler = handler;
+}
+
+// ============================================================================
+// Debug Output
+// ============================================================================
+
+void hal_debug_write(const void* data, size_t len) {
+    Serial.write((const uint8_t*)data, len);
+}
+
+int hal_serial_read() {
+    return Serial.available() > 0 ? Serial.read() : -1;
+}
+
+// Drain task - idle priority, so it only runs while every other task
+// (the loop task included) is blocked
+static TaskHandle_t drainTask = nullptr;
+static void (*drainFn)() = nullptr;
+
+static void drainTaskLoop(void* arg) {
+    (void)arg;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        drainFn();
+    }
+}
+
+void hal_drain_task_begin(void (*drain)()) {
+    if (drainTask) {
+        return;
+    }
+    drainFn = drain;
+    xTaskCreate(drainTaskLoop, "log_drain", 3072, nullptr, tskIDLE_PRIORITY, &drainTask);
+
+    // Output anything logged before the task existed
+    xTaskNotifyGive(drainTask);
+}
+
+void hal_drain_task_wake() {
+    if (drainTask) {
+        xTaskNotifyGive(drainTask);
+    }
+}
+
+#endif // ARDUINO
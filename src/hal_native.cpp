@@ -0,0 +1,828 @@
+/*
+ * Water Flow Meter - Native HAL
+ * Linux host simulation of clock, pulse ISR, NVS, raw flash, radio, serial
+ * input and debug output
+ */
+
+#ifndef ARDUINO
+
+#include "hal_native.h"
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// ============================================================================
+// Simulation State
+// ============================================================================
+
+static uint64_t simMicros = 0;
+static void (*pulseIsr[NATIVE_GPIO_COUNT])() = {};
+static bool pulseIsrMasked[NATIVE_GPIO_COUNT] = {};
+static uint32_t edgesBeforeUnmask = 0;
+static uint32_t isrCount = 0;
+
+struct NativePcntUnit {
+    void (*isr)(HalPcntEvent event);   // nullptr while the unit is stopped
+    uint8_t pin;
+    uint32_t count;
+    uint32_t filterNs;
+};
+static NativePcntUnit pcntUnits[HAL_PCNT_UNITS] = {};
+static bool pcntAvailable = true;
+static bool pcntHeld = false;
+
+struct NativePcntPending {
+    uint8_t unit;
+    HalPcntEvent event;
+};
+static std::vector<NativePcntPending> pcntPending;
+
+static bool notifyPending = false;
+static NativeWaitHook waitHook = nullptr;
+static uint32_t waitCount = 0;
+
+static uint32_t adcMillivolts = 0;
+static uint32_t adcReads = 0;
+
+static std::map<std::string, uint64_t> nvsStore;
+static std::map<std::string, std::vector<uint8_t>> nvsBlobs;
+static bool nvsOpen = false;
+static bool nvsReadOnly = true;
+static uint32_t nvsWrites = 0;
+
+static std::vector<uint8_t> flashData;
+static std::vector<uint32_t> flashSectorErases;
+static NativeFlashStats flashStats;
+static uint32_t flashFailBudget = 0;
+static bool flashFailArmed = false;
+
+static NativeNetworkConfig networkConfig;
+static HalNetworkState networkState = HAL_NET_IDLE;
+static uint64_t networkReadyUs = 0;
+static bool networkAttemptFails = false;
+static NativeRadioStats radioStats;
+
+static std::vector<NativeRadioFrame> radioFrames;
+static bool radioCapture = true;
+static std::vector<uint64_t> ackDueUs;   // By handle, UINT64_MAX: lost
+
+// RTC no-init memory and the reason for the last "reset"
+static uint32_t retainedMemory[HAL_RETAINED_WORDS];
+static HalResetReason resetReason = HAL_RESET_POWER_ON;
+
+// Server attributes by endpoint << 32 | cluster << 16 | attribute
+static std::map<uint64_t, HalAttribute> radioAttributes;
+static uint8_t (*configureReportingHandler)(const HalReportingConfig* record) = nullptr;
+static uint8_t (*writeAttributeHandler)(uint8_t endpoint, uint16_t clusterId,
+                                        const HalAttribute* attr) = nullptr;
+static void (*timeHandler)(const HalTime* time) = nullptr;
+static uint32_t timeRequests = 0;
+
+static bool logEnabled = false;
+static std::string debugOutput;
+static std::string serialInput;
+static size_t serialInputPos = 0;
+static void (*drainTask)() = nullptr;
+static uint32_t drainWakes = 0;
+
+void hal_native_reset() {
+    simMicros = 0;
+    memset(pulseIsr, 0, sizeof(pulseIsr));
+    memset(pulseIsrMasked, 0, sizeof(pulseIsrMasked));
+    edgesBeforeUnmask = 0;
+    isrCount = 0;
+    memset(pcntUnits, 0, sizeof(pcntUnits));
+    pcntAvailable = true;
+    pcntHeld = false;
+    pcntPending.clear();
+    notifyPending = false;
+    waitHook = nullptr;
+    waitCount = 0;
+    adcMillivolts = 0;
+    adcReads = 0;
+    nvsStore.clear();
+    nvsBlobs.clear();
+    nvsOpen = false;
+    nvsReadOnly = true;
+    nvsWrites = 0;
+    hal_native_flash_reset(NATIVE_FLASH_DEFAULT_SIZE);
+    networkConfig = NativeNetworkConfig();
+    networkState = HAL_NET_IDLE;
+    networkReadyUs = 0;
+    networkAttemptFails = false;
+    radioStats = NativeRadioStats();
+    radioFrames.clear();
+    radioCapture = true;
+    ackDueUs.clear();
+    radioAttributes.clear();
+    configureReportingHandler = nullptr;
+    writeAttributeHandler = nullptr;
+    timeHandler = nullptr;
+    timeRequests = 0;
+    hal_native_power_loss();
+    debugOutput.clear();
+    serialInput.clear();
+    serialInputPos = 0;
+    drainTask = nullptr;
+    drainWakes = 0;
+}
+
+// ============================================================================
+// Reset Reason / Retained Memory
+// ============================================================================
+
+HalResetReason hal_reset_reason() {
+    return resetReason;
+}
+
+uint32_t* hal_retained_memory() {
+    return retainedMemory;
+}
+
+void hal_native_set_reset_reason(HalResetReason reason) {
+    resetReason = reason;
+}
+
+void hal_native_power_loss() {
+    // Whatever the cells power up with - not zeros
+    uint32_t noise = 0x9E3779B9;
+    for (uint32_t i = 0; i < HAL_RETAINED_WORDS; i++) {
+        noise = noise * 1664525 + 1013904223;
+        retainedMemory[i] = noise;
+    }
+    resetReason = HAL_RESET_POWER_ON;
+}
+
+// ============================================================================
+// Clock
+// ============================================================================
+
+uint32_t hal_millis() {
+    return (uint32_t)(simMicros / 1000);
+}
+
+uint32_t hal_micros() {
+    return (uint32_t)simMicros;
+}
+
+uint64_t hal_micros64() {
+    return simMicros;
+}
+
+// Simulated time only: code takes no cycles on the host, waits do
+uint32_t hal_cycles() {
+    return (uint32_t)(simMicros * HAL_CPU_MHZ);
+}
+
+void hal_native_set_micros(uint64_t us) {
+    simMicros = us;
+}
+
+void hal_native_advance_ms(uint32_t ms) {
+    simMicros += (uint64_t)ms * 1000;
+}
+
+void hal_native_advance_us(uint64_t us) {
+    simMicros += us;
+}
+
+uint64_t hal_native_now_us() {
+    return simMicros;
+}
+
+// ============================================================================
+// Main Task Sleep / Wake-up
+// ============================================================================
+
+bool hal_wait_event(uint32_t timeoutMs) {
+    waitCount++;
+    if (!notifyPending) {
+        uint64_t deadlineUs = simMicros + (uint64_t)timeoutMs * 1000;
+        if (waitHook) {
+            waitHook(deadlineUs);
+        }
+        if (!notifyPending && simMicros < deadlineUs) {
+            simMicros = deadlineUs;
+        }
+    }
+    bool notified = notifyPending;
+    notifyPending = false;
+    return notified;
+}
+
+void hal_notify_from_isr() {
+    notifyPending = true;
+}
+
+void hal_native_set_wait_hook(NativeWaitHook hook) {
+    waitHook = hook;
+}
+
+bool hal_native_notify_pending() {
+    return notifyPending;
+}
+
+uint32_t hal_native_wait_count() {
+    return waitCount;
+}
+
+// ============================================================================
+// GPIO / Interrupts
+// ============================================================================
+
+void hal_attach_pulse_interrupt(uint8_t pin, void (*isr)()) {
+    if (pin < NATIVE_GPIO_COUNT) {
+        pulseIsr[pin] = isr;
+        pulseIsrMasked[pin] = false;
+    }
+}
+
+void hal_detach_pulse_interrupt(uint8_t pin) {
+    if (pin < NATIVE_GPIO_COUNT) {
+        pulseIsr[pin] = nullptr;
+    }
+}
+
+static void sensorEdge(uint8_t pin, uint32_t widthNs);
+
+void hal_pulse_interrupt_enable(uint8_t pin, bool enable) {
+    if (pin >= NATIVE_GPIO_COUNT) {
+        return;
+    }
+    if (enable) {
+        // Edges landing while the unmask is under way are still masked
+        while (edgesBeforeUnmask > 0) {
+            edgesBeforeUnmask--;
+            sensorEdge(pin, NATIVE_PULSE_WIDTH_NS);
+        }
+    }
+    pulseIsrMasked[pin] = !enable;
+}
+
+void hal_native_edges_before_unmask(uint32_t edges) {
+    edgesBeforeUnmask = edges;
+}
+
+// ============================================================================
+// Pulse Counter Peripheral
+// ============================================================================
+
+bool hal_pcnt_begin(uint8_t unit, uint8_t pin, uint32_t filterNs, void (*isr)(HalPcntEvent event)) {
+    if (!pcntAvailable || unit >= HAL_PCNT_UNITS || pcntUnits[unit].isr) {
+        return false;
+    }
+    pcntUnits[unit].isr = isr;
+    pcntUnits[unit].pin = pin;
+    pcntUnits[unit].count = 0;
+    pcntUnits[unit].filterNs = filterNs;
+    return true;
+}
+
+void hal_pcnt_end(uint8_t unit) {
+    if (unit < HAL_PCNT_UNITS) {
+        pcntUnits[unit].isr = nullptr;
+    }
+}
+
+uint32_t hal_pcnt_count(uint8_t unit) {
+    return pcntUnits[unit].count;
+}
+
+void hal_native_set_pcnt_available(bool available) {
+    pcntAvailable = available;
+}
+
+static void pcntRaise(uint8_t unit, HalPcntEvent event) {
+    if (pcntHeld) {
+        pcntPending.push_back({unit, event});
+        return;
+    }
+    isrCount++;
+    pcntUnits[unit].isr(event);
+}
+
+void hal_native_pcnt_hold_interrupts(bool hold) {
+    pcntHeld = hold;
+    if (!hold) {
+        for (const NativePcntPending& pending : pcntPending) {
+            pcntRaise(pending.unit, pending.event);
+        }
+        pcntPending.clear();
+    }
+}
+
+// One edge of widthNs on a sensor pin: a counter unit on the pin counts
+// those its glitch filter lets through, then the GPIO interrupt (if not
+// masked) sees every edge - its latency outlasts the filter delay
+static void sensorEdge(uint8_t pin, uint32_t widthNs) {
+    for (uint8_t i = 0; i < HAL_PCNT_UNITS; i++) {
+        NativePcntUnit* unit = &pcntUnits[i];
+        if (!unit->isr || unit->pin != pin || widthNs < unit->filterNs) {
+            continue;
+        }
+        if (++unit->count == HAL_PCNT_LIMIT) {
+            unit->count = 0;
+            pcntRaise(i, HAL_PCNT_OVERFLOW);
+        }
+    }
+    if (pin < NATIVE_GPIO_COUNT && pulseIsr[pin] && !pulseIsrMasked[pin]) {
+        isrCount++;
+        pulseIsr[pin]();
+    }
+}
+
+void hal_native_pulse() {
+    sensorEdge(FLOW_SENSOR_PIN, NATIVE_PULSE_WIDTH_NS);
+}
+
+void hal_native_pulse_pin(uint8_t pin) {
+    sensorEdge(pin, NATIVE_PULSE_WIDTH_NS);
+}
+
+void hal_native_glitch(uint32_t widthNs) {
+    sensorEdge(FLOW_SENSOR_PIN, widthNs);
+}
+
+uint32_t hal_native_isr_count() {
+    return isrCount;
+}
+
+void hal_native_pulses(uint32_t count, uint32_t periodUs) {
+    for (uint32_t i = 0; i < count; i++) {
+        simMicros += periodUs;
+        hal_native_pulse();
+    }
+}
+
+// ============================================================================
+// ADC
+// ============================================================================
+
+void hal_adc_begin(uint8_t pin) {
+    (void)pin;
+}
+
+uint32_t hal_adc_read_mv(uint8_t pin) {
+    (void)pin;
+    adcReads++;
+    return adcMillivolts;
+}
+
+void hal_native_set_adc_mv(uint32_t mv) {
+    adcMillivolts = mv;
+}
+
+uint32_t hal_native_adc_read_count() {
+    return adcReads;
+}
+
+// ============================================================================
+// Non-Volatile Storage
+// ============================================================================
+
+// Values are stored as raw 64-bit words; floats keep their bit pattern.
+// Blobs are kept apart, as bytes
+
+bool hal_nvs_begin(const char* ns, bool readOnly) {
+    (void)ns;
+    nvsOpen = true;
+    nvsReadOnly = readOnly;
+    return true;
+}
+
+void hal_nvs_end() {
+    nvsOpen = false;
+}
+
+static bool nvsLookup(const char* key, uint64_t* raw) {
+    if (!nvsOpen) {
+        return false;
+    }
+    auto it = nvsStore.find(key);
+    if (it == nvsStore.end()) {
+        return false;
+    }
+    *raw = it->second;
+    return true;
+}
+
+static void nvsStoreRaw(const char* key, uint64_t raw) {
+    if (!nvsOpen || nvsReadOnly) {
+        return;
+    }
+    nvsStore[key] = raw;
+    nvsWrites++;
+}
+
+float hal_nvs_get_float(const char* key, float defaultValue) {
+    uint64_t raw;
+    if (!nvsLookup(key, &raw)) {
+        return defaultValue;
+    }
+    uint32_t bits = (uint32_t)raw;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+uint32_t hal_nvs_get_u32(const char* key, uint32_t defaultValue) {
+    uint64_t raw;
+    return nvsLookup(key, &raw) ? (uint32_t)raw : defaultValue;
+}
+
+uint64_t hal_nvs_get_u64(const char* key, uint64_t defaultValue) {
+    uint64_t raw;
+    return nvsLookup(key, &raw) ? raw : defaultValue;
+}
+
+void hal_nvs_put_float(const char* key, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    nvsStoreRaw(key, bits);
+}
+
+void hal_nvs_put_u32(const char* key, uint32_t value) {
+    nvsStoreRaw(key, value);
+}
+
+void hal_nvs_put_u64(const char* key, uint64_t value) {
+    nvsStoreRaw(key, value);
+}
+
+bool hal_nvs_get_blob(const char* key, void* data, size_t len) {
+    if (!nvsOpen) {
+        return false;
+    }
+    auto it = nvsBlobs.find(key);
+    if (it == nvsBlobs.end() || it->second.size() != len) {
+        return false;
+    }
+    memcpy(data, it->second.data(), len);
+    return true;
+}
+
+void hal_nvs_put_blob(const char* key, const void* data, size_t len) {
+    if (!nvsOpen || nvsReadOnly) {
+        return;
+    }
+    const uint8_t* bytes = (const uint8_t*)data;
+    nvsBlobs[key].assign(bytes, bytes + len);
+    nvsWrites++;
+}
+
+uint32_t hal_native_nvs_write_count() {
+    return nvsWrites;
+}
+
+bool hal_native_nvs_has_key(const char* key) {
+    return nvsStore.find(key) != nvsStore.end() || nvsBlobs.find(key) != nvsBlobs.end();
+}
+
+// ============================================================================
+// Raw Flash
+// ============================================================================
+
+void hal_native_flash_reset(uint32_t size) {
+    flashData.assign(size, 0xFF);
+    flashSectorErases.assign(size / HAL_FLASH_SECTOR_SIZE, 0);
+    flashStats = NativeFlashStats();
+    flashFailArmed = false;
+}
+
+const NativeFlashStats* hal_native_flash_stats() {
+    return &flashStats;
+}
+
+void hal_native_flash_clear_stats() {
+    flashStats = NativeFlashStats();
+    flashSectorErases.assign(flashSectorErases.size(), 0);
+}
+
+void hal_native_flash_fail_after(uint32_t budget) {
+    flashFailBudget = budget;
+    flashFailArmed = budget > 0;
+}
+
+bool hal_flash_begin(const char* label) {
+    (void)label;
+    if (flashData.empty()) {
+        hal_native_flash_reset(NATIVE_FLASH_DEFAULT_SIZE);
+    }
+    return true;
+}
+
+uint32_t hal_flash_size() {
+    return (uint32_t)flashData.size();
+}
+
+bool hal_flash_read(uint32_t offset, void* data, size_t len) {
+    if ((uint64_t)offset + len > flashData.size()) {
+        return false;
+    }
+    memcpy(data, &flashData[offset], len);
+    flashStats.reads++;
+    flashStats.bytesRead += len;
+    return true;
+}
+
+bool hal_flash_write(uint32_t offset, const void* data, size_t len) {
+    if ((uint64_t)offset + len > flashData.size()) {
+        return false;
+    }
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < len; i++) {
+        if (flashFailArmed) {
+            if (flashFailBudget == 0) {
+                return false;   // Power is gone - rest of the write is lost
+            }
+            flashFailBudget--;
+        }
+        flashData[offset + i] &= bytes[i];
+        flashStats.bytesWritten++;
+    }
+    return true;
+}
+
+bool hal_flash_erase(uint32_t offset, size_t len) {
+    if (offset % HAL_FLASH_SECTOR_SIZE || len % HAL_FLASH_SECTOR_SIZE ||
+        (uint64_t)offset + len > flashData.size()) {
+        return false;
+    }
+    if (flashFailArmed && flashFailBudget == 0) {
+        return false;
+    }
+    memset(&flashData[offset], 0xFF, len);
+    for (uint32_t s = offset / HAL_FLASH_SECTOR_SIZE;
+         s < (offset + len) / HAL_FLASH_SECTOR_SIZE; s++) {
+        flashSectorErases[s]++;
+        flashStats.erases++;
+        if (flashSectorErases[s] > flashStats.maxSectorErases) {
+            flashStats.maxSectorErases = flashSectorErases[s];
+        }
+    }
+    return true;
+}
+
+// ============================================================================
+// Radio
+// ============================================================================
+
+bool hal_radio_begin() {
+    return true;
+}
+
+bool hal_radio_has_stored_network() {
+    return networkConfig.storedNetwork;
+}
+
+static void startAttempt(uint32_t latencyMs) {
+    networkState = HAL_NET_JOINING;
+    networkReadyUs = simMicros + (uint64_t)latencyMs * 1000;
+    networkAttemptFails = networkConfig.failAttempts > 0;
+    if (networkAttemptFails) {
+        networkConfig.failAttempts--;
+    }
+}
+
+void hal_radio_rejoin() {
+    radioStats.rejoins++;
+    startAttempt(networkConfig.rejoinMs);
+}
+
+void hal_radio_join() {
+    radioStats.joins++;
+    startAttempt(networkConfig.joinMs);
+}
+
+HalNetworkState hal_radio_network_state() {
+    if (networkState == HAL_NET_JOINING && simMicros >= networkReadyUs) {
+        networkState = networkAttemptFails ? HAL_NET_FAILED : HAL_NET_JOINED;
+        if (networkState == HAL_NET_JOINED) {
+            networkConfig.storedNetwork = true;
+        }
+    }
+    return networkState;
+}
+
+uint16_t hal_radio_short_address() {
+    return networkState == HAL_NET_JOINED ? 0x1234 : 0xFFFF;
+}
+
+void hal_native_radio_set_network(const NativeNetworkConfig* config) {
+    networkConfig = *config;
+}
+
+void hal_native_radio_leave() {
+    networkState = HAL_NET_IDLE;
+}
+
+const NativeRadioStats* hal_native_radio_stats() {
+    return &radioStats;
+}
+
+static bool sendFrame(uint8_t endpoint, uint16_t clusterId,
+                      const HalAttribute* attrs, uint8_t count, bool acked) {
+    if (count > HAL_RADIO_MAX_ATTRIBUTES) {
+        return false;
+    }
+
+    uint32_t bytes = hal_radio_frame_bytes(attrs, count);
+    radioStats.frames++;
+    radioStats.bytesOnAir += bytes;
+    if (!radioCapture) {
+        return true;
+    }
+
+    NativeRadioFrame frame = {};
+    frame.timeUs = simMicros;
+    frame.endpoint = endpoint;
+    frame.clusterId = clusterId;
+    frame.count = count;
+    frame.bytesOnAir = (uint16_t)bytes;
+    frame.acked = acked;
+    memcpy(frame.attrs, attrs, count * sizeof(HalAttribute));
+    radioFrames.push_back(frame);
+    return true;
+}
+
+bool hal_radio_report_attributes(uint8_t endpoint, uint16_t clusterId,
+                                 const HalAttribute* attrs, uint8_t count) {
+    return sendFrame(endpoint, clusterId, attrs, count, false);
+}
+
+int hal_radio_report_attributes_acked(uint8_t endpoint, uint16_t clusterId,
+                                      const HalAttribute* attrs, uint8_t count) {
+    if (!sendFrame(endpoint, clusterId, attrs, count, true)) {
+        return -1;
+    }
+    radioStats.ackedFrames++;
+    if (networkConfig.lostAcks > 0) {
+        networkConfig.lostAcks--;
+        radioStats.lostAcks++;
+        ackDueUs.push_back(UINT64_MAX);
+    } else {
+        ackDueUs.push_back(simMicros + (uint64_t)networkConfig.ackMs * 1000);
+    }
+    return (int)ackDueUs.size() - 1;
+}
+
+// A lost acknowledgement stays pending: the stack's own timeout is left to
+// the caller
+HalReportStatus hal_radio_report_status(int handle) {
+    if (handle < 0 || (size_t)handle >= ackDueUs.size()) {
+        return HAL_REPORT_FAILED;
+    }
+    return simMicros >= ackDueUs[handle] ? HAL_REPORT_DELIVERED : HAL_REPORT_PENDING;
+}
+
+static uint64_t attributeKey(uint8_t endpoint, uint16_t clusterId, uint16_t attrId) {
+    return (uint64_t)endpoint << 32 | (uint32_t)clusterId << 16 | attrId;
+}
+
+bool hal_radio_add_cluster(uint8_t endpoint, uint16_t clusterId,
+                           const HalAttribute* attrs, uint8_t count) {
+    for (uint8_t i = 0; i < count; i++) {
+        radioAttributes[attributeKey(endpoint, clusterId, attrs[i].attrId)] = attrs[i];
+    }
+    return true;
+}
+
+void hal_radio_set_attribute(uint8_t endpoint, uint16_t clusterId, const HalAttribute* attr) {
+    auto it = radioAttributes.find(attributeKey(endpoint, clusterId, attr->attrId));
+    if (it != radioAttributes.end()) {
+        it->second = *attr;
+    }
+}
+
+void hal_radio_on_configure_reporting(uint8_t (*handler)(const HalReportingConfig* record)) {
+    configureReportingHandler = handler;
+}
+
+bool hal_native_radio_read_attribute(uint8_t endpoint, uint16_t clusterId, uint16_t attrId,
+                                     HalAttribute* attr) {
+    auto it = radioAttributes.find(attributeKey(endpoint, clusterId, attrId));
+    if (it == radioAttributes.end()) {
+        return false;
+    }
+    *attr = it->second;
+    return true;
+}
+
+uint8_t hal_native_radio_configure_reporting(const HalReportingConfig* record) {
+    // Unsupported attribute (0x86) when nothing handles the command
+    return configureReportingHandler ? configureReportingHandler(record) : 0x86;
+}
+
+void hal_radio_on_write_attribute(uint8_t (*handler)(uint8_t endpoint, uint16_t clusterId,
+                                                     const HalAttribute* attr)) {
+    writeAttributeHandler = handler;
+}
+
+uint8_t hal_native_radio_write_attribute(uint8_t endpoint, uint16_t clusterId,
+                                         const HalAttribute* attr) {
+    if (radioAttributes.find(attributeKey(endpoint, clusterId, attr->attrId)) ==
+            radioAttributes.end() || !writeAttributeHandler) {
+        return 0x86;
+    }
+    return writeAttributeHandler(endpoint, clusterId, attr);
+}
+
+bool hal_radio_read_time() {
+    timeRequests++;
+    return true;
+}
+
+void hal_radio_on_time(void (*handler)(const HalTime* time)) {
+    timeHandler = handler;
+}
+
+uint32_t hal_native_radio_time_requests() {
+    return timeRequests;
+}
+
+void hal_native_radio_time_response(const HalTime* time) {
+    if (timeHandler) {
+        timeHandler(time);
+    }
+}
+
+size_t hal_native_radio_frame_count() {
+    return radioFrames.size();
+}
+
+const NativeRadioFrame* hal_native_radio_frame(size_t index) {
+    return index < radioFrames.size() ? &radioFrames[index] : nullptr;
+}
+
+void hal_native_radio_clear() {
+    radioFrames.clear();
+}
+
+void hal_native_radio_set_capture(bool enabled) {
+    radioCapture = enabled;
+}
+
+// ============================================================================
+// Debug Output
+// ============================================================================
+
+void hal_debug_write(const void* data, size_t len) {
+    debugOutput.append((const char*)data, len);
+    if (logEnabled) {
+        fwrite(data, 1, len, stdout);
+    }
+}
+
+int hal_serial_read() {
+    if (serialInputPos >= serialInput.size()) {
+        return -1;
+    }
+    return (uint8_t)serialInput[serialInputPos++];
+}
+
+void hal_drain_task_begin(void (*drain)()) {
+    drainTask = drain;
+}
+
+void hal_drain_task_wake() {
+    drainWakes++;
+}
+
+void hal_native_set_log_enabled(bool enabled) {
+    logEnabled = enabled;
+}
+
+const char* hal_native_debug_output(size_t* len) {
+    *len = debugOutput.size();
+    return debugOutput.data();
+}
+
+void hal_native_debug_clear() {
+    debugOutput.clear();
+}
+
+void hal_native_serial_input(const char* text) {
+    serialInput.erase(0, serialInputPos);
+    serialInputPos = 0;
+    serialInput.append(text);
+}
+
+size_t hal_native_serial_pending() {
+    return serialInput.size() - serialInputPos;
+}
+
+uint32_t hal_native_drain_wake_count() {
+    return drainWakes;
+}
+
+void hal_native_run_drain_task() {
+    if (drainTask) {
+        drainTask();
+    }
+}
+
+#endif // !ARDUINO
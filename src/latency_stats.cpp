@@ -0,0 +1,150 @@
+/*
+ * Water Flow Meter - Latency Statistics
+ * Cycle-counter latency histograms
+ */
+
+#include "latency_stats.h"
+
+#if LATENCY_STATS_ENABLED
+
+#include <string.h>
+#include "deferred_log.h"
+#include "report_engine.h"
+
+static LatencyHistogram histograms[LATENCY_SECTIONS];
+
+// ============================================================================
+// Recording
+// ============================================================================
+
+void IRAM_ATTR latencyRecord(uint8_t section, uint32_t cycles) {
+    LatencyHistogram* histogram = &histograms[section];
+    histogram->counts[latencyBucket(cycles)]++;
+    if (cycles > histogram->max) {
+        histogram->max = cycles;
+    }
+}
+
+// ============================================================================
+// Queries
+// ============================================================================
+
+const LatencyHistogram* latencyHistogram(uint8_t section) {
+    return &histograms[section];
+}
+
+uint32_t latencySamples(uint8_t section) {
+    uint32_t samples = 0;
+    for (uint8_t b = 0; b < LATENCY_BUCKETS; b++) {
+        samples += histograms[section].counts[b];
+    }
+    return samples;
+}
+
+// Exclusive upper bound of a bucket, saturated for the last one
+static uint32_t bucketLimit(uint8_t bucket) {
+    return bucket < LATENCY_BUCKETS - 1 ? 1UL << bucket : UINT32_MAX;
+}
+
+uint32_t latencyPercentile(uint8_t section, uint16_t permille) {
+    uint32_t samples = latencySamples(section);
+    if (samples == 0) {
+        return 0;
+    }
+
+    uint64_t wanted = ((uint64_t)samples * permille + 999) / 1000;
+    uint64_t seen = 0;
+    for (uint8_t b = 0; b < LATENCY_BUCKETS; b++) {
+        seen += histograms[section].counts[b];
+        if (seen >= wanted) {
+            return bucketLimit(b);
+        }
+    }
+    return UINT32_MAX;
+}
+
+// ============================================================================
+// Diagnostics Cluster
+// ============================================================================
+
+static uint16_t attributeId(uint8_t section, uint8_t field) {
+    return LATENCY_ATTR_BASE + section * LATENCY_ATTR_STRIDE + field;
+}
+
+void latencyBegin() {
+    HalAttribute attrs[LATENCY_SECTIONS * 4];
+    uint8_t count = 0;
+    for (uint8_t s = 0; s < LATENCY_SECTIONS; s++) {
+        for (uint8_t field = LATENCY_ATTR_SAMPLES; field <= LATENCY_ATTR_MAX; field++) {
+            reportEncode(attributeId(s, field), ZCL_TYPE_UINT32, 0, &attrs[count++]);
+        }
+    }
+    hal_radio_add_cluster(FLOW_ENDPOINT, DIAGNOSTICS_CLUSTER_ID, attrs, count);
+}
+
+static void publish(uint8_t section, uint8_t field, uint32_t value) {
+    HalAttribute attr;
+    reportEncode(attributeId(section, field), ZCL_TYPE_UINT32, value, &attr);
+    hal_radio_set_attribute(FLOW_ENDPOINT, DIAGNOSTICS_CLUSTER_ID, &attr);
+}
+
+void latencyPublish() {
+    for (uint8_t s = 0; s < LATENCY_SECTIONS; s++) {
+        publish(s, LATENCY_ATTR_SAMPLES, latencySamples(s));
+        publish(s, LATENCY_ATTR_P50, latencyPercentile(s, 500));
+        publish(s, LATENCY_ATTR_P99, latencyPercentile(s, 990));
+        publish(s, LATENCY_ATTR_MAX, histograms[s].max);
+    }
+}
+
+// ============================================================================
+// Serial Output
+// ============================================================================
+
+static void printName(uint8_t section) {
+    switch (section) {
+        case LATENCY_LOOP:
+            LOG(LATENCY_NAME_LOOP);
+            break;
+        case LATENCY_PULSE_ISR:
+            LOG(LATENCY_NAME_PULSE_ISR);
+            break;
+        case LATENCY_SAVE:
+            LOG(LATENCY_NAME_SAVE);
+            break;
+        case LATENCY_REPORT:
+            LOG(LATENCY_NAME_REPORT);
+            break;
+        case LATENCY_JOB_LATE:
+            LOG(LATENCY_NAME_JOB_LATE);
+            break;
+    }
+}
+
+void latencyPrint() {
+    for (uint8_t s = 0; s < LATENCY_SECTIONS; s++) {
+        printName(s);
+        LOG(LATENCY_SUMMARY, (unsigned long)latencySamples(s),
+            (unsigned long)latencyPercentile(s, 500), (unsigned long)latencyPercentile(s, 990),
+            (unsigned long)histograms[s].max, (unsigned long)(histograms[s].max / HAL_CPU_MHZ));
+    }
+}
+
+void latencyPrintHistogram(uint8_t section) {
+    if (section >= LATENCY_SECTIONS) {
+        return;
+    }
+    printName(section);
+    for (uint8_t b = 0; b < LATENCY_BUCKETS; b++) {
+        if (histograms[section].counts[b] > 0) {
+            LOG(LATENCY_BUCKET, (unsigned long)(b > 0 ? 1UL << (b - 1) : 0),
+                (unsigned long)histograms[section].counts[b]);
+        }
+    }
+}
+
+void resetLatencyStats() {
+    memset(histograms, 0, sizeof(histograms));
+}
+
+#endif // LATENCY_STATS_ENABLED
@@ -0,0 +1,63 @@
+/*
+ * Water Flow Meter - Leak Detector
+ * Streaming leak and burst rules on a flow channel's ledger and rate
+ */
+
+#include "leak_detector.h"
+#include "config_traits.h"
+
+void leakDetectorReset(LeakDetector* leak, uint64_t ledger, uint32_t nowMs) {
+    leak->ledger = ledger;
+    leak->drawLedger = ledger;
+    leak->drawStartMs = nowMs;
+    leak->lastPulseMs = nowMs;
+    leak->quietMs = nowMs;
+    leak->drawing = false;
+    leak->alarms = 0;
+}
+
+uint8_t leakDetectorUpdate(LeakDetector* leak, uint64_t ledger, uint32_t rateMlMin, uint32_t nowMs) {
+    uint64_t previous = leak->ledger;
+
+    // Never quiet: a pulse-free stretch of LEAK_QUIET_PERIOD - up to now, or
+    // up to the pulses of this window - restarts the clock
+    if (nowMs - leak->lastPulseMs >= LEAK_QUIET_MS) {
+        leak->quietMs = nowMs;
+        leak->alarms &= ~LEAK_ALARM_NEVER_QUIET;
+    }
+    if (ledger != previous) {
+        leak->ledger = ledger;
+        leak->lastPulseMs = nowMs;
+    }
+    if (LEAK_NEVER_QUIET_MS > 0 && nowMs - leak->quietMs >= LEAK_NEVER_QUIET_MS) {
+        leak->alarms |= LEAK_ALARM_NEVER_QUIET;
+    }
+
+    // A draw runs while the rate is above 0 (it only drops to 0 after
+    // FLOW_IDLE_TIMEOUT without a pulse)
+    if (rateMlMin == 0) {
+        leak->drawing = false;
+        leak->alarms &= ~(LEAK_ALARM_CONTINUOUS | LEAK_ALARM_BURST);
+        return leak->alarms;
+    }
+    if (!leak->drawing) {
+        leak->drawing = true;
+        leak->drawStartMs = nowMs;
+        leak->drawLedger = previous;
+    }
+    if (LEAK_CONTINUOUS_MS > 0 && nowMs - leak->drawStartMs >= LEAK_CONTINUOUS_MS) {
+        leak->alarms |= LEAK_ALARM_CONTINUOUS;
+    }
+    if (LEAK_BURST_PULSES > 0 && ledger - leak->drawLedger >= LEAK_BURST_PULSES) {
+        leak->alarms |= LEAK_ALARM_BURST;
+    }
+    return leak->alarms;
+}
+
+uint32_t leakDetectorWakeMs(const LeakDetector* leak, uint32_t nowMs) {
+    if (!(leak->alarms & LEAK_ALARM_NEVER_QUIET)) {
+        return LEAK_NO_WAKE;
+    }
+    uint32_t quietForMs = nowMs - leak->lastPulseMs;
+    return quietForMs < LEAK_QUIET_MS ? LEAK_QUIET_MS - quietForMs : 0;
+}
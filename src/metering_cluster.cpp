@@ -0,0 +1,195 @@
+/*
+ * Water Flow Meter - Metering Cluster
+ * ZCL Metering (0x0702) server on each flow channel's endpoint
+ */
+
+#include "metering_cluster.h"
+#include "config_traits.h"
+#include "report_engine.h"
+#include "leak_detector.h"
+#include "consumption.h"
+
+// Registered with the radio and the report engine (meteringBegin)
+static bool ready = false;
+
+// Report engine attributes and the last values written to the server
+// attributes, by flow channel
+static int summationAttr[FLOW_CHANNELS];
+static int demandAttr[FLOW_CHANNELS];
+static int statusAttr[FLOW_CHANNELS];
+static uint64_t lastVolumeMl[FLOW_CHANNELS];
+static uint32_t lastDemand[FLOW_CHANNELS];
+static uint8_t lastAlarms[FLOW_CHANNELS];
+static ConsumptionTotals lastConsumption[FLOW_CHANNELS];
+
+// ============================================================================
+// Server Attributes
+// ============================================================================
+
+static void setAttribute(uint8_t channel, uint16_t attrId, uint8_t zclType, uint64_t value) {
+    HalAttribute attr;
+    reportEncode(attrId, zclType, value, &attr);
+    hal_radio_set_attribute(FLOW_ENDPOINT + channel, METERING_CLUSTER_ID, &attr);
+}
+
+static void addCluster(uint8_t channel) {
+    HalAttribute attrs[15];
+    reportEncode(METERING_SUMMATION_ATTR, ZCL_TYPE_UINT48, 0, &attrs[0]);
+    reportEncode(METERING_STATUS_ATTR, ZCL_TYPE_BITMAP8, 0, &attrs[1]);
+    reportEncode(METERING_UNIT_ATTR, ZCL_TYPE_ENUM8, METERING_UNIT_M3, &attrs[2]);
+    reportEncode(METERING_MULTIPLIER_ATTR, ZCL_TYPE_UINT24, METERING_MULTIPLIER, &attrs[3]);
+    reportEncode(METERING_DIVISOR_ATTR, ZCL_TYPE_UINT24, METERING_DIVISOR, &attrs[4]);
+    reportEncode(METERING_SUMMATION_FORMAT_ATTR, ZCL_TYPE_BITMAP8, METERING_FORMAT, &attrs[5]);
+    reportEncode(METERING_DEMAND_FORMAT_ATTR, ZCL_TYPE_BITMAP8, METERING_FORMAT, &attrs[6]);
+    reportEncode(METERING_DEVICE_TYPE_ATTR, ZCL_TYPE_BITMAP8, METERING_DEVICE_WATER, &attrs[7]);
+    reportEncode(METERING_DEMAND_ATTR, ZCL_TYPE_INT24, 0, &attrs[8]);
+    reportEncode(METERING_LEAK_ALARMS_ATTR, ZCL_TYPE_BITMAP8, 0, &attrs[9]);
+    reportEncode(METERING_DAY_ATTR, ZCL_TYPE_UINT24, 0, &attrs[10]);
+    reportEncode(METERING_PREVIOUS_DAY_ATTR, ZCL_TYPE_UINT24, 0, &attrs[11]);
+    reportEncode(METERING_WEEK_ATTR, ZCL_TYPE_UINT24, 0, &attrs[12]);
+    reportEncode(METERING_MONTH_ATTR, ZCL_TYPE_UINT32, 0, &attrs[13]);
+    reportEncode(METERING_YEAR_ATTR, ZCL_TYPE_UINT32, 0, &attrs[14]);
+    hal_radio_add_cluster(FLOW_ENDPOINT + channel, METERING_CLUSTER_ID, attrs, 15);
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+static void addChannel(uint8_t channel) {
+    addCluster(channel);
+    lastVolumeMl[channel] = 0;
+    lastDemand[channel] = 0;
+    lastAlarms[channel] = 0;
+    lastConsumption[channel] = ConsumptionTotals();
+
+    ReportAttributeConfig demand = {};
+    demand.endpoint = FLOW_ENDPOINT + channel;
+    demand.clusterId = METERING_CLUSTER_ID;
+    demand.attrId = METERING_DEMAND_ATTR;
+    demand.zclType = ZCL_TYPE_INT24;
+    demand.minIntervalMs = REPORT_MIN_INTERVAL_MS;
+    demand.maxIntervalMs = FLOW_REPORT_INTERVAL_MS;
+    demand.minChange = DEMAND_MIN_CHANGE;
+    demand.changePermille = FLOW_CHANGE_PERMILLE;
+
+    ReportAttributeConfig summation = demand;
+    summation.attrId = METERING_SUMMATION_ATTR;
+    summation.zclType = ZCL_TYPE_UINT48;
+    summation.minChange = VOLUME_MILESTONE_ML;
+    summation.changePermille = 0;
+
+    // Alarms: every change at once, no deadline
+    ReportAttributeConfig status = demand;
+    status.attrId = METERING_STATUS_ATTR;
+    status.zclType = ZCL_TYPE_BITMAP8;
+    status.minIntervalMs = 0;
+    status.maxIntervalMs = 0;
+    status.minChange = 1;
+    status.changePermille = 0;
+
+    summationAttr[channel] = reportAttributeAdd(&summation);
+    demandAttr[channel] = reportAttributeAdd(&demand);
+    statusAttr[channel] = reportAttributeAdd(&status);
+}
+
+void meteringBegin() {
+    if (ready) {
+        return;
+    }
+    ready = true;
+
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        addChannel(i);
+    }
+}
+
+void meteringUpdate(uint64_t volumeMl, uint32_t flowMlMin, uint8_t channel) {
+    meteringBegin();
+
+    uint32_t demand = meteringDemand(flowMlMin);
+    if (volumeMl != lastVolumeMl[channel]) {
+        setAttribute(channel, METERING_SUMMATION_ATTR, ZCL_TYPE_UINT48, volumeMl);
+        lastVolumeMl[channel] = volumeMl;
+    }
+    if (demand != lastDemand[channel]) {
+        setAttribute(channel, METERING_DEMAND_ATTR, ZCL_TYPE_INT24, demand);
+        lastDemand[channel] = demand;
+    }
+
+    reportAttributeSet(summationAttr[channel], volumeMl);
+    reportAttributeSet(demandAttr[channel], demand);
+}
+
+void meteringHoldChanges(bool hold, uint8_t channel) {
+    meteringBegin();
+    reportHoldChanges(summationAttr[channel], hold);
+    reportHoldChanges(demandAttr[channel], hold);
+}
+
+void meteringSetAlarms(uint8_t alarms, uint64_t originUs, uint8_t channel) {
+    meteringBegin();
+    if (alarms == lastAlarms[channel]) {
+        return;
+    }
+
+    uint8_t status = meteringStatus(alarms);
+    setAttribute(channel, METERING_STATUS_ATTR, ZCL_TYPE_BITMAP8, status);
+    setAttribute(channel, METERING_LEAK_ALARMS_ATTR, ZCL_TYPE_BITMAP8, alarms);
+    lastAlarms[channel] = alarms;
+    reportAlarm(statusAttr[channel], status, originUs);
+}
+
+// Consumption attribute: set when it changed, saturated to its type
+static void setConsumption(uint8_t channel, uint16_t attrId, uint8_t zclType, uint64_t valueMl,
+                           uint64_t* lastMl, uint32_t max) {
+    uint64_t value = valueMl > max ? max : valueMl;
+    if (value != *lastMl) {
+        setAttribute(channel, attrId, zclType, value);
+        *lastMl = value;
+    }
+}
+
+void meteringSetConsumption(const ConsumptionTotals* totals, uint8_t channel) {
+    meteringBegin();
+    ConsumptionTotals* last = &lastConsumption[channel];
+    setConsumption(channel, METERING_DAY_ATTR, ZCL_TYPE_UINT24, totals->todayMl, &last->todayMl,
+                   METERING_UINT24_MAX);
+    setConsumption(channel, METERING_PREVIOUS_DAY_ATTR, ZCL_TYPE_UINT24, totals->yesterdayMl,
+                   &last->yesterdayMl, METERING_UINT24_MAX);
+    setConsumption(channel, METERING_WEEK_ATTR, ZCL_TYPE_UINT24, totals->weekMl, &last->weekMl,
+                   METERING_UINT24_MAX);
+    setConsumption(channel, METERING_MONTH_ATTR, ZCL_TYPE_UINT32, totals->monthMl, &last->monthMl,
+                   UINT32_MAX);
+    setConsumption(channel, METERING_YEAR_ATTR, ZCL_TYPE_UINT32, totals->yearMl, &last->yearMl,
+                   UINT32_MAX);
+}
+
+uint8_t meteringStatus(uint8_t alarms) {
+    uint8_t status = 0;
+    if (alarms & (LEAK_ALARM_CONTINUOUS | LEAK_ALARM_NEVER_QUIET)) {
+        status |= METERING_STATUS_LEAK;
+    }
+    if (alarms & LEAK_ALARM_BURST) {
+        status |= METERING_STATUS_BURST;
+    }
+    return status;
+}
+
+uint32_t meteringDemand(uint32_t flowMlMin) {
+    uint64_t demand = (uint64_t)flowMlMin * 60;
+    return demand > METERING_DEMAND_MAX ? METERING_DEMAND_MAX : (uint32_t)demand;
+}
+
+void resetMeteringCluster() {
+    ready = false;
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        summationAttr[i] = REPORT_NO_ATTRIBUTE;
+        demandAttr[i] = REPORT_NO_ATTRIBUTE;
+        statusAttr[i] = REPORT_NO_ATTRIBUTE;
+        lastVolumeMl[i] = 0;
+        lastDemand[i] = 0;
+        lastAlarms[i] = 0;
+        lastConsumption[i] = ConsumptionTotals();
+    }
+}
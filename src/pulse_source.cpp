@@ -0,0 +1,347 @@
+/*
+ * Water Flow Meter - Pulse Source
+ * GPIO interrupt and PCNT peripheral pulse counting backends
+ */
+
+#include "pulse_source.h"
+#include "config_traits.h"
+#include "seqlock.h"
+#include "latency_stats.h"
+#include "pulse_trace.h"
+
+// GPIO backend: the channel's pulse ISR owns gpioLatest and publishes it
+struct GpioState {
+    uint64_t count;          // Pulses since begin
+    uint64_t edgeUs;         // hal_micros64() at the last edge
+};
+
+// PCNT backend: the channel's overflow and timed edge interrupts own
+// pcntLatest and publish it (same level - they never nest)
+struct PcntState {
+    uint32_t overflows;      // Hardware count overflows since begin
+    uint32_t reserved;
+    uint64_t edgeCount;      // Extended count at the newest timed edge
+    uint64_t edgeUs;         // hal_micros64() at that edge
+};
+
+// One flow channel's source - its interrupt handlers touch only this entry
+struct ChannelSource {
+    GpioState gpioLatest = {};
+    Seqlock<GpioState> gpioShared = {};
+    PcntState pcntLatest = {};
+    Seqlock<PcntState> pcntShared = {};
+    volatile bool pcntTimerArmed = false;   // Timed edge interrupt unmasked
+    uint64_t pcntArmedCount = 0;             // Count when it was unmasked
+    uint64_t pcntLastCount = 0;
+    uint64_t pcntEdgeCount = 0;              // Newest timed edge the count confirms
+    uint64_t pcntEdgeUs = 0;
+    uint64_t pcntGlitchUs = 0;               // Timed edge found to be a glitch
+    uint8_t pin = 0;
+    const PulseSource* source = &pulseSourceGpio;
+    uint8_t backend = PULSE_BACKEND_GPIO;
+    uint64_t countBase = 0;  // Pulses counted by earlier backends
+};
+
+static ChannelSource channels[FLOW_CHANNELS];
+static void (*edgeHandler)(uint8_t channel) = nullptr;
+static volatile PulseSourceStats stats;
+
+// ============================================================================
+// GPIO Interrupt Backend
+// ============================================================================
+
+static void IRAM_ATTR gpioEdge(uint8_t channel) {
+    uint32_t start = LATENCY_START();
+    ChannelSource* ch = &channels[channel];
+    ch->gpioLatest.count++;
+    ch->gpioLatest.edgeUs = hal_micros64();
+    seqlockWrite(&ch->gpioShared, ch->gpioLatest);
+    stats.interrupts = stats.interrupts + 1;
+    if (channel == 0) {
+        traceEdge((uint32_t)ch->gpioLatest.edgeUs);   // The trace records channel 0
+    }
+
+    if (edgeHandler) {
+        edgeHandler(channel);
+    }
+    LATENCY_RECORD(LATENCY_PULSE_ISR, start);
+}
+
+/**
+ * Interrupt handler for flow sensor pulses
+ * MUST remain active at all times - never disable this interrupt
+ */
+void IRAM_ATTR pulseCounter() {
+    gpioEdge(0);
+}
+
+// hal_attach_pulse_interrupt() handlers take no argument: one per channel.
+// Handlers past FLOW_CHANNELS are never attached and compile to nothing
+template <uint8_t CHANNEL>
+static void IRAM_ATTR channelPulseCounter() {
+    if (CHANNEL < FLOW_CHANNELS) {
+        gpioEdge(CHANNEL);
+    }
+}
+
+static_assert(HAL_PCNT_UNITS == 4, "one interrupt handler per channel below");
+static void (*const GPIO_HANDLERS[HAL_PCNT_UNITS])() = {
+    pulseCounter, channelPulseCounter<1>, channelPulseCounter<2>, channelPulseCounter<3>,
+};
+
+static bool gpioBegin(uint8_t channel, uint8_t pin) {
+    // Interrupt not attached yet - safe to write from the main task
+    ChannelSource* ch = &channels[channel];
+    ch->gpioLatest.count = 0;
+    ch->gpioLatest.edgeUs = hal_micros64();
+    seqlockWrite(&ch->gpioShared, ch->gpioLatest);
+    hal_attach_pulse_interrupt(pin, GPIO_HANDLERS[channel]);
+    return true;
+}
+
+static void gpioEnd(uint8_t channel, uint8_t pin) {
+    (void)channel;
+    hal_detach_pulse_interrupt(pin);
+}
+
+static void gpioRead(uint8_t channel, PulseReading* reading) {
+    GpioState state = seqlockRead(&channels[channel].gpioShared);
+    reading->count = state.count;
+    reading->edgeCount = state.count;
+    reading->edgeUs = state.edgeUs;
+}
+
+const PulseSource pulseSourceGpio = { gpioBegin, gpioEnd, gpioRead };
+
+// ============================================================================
+// PCNT Peripheral Backend
+// ============================================================================
+
+/**
+ * Counter overflow - the edge at the limit is timed by the event itself
+ */
+static void IRAM_ATTR pcntOverflow(uint8_t channel) {
+    uint32_t start = LATENCY_START();
+    ChannelSource* ch = &channels[channel];
+    ch->pcntLatest.edgeUs = hal_micros64();
+    ch->pcntLatest.overflows++;
+    stats.overflows = stats.overflows + 1;
+    ch->pcntLatest.edgeCount = (uint64_t)ch->pcntLatest.overflows * HAL_PCNT_LIMIT;
+    seqlockWrite(&ch->pcntShared, ch->pcntLatest);
+    stats.interrupts = stats.interrupts + 1;
+
+    if (edgeHandler) {
+        edgeHandler(channel);
+    }
+    LATENCY_RECORD(LATENCY_PULSE_ISR, start);
+}
+
+/**
+ * One-shot GPIO interrupt on the counted pin: times the first edge after
+ * pcntArm() and masks itself again
+ */
+static void IRAM_ATTR pcntTimedEdge(uint8_t channel) {
+    uint32_t start = LATENCY_START();
+    ChannelSource* ch = &channels[channel];
+    hal_pulse_interrupt_enable(ch->pin, false);
+    ch->pcntLatest.edgeUs = hal_micros64();
+    ch->pcntLatest.edgeCount = ch->pcntArmedCount + 1;
+    seqlockWrite(&ch->pcntShared, ch->pcntLatest);
+    ch->pcntTimerArmed = false;
+    stats.interrupts = stats.interrupts + 1;
+
+    if (edgeHandler) {
+        edgeHandler(channel);
+    }
+    LATENCY_RECORD(LATENCY_PULSE_ISR, start);
+}
+
+template <uint8_t CHANNEL>
+static void IRAM_ATTR channelPcntEvent(HalPcntEvent event) {
+    (void)event;    // Overflow is the only counter event
+    if (CHANNEL < FLOW_CHANNELS) {
+        pcntOverflow(CHANNEL);
+    }
+}
+
+template <uint8_t CHANNEL>
+static void IRAM_ATTR channelPcntEdge() {
+    if (CHANNEL < FLOW_CHANNELS) {
+        pcntTimedEdge(CHANNEL);
+    }
+}
+
+static void (*const PCNT_HANDLERS[HAL_PCNT_UNITS])(HalPcntEvent event) = {
+    channelPcntEvent<0>, channelPcntEvent<1>, channelPcntEvent<2>, channelPcntEvent<3>,
+};
+
+static void (*const PCNT_EDGE_HANDLERS[HAL_PCNT_UNITS])() = {
+    channelPcntEdge<0>, channelPcntEdge<1>, channelPcntEdge<2>, channelPcntEdge<3>,
+};
+
+/**
+ * Extended count: overflows and hardware count read inside the section -
+ * an overflow event between the two would otherwise pair a new count with
+ * old overflows
+ */
+static uint64_t pcntCount(uint8_t channel, PcntState* state) {
+    ChannelSource* ch = &channels[channel];
+    uint32_t hardware;
+    uint32_t seq;
+    do {
+        seq = seqlockReadBegin(&ch->pcntShared);
+        seqlockCopy(&ch->pcntShared, state);
+        hardware = hal_pcnt_count(channel);
+    } while (seqlockReadRetry(&ch->pcntShared, seq));
+
+    // The counter restarts at 0 just before its overflow interrupt runs -
+    // a read in between would go backwards by one full hardware range
+    uint64_t count = (uint64_t)state->overflows * HAL_PCNT_LIMIT + hardware;
+    if (count < ch->pcntLastCount) {
+        count += HAL_PCNT_LIMIT;
+    }
+    ch->pcntLastCount = count;
+    return count;
+}
+
+/**
+ * Unmask the timed edge interrupt for the edge after count. An edge
+ * between the count read and the unmask would be timed as count + 1 when
+ * it is later - re-read and arm again until the count stood still (the
+ * interrupt disarms itself if it timed the edge in between)
+ */
+static void pcntArm(uint8_t channel, uint64_t count) {
+    ChannelSource* ch = &channels[channel];
+    for (;;) {
+        ch->pcntArmedCount = count;
+        ch->pcntTimerArmed = true;
+        hal_pulse_interrupt_enable(ch->pin, true);
+
+        PcntState state;
+        uint64_t now = pcntCount(channel, &state);
+        if (!ch->pcntTimerArmed || now == count) {
+            return;
+        }
+        hal_pulse_interrupt_enable(ch->pin, false);
+        count = now;
+    }
+}
+
+static bool pcntBegin(uint8_t channel, uint8_t pin) {
+    ChannelSource* ch = &channels[channel];
+    ch->pin = pin;
+    ch->pcntLatest = PcntState();
+    ch->pcntLatest.edgeUs = hal_micros64();
+    seqlockWrite(&ch->pcntShared, ch->pcntLatest);
+    ch->pcntTimerArmed = false;
+    ch->pcntLastCount = 0;
+    ch->pcntEdgeCount = 0;
+    ch->pcntEdgeUs = ch->pcntLatest.edgeUs;
+    ch->pcntGlitchUs = 0;
+    if (!hal_pcnt_begin(channel, pin, PULSE_GLITCH_FILTER_NS, PCNT_HANDLERS[channel])) {
+        return false;
+    }
+
+    // Edges are timed by a GPIO interrupt on the same pin, unmasked only
+    // while a timed edge is wanted - counter watch points added while the
+    // unit runs never fire. Time the first edge: it wakes an idle meter
+    hal_attach_pulse_interrupt(pin, PCNT_EDGE_HANDLERS[channel]);
+    hal_pulse_interrupt_enable(pin, false);
+    pcntArm(channel, 0);
+    return true;
+}
+
+static void pcntEnd(uint8_t channel, uint8_t pin) {
+    hal_detach_pulse_interrupt(pin);
+    hal_pcnt_end(channel);
+    channels[channel].pcntTimerArmed = false;
+}
+
+static void pcntRead(uint8_t channel, PulseReading* reading) {
+    ChannelSource* ch = &channels[channel];
+    PcntState state;
+    uint64_t count = pcntCount(channel, &state);
+    reading->count = count;
+
+    // The GPIO interrupt also sees glitches the counter filters out: a
+    // timed edge ahead of the count was one, and keeps being ignored once
+    // real edges catch up with it
+    if (state.edgeCount > count) {
+        ch->pcntGlitchUs = state.edgeUs;
+    } else if (state.edgeUs != ch->pcntGlitchUs) {
+        ch->pcntEdgeCount = state.edgeCount;
+        ch->pcntEdgeUs = state.edgeUs;
+    }
+    reading->edgeCount = ch->pcntEdgeCount;
+    reading->edgeUs = ch->pcntEdgeUs;
+
+    // Time the next edge: at most one interrupt per read whatever the rate
+    if (!ch->pcntTimerArmed) {
+        pcntArm(channel, count);
+    }
+}
+
+const PulseSource pulseSourcePcnt = { pcntBegin, pcntEnd, pcntRead };
+
+// ============================================================================
+// Source Selection
+// ============================================================================
+
+uint8_t pulseSourceBegin(uint8_t channel, uint8_t backend, uint8_t pin,
+                         void (*onEdge)(uint8_t channel)) {
+    // Carry the count over from the previous backend
+    ChannelSource* ch = &channels[channel];
+    ch->countBase = pulseSourceCount(channel);
+    ch->source->end(channel, pin);
+
+    edgeHandler = onEdge;
+    ch->source = backend == PULSE_BACKEND_PCNT ? &pulseSourcePcnt : &pulseSourceGpio;
+    ch->backend = backend;
+    if (!ch->source->begin(channel, pin)) {
+        ch->source = &pulseSourceGpio;
+        ch->backend = PULSE_BACKEND_GPIO;
+        ch->source->begin(channel, pin);
+    }
+    return ch->backend;
+}
+
+uint8_t pulseSourceBackend(uint8_t channel) {
+    return channels[channel].backend;
+}
+
+void pulseSourceRead(PulseReading* reading, uint8_t channel) {
+    ChannelSource* ch = &channels[channel];
+    ch->source->read(channel, reading);
+    reading->count += ch->countBase;
+    reading->edgeCount += ch->countBase;
+}
+
+uint64_t pulseSourceCount(uint8_t channel) {
+    PulseReading reading;
+    pulseSourceRead(&reading, channel);
+    return reading.count;
+}
+
+const PulseSourceStats* pulseSourceStats() {
+    return (const PulseSourceStats*)&stats;
+}
+
+// ============================================================================
+// Test Support
+// ============================================================================
+
+void pulseSourceInject(uint64_t pulses, uint8_t channel) {
+    ChannelSource* ch = &channels[channel];
+    ch->gpioLatest.count += pulses;
+    ch->gpioLatest.edgeUs = hal_micros64();
+    seqlockWrite(&ch->gpioShared, ch->gpioLatest);
+}
+
+void resetPulseSource() {
+    for (ChannelSource& ch : channels) {
+        ch = ChannelSource();
+    }
+    edgeHandler = nullptr;
+    stats.interrupts = 0;
+    stats.overflows = 0;
+}
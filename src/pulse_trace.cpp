@@ -0,0 +1,329 @@
+/*
+ * Water Flow Meter - Pulse Trace
+ * Edge capture ring, delta + varint chunks in flash, sequential reader
+ */
+
+#include "pulse_trace.h"
+#include "crc32.h"
+#include "flow_history.h"
+#include <stddef.h>
+#include <string.h>
+
+#define TRACE_VARINT_MAX 10            // Longest varint of a 64-bit token
+
+static_assert((TRACE_RING_EDGES & (TRACE_RING_EDGES - 1)) == 0,
+              "TRACE_RING_EDGES must be a power of two");
+static_assert(TRACE_HEADER_SIZE + TRACE_CHUNK_BYTES <= HAL_FLASH_SECTOR_SIZE,
+              "a trace chunk must fit in one flash sector");
+static_assert(TRACE_CHUNK_BYTES <= 0xFFFF, "chunk length is a uint16 in the header");
+
+static uint32_t chunkCrc(const TraceChunkHeader* header, const uint8_t* data) {
+    return crc32Update(crc32(header, offsetof(TraceChunkHeader, crc)), data, header->length);
+}
+
+/**
+ * Read and check the chunk at offset (within the trace area)
+ */
+static bool readChunk(uint32_t offset, TraceChunkHeader* header, uint8_t* data) {
+    if (offset + TRACE_HEADER_SIZE > TRACE_AREA_BYTES ||
+        !hal_flash_read(TRACE_OFFSET + offset, header, sizeof(*header))) {
+        return false;
+    }
+    if (header->magic != TRACE_CHUNK_MAGIC || header->length > TRACE_CHUNK_BYTES ||
+        offset % HAL_FLASH_SECTOR_SIZE + TRACE_HEADER_SIZE + header->length >
+            HAL_FLASH_SECTOR_SIZE) {
+        return false;
+    }
+    return hal_flash_read(TRACE_OFFSET + offset + TRACE_HEADER_SIZE, data, header->length) &&
+           header->crc == chunkCrc(header, data);
+}
+
+/**
+ * Load the next chunk of the trace into the reader. A chunk that does not
+ * fit the rest of a sector starts the next one, and every chunk must carry
+ * on where the previous one ended - which also stops the reader at chunks
+ * left over from an older, longer trace
+ */
+static bool loadChunk(TraceReader* reader, uint64_t ledger) {
+    TraceChunkHeader header;
+    uint32_t offset = reader->offset;
+    if (!readChunk(offset, &header, reader->data)) {
+        uint32_t next = (offset / HAL_FLASH_SECTOR_SIZE + 1) * HAL_FLASH_SECTOR_SIZE;
+        if (offset % HAL_FLASH_SECTOR_SIZE == 0 || !readChunk(next, &header, reader->data)) {
+            return false;
+        }
+        offset = next;
+    }
+    if (header.seq != reader->seq ||
+        (reader->seq > 0 && (header.baseUs != reader->timeUs || header.baseLedger != ledger))) {
+        return false;
+    }
+
+    reader->offset = offset + TRACE_HEADER_SIZE + header.length;
+    reader->seq++;
+    reader->timeUs = header.baseUs;
+    reader->length = header.length;
+    reader->pos = 0;
+    if (header.seq == 0) {
+        reader->startUs = header.baseUs;
+        reader->startLedger = header.baseLedger;
+    }
+    return true;
+}
+
+// ============================================================================
+// Reading
+// ============================================================================
+
+bool traceReaderBegin(TraceReader* reader) {
+    memset(reader, 0, sizeof(*reader));
+    if (!hal_flash_begin(DATA_PARTITION_LABEL) || !loadChunk(reader, 0)) {
+        reader->done = true;
+        return false;
+    }
+    return true;
+}
+
+bool traceReaderNext(TraceReader* reader, uint64_t* edgeUs) {
+    while (!reader->done) {
+        if (reader->pos >= reader->length) {
+            // Ledger at the end of this chunk, for the next one's check
+            uint64_t ledger = reader->startLedger + reader->edges;
+            if (!loadChunk(reader, ledger)) {
+                reader->done = true;
+            }
+            continue;
+        }
+
+        uint64_t token;
+        size_t used = historyGetVarint(reader->data + reader->pos, reader->length - reader->pos,
+                                       &token);
+        if (used == 0) {
+            reader->done = true;
+            break;
+        }
+        reader->pos += used;
+        reader->timeUs += token >> 1;
+        if (!(token & 1)) {
+            reader->edges++;
+            *edgeUs = reader->timeUs;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t traceLength() {
+    TraceReader reader;
+    if (!traceReaderBegin(&reader)) {
+        return 0;
+    }
+    uint64_t edgeUs;
+    while (traceReaderNext(&reader, &edgeUs)) {
+    }
+    return reader.offset;
+}
+
+#if PULSE_TRACE_ENABLED
+
+#include "flow_meter.h"
+#include "deferred_log.h"
+
+// ============================================================================
+// Capture State
+// ============================================================================
+
+// Edge times (low 32 bits) from the ISR to the flow job
+static uint32_t ring[TRACE_RING_EDGES];
+static uint32_t ringHead = 0;          // Written by the ISR
+static uint32_t ringTail = 0;          // Written by the main task
+static bool capturing = false;
+
+static TraceStats stats;
+static uint8_t restoreBackend = PULSE_BACKEND_GPIO;
+static uint64_t skipUntilUs = 0;       // Edges up to here are in the base ledger
+
+// Chunk being filled
+static TraceChunkHeader chunk;
+static uint8_t chunkData[TRACE_CHUNK_BYTES];
+static uint64_t lastUs = 0;            // Time of the last token
+static uint32_t writeOffset = 0;       // Next free byte of the trace area
+
+// ============================================================================
+// ISR Side
+// ============================================================================
+
+void IRAM_ATTR traceEdge(uint32_t edgeUs) {
+    if (!__atomic_load_n(&capturing, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    uint32_t head = ringHead;
+    if (head - __atomic_load_n(&ringTail, __ATOMIC_ACQUIRE) >= TRACE_RING_EDGES) {
+        stats.dropped++;
+        return;
+    }
+    ring[head & (TRACE_RING_EDGES - 1)] = edgeUs;
+    __atomic_store_n(&ringHead, head + 1, __ATOMIC_RELEASE);
+}
+
+// ============================================================================
+// Chunk Writing
+// ============================================================================
+
+static void openChunk(uint64_t baseUs, uint64_t baseLedger, uint32_t seq) {
+    memset(&chunk, 0, sizeof(chunk));
+    chunk.magic = TRACE_CHUNK_MAGIC;
+    chunk.seq = seq;
+    chunk.baseUs = baseUs;
+    chunk.baseLedger = baseLedger;
+}
+
+static void endCapture() {
+    __atomic_store_n(&capturing, false, __ATOMIC_RELEASE);
+    if (restoreBackend != PULSE_BACKEND_GPIO) {
+        selectPulseBackend(restoreBackend);
+    }
+    LOG(TRACE_STOPPED, (unsigned long)stats.edges, (unsigned long)stats.bytes,
+        (unsigned long)stats.dropped);
+}
+
+/**
+ * Write the chunk and open the next one where it ended
+ * False (and the capture ends) if the trace area is full
+ */
+static bool writeChunk() {
+    uint32_t size = TRACE_HEADER_SIZE + chunk.length;
+    if (writeOffset % HAL_FLASH_SECTOR_SIZE + size > HAL_FLASH_SECTOR_SIZE) {
+        writeOffset = (writeOffset / HAL_FLASH_SECTOR_SIZE + 1) * HAL_FLASH_SECTOR_SIZE;
+    }
+    if (writeOffset + size > TRACE_AREA_BYTES) {
+        endCapture();
+        return false;
+    }
+    if (writeOffset % HAL_FLASH_SECTOR_SIZE == 0 && writeOffset > 0) {
+        hal_flash_erase(TRACE_OFFSET + writeOffset, HAL_FLASH_SECTOR_SIZE);
+    }
+
+    chunk.crc = chunkCrc(&chunk, chunkData);
+    hal_flash_write(TRACE_OFFSET + writeOffset, &chunk, sizeof(chunk));
+    hal_flash_write(TRACE_OFFSET + writeOffset + TRACE_HEADER_SIZE, chunkData, chunk.length);
+    writeOffset += size;
+    stats.chunks++;
+    stats.bytes = writeOffset;
+
+    openChunk(lastUs, chunk.baseLedger + chunk.edges, chunk.seq + 1);
+    return true;
+}
+
+static bool appendToken(uint64_t token) {
+    if (chunk.length + TRACE_VARINT_MAX > TRACE_CHUNK_BYTES && !writeChunk()) {
+        return false;
+    }
+    chunk.length += historyPutVarint(chunkData + chunk.length, token);
+    return true;
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+bool traceStart() {
+    if (capturing) {
+        return true;
+    }
+    if (!hal_flash_begin(DATA_PARTITION_LABEL)) {
+        return false;
+    }
+
+    // Erasing the first sector invalidates the previous trace; later
+    // sectors are erased as the capture reaches them
+    hal_flash_erase(TRACE_OFFSET, HAL_FLASH_SECTOR_SIZE);
+    writeOffset = 0;
+    stats = TraceStats();
+
+    restoreBackend = pulseSourceBackend();
+    if (restoreBackend != PULSE_BACKEND_GPIO) {
+        selectPulseBackend(PULSE_BACKEND_GPIO);
+    }
+    ringTail = ringHead;
+    __atomic_store_n(&capturing, true, __ATOMIC_RELEASE);
+
+    // Every edge before the reading is in its count and timed no later than
+    // its edgeUs; every edge after it is queued and timed after startUs
+    uint64_t startUs = hal_micros64();
+    PulseReading reading;
+    pulseSourceRead(&reading);
+    skipUntilUs = reading.edgeUs;
+
+    lastUs = startUs;
+    openChunk(startUs, ledgerAt(&reading), 0);
+    LOG(TRACE_STARTED, (unsigned long long)chunk.baseLedger);
+    return true;
+}
+
+void traceUpdate() {
+    if (!capturing) {
+        return;
+    }
+
+    // Every queued edge happened before now - that places its low 32 bits
+    uint32_t head = __atomic_load_n(&ringHead, __ATOMIC_ACQUIRE);
+    uint64_t nowUs = hal_micros64();
+    while (ringTail != head) {
+        uint32_t low = ring[ringTail & (TRACE_RING_EDGES - 1)];
+        __atomic_store_n(&ringTail, ringTail + 1, __ATOMIC_RELEASE);
+
+        uint64_t edgeUs = nowUs - (uint32_t)((uint32_t)nowUs - low);
+        if (edgeUs <= skipUntilUs) {
+            continue;
+        }
+        if (!appendToken((edgeUs - lastUs) << 1)) {
+            return;
+        }
+        lastUs = edgeUs;
+        chunk.edges++;
+        stats.edges++;
+    }
+}
+
+void traceStop() {
+    traceUpdate();
+    if (!capturing) {
+        return;
+    }
+
+    uint64_t nowUs = hal_micros64();
+    if (!appendToken(((nowUs - lastUs) << 1) | 1)) {
+        return;
+    }
+    lastUs = nowUs;
+    if (writeChunk()) {
+        endCapture();
+    }
+}
+
+bool traceCapturing() {
+    return capturing;
+}
+
+const TraceStats* traceStats() {
+    return &stats;
+}
+
+// ============================================================================
+// Test Support
+// ============================================================================
+
+void resetPulseTrace() {
+    capturing = false;
+    ringHead = 0;
+    ringTail = 0;
+    stats = TraceStats();
+    restoreBackend = PULSE_BACKEND_GPIO;
+    skipUntilUs = 0;
+    lastUs = 0;
+    writeOffset = 0;
+    memset(&chunk, 0, sizeof(chunk));
+}
+
+#endif // PULSE_TRACE_ENABLED
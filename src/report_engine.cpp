@@ -0,0 +1,589 @@
+/*
+ * Water Flow Meter - Report Engine
+ * Coalesced, rate-limited Zigbee attribute reporting
+ */
+
+#include "report_engine.h"
+#include "config_traits.h"
+#include "deferred_log.h"
+#include <stdio.h>
+#include <string.h>
+
+struct ReportAttribute {
+    ReportAttributeConfig config;    // Rules in force
+    ReportAttributeConfig defaults;  // Compiled-in rules
+    uint64_t value;          // Current value
+    uint64_t reported;       // Value in the last report
+    uint32_t reportedMs;     // hal_millis() of the last report
+    bool requested;          // Cluster report requested (reportRequestCluster)
+    bool held;               // Change reports held (reportHoldChanges)
+    // Urgent lane
+    bool urgent;             // Alarm waiting to be sent
+    bool awaitingAck;        // Sent, acknowledgement not seen yet
+    uint8_t tries;           // Transmissions of the current alarm
+    int ackHandle;           // hal_radio_report_status() handle
+    uint32_t sentMs;         // hal_millis() of the last transmission
+    uint64_t originUs;       // Sample that raised the alarm
+};
+
+static ReportAttribute attributes[REPORT_MAX_ATTRIBUTES];
+static uint8_t attributeCount = 0;
+static bool requested = false;
+
+// Token bucket in milli-bytes, refilled lazily from budgetMs
+static uint32_t budget = REPORT_BUDGET_MAX;
+static uint32_t budgetMs = 0;
+
+static ReportEngineStats stats;
+
+// ============================================================================
+// Reporting Rules
+// ============================================================================
+
+static uint32_t age(const ReportAttribute* attr, uint32_t now) {
+    return now - attr->reportedMs;
+}
+
+// Configured with maximum interval 0xFFFF: not reported at all
+static bool reportingOff(const ReportAttribute* attr) {
+    return attr->config.maxIntervalMs == REPORT_INTERVAL_OFF;
+}
+
+static bool deadlineDue(const ReportAttribute* attr, uint32_t now) {
+    return attr->config.maxIntervalMs > 0 && !reportingOff(attr) &&
+           age(attr, now) >= attr->config.maxIntervalMs;
+}
+
+/**
+ * Moved by at least the absolute floor and by more than the per-mille of
+ * the last report - the floor keeps a near-zero value from reporting on
+ * every small wobble
+ */
+static bool significant(const ReportAttribute* attr) {
+    uint64_t diff = attr->value > attr->reported ? attr->value - attr->reported
+                                                 : attr->reported - attr->value;
+    return diff > 0 && diff >= attr->config.minChange &&
+           diff * 1000 > attr->reported * attr->config.changePermille;
+}
+
+static bool changeDue(const ReportAttribute* attr, uint32_t now) {
+    return !reportingOff(attr) && !attr->held && significant(attr) &&
+           age(attr, now) >= attr->config.minIntervalMs;
+}
+
+// Worth carrying in a frame that goes out anyway
+static bool piggyback(const ReportAttribute* attr, uint32_t now) {
+    return !reportingOff(attr) &&
+           (attr->value != attr->reported ||
+            (attr->config.maxIntervalMs > 0 && age(attr, now) >= attr->config.maxIntervalMs / 2));
+}
+
+// Full report requested, and attr goes in full reports
+static bool requestedAll(const ReportAttribute* attr) {
+    return requested && !attr->config.onRequest;
+}
+
+static bool sameCluster(const ReportAttribute* a, const ReportAttribute* b) {
+    return a->config.endpoint == b->config.endpoint && a->config.clusterId == b->config.clusterId;
+}
+
+// Encoded size of a ZCL integer type, 0 if not supported
+static uint8_t typeLength(uint8_t zclType) {
+    switch (zclType) {
+        case ZCL_TYPE_BITMAP8:
+        case ZCL_TYPE_UINT8:
+        case ZCL_TYPE_ENUM8:
+            return 1;
+        case ZCL_TYPE_UINT24:
+        case ZCL_TYPE_INT24:
+            return 3;
+        case ZCL_TYPE_BITMAP32:
+        case ZCL_TYPE_UINT32:
+            return 4;
+        case ZCL_TYPE_UINT48:
+            return 6;
+        default:
+            return 0;
+    }
+}
+
+// ============================================================================
+// Stored Reporting Configuration
+// ============================================================================
+
+// "back to defaults" as stored: min 0xFFFF, max 0
+#define STORED_DEFAULTS 0xFFFF0000UL
+
+static void storageKey(const ReportAttributeConfig* config, char suffix, char* key) {
+    snprintf(key, 16, "r%02x%04x%04x%c", config->endpoint, config->clusterId, config->attrId, suffix);
+}
+
+static void applyIntervals(ReportAttribute* attr, uint16_t minS, uint16_t maxS, uint64_t change) {
+    attr->config.minIntervalMs = (uint32_t)minS * 1000;
+    attr->config.maxIntervalMs = maxS == 0xFFFF ? REPORT_INTERVAL_OFF : (uint32_t)maxS * 1000;
+    attr->config.minChange = change;
+    attr->config.changePermille = 0;
+}
+
+static void loadConfig(ReportAttribute* attr) {
+    char key[16];
+    hal_nvs_begin(EEPROM_NAMESPACE, true);
+    storageKey(&attr->config, 'i', key);
+    uint32_t intervals = hal_nvs_get_u32(key, STORED_DEFAULTS);
+    storageKey(&attr->config, 'c', key);
+    uint64_t change = hal_nvs_get_u64(key, 0);
+    hal_nvs_end();
+
+    if (intervals != STORED_DEFAULTS) {
+        applyIntervals(attr, (uint16_t)(intervals >> 16), (uint16_t)intervals, change);
+    }
+}
+
+// Only on a Configure Reporting command - never on the reporting path
+static void storeConfig(const ReportAttribute* attr, uint32_t intervals, uint64_t change) {
+    char key[16];
+    hal_nvs_begin(EEPROM_NAMESPACE, false);
+    storageKey(&attr->config, 'i', key);
+    hal_nvs_put_u32(key, intervals);
+    storageKey(&attr->config, 'c', key);
+    hal_nvs_put_u64(key, change);
+    hal_nvs_end();
+}
+
+// ============================================================================
+// Airtime Budget
+// ============================================================================
+
+// Every report check - multiplies by the precomputed rate (config_traits.h)
+static void budgetRefill(uint32_t now) {
+    uint64_t refill = mulQ32(now - budgetMs, REPORT_BUDGET_PER_MS_Q32);
+    budgetMs = now;
+    budget = budget + refill >= REPORT_BUDGET_MAX ? REPORT_BUDGET_MAX : (uint32_t)(budget + refill);
+}
+
+static void budgetSpend(uint32_t bytes) {
+    uint32_t cost = bytes * 1000;
+    budget = budget > cost ? budget - cost : 0;
+}
+
+// Milliseconds until the bucket holds bytes
+static uint32_t budgetWaitMs(uint32_t bytes) {
+    uint32_t cost = bytes * 1000;
+    if (budget >= cost) {
+        return 0;
+    }
+    return (uint32_t)(((uint64_t)(cost - budget) * REPORT_BUDGET_MS_PER_Q32 + 0xFFFFFFFFULL) >> 32);
+}
+
+// ============================================================================
+// Frames
+// ============================================================================
+
+/**
+ * Collect the frame of the cluster starting at attributes[first]
+ * Sets *forced (a deadline or request) and *change (a change report is
+ * due); returns the number of records - 0 if nothing in it is due
+ */
+static uint8_t buildFrame(uint8_t first, uint32_t now, bool* forced, bool* change,
+                          HalAttribute* records, uint8_t* members) {
+    *forced = false;
+    *change = false;
+    for (uint8_t i = first; i < attributeCount; i++) {
+        if (sameCluster(&attributes[i], &attributes[first])) {
+            *forced = *forced || requestedAll(&attributes[i]) || attributes[i].requested ||
+                      attributes[i].urgent || deadlineDue(&attributes[i], now);
+            *change = *change || changeDue(&attributes[i], now);
+        }
+    }
+    if (!*forced && !*change) {
+        return 0;
+    }
+
+    uint8_t count = 0;
+    for (uint8_t i = first; i < attributeCount; i++) {
+        ReportAttribute* attr = &attributes[i];
+        if (sameCluster(attr, &attributes[first]) && !reportingOff(attr) &&
+            (requestedAll(attr) || attr->requested || attr->urgent || deadlineDue(attr, now) ||
+             changeDue(attr, now) || piggyback(attr, now))) {
+            reportEncode(attr->config.attrId, attr->config.zclType, attr->value, &records[count]);
+            members[count++] = i;
+        }
+    }
+    return count;
+}
+
+// First attribute of each cluster - later ones are collected with it
+static bool clusterLeader(uint8_t index) {
+    for (uint8_t i = 0; i < index; i++) {
+        if (sameCluster(&attributes[i], &attributes[index])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ============================================================================
+// Urgent Lane
+// ============================================================================
+
+static bool clusterUrgent(uint8_t first) {
+    for (uint8_t i = first; i < attributeCount; i++) {
+        if (attributes[i].urgent && sameCluster(&attributes[i], &attributes[first])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Alarm frames not acknowledged within REPORT_ACK_TIMEOUT (or failed)
+ * go back into the urgent lane until REPORT_ALARM_TRIES are used up
+ */
+static void checkAcks(uint32_t now) {
+    for (uint8_t i = 0; i < attributeCount; i++) {
+        ReportAttribute* attr = &attributes[i];
+        if (!attr->awaitingAck) {
+            continue;
+        }
+        HalReportStatus status = hal_radio_report_status(attr->ackHandle);
+        if (status == HAL_REPORT_PENDING && now - attr->sentMs < REPORT_ACK_TIMEOUT_MS) {
+            continue;
+        }
+        attr->awaitingAck = false;
+        if (status == HAL_REPORT_DELIVERED) {
+            continue;
+        }
+        if (attr->tries < REPORT_CONFIG.alarmTries) {
+            attr->urgent = true;
+            stats.alarmRetries++;
+        } else {
+            stats.alarmsLost++;
+            LOG(REPORT_ALARM_LOST, attr->config.endpoint, attr->config.clusterId, attr->config.attrId);
+        }
+    }
+}
+
+/**
+ * Send the frame of every cluster with an alarm waiting - acknowledged,
+ * whatever the minimum interval and budget say
+ */
+static uint8_t sendUrgent(uint32_t now, bool radioUp) {
+    checkAcks(now);
+
+    uint8_t sent = 0;
+    for (uint8_t first = 0; first < attributeCount; first++) {
+        if (!clusterLeader(first) || !clusterUrgent(first)) {
+            continue;
+        }
+
+        HalAttribute records[HAL_RADIO_MAX_ATTRIBUTES];
+        uint8_t members[HAL_RADIO_MAX_ATTRIBUTES];
+        bool forced;
+        bool change;
+        uint8_t count = buildFrame(first, now, &forced, &change, records, members);
+        if (count == 0) {
+            // Reporting switched off by the coordinator
+            for (uint8_t i = first; i < attributeCount; i++) {
+                if (sameCluster(&attributes[i], &attributes[first])) {
+                    attributes[i].urgent = false;
+                }
+            }
+            continue;
+        }
+
+        int handle = -1;
+        sent++;
+        if (radioUp) {
+            uint32_t bytes = hal_radio_frame_bytes(records, count);
+            handle = hal_radio_report_attributes_acked(attributes[first].config.endpoint,
+                                                       attributes[first].config.clusterId,
+                                                       records, count);
+            budgetSpend(bytes);
+            stats.frames++;
+            stats.alarmFrames++;
+            stats.bytesOnAir += bytes;
+        }
+
+        uint64_t nowUs = hal_micros64();
+        for (uint8_t i = 0; i < count; i++) {
+            ReportAttribute* attr = &attributes[members[i]];
+            attr->reported = attr->value;
+            attr->reportedMs = now;
+            attr->requested = false;
+            if (!attr->urgent) {
+                continue;
+            }
+            attr->urgent = false;
+            attr->tries++;
+            attr->sentMs = now;
+            // Dropped while disconnected: the join's full report carries it
+            attr->awaitingAck = radioUp;
+            attr->ackHandle = handle;
+            if (radioUp && attr->tries == 1) {
+                uint64_t latency = nowUs > attr->originUs ? nowUs - attr->originUs : 0;
+                stats.alarmLatencyUs = latency > UINT32_MAX ? UINT32_MAX : (uint32_t)latency;
+                if (stats.alarmLatencyUs > stats.alarmLatencyMaxUs) {
+                    stats.alarmLatencyMaxUs = stats.alarmLatencyUs;
+                }
+            }
+        }
+    }
+    return sent;
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+void reportEngineReset() {
+    attributeCount = 0;
+    requested = false;
+    budget = REPORT_BUDGET_MAX;
+    budgetMs = hal_millis();
+    memset(&stats, 0, sizeof(stats));
+}
+
+int reportAttributeAdd(const ReportAttributeConfig* config) {
+    // A cluster's attributes must fit in one frame
+    uint8_t clusterSize = 0;
+    for (uint8_t i = 0; i < attributeCount; i++) {
+        if (attributes[i].config.endpoint == config->endpoint &&
+            attributes[i].config.clusterId == config->clusterId) {
+            clusterSize++;
+        }
+    }
+    if (attributeCount >= REPORT_MAX_ATTRIBUTES || clusterSize >= HAL_RADIO_MAX_ATTRIBUTES) {
+        return REPORT_NO_ATTRIBUTE;
+    }
+    ReportAttribute* attr = &attributes[attributeCount];
+    attr->config = *config;
+    attr->defaults = *config;
+    attr->value = 0;
+    attr->reported = 0;
+    attr->reportedMs = 0;
+    attr->requested = false;
+    attr->held = false;
+    attr->urgent = false;
+    attr->awaitingAck = false;
+    attr->tries = 0;
+    attr->ackHandle = -1;
+    attr->sentMs = 0;
+    attr->originUs = 0;
+    loadConfig(attr);
+    return attributeCount++;
+}
+
+void reportAttributeSet(int attr, uint64_t value) {
+    if (attr >= 0 && attr < attributeCount) {
+        attributes[attr].value = value;
+    }
+}
+
+void reportHoldChanges(int attr, bool hold) {
+    if (attr >= 0 && attr < attributeCount) {
+        attributes[attr].held = hold;
+    }
+}
+
+void reportAlarm(int attr, uint64_t value, uint64_t originUs) {
+    if (attr < 0 || attr >= attributeCount) {
+        return;
+    }
+    // A newer alarm value replaces one still being retried
+    ReportAttribute* alarm = &attributes[attr];
+    alarm->value = value;
+    alarm->urgent = true;
+    alarm->awaitingAck = false;
+    alarm->tries = 0;
+    alarm->originUs = originUs;
+}
+
+uint8_t reportPollUrgent(bool radioUp) {
+    uint32_t now = hal_millis();
+    budgetRefill(now);
+    return sendUrgent(now, radioUp);
+}
+
+void reportRequestAll() {
+    requested = true;
+}
+
+void reportRequestCluster(int attr) {
+    if (attr < 0 || attr >= attributeCount) {
+        return;
+    }
+    for (uint8_t i = 0; i < attributeCount; i++) {
+        if (sameCluster(&attributes[i], &attributes[attr])) {
+            attributes[i].requested = true;
+        }
+    }
+}
+
+bool reportPending(int attr) {
+    return attr >= 0 && attr < attributeCount && attributes[attr].requested &&
+           !reportingOff(&attributes[attr]);
+}
+
+uint8_t reportConfigure(const HalReportingConfig* record) {
+    ReportAttribute* attr = nullptr;
+    for (uint8_t i = 0; i < attributeCount; i++) {
+        const ReportAttributeConfig* config = &attributes[i].config;
+        if (config->endpoint == record->endpoint && config->clusterId == record->clusterId &&
+            config->attrId == record->attrId) {
+            attr = &attributes[i];
+            break;
+        }
+    }
+    if (attr == nullptr) {
+        return ZCL_STATUS_UNSUPPORTED_ATTRIBUTE;
+    }
+    if (record->zclType != attr->config.zclType) {
+        return ZCL_STATUS_INVALID_DATA_TYPE;
+    }
+
+    uint32_t intervals = (uint32_t)record->minIntervalS << 16 | record->maxIntervalS;
+    if (intervals == STORED_DEFAULTS) {
+        attr->config = attr->defaults;
+        storeConfig(attr, STORED_DEFAULTS, 0);
+        return ZCL_STATUS_SUCCESS;
+    }
+    // Maximum 0 (no periodic report) and 0xFFFF (off) take any minimum
+    if (record->maxIntervalS != 0 && record->maxIntervalS != 0xFFFF &&
+        record->minIntervalS > record->maxIntervalS) {
+        return ZCL_STATUS_INVALID_VALUE;
+    }
+
+    applyIntervals(attr, record->minIntervalS, record->maxIntervalS, record->reportableChange);
+    storeConfig(attr, intervals, record->reportableChange);
+    return ZCL_STATUS_SUCCESS;
+}
+
+const ReportAttributeConfig* reportAttributeConfig(int attr) {
+    if (attr < 0 || attr >= attributeCount) {
+        return nullptr;
+    }
+    return &attributes[attr].config;
+}
+
+void reportEncode(uint16_t attrId, uint8_t zclType, uint64_t value, HalAttribute* record) {
+    record->attrId = attrId;
+    record->zclType = zclType;
+    record->len = typeLength(zclType);
+    for (uint8_t i = 0; i < record->len; i++) {
+        record->value[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+uint8_t reportPoll(bool radioUp) {
+    uint32_t now = hal_millis();
+    budgetRefill(now);
+
+    uint8_t due = sendUrgent(now, radioUp);
+    for (uint8_t first = 0; first < attributeCount; first++) {
+        if (!clusterLeader(first)) {
+            continue;
+        }
+
+        HalAttribute records[HAL_RADIO_MAX_ATTRIBUTES];
+        uint8_t members[HAL_RADIO_MAX_ATTRIBUTES];
+        bool forced;
+        bool change;
+        uint8_t count = buildFrame(first, now, &forced, &change, records, members);
+        if (count == 0) {
+            continue;
+        }
+
+        uint32_t bytes = hal_radio_frame_bytes(records, count);
+        if (radioUp && !forced && budgetWaitMs(bytes) > 0) {
+            stats.budgetDeferrals++;
+            continue;
+        }
+
+        due++;
+        if (radioUp) {
+            hal_radio_report_attributes(attributes[first].config.endpoint,
+                                        attributes[first].config.clusterId, records, count);
+            budgetSpend(bytes);
+            stats.frames++;
+            stats.bytesOnAir += bytes;
+            if (forced) {
+                stats.deadlineFrames++;
+            }
+        }
+        for (uint8_t i = 0; i < count; i++) {
+            attributes[members[i]].reported = attributes[members[i]].value;
+            attributes[members[i]].reportedMs = now;
+            attributes[members[i]].requested = false;
+        }
+    }
+
+    requested = false;
+    return due;
+}
+
+uint32_t reportNextMs() {
+    if (requested) {
+        return 0;
+    }
+
+    uint32_t now = hal_millis();
+    budgetRefill(now);
+
+    uint32_t next = HAL_WAIT_FOREVER;
+    for (uint8_t i = 0; i < attributeCount; i++) {
+        const ReportAttribute* attr = &attributes[i];
+        uint32_t elapsed = age(attr, now);
+        uint32_t wait = HAL_WAIT_FOREVER;
+
+        if (attr->urgent || (attr->requested && !reportingOff(attr))) {
+            return 0;
+        }
+        if (attr->awaitingAck) {
+            uint32_t sent = now - attr->sentMs;
+            uint32_t ackWait = sent >= REPORT_ACK_TIMEOUT_MS ? 0 : REPORT_ACK_TIMEOUT_MS - sent;
+            if (ackWait < next) {
+                next = ackWait;
+            }
+        }
+        if (reportingOff(attr)) {
+            continue;
+        }
+        if (attr->config.maxIntervalMs > 0) {
+            wait = elapsed >= attr->config.maxIntervalMs ? 0 : attr->config.maxIntervalMs - elapsed;
+        }
+        if (!attr->held && significant(attr) && elapsed < attr->config.minIntervalMs &&
+            attr->config.minIntervalMs - elapsed < wait) {
+            wait = attr->config.minIntervalMs - elapsed;
+        }
+        if (wait < next) {
+            next = wait;
+        }
+    }
+
+    // Change frames waiting for the budget
+    for (uint8_t first = 0; first < attributeCount; first++) {
+        HalAttribute records[HAL_RADIO_MAX_ATTRIBUTES];
+        uint8_t members[HAL_RADIO_MAX_ATTRIBUTES];
+        bool forced;
+        bool change;
+        if (!clusterLeader(first)) {
+            continue;
+        }
+        uint8_t count = buildFrame(first, now, &forced, &change, records, members);
+        if (count > 0) {
+            uint32_t wait = forced ? 0 : budgetWaitMs(hal_radio_frame_bytes(records, count));
+            if (wait < next) {
+                next = wait;
+            }
+        }
+    }
+    return next;
+}
+
+const ReportEngineStats* reportEngineStats() {
+    return &stats;
+}
+
+void reportClearStats() {
+    memset(&stats, 0, sizeof(stats));
+}
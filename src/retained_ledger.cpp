@@ -0,0 +1,67 @@
+/*
+ * Water Flow Meter - Retained Ledger
+ * Mirror of the live pulse ledger in RTC no-init memory
+ */
+
+#include "retained_ledger.h"
+#include "crc32.h"
+#include <string.h>
+
+#define RETAINED_MAGIC 0x4C444752UL   // "RGDL"
+
+struct RetainedSlot {
+    uint32_t magic;
+    uint32_t seq;            // Increments with every store
+    RetainedLedger ledger;
+    uint32_t crc;            // CRC-32 over everything above
+    uint32_t reserved;
+};
+
+#define RETAINED_SLOT_WORDS (sizeof(RetainedSlot) / sizeof(uint32_t))
+
+static_assert(sizeof(RetainedSlot) % sizeof(uint32_t) == 0, "slots are whole words");
+static_assert(2 * RETAINED_SLOT_WORDS <= HAL_RETAINED_WORDS, "two slots must fit");
+
+// Sequence of the newest slot
+static uint32_t seq = 0;
+
+static uint32_t slotCrc(const RetainedSlot* slot) {
+    return crc32(slot, offsetof(RetainedSlot, crc));
+}
+
+// Slots are copied in and out - the retained words are never aliased
+static bool readSlot(uint8_t index, RetainedSlot* slot) {
+    memcpy(slot, hal_retained_memory() + index * RETAINED_SLOT_WORDS, sizeof(*slot));
+    return slot->magic == RETAINED_MAGIC && slot->crc == slotCrc(slot);
+}
+
+bool retainedLedgerRecover(RetainedLedger* ledger) {
+    seq = 0;
+    HalResetReason reason = hal_reset_reason();
+    if (reason == HAL_RESET_POWER_ON || reason == HAL_RESET_BROWNOUT) {
+        return false;
+    }
+
+    RetainedSlot slots[2];
+    bool valid[2] = { readSlot(0, &slots[0]), readSlot(1, &slots[1]) };
+    if (!valid[0] && !valid[1]) {
+        return false;
+    }
+
+    // Newest valid slot (sequence compared modulo 2^32)
+    uint8_t newest = !valid[1] || (valid[0] && (int32_t)(slots[0].seq - slots[1].seq) > 0) ? 0 : 1;
+    *ledger = slots[newest].ledger;
+    seq = slots[newest].seq;
+    return true;
+}
+
+void retainedLedgerStore(const RetainedLedger* ledger) {
+    RetainedSlot slot = {};
+    slot.magic = RETAINED_MAGIC;
+    slot.seq = ++seq;
+    slot.ledger = *ledger;
+    slot.crc = slotCrc(&slot);
+
+    // The newest slot stays intact until this one is complete
+    memcpy(hal_retained_memory() + (seq & 1) * RETAINED_SLOT_WORDS, &slot, sizeof(slot));
+}
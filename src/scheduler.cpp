@@ -0,0 +1,217 @@
+/*
+ * Water Flow Meter - Job Scheduler
+ * Binary min-heap of job deadlines driven by hal_wait_event()
+ */
+
+#include "scheduler.h"
+#include "latency_stats.h"
+
+struct SchedulerJob {
+    SchedulerJobFn fn;
+    uint32_t periodMs;       // 0 = one-shot
+    uint32_t deadline;       // hal_millis() time of the next run
+    int8_t heapIndex;        // Position in the heap, -1 when not armed
+};
+
+static SchedulerJob jobs[SCHEDULER_MAX_JOBS];
+static uint8_t jobCount = 0;
+
+// Job ids ordered by deadline (heap[0] is the next to run)
+static uint8_t heap[SCHEDULER_MAX_JOBS];
+static uint8_t heapSize = 0;
+
+static SchedulerJobFn notifyHandler = nullptr;
+static SchedulerStats stats;
+
+#if LATENCY_STATS_ENABLED
+static uint32_t awakeSince = 0;  // hal_cycles() when the task last woke
+#endif
+
+// ============================================================================
+// Heap
+// ============================================================================
+
+// Deadlines are millis() values - compare by signed difference so the
+// ordering survives the 49-day counter wrap
+static bool before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+static void heapPlace(uint8_t index, uint8_t job) {
+    heap[index] = job;
+    jobs[job].heapIndex = (int8_t)index;
+}
+
+static void siftUp(uint8_t index) {
+    uint8_t job = heap[index];
+    while (index > 0) {
+        uint8_t parent = (index - 1) / 2;
+        if (!before(jobs[job].deadline, jobs[heap[parent]].deadline)) {
+            break;
+        }
+        heapPlace(index, heap[parent]);
+        index = parent;
+    }
+    heapPlace(index, job);
+}
+
+static void siftDown(uint8_t index) {
+    uint8_t job = heap[index];
+    for (;;) {
+        uint8_t child = 2 * index + 1;
+        if (child >= heapSize) {
+            break;
+        }
+        if (child + 1 < heapSize &&
+            before(jobs[heap[child + 1]].deadline, jobs[heap[child]].deadline)) {
+            child++;
+        }
+        if (!before(jobs[heap[child]].deadline, jobs[job].deadline)) {
+            break;
+        }
+        heapPlace(index, heap[child]);
+        index = child;
+    }
+    heapPlace(index, job);
+}
+
+static void heapRemove(uint8_t job) {
+    uint8_t index = (uint8_t)jobs[job].heapIndex;
+    jobs[job].heapIndex = -1;
+    heapSize--;
+    if (index == heapSize) {
+        return;
+    }
+    // Fill the hole with the last entry and restore heap order
+    heapPlace(index, heap[heapSize]);
+    if (index > 0 && before(jobs[heap[index]].deadline, jobs[heap[(index - 1) / 2]].deadline)) {
+        siftUp(index);
+    } else {
+        siftDown(index);
+    }
+}
+
+static void heapInsert(uint8_t job) {
+    heapPlace(heapSize, job);
+    heapSize++;
+    siftUp(heapSize - 1);
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+void schedulerReset() {
+    jobCount = 0;
+    heapSize = 0;
+    notifyHandler = nullptr;
+    stats = SchedulerStats();
+    #if LATENCY_STATS_ENABLED
+    awakeSince = hal_cycles();
+    #endif
+}
+
+int schedulerAdd(SchedulerJobFn fn, uint32_t periodMs, uint32_t delayMs) {
+    if (jobCount >= SCHEDULER_MAX_JOBS) {
+        return SCHEDULER_NO_JOB;
+    }
+    uint8_t job = jobCount++;
+    jobs[job].fn = fn;
+    jobs[job].periodMs = periodMs;
+    jobs[job].heapIndex = -1;
+    schedulerArm(job, delayMs);
+    return job;
+}
+
+void schedulerArm(int job, uint32_t delayMs) {
+    if (job < 0 || job >= jobCount) {
+        return;
+    }
+    if (jobs[job].heapIndex >= 0) {
+        heapRemove((uint8_t)job);
+    }
+    jobs[job].deadline = hal_millis() + delayMs;
+    heapInsert((uint8_t)job);
+}
+
+void schedulerCancel(int job) {
+    if (job >= 0 && job < jobCount && jobs[job].heapIndex >= 0) {
+        heapRemove((uint8_t)job);
+    }
+}
+
+bool schedulerArmed(int job) {
+    return job >= 0 && job < jobCount && jobs[job].heapIndex >= 0;
+}
+
+void schedulerOnNotify(SchedulerJobFn handler) {
+    notifyHandler = handler;
+}
+
+uint32_t schedulerRunDue() {
+    uint32_t now = hal_millis();
+
+    while (heapSize > 0 && !before(now, jobs[heap[0]].deadline)) {
+        uint8_t job = heap[0];
+        uint32_t late = now - jobs[job].deadline;
+        stats.runs++;
+        stats.totalLateMs += late;
+        if (late > stats.maxLateMs) {
+            stats.maxLateMs = late;
+        }
+        #if LATENCY_STATS_ENABLED
+        uint32_t lateCycles = late < UINT32_MAX / (1000UL * HAL_CPU_MHZ)
+                                  ? late * 1000UL * HAL_CPU_MHZ : UINT32_MAX;
+        latencyRecord(LATENCY_JOB_LATE, lateCycles);
+        #endif
+
+        // Requeue before running so the job may re-arm or cancel itself
+        heapRemove(job);
+        if (jobs[job].periodMs > 0) {
+            // Missed whole periods are skipped rather than run as a burst;
+            // the deadline stays on the original phase
+            do {
+                jobs[job].deadline += jobs[job].periodMs;
+            } while (!before(now, jobs[job].deadline));
+            heapInsert(job);
+        }
+
+        uint32_t startUs = hal_micros();
+        jobs[job].fn();
+        uint32_t runUs = hal_micros() - startUs;
+        if (runUs > stats.maxRunUs) {
+            stats.maxRunUs = runUs;
+        }
+        now = hal_millis();
+    }
+
+    return heapSize > 0 ? jobs[heap[0]].deadline - now : HAL_WAIT_FOREVER;
+}
+
+void schedulerRun() {
+    uint32_t timeout = schedulerRunDue();
+
+    // Awake time: notify handler after the last wake-up plus the jobs above
+    #if LATENCY_STATS_ENABLED
+    LATENCY_RECORD(LATENCY_LOOP, awakeSince);
+    #endif
+    bool notified = hal_wait_event(timeout);
+    #if LATENCY_STATS_ENABLED
+    awakeSince = LATENCY_START();
+    #endif
+    stats.wakeups++;
+    if (notified) {
+        stats.notifications++;
+        if (notifyHandler) {
+            notifyHandler();
+        }
+    }
+}
+
+const SchedulerStats* schedulerStats() {
+    return &stats;
+}
+
+void schedulerClearStats() {
+    stats = SchedulerStats();
+}
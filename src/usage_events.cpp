@@ -0,0 +1,358 @@
+/*
+ * Water Flow Meter - Usage Events
+ * Draw segmenter, decision tree classifier, event ring and Usage Events cluster
+ */
+
+#include "usage_events.h"
+#include "config_traits.h"
+#include "deferred_log.h"
+#include "flow_history.h"
+#include "flow_math.h"
+#include "report_engine.h"
+#include <stdio.h>
+
+// NVS keys: node count, then one u64 per node
+// (feature << 56 | left << 48 | right << 40 | threshold)
+#define USAGE_KEY_COUNT "usageNodes"
+#define USAGE_KEY_NODE "usage%u"
+
+// ============================================================================
+// Segmenter and Classifier
+// ============================================================================
+
+void usageSegmenterReset(UsageSegmenter* segmenter, uint64_t ledger) {
+    segmenter->ledger = ledger;
+    segmenter->startLedger = ledger;
+    segmenter->startMs = 0;
+    segmenter->lastPulseMs = 0;
+    segmenter->startTime = 0;
+    segmenter->peakMlMin = 0;
+    segmenter->drawing = false;
+}
+
+bool usageSegmenterUpdate(UsageSegmenter* segmenter, uint64_t ledger, uint32_t rateMlMin, bool idle,
+                          uint32_t nowMs, uint32_t nowTime, UsageEvent* event) {
+    uint64_t previous = segmenter->ledger;
+    bool pulsed = ledger != previous;
+    segmenter->ledger = ledger;
+
+    // A draw starts with its first pulse (the rate follows at the second)
+    // and runs until the estimator gives up on the flow
+    if (!segmenter->drawing) {
+        if (!pulsed) {
+            return false;
+        }
+        segmenter->drawing = true;
+        segmenter->startLedger = previous;
+        segmenter->startMs = nowMs;
+        segmenter->startTime = nowTime;
+        segmenter->peakMlMin = 0;
+    }
+    if (pulsed) {
+        segmenter->lastPulseMs = nowMs;
+    }
+    if (rateMlMin > segmenter->peakMlMin) {
+        segmenter->peakMlMin = rateMlMin;
+    }
+    if (!idle || pulsed) {
+        return false;
+    }
+
+    segmenter->drawing = false;
+    uint64_t pulses = ledger - segmenter->startLedger;
+    if (pulses < USAGE_MIN_PULSES) {
+        return false;
+    }
+    event->startTime = segmenter->startTime;
+    event->durationS = (segmenter->lastPulseMs - segmenter->startMs + 500) / 1000;
+    event->volumeMl = (uint32_t)pulsesToMillilitres(pulses);
+    event->peakMlMin = segmenter->peakMlMin;
+    return true;
+}
+
+uint32_t usageFeature(const UsageEvent* event, uint8_t feature) {
+    switch (feature) {
+        case USAGE_FEATURE_DURATION:
+            return event->durationS;
+        case USAGE_FEATURE_VOLUME:
+            return event->volumeMl;
+        case USAGE_FEATURE_PEAK:
+            return event->peakMlMin;
+        case USAGE_FEATURE_MEAN:
+            // Under a second: all of it at the peak
+            return event->durationS > 0 ? (uint32_t)((uint64_t)event->volumeMl * 60 / event->durationS)
+                                        : event->peakMlMin;
+        default:
+            return 0;
+    }
+}
+
+uint8_t usageClassify(const UsageTree* tree, const UsageEvent* event) {
+    uint8_t i = 0;
+    for (uint8_t step = 0; step < tree->count; step++) {
+        const UsageTreeNode* node = &tree->nodes[i];
+        if (node->feature == USAGE_LEAF) {
+            return (uint8_t)node->threshold;
+        }
+        i = usageFeature(event, node->feature) <= node->threshold ? node->left : node->right;
+    }
+    return USAGE_OTHER;
+}
+
+// ============================================================================
+// Built-in Tree
+// ============================================================================
+
+// A typical household: short draws are taps or a toilet cistern, long
+// ones appliance fills (slow), showers, or the garden (strong, or over
+// half an hour)
+static constexpr UsageTree defaultTree() {
+    UsageTree tree{};
+    const UsageTreeNode nodes[] = {
+        { USAGE_FEATURE_DURATION, 1, 2, 150 },     // 0: up to 2.5 min
+        { USAGE_FEATURE_PEAK, 7, 3, 5500 },        // 1: short, gentle: tap
+        { USAGE_FEATURE_MEAN, 9, 4, 3000 },        // 2: long, slow: appliance
+        { USAGE_FEATURE_VOLUME, 7, 5, 2500 },      // 3: short, strong, small: tap
+        { USAGE_FEATURE_MEAN, 6, 11, 11000 },      // 4: long, strong: garden
+        { USAGE_FEATURE_VOLUME, 8, 12, 12000 },    // 5: a cistern's worth
+        { USAGE_FEATURE_DURATION, 10, 11, 1800 },  // 6: up to half an hour
+        { USAGE_LEAF, 0, 0, USAGE_TAP },
+        { USAGE_LEAF, 0, 0, USAGE_TOILET },
+        { USAGE_LEAF, 0, 0, USAGE_APPLIANCE },
+        { USAGE_LEAF, 0, 0, USAGE_SHOWER },
+        { USAGE_LEAF, 0, 0, USAGE_GARDEN },
+        { USAGE_LEAF, 0, 0, USAGE_OTHER },
+    };
+    for (const UsageTreeNode& node : nodes) {
+        tree.nodes[tree.count++] = node;
+    }
+    return tree;
+}
+
+static constexpr UsageTree USAGE_DEFAULT_TREE = defaultTree();
+
+static_assert(usageTreeValid(USAGE_DEFAULT_TREE), "Built-in usage tree is not valid");
+
+// ============================================================================
+// Events and Tree
+// ============================================================================
+
+static UsageTree tree = USAGE_DEFAULT_TREE;
+static UsageSegmenter segmenters[FLOW_CHANNELS];
+static bool holdReports = USAGE_CONFIG.holdReports;
+
+// Newest USAGE_EVENT_RING events, event seq at index (seq - 1) % USAGE_EVENT_RING
+static UsageEvent ring[USAGE_EVENT_RING];
+static uint32_t eventCount = 0;
+
+static void nodeKey(char* key, size_t size, uint8_t node) {
+    snprintf(key, size, USAGE_KEY_NODE, (unsigned)node);
+}
+
+void usageBegin() {
+    UsageTree stored{};
+    char key[16];
+    hal_nvs_begin(EEPROM_NAMESPACE, true);
+    uint32_t count = hal_nvs_get_u32(USAGE_KEY_COUNT, 0);
+    if (count <= USAGE_TREE_MAX_NODES) {
+        stored.count = (uint8_t)count;
+        for (uint8_t i = 0; i < stored.count; i++) {
+            nodeKey(key, sizeof(key), i);
+            uint64_t raw = hal_nvs_get_u64(key, 0);
+            stored.nodes[i].feature = (uint8_t)(raw >> 56);
+            stored.nodes[i].left = (uint8_t)(raw >> 48);
+            stored.nodes[i].right = (uint8_t)(raw >> 40);
+            stored.nodes[i].threshold = (uint32_t)raw;
+        }
+    }
+    hal_nvs_end();
+
+    if (count > 0 && usageTreeValid(stored)) {
+        tree = stored;
+        LOG(USAGE_TREE_STORED, (unsigned)tree.count);
+    } else {
+        if (count > 0) {
+            LOG(USAGE_TREE_INVALID);
+        }
+        tree = USAGE_DEFAULT_TREE;
+        LOG(USAGE_TREE_DEFAULT, (unsigned)tree.count);
+    }
+}
+
+void usageStart(const uint64_t* ledgers) {
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        usageSegmenterReset(&segmenters[i], ledgers[i]);
+    }
+}
+
+const UsageEvent* usageUpdate(uint8_t channel, uint64_t ledger, uint32_t rateMlMin, bool idle,
+                              uint32_t nowMs) {
+    UsageEvent event;
+    if (!usageSegmenterUpdate(&segmenters[channel], ledger, rateMlMin, idle, nowMs, historyNow(),
+                              &event)) {
+        return nullptr;
+    }
+    event.seq = ++eventCount;
+    event.channel = channel;
+    event.usageClass = usageClassify(&tree, &event);
+
+    UsageEvent* slot = &ring[(event.seq - 1) % USAGE_EVENT_RING];
+    *slot = event;
+    return slot;
+}
+
+bool usageDrawing(uint8_t channel) {
+    return channel < FLOW_CHANNELS && segmenters[channel].drawing;
+}
+
+bool usageHoldsReports(uint8_t channel) {
+    return holdReports && usageDrawing(channel);
+}
+
+void usageSetHoldReports(bool hold) {
+    holdReports = hold;
+}
+
+uint32_t usageEventCount() {
+    return eventCount;
+}
+
+const UsageEvent* usageEvent(uint32_t back) {
+    if (back >= eventCount || back >= USAGE_EVENT_RING) {
+        return nullptr;
+    }
+    return &ring[(eventCount - 1 - back) % USAGE_EVENT_RING];
+}
+
+const UsageTree* usageTree() {
+    return &tree;
+}
+
+bool usageStoreTree(const UsageTree* newTree) {
+    if (!usageTreeValid(*newTree)) {
+        return false;
+    }
+    tree = *newTree;
+
+    // No count while the nodes change: a save cut short reads as no tree
+    char key[16];
+    hal_nvs_begin(EEPROM_NAMESPACE, false);
+    hal_nvs_put_u32(USAGE_KEY_COUNT, 0);
+    for (uint8_t i = 0; i < tree.count; i++) {
+        const UsageTreeNode* node = &tree.nodes[i];
+        nodeKey(key, sizeof(key), i);
+        hal_nvs_put_u64(key, (uint64_t)node->feature << 56 | (uint64_t)node->left << 48 |
+                             (uint64_t)node->right << 40 | node->threshold);
+    }
+    hal_nvs_put_u32(USAGE_KEY_COUNT, tree.count);
+    hal_nvs_end();
+    return true;
+}
+
+void usageRestoreDefault() {
+    hal_nvs_begin(EEPROM_NAMESPACE, false);
+    hal_nvs_put_u32(USAGE_KEY_COUNT, 0);
+    hal_nvs_end();
+    tree = USAGE_DEFAULT_TREE;
+    LOG(USAGE_TREE_DEFAULT, (unsigned)tree.count);
+}
+
+// ============================================================================
+// Usage Events Cluster (Zigbee)
+// ============================================================================
+
+struct UsageAttribute {
+    uint16_t attrId;
+    uint8_t zclType;
+};
+
+static const UsageAttribute clusterAttributes[USAGE_ATTRIBUTES] = {
+    { USAGE_SEQ_ATTR, ZCL_TYPE_UINT32 },
+    { USAGE_CHANNEL_ATTR, ZCL_TYPE_UINT8 },
+    { USAGE_CLASS_ATTR, ZCL_TYPE_ENUM8 },
+    { USAGE_START_ATTR, ZCL_TYPE_UINT32 },
+    { USAGE_DURATION_ATTR, ZCL_TYPE_UINT24 },
+    { USAGE_VOLUME_ATTR, ZCL_TYPE_UINT32 },
+    { USAGE_PEAK_ATTR, ZCL_TYPE_UINT24 },
+};
+
+static bool clusterReady = false;
+static int reportAttrs[USAGE_ATTRIBUTES];
+static uint32_t reportedSeq = 0;     // Last event handed to the report engine
+
+void usageClusterBegin() {
+    if (clusterReady) {
+        return;
+    }
+    clusterReady = true;
+
+    HalAttribute attrs[USAGE_ATTRIBUTES];
+    for (uint8_t i = 0; i < USAGE_ATTRIBUTES; i++) {
+        reportEncode(clusterAttributes[i].attrId, clusterAttributes[i].zclType, 0, &attrs[i]);
+    }
+    hal_radio_add_cluster(FLOW_ENDPOINT, USAGE_CLUSTER_ID, attrs, USAGE_ATTRIBUTES);
+
+    // Sent on request only, all together (usageReportNext) - a full report
+    // does not repeat the last event
+    ReportAttributeConfig config = {};
+    config.endpoint = FLOW_ENDPOINT;
+    config.clusterId = USAGE_CLUSTER_ID;
+    config.minIntervalMs = 0;
+    config.maxIntervalMs = 0;
+    config.minChange = 1;
+    config.changePermille = 0;
+    config.onRequest = true;
+    for (uint8_t i = 0; i < USAGE_ATTRIBUTES; i++) {
+        config.attrId = clusterAttributes[i].attrId;
+        config.zclType = clusterAttributes[i].zclType;
+        reportAttrs[i] = reportAttributeAdd(&config);
+    }
+}
+
+bool usageReportNext() {
+    if (!clusterReady) {
+        return false;
+    }
+    if (reportPending(reportAttrs[0])) {
+        return true;
+    }
+    if (reportedSeq == eventCount) {
+        return false;
+    }
+
+    // Events the ring lost while the radio was down are skipped
+    uint32_t oldest = eventCount > USAGE_EVENT_RING ? eventCount - USAGE_EVENT_RING + 1 : 1;
+    uint32_t seq = reportedSeq + 1 > oldest ? reportedSeq + 1 : oldest;
+    const UsageEvent* event = &ring[(seq - 1) % USAGE_EVENT_RING];
+    const uint32_t values[USAGE_ATTRIBUTES] = {
+        event->seq, event->channel, event->usageClass, event->startTime,
+        event->durationS, event->volumeMl, event->peakMlMin,
+    };
+    for (uint8_t i = 0; i < USAGE_ATTRIBUTES; i++) {
+        HalAttribute attr;
+        reportEncode(clusterAttributes[i].attrId, clusterAttributes[i].zclType, values[i], &attr);
+        hal_radio_set_attribute(FLOW_ENDPOINT, USAGE_CLUSTER_ID, &attr);
+        reportAttributeSet(reportAttrs[i], values[i]);
+    }
+    reportRequestCluster(reportAttrs[0]);
+    reportedSeq = seq;
+    return true;
+}
+
+// ============================================================================
+// Test Support
+// ============================================================================
+
+void resetUsageEvents() {
+    tree = USAGE_DEFAULT_TREE;
+    holdReports = USAGE_CONFIG.holdReports;
+    for (UsageSegmenter& segmenter : segmenters) {
+        usageSegmenterReset(&segmenter, 0);
+    }
+    eventCount = 0;
+    reportedSeq = 0;
+    clusterReady = false;
+    for (int& attr : reportAttrs) {
+        attr = REPORT_NO_ATTRIBUTE;
+    }
+}
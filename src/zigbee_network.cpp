@@ -0,0 +1,157 @@
+/*
+ * Water Flow Meter - Zigbee Network
+ * Join/rejoin state machine driven by a scheduler job
+ */
+
+#include "zigbee_network.h"
+#include "flow_meter.h"
+#include "scheduler.h"
+#include "deferred_log.h"
+
+// ============================================================================
+// Global Variables
+// ============================================================================
+
+uint16_t zigbeeShortAddr = 0xFFFF;
+
+static ZigbeeJoinState joinState = ZB_STATE_IDLE;
+static uint32_t attemptStart = 0;
+static uint8_t failures = 0;          // Consecutive failed attempts
+static uint8_t rejoinFailures = 0;    // ... of which were rejoins
+static int joinJob = SCHEDULER_NO_JOB;
+
+// ============================================================================
+// State Machine
+// ============================================================================
+
+uint32_t zigbeeBackoffMs(uint8_t failures) {
+    uint32_t backoff = ZIGBEE_BACKOFF_MIN;
+    for (uint8_t i = 1; i < failures && backoff < ZIGBEE_BACKOFF_MAX; i++) {
+        backoff *= 2;
+    }
+    return backoff < ZIGBEE_BACKOFF_MAX ? backoff : ZIGBEE_BACKOFF_MAX;
+}
+
+static void startAttempt() {
+    attemptStart = hal_millis();
+
+    if (hal_radio_has_stored_network() && rejoinFailures < ZIGBEE_REJOIN_ATTEMPTS) {
+        joinState = ZB_STATE_REJOINING;
+        hal_radio_rejoin();
+        LOG(ZIGBEE_REJOINING);
+    } else {
+        joinState = ZB_STATE_JOINING;
+        hal_radio_join();
+        LOG(ZIGBEE_JOINING);
+        LOG(ZIGBEE_PAIRING_HINT);
+    }
+
+    schedulerArm(joinJob, ZIGBEE_POLL_INTERVAL);
+}
+
+static void attemptFailed() {
+    if (joinState == ZB_STATE_REJOINING) {
+        rejoinFailures++;
+    }
+    if (failures < 255) {
+        failures++;
+    }
+
+    // Spread retries of devices that lost the same coordinator
+    uint32_t backoff = zigbeeBackoffMs(failures);
+    backoff += hal_micros() % (backoff / 4 + 1);
+
+    if (joinState == ZB_STATE_REJOINING) {
+        LOG(ZIGBEE_REJOIN_FAILED, (unsigned long)backoff);
+    } else {
+        LOG(ZIGBEE_JOIN_FAILED, (unsigned long)backoff);
+    }
+
+    joinState = ZB_STATE_BACKOFF;
+    schedulerArm(joinJob, backoff);
+}
+
+static void connected() {
+    joinState = ZB_STATE_CONNECTED;
+    zigbeeConnected = true;
+    zigbeeShortAddr = hal_radio_short_address();
+    failures = 0;
+    rejoinFailures = 0;
+
+    LOG(ZIGBEE_CONNECTED, (unsigned long)(hal_millis() - attemptStart), zigbeeShortAddr);
+
+    // Bring the coordinator up to date straight away
+    requestFlowReport();
+}
+
+/**
+ * Join job - polls join progress every ZIGBEE_POLL_INTERVAL while an
+ * attempt is running, or starts the next attempt after a backoff
+ */
+static void joinJobRun() {
+    switch (joinState) {
+        case ZB_STATE_BACKOFF:
+            startAttempt();
+            break;
+
+        case ZB_STATE_REJOINING:
+        case ZB_STATE_JOINING: {
+            HalNetworkState net = hal_radio_network_state();
+            uint32_t timeout = joinState == ZB_STATE_REJOINING ?
+                               ZIGBEE_REJOIN_TIMEOUT : ZIGBEE_JOIN_TIMEOUT;
+
+            if (net == HAL_NET_JOINED) {
+                connected();
+            } else if (net == HAL_NET_FAILED || hal_millis() - attemptStart >= timeout) {
+                attemptFailed();
+            } else {
+                schedulerArm(joinJob, ZIGBEE_POLL_INTERVAL);
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+void zigbeeNetworkBegin() {
+    LOG(ZIGBEE_INIT);
+
+    if (!hal_radio_begin()) {
+        LOG(ZIGBEE_INIT_FAILED);
+        return;
+    }
+
+    joinJob = schedulerAdd(joinJobRun, 0, 0);
+    startAttempt();
+}
+
+void zigbeeNetworkLost() {
+    zigbeeConnected = false;
+    zigbeeShortAddr = 0xFFFF;
+
+    LOG(ZIGBEE_LOST);
+    startAttempt();
+}
+
+ZigbeeJoinState zigbeeJoinState() {
+    return joinState;
+}
+
+// ============================================================================
+// Test Support
+// ============================================================================
+
+void resetZigbeeNetwork() {
+    zigbeeShortAddr = 0xFFFF;
+    joinState = ZB_STATE_IDLE;
+    attemptStart = 0;
+    failures = 0;
+    rejoinFailures = 0;
+    joinJob = SCHEDULER_NO_JOB;
+}
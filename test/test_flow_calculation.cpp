@@ -90,17 +90,17 @@ void test_volume_accuracy(void) {
 
 void test_flow_stopped_detection(void) {
     // Test flow stopped detection logic
-    // Flow should be considered stopped if no pulses for FLOW_IDLE_TIMEOUT (5000ms)
+    // Flow should be considered stopped if no pulses for FLOW_IDLE_TIMEOUT
     
-    unsigned long currentTime = 10000;
-    unsigned long lastPulseTime = 4000; // Last pulse 6 seconds ago
+    unsigned long currentTime = FLOW_IDLE_TIMEOUT + 10000;
+    unsigned long lastPulseTime = 4000; // Last pulse 6 seconds past the timeout
     
     bool flowStopped = (currentTime - lastPulseTime) > FLOW_IDLE_TIMEOUT;
     
     TEST_ASSERT_TRUE(flowStopped);
     
     // Test: flow still active (pulse 3 seconds ago)
-    lastPulseTime = 7000;
+    lastPulseTime = currentTime - 3000;
     flowStopped = (currentTime - lastPulseTime) > FLOW_IDLE_TIMEOUT;
     
     TEST_ASSERT_FALSE(flowStopped);
@@ -1,6 +1,9 @@
 /*
  * Integration Tests
  * Tests for system integration and component interaction
+ *
+ * The configuration checks repeat on the device what config_traits.h
+ * already enforces at compile time.
  */
 
 #include "test_integration.h"
@@ -0,0 +1,114 @@
+/*
+ * Battery Sampler Tests
+ * Tests for the incremental battery check state machine
+ */
+
+#include "test_battery_sampler.h"
+#include "test_helpers.h"
+
+void test_battery_percent_from_millivolts(void) {
+    TEST_ASSERT_EQUAL(0, batteryPercentFromMillivolts(2500));
+    TEST_ASSERT_EQUAL(0, batteryPercentFromMillivolts(3000));
+    TEST_ASSERT_EQUAL(50, batteryPercentFromMillivolts(3600));
+    TEST_ASSERT_EQUAL(100, batteryPercentFromMillivolts(4200));
+    TEST_ASSERT_EQUAL(100, batteryPercentFromMillivolts(4500));
+}
+
+void test_battery_check_one_sample_per_run(void) {
+    hal_native_set_adc_mv(1850);
+    setupBatteryMonitor();
+    TEST_ASSERT_TRUE(batteryCheckInProgress());
+
+    // Each scheduler pass takes exactly one conversion and never sleeps
+    for (uint32_t i = 1; i <= BATTERY_SAMPLES; i++) {
+        uint32_t before = hal_millis();
+        uint32_t nextIn = schedulerRunDue();
+        TEST_ASSERT_EQUAL(before, hal_millis());
+        TEST_ASSERT_EQUAL(i, hal_native_adc_read_count());
+        if (i < BATTERY_SAMPLES) {
+            TEST_ASSERT_EQUAL(BATTERY_SAMPLE_INTERVAL, nextIn);
+            hal_native_advance_ms(BATTERY_SAMPLE_INTERVAL);
+        }
+    }
+    TEST_ASSERT_FALSE(batteryCheckInProgress());
+}
+
+void test_battery_check_averages_samples(void) {
+    hal_native_set_adc_mv(1850);    // 3.70 V at the battery
+    setupBatteryMonitor();
+    simulateScheduledFlow(BATTERY_SAMPLES * BATTERY_SAMPLE_INTERVAL, 0);
+
+    TEST_ASSERT_FALSE(batteryCheckInProgress());
+    TEST_ASSERT_EQUAL(3700, batteryMillivolts);
+    TEST_ASSERT_EQUAL(58, batteryPercent);
+    TEST_ASSERT_EQUAL(BATTERY_SAMPLES, hal_native_adc_read_count());
+}
+
+void test_battery_check_does_not_delay_flow_jobs(void) {
+    uint8_t battery = 100;
+    hal_native_set_adc_mv(1900);
+    setupFlowSensor();
+    scheduleFlowMeter(&battery);
+    setupBatteryMonitor();
+
+    // A check runs alongside a flow at 12 pulses/s
+    simulateScheduledFlow(5000, 83333);
+    TEST_ASSERT_FALSE(batteryCheckInProgress());
+    TEST_ASSERT_EQUAL(0, schedulerStats()->maxLateMs);
+    TEST_ASSERT_UINT32_WITHIN(100, 96000, flowRateMlMin);
+}
+
+void test_battery_check_repeats_on_interval(void) {
+    hal_native_set_adc_mv(2000);
+    setupBatteryMonitor();
+    simulateScheduledFlow(BATTERY_CHECK_INTERVAL * 3 + 1000, 0);
+
+    TEST_ASSERT_EQUAL(4 * BATTERY_SAMPLES, hal_native_adc_read_count());
+    TEST_ASSERT_EQUAL(4000, batteryMillivolts);
+    TEST_ASSERT_EQUAL(83, batteryPercent);
+}
+
+static uint8_t alarmCalls;
+static uint8_t alarmSeen;
+static uint64_t alarmSampleUs;
+
+static void recordAlarm(uint8_t alarms, uint64_t sampleUs) {
+    alarmCalls++;
+    alarmSeen = alarms;
+    alarmSampleUs = sampleUs;
+}
+
+void test_battery_alarm_on_change(void) {
+    alarmCalls = 0;
+    hal_native_set_adc_mv(1550);    // 3.10 V: 8%, critical
+    setupBatteryMonitor();
+    batteryOnAlarm(recordAlarm);
+    simulateScheduledFlow(BATTERY_SAMPLES * BATTERY_SAMPLE_INTERVAL, 0);
+
+    // Raised from the check's last sample
+    TEST_ASSERT_EQUAL(1, alarmCalls);
+    TEST_ASSERT_EQUAL(BATTERY_ALARM_CRITICAL | BATTERY_ALARM_WARNING, alarmSeen);
+    TEST_ASSERT_EQUAL((BATTERY_SAMPLES - 1) * BATTERY_SAMPLE_INTERVAL * 1000ULL, alarmSampleUs);
+
+    // The same state again is not an alarm; recovering clears it
+    simulateScheduledFlow(BATTERY_CHECK_INTERVAL, 0);
+    TEST_ASSERT_EQUAL(1, alarmCalls);
+    hal_native_set_adc_mv(1600);    // 16%: warning only
+    simulateScheduledFlow(BATTERY_CHECK_INTERVAL, 0);
+    TEST_ASSERT_EQUAL(2, alarmCalls);
+    TEST_ASSERT_EQUAL(BATTERY_ALARM_WARNING, batteryAlarms);
+    hal_native_set_adc_mv(2000);
+    simulateScheduledFlow(BATTERY_CHECK_INTERVAL, 0);
+    TEST_ASSERT_EQUAL(3, alarmCalls);
+    TEST_ASSERT_EQUAL(0, alarmSeen);
+}
+
+// Test suite runner
+void BatterySamplerTests(void) {
+    RUN_TEST(test_battery_percent_from_millivolts);
+    RUN_TEST(test_battery_check_one_sample_per_run);
+    RUN_TEST(test_battery_check_averages_samples);
+    RUN_TEST(test_battery_check_does_not_delay_flow_jobs);
+    RUN_TEST(test_battery_check_repeats_on_interval);
+    RUN_TEST(test_battery_alarm_on_change);
+}
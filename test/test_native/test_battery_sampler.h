@@ -0,0 +1,24 @@
+/*
+ * Battery Sampler Tests
+ * Tests for the incremental battery check state machine
+ */
+
+#ifndef TEST_BATTERY_SAMPLER_H
+#define TEST_BATTERY_SAMPLER_H
+
+#include <unity.h>
+#include "hal_native.h"
+#include "battery_monitor.h"
+
+// Test suite declarations
+void test_battery_percent_from_millivolts(void);
+void test_battery_check_one_sample_per_run(void);
+void test_battery_check_averages_samples(void);
+void test_battery_check_does_not_delay_flow_jobs(void);
+void test_battery_check_repeats_on_interval(void);
+void test_battery_alarm_on_change(void);
+
+// Test suite runner
+void BatterySamplerTests(void);
+
+#endif // TEST_BATTERY_SAMPLER_H
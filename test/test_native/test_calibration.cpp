@@ -0,0 +1,246 @@
+/*
+ * Calibration Curve Tests
+ * Tests for the frequency -> K-factor lookup table and its use in the ledger
+ */
+
+#include "test_calibration.h"
+#include "test_helpers.h"
+#include "report_engine.h"
+
+// The default single-point curve resamples to exactly 1.0 at compile time
+static_assert(CALIBRATION_CONFIG_TABLE.scaleQ16[0] == CALIBRATION_SCALE_ONE &&
+              CALIBRATION_CONFIG_TABLE.scaleQ16[CALIBRATION_TABLE_SIZE - 1] ==
+                  CALIBRATION_SCALE_ONE,
+              "config curve is CALIBRATION_FACTOR");
+
+// A YF-S201 reading 20% low at a trickle, right from 1.5 Hz
+static const CalibrationCurve LOW_FLOW_CURVE = {
+    3, { { 100, 6000 }, { 500, 7000 }, { 1500, 7500 } }
+};
+
+void test_calibration_config_curve_is_identity(void) {
+    for (uint32_t rate = 0; rate < 100000; rate += 997) {
+        TEST_ASSERT_EQUAL(CALIBRATION_SCALE_ONE, calibrationScaleAtRate(rate));
+    }
+
+    // Ledger and rate are the uncalibrated ones, pulse for pulse
+    setupFlowSensor();
+    simulateFlow(60000, 200000);
+    TEST_ASSERT_EQUAL_UINT64(300, totalPulses);
+    TEST_ASSERT_EQUAL_UINT64(pulsesToMillilitres(300), totalVolumeMl());
+}
+
+void test_calibration_table_follows_curve(void) {
+    CalibrationTable table = calibrationBuild(LOW_FLOW_CURVE);
+
+    // 32 steps of 64 mHz reach the last breakpoint
+    TEST_ASSERT_EQUAL(6, table.shift);
+
+    // Within 1% everywhere - a breakpoint between grid points is rounded
+    // off over one step
+    for (uint32_t milliHz = 0; milliHz < 4000; milliHz += 7) {
+        double exact = CALIBRATION_NOMINAL_MILLI / (double)calibrationK(LOW_FLOW_CURVE, milliHz);
+        double scale = calibrationScale(&table, milliHz) / 65536.0;
+        TEST_ASSERT_DOUBLE_WITHIN(exact * 0.01, exact, scale);
+    }
+
+    // Flat beyond the ends
+    TEST_ASSERT_EQUAL(calibrationScale(&table, 0), calibrationScale(&table, 50));
+    TEST_ASSERT_EQUAL(CALIBRATION_SCALE_ONE, calibrationScale(&table, 100000));
+    TEST_ASSERT_EQUAL(CALIBRATION_SCALE_ONE, calibrationScale(&table, UINT32_MAX));
+}
+
+void test_calibration_rejects_bad_curves(void) {
+    CalibrationCurve unsorted = { 2, { { 500, 7000 }, { 100, 6000 } } };
+    CalibrationCurve tooSmall = { 1, { { 0, 1000 } } };
+    CalibrationCurve empty = { 0, {} };
+    TEST_ASSERT_FALSE(calibrationSetCurve(&unsorted));
+    TEST_ASSERT_FALSE(calibrationSetCurve(&tooSmall));
+    TEST_ASSERT_FALSE(calibrationSetCurve(&empty));
+    TEST_ASSERT_EQUAL(CALIBRATION_CONFIG_COUNT, calibrationCurve()->count);
+}
+
+void test_calibration_corrects_low_flow_under_read(void) {
+    TEST_ASSERT_TRUE(calibrationSetCurve(&LOW_FLOW_CURVE));
+    setupFlowSensor();
+
+    // A trickle at 0.1 Hz: 6.0 pulses/L there, so 60 pulses are 10 L - the
+    // nominal factor would have counted 8 L
+    simulateFlow(605000, 10000000);
+    TEST_ASSERT_UINT32_WITHIN(150, 10000, (uint32_t)totalVolumeMl());
+    TEST_ASSERT_UINT32_WITHIN(20, 1000, flowRateMlMin);
+
+    // Above the last breakpoint the nominal factor applies unchanged
+    uint64_t before = totalVolumeMl();
+    simulateFlow(60000, 400000);      // 2.5 Hz, 150 pulses = 20 L
+    TEST_ASSERT_UINT32_WITHIN(200, 20000, (uint32_t)(totalVolumeMl() - before));
+    TEST_ASSERT_UINT32_WITHIN(100, 20000, flowRateMlMin);
+}
+
+void test_calibration_curve_survives_reboot(void) {
+    TEST_ASSERT_TRUE(calibrationSetCurve(&LOW_FLOW_CURVE));
+    calibrationSave();
+
+    resetCalibration();
+    TEST_ASSERT_EQUAL(CALIBRATION_CONFIG_COUNT, calibrationCurve()->count);
+    calibrationBegin();
+    TEST_ASSERT_EQUAL(3, calibrationCurve()->count);
+    TEST_ASSERT_EQUAL_MEMORY(LOW_FLOW_CURVE.points, calibrationCurve()->points,
+                             3 * sizeof(CalibrationPoint));
+
+    // A stored curve that no longer validates falls back to the config
+    hal_nvs_begin(EEPROM_NAMESPACE, false);
+    hal_nvs_put_u64("cal1", ((uint64_t)50 << 32) | 7000);
+    hal_nvs_end();
+    calibrationBegin();
+    TEST_ASSERT_EQUAL(CALIBRATION_CONFIG_COUNT, calibrationCurve()->count);
+
+    calibrationRestoreDefault();
+    calibrationBegin();
+    TEST_ASSERT_EQUAL(CALIBRATION_CONFIG_COUNT, calibrationCurve()->count);
+    TEST_ASSERT_EQUAL(CALIBRATION_SCALE_ONE, calibrationScaleAtRate(100));
+}
+
+/**
+ * One calibration run: pulses at pulsePeriodUs, then the flow stops for
+ * long enough to end the run even at a trickle
+ */
+static void calibrationRun(uint32_t pulses, uint32_t pulsePeriodUs) {
+    simulateFlow((uint32_t)((uint64_t)pulses * pulsePeriodUs / 1000), pulsePeriodUs);
+    simulateFlow(FLOW_IDLE_TIMEOUT + 2000, 0);
+}
+
+void test_calibration_session_fits_curve_while_metering(void) {
+    setupFlowSensor();
+    TEST_ASSERT_TRUE(calibrationSessionStart(10000, 3));
+    TEST_ASSERT_EQUAL(CALIBRATION_WAITING, calibrationSession()->state);
+
+    // 10 L each: 6.0 pulses/L at a trickle, 7.0 at 1 Hz, 7.5 at 4 Hz
+    calibrationRun(60, 10000000);
+    TEST_ASSERT_EQUAL(1, calibrationSession()->runCount);
+    TEST_ASSERT_EQUAL(CALIBRATION_WAITING, calibrationSession()->state);
+    calibrationRun(70, 1000000);
+    calibrationRun(75, 250000);
+
+    // Metering went on meanwhile, at the old curve
+    TEST_ASSERT_EQUAL_UINT64(205, totalPulses);
+
+    TEST_ASSERT_EQUAL(CALIBRATION_IDLE, calibrationSession()->state);
+    const CalibrationCurve* curve = calibrationCurve();
+    TEST_ASSERT_EQUAL(3, curve->count);
+    TEST_ASSERT_EQUAL(100, curve->points[0].milliHz);
+    TEST_ASSERT_EQUAL(6000, curve->points[0].kMilli);
+    TEST_ASSERT_EQUAL(1000, curve->points[1].milliHz);
+    TEST_ASSERT_EQUAL(7000, curve->points[1].kMilli);
+    TEST_ASSERT_EQUAL(4000, curve->points[2].milliHz);
+    TEST_ASSERT_EQUAL(7500, curve->points[2].kMilli);
+
+    // Applied at once: a further 10 L trickle now reads 10 L, not 8
+    uint64_t before = totalVolumeMl();
+    simulateFlow(605000, 10000000);
+    TEST_ASSERT_UINT32_WITHIN(150, 10000, (uint32_t)(totalVolumeMl() - before));
+
+    // And stored for the next boot
+    resetCalibration();
+    calibrationBegin();
+    TEST_ASSERT_EQUAL(3, calibrationCurve()->count);
+    TEST_ASSERT_EQUAL(6000, calibrationCurve()->points[0].kMilli);
+}
+
+void test_calibration_session_merges_close_rates(void) {
+    setupFlowSensor();
+    TEST_ASSERT_TRUE(calibrationSessionStart(10000, 3));
+
+    // A drip between runs does not count as one; two runs 5% apart in
+    // frequency make a single point from all 20 L
+    calibrationRun(70, 1000000);
+    calibrationRun(5, 1000000);
+    TEST_ASSERT_EQUAL(1, calibrationSession()->runCount);
+    calibrationRun(72, 952381);
+    calibrationRun(75, 250000);
+
+    const CalibrationCurve* curve = calibrationCurve();
+    TEST_ASSERT_EQUAL(2, curve->count);
+    TEST_ASSERT_UINT32_WITHIN(2, 1025, curve->points[0].milliHz);
+    TEST_ASSERT_EQUAL(7100, curve->points[0].kMilli);
+    TEST_ASSERT_EQUAL(7500, curve->points[1].kMilli);
+
+    // Finishing early fits what there is; nothing to finish afterwards
+    TEST_ASSERT_TRUE(calibrationSessionStart(10000, 3));
+    calibrationRun(80, 500000);
+    TEST_ASSERT_TRUE(calibrationSessionFinish());
+    TEST_ASSERT_EQUAL(1, calibrationCurve()->count);
+    TEST_ASSERT_EQUAL(8000, calibrationCurve()->points[0].kMilli);
+    TEST_ASSERT_FALSE(calibrationSessionFinish());
+}
+
+static uint8_t writeAttribute(uint16_t attrId, uint8_t zclType, uint64_t value) {
+    HalAttribute attr;
+    reportEncode(attrId, zclType, value, &attr);
+    return hal_native_radio_write_attribute(FLOW_ENDPOINT, CALIBRATION_CLUSTER_ID, &attr);
+}
+
+static uint64_t readAttribute(uint16_t attrId) {
+    HalAttribute attr;
+    TEST_ASSERT_TRUE(hal_native_radio_read_attribute(FLOW_ENDPOINT, CALIBRATION_CLUSTER_ID,
+                                                     attrId, &attr));
+    uint64_t value = 0;
+    for (uint8_t i = 0; i < attr.len; i++) {
+        value |= (uint64_t)attr.value[i] << (8 * i);
+    }
+    return value;
+}
+
+void test_calibration_cluster_drives_session(void) {
+    static uint8_t battery = 100;
+    setupFlowSensor();
+    scheduleFlowMeter(&battery);
+
+    // Bad writes are refused with the matching ZCL status
+    TEST_ASSERT_EQUAL(ZCL_STATUS_INVALID_VALUE,
+                      writeAttribute(CALIBRATION_CONTROL_ATTR, ZCL_TYPE_ENUM8,
+                                     CALIBRATION_CONTROL_START));   // No volume yet
+    TEST_ASSERT_EQUAL(ZCL_STATUS_INVALID_DATA_TYPE,
+                      writeAttribute(CALIBRATION_VOLUME_ATTR, ZCL_TYPE_UINT8, 10));
+    TEST_ASSERT_EQUAL(ZCL_STATUS_INVALID_VALUE,
+                      writeAttribute(CALIBRATION_RUNS_ATTR, ZCL_TYPE_UINT8, 9));
+    TEST_ASSERT_EQUAL(ZCL_STATUS_READ_ONLY,
+                      writeAttribute(CALIBRATION_DONE_ATTR, ZCL_TYPE_UINT8, 1));
+    TEST_ASSERT_EQUAL(ZCL_STATUS_INVALID_VALUE,
+                      writeAttribute(CALIBRATION_CONTROL_ATTR, ZCL_TYPE_ENUM8, 9));
+
+    TEST_ASSERT_EQUAL(ZCL_STATUS_SUCCESS,
+                      writeAttribute(CALIBRATION_VOLUME_ATTR, ZCL_TYPE_UINT32, 10000));
+    TEST_ASSERT_EQUAL(ZCL_STATUS_SUCCESS, writeAttribute(CALIBRATION_RUNS_ATTR, ZCL_TYPE_UINT8, 1));
+    TEST_ASSERT_EQUAL(ZCL_STATUS_SUCCESS,
+                      writeAttribute(CALIBRATION_CONTROL_ATTR, ZCL_TYPE_ENUM8,
+                                     CALIBRATION_CONTROL_START));
+    TEST_ASSERT_EQUAL(CALIBRATION_WAITING, readAttribute(CALIBRATION_CONTROL_ATTR));
+    TEST_ASSERT_EQUAL(10000, readAttribute(CALIBRATION_VOLUME_ATTR));
+
+    // One run through the real scheduler: the flow job ends it and fits
+    simulateScheduledFlow(20000, 250000);
+    TEST_ASSERT_EQUAL(CALIBRATION_RUNNING, readAttribute(CALIBRATION_CONTROL_ATTR));
+    simulateScheduledFlow(CALIBRATION_RUN_IDLE_MS + 2000, 0);
+    TEST_ASSERT_EQUAL(CALIBRATION_IDLE, readAttribute(CALIBRATION_CONTROL_ATTR));
+    TEST_ASSERT_EQUAL(1, readAttribute(CALIBRATION_DONE_ATTR));
+    TEST_ASSERT_EQUAL(8000, calibrationCurve()->points[0].kMilli);
+
+    TEST_ASSERT_EQUAL(ZCL_STATUS_SUCCESS,
+                      writeAttribute(CALIBRATION_CONTROL_ATTR, ZCL_TYPE_ENUM8,
+                                     CALIBRATION_CONTROL_DEFAULT));
+    TEST_ASSERT_EQUAL(CALIBRATION_NOMINAL_MILLI, calibrationCurve()->points[0].kMilli);
+    calibrationBegin();
+    TEST_ASSERT_EQUAL(CALIBRATION_NOMINAL_MILLI, calibrationCurve()->points[0].kMilli);
+}
+
+void CalibrationTests(void) {
+    RUN_TEST(test_calibration_config_curve_is_identity);
+    RUN_TEST(test_calibration_table_follows_curve);
+    RUN_TEST(test_calibration_rejects_bad_curves);
+    RUN_TEST(test_calibration_corrects_low_flow_under_read);
+    RUN_TEST(test_calibration_curve_survives_reboot);
+    RUN_TEST(test_calibration_session_fits_curve_while_metering);
+    RUN_TEST(test_calibration_session_merges_close_rates);
+    RUN_TEST(test_calibration_cluster_drives_session);
+}
@@ -0,0 +1,26 @@
+/*
+ * Calibration Curve Tests
+ * Tests for the frequency -> K-factor lookup table and its use in the ledger
+ */
+
+#ifndef TEST_CALIBRATION_H
+#define TEST_CALIBRATION_H
+
+#include <unity.h>
+#include "hal_native.h"
+#include "calibration.h"
+
+// Test suite declarations
+void test_calibration_config_curve_is_identity(void);
+void test_calibration_table_follows_curve(void);
+void test_calibration_rejects_bad_curves(void);
+void test_calibration_corrects_low_flow_under_read(void);
+void test_calibration_curve_survives_reboot(void);
+void test_calibration_session_fits_curve_while_metering(void);
+void test_calibration_session_merges_close_rates(void);
+void test_calibration_cluster_drives_session(void);
+
+// Test suite runner
+void CalibrationTests(void);
+
+#endif // TEST_CALIBRATION_H
@@ -0,0 +1,44 @@
+/*
+ * Configuration Traits Tests
+ * Tests for the constants derived from config.h at compile time
+ */
+
+#include "test_config_traits.h"
+
+void test_config_derived_constants_match_config(void) {
+    // Save threshold: whole pulses, never less than SAVE_THRESHOLD litres
+    TEST_ASSERT_TRUE(SAVE_THRESHOLD_PULSES >= SAVE_THRESHOLD * CALIBRATION_FACTOR);
+    TEST_ASSERT_TRUE(SAVE_THRESHOLD_PULSES - 1 < SAVE_THRESHOLD * CALIBRATION_FACTOR);
+
+    TEST_ASSERT_EQUAL_UINT64((uint64_t)FLOW_IDLE_TIMEOUT * 1000, FLOW_IDLE_TIMEOUT_US);
+    TEST_ASSERT_EQUAL(FLOW_REPORT_INTERVAL * 1000UL, FLOW_REPORT_INTERVAL_MS);
+    TEST_ASSERT_EQUAL(REPORT_MIN_INTERVAL * 1000UL, REPORT_MIN_INTERVAL_MS);
+    TEST_ASSERT_EQUAL((uint32_t)(VOLUME_MILESTONE * 1000 + 0.5), VOLUME_MILESTONE_ML);
+    TEST_ASSERT_EQUAL((uint32_t)(FLOW_RATE_MIN_CHANGE * 60000 + 0.5), DEMAND_MIN_CHANGE);
+    TEST_ASSERT_EQUAL((uint16_t)(FLOW_RATE_CHANGE_THRESHOLD * 1000 + 0.5), FLOW_CHANGE_PERMILLE);
+    TEST_ASSERT_EQUAL(REPORT_BUDGET_BURST_BYTES * 1000UL, REPORT_BUDGET_MAX);
+}
+
+void test_config_budget_reciprocals_match_division(void) {
+    // Refill: the multiply never falls short of the exact division and is
+    // at most one milli-byte over, for any elapsed time up to the ms wrap
+    for (uint64_t ms = 0; ms <= UINT32_MAX; ms = ms * 3 + 7) {
+        uint64_t exact = ms * REPORT_BUDGET_BYTES_PER_HOUR / 3600;
+        uint64_t refill = mulQ32(ms, REPORT_BUDGET_PER_MS_Q32);
+        TEST_ASSERT_TRUE(refill >= exact && refill <= exact + 1);
+    }
+
+    // Wait: rounded up like the division, at most 1 ms longer
+    for (uint64_t deficit = 1; deficit <= REPORT_BUDGET_MAX; deficit = deficit * 2 + 1) {
+        uint64_t exact = (deficit * 3600 + REPORT_BUDGET_BYTES_PER_HOUR - 1) /
+                         REPORT_BUDGET_BYTES_PER_HOUR;
+        uint64_t wait = (deficit * REPORT_BUDGET_MS_PER_Q32 + 0xFFFFFFFFULL) >> 32;
+        TEST_ASSERT_TRUE(wait >= exact && wait <= exact + 1);
+    }
+}
+
+// Test suite runner
+void ConfigTraitsTests(void) {
+    RUN_TEST(test_config_derived_constants_match_config);
+    RUN_TEST(test_config_budget_reciprocals_match_division);
+}
@@ -0,0 +1,19 @@
+/*
+ * Configuration Traits Tests
+ * Tests for the constants derived from config.h at compile time
+ */
+
+#ifndef TEST_CONFIG_TRAITS_H
+#define TEST_CONFIG_TRAITS_H
+
+#include <unity.h>
+#include "config_traits.h"
+
+// Test suite declarations
+void test_config_derived_constants_match_config(void);
+void test_config_budget_reciprocals_match_division(void);
+
+// Test suite runner
+void ConfigTraitsTests(void);
+
+#endif // TEST_CONFIG_TRAITS_H
@@ -0,0 +1,272 @@
+/*
+ * Serial Console Tests
+ * Tests for the non-blocking line reader, tokenizer and command table
+ */
+
+#include "test_console.h"
+#include "test_helpers.h"
+#include "deferred_log.h"
+#include "flow_history.h"
+#include "latency_stats.h"
+#include "report_engine.h"
+#include "calibration.h"
+#include "usage_events.h"
+
+/**
+ * Take records out of the log until one with id turns up (false if none)
+ */
+static bool takeReply(LogMsgId id, LogRecord* record) {
+    while (logRead(record)) {
+        if (record->id == id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool replied(LogMsgId id) {
+    LogRecord record;
+    return takeReply(id, &record);
+}
+
+static void typeLine(const char* text) {
+    hal_native_serial_input(text);
+    consolePoll();
+}
+
+void test_console_line_split_across_polls(void) {
+    setupFlowSensor();
+    TEST_ASSERT_EQUAL(PULSE_BACKEND_GPIO, pulseSourceBackend());
+
+    // Half a line: nothing runs, nothing is lost
+    typeLine("set  back");
+    TEST_ASSERT_EQUAL(0, logStats()->records);
+
+    typeLine("end\t1\r\n");
+    LogRecord record;
+    TEST_ASSERT_TRUE(takeReply(LOG_ID_CONSOLE_SET_BACKEND, &record));
+    TEST_ASSERT_EQUAL(PULSE_BACKEND_PCNT, record.words[0]);
+    TEST_ASSERT_EQUAL(PULSE_BACKEND_PCNT, pulseSourceBackend());
+
+    // The line end's second byte is an empty line - nothing to run
+    consolePoll();
+    TEST_ASSERT_FALSE(logRead(&record));
+}
+
+void test_console_one_command_per_poll(void) {
+    typeLine("help\nnonsense\n");
+
+    LogRecord record;
+    TEST_ASSERT_TRUE(takeReply(LOG_ID_CONSOLE_HELP_RESET, &record));
+#if PULSE_TRACE_ENABLED
+    TEST_ASSERT_TRUE(takeReply(LOG_ID_CONSOLE_HELP_TRACE, &record));
+#endif
+    TEST_ASSERT_FALSE(logRead(&record));
+    TEST_ASSERT_EQUAL(9, hal_native_serial_pending());
+
+    consolePoll();
+    TEST_ASSERT_TRUE(replied(LOG_ID_CONSOLE_UNKNOWN));
+    TEST_ASSERT_EQUAL(0, hal_native_serial_pending());
+}
+
+void test_console_rejects_bad_input(void) {
+    setupFlowSensor();
+
+    // Overlong line: dropped whole, reported once, the next line works
+    char longLine[CONSOLE_LINE_MAX + 8];
+    memset(longLine, 'x', sizeof(longLine) - 2);
+    longLine[sizeof(longLine) - 2] = '\n';
+    longLine[sizeof(longLine) - 1] = '\0';
+    typeLine(longLine);
+    LogRecord record;
+    TEST_ASSERT_TRUE(takeReply(LOG_ID_CONSOLE_TOO_LONG, &record));
+    TEST_ASSERT_EQUAL(CONSOLE_LINE_MAX, record.words[0]);
+    TEST_ASSERT_FALSE(logRead(&record));
+
+    typeLine("set backend 7\n");
+    TEST_ASSERT_TRUE(replied(LOG_ID_CONSOLE_SET_REJECTED));
+    TEST_ASSERT_EQUAL(PULSE_BACKEND_GPIO, pulseSourceBackend());
+
+    // Bad arguments print the command's usage line
+    const char* bad[] = {"set backend 1x\n", "set speed 1\n", "calibrate stop\n",
+                         "calibrate stop 0\n", "dump history 1d\n",
+                         "reset counters and more words\n", "status now\n",
+                         "stats 5\n"};
+    for (const char* text : bad) {
+        typeLine(text);
+        TEST_ASSERT_TRUE_MESSAGE(replied(LOG_ID_CONSOLE_USAGE), text);
+    }
+
+    // Backspace edits the line before it runs
+    typeLine("helpx\b\n");
+    TEST_ASSERT_TRUE(replied(LOG_ID_CONSOLE_HELP_HELP));
+}
+
+void test_console_calibrate_counts_pulses(void) {
+    setupFlowSensor();
+    simulateFlow(500, 10000);
+
+    typeLine("calibrate\n");
+    TEST_ASSERT_TRUE(replied(LOG_ID_CALIBRATE_IDLE));
+
+    typeLine("calibrate start\n");
+    TEST_ASSERT_TRUE(replied(LOG_ID_CALIBRATE_STARTED));
+
+    // 150 pulses for a reference volume of 10 L: 15 pulses per litre, so
+    // the stock 7.5 pulses/L factor reads twice the volume
+    simulateFlow(1500, 10000);
+    typeLine("calibrate\n");
+    LogRecord record;
+    TEST_ASSERT_TRUE(takeReply(LOG_ID_CALIBRATE_PROGRESS, &record));
+    TEST_ASSERT_EQUAL(150, record.words[0]);
+    TEST_ASSERT_EQUAL(1, record.words[1]);
+
+    typeLine("calibrate stop 10000\n");
+    TEST_ASSERT_TRUE(takeReply(LOG_ID_CALIBRATE_RESULT, &record));
+    TEST_ASSERT_EQUAL(150, record.words[0]);
+    TEST_ASSERT_EQUAL(10000, record.words[1]);
+    TEST_ASSERT_EQUAL(15, record.words[2]);
+    TEST_ASSERT_EQUAL(0, record.words[3]);
+    TEST_ASSERT_EQUAL(1000, (int32_t)record.words[4]);
+
+    typeLine("calibrate stop 10000\n");
+    TEST_ASSERT_TRUE(replied(LOG_ID_CALIBRATE_IDLE));
+}
+
+void test_console_calibrate_auto_session(void) {
+    setupFlowSensor();
+
+    typeLine("calibrate auto 10000 9\n");
+    TEST_ASSERT_TRUE(replied(LOG_ID_CONSOLE_USAGE));
+    typeLine("calibrate done\n");
+    TEST_ASSERT_TRUE(replied(LOG_ID_CALIBRATE_NO_CURVE));
+
+    typeLine("calibrate auto 10000 2\n");
+    LogRecord record;
+    TEST_ASSERT_TRUE(takeReply(LOG_ID_CALIBRATE_SESSION, &record));
+    TEST_ASSERT_EQUAL(0, record.words[0]);
+    TEST_ASSERT_EQUAL(2, record.words[1]);
+
+    // First run: 60 pulses for 10 L, then the flow stops
+    simulateFlow(600, 10000);
+    simulateFlow(CALIBRATION_RUN_IDLE_MS + 1000, 0);
+    typeLine("calibrate\n");
+    TEST_ASSERT_TRUE(takeReply(LOG_ID_CALIBRATE_SESSION, &record));
+    TEST_ASSERT_EQUAL(1, record.words[0]);
+    TEST_ASSERT_TRUE(replied(LOG_ID_CALIBRATE_CURVE));   // Still the old one
+    TEST_ASSERT_TRUE(takeReply(LOG_ID_CALIBRATION_POINT, &record));
+    TEST_ASSERT_EQUAL(CALIBRATION_NOMINAL_MILLI / 1000, record.words[1]);
+
+    // Second run still flowing: done fits the one finished run
+    simulateFlow(300, 10000);
+    typeLine("calibrate done\n");
+    TEST_ASSERT_TRUE(takeReply(LOG_ID_CALIBRATE_CURVE, &record));
+    TEST_ASSERT_EQUAL(1, record.words[0]);
+    TEST_ASSERT_TRUE(takeReply(LOG_ID_CALIBRATION_POINT, &record));
+    TEST_ASSERT_EQUAL(6, record.words[1]);
+    TEST_ASSERT_EQUAL(0, record.words[2]);
+
+    typeLine("calibrate default\n");
+    TEST_ASSERT_TRUE(takeReply(LOG_ID_CALIBRATION_POINT, &record));
+    TEST_ASSERT_EQUAL(CALIBRATION_NOMINAL_MILLI / 1000, record.words[1]);
+}
+
+void test_console_dump_history_streams_rows(void) {
+    // Alternating flowing and idle 10 s intervals: one row each
+    uint64_t ledger = 0;
+    historyBegin(&ledger);
+    for (int i = 0; i < 30; i++) {
+        ledger += (i % 3 == 0) ? 5 : 0;
+        hal_native_advance_ms(10000);
+        historyUpdate();
+    }
+
+    typeLine("dump history 10s\n");
+    LogRecord record;
+    TEST_ASSERT_TRUE(takeReply(LOG_ID_HISTORY_DUMP_START, &record));
+    TEST_ASSERT_EQUAL(10, record.words[0]);
+
+    uint32_t intervals = 0;
+    uint64_t pulses = 0;
+    uint32_t polls = 0;
+    bool ended = false;
+    while (!ended && polls < 20) {
+        consolePoll();
+        polls++;
+        uint32_t rows = 0;
+        while (logRead(&record)) {
+            if (record.id == LOG_ID_HISTORY_DUMP_ROW) {
+                rows++;
+                intervals += record.words[1];
+                pulses += (uint64_t)record.words[1] * record.words[2];
+            } else if (record.id == LOG_ID_HISTORY_DUMP_END) {
+                TEST_ASSERT_EQUAL(intervals, record.words[0]);
+                ended = true;
+            }
+        }
+        TEST_ASSERT_TRUE(rows <= CONSOLE_DUMP_ROWS);
+    }
+
+    TEST_ASSERT_TRUE(ended);
+    TEST_ASSERT_TRUE(polls > 1);
+    TEST_ASSERT_EQUAL(30, intervals);
+    TEST_ASSERT_EQUAL(ledger, pulses);
+}
+
+void test_console_reset_counters_keeps_ledger(void) {
+    setupFlowSensor();
+    scheduleFlowMeter(nullptr);
+    simulateScheduledFlow(5000, 10000);
+    latencyRecord(LATENCY_SAVE, 1000);
+    uint64_t pulses = totalPulses;
+    TEST_ASSERT_TRUE(pulses > 0);
+    TEST_ASSERT_TRUE(schedulerStats()->runs > 0);
+
+    typeLine("reset counters\n");
+    TEST_ASSERT_TRUE(replied(LOG_ID_CONSOLE_COUNTERS_RESET));
+    TEST_ASSERT_EQUAL(0, schedulerStats()->runs);
+    TEST_ASSERT_EQUAL(0, schedulerStats()->wakeups);
+    TEST_ASSERT_EQUAL(0, reportEngineStats()->frames);
+    TEST_ASSERT_EQUAL(0, latencySamples(LATENCY_SAVE));
+    TEST_ASSERT_EQUAL(pulses, totalPulses);
+
+    typeLine("stats\n");
+    TEST_ASSERT_TRUE(replied(LOG_ID_STATS_SCHEDULER));
+}
+
+void test_console_usage_tree_edit(void) {
+    // Edits start from the tree in use and only apply when stored
+    typeLine("usage node 0 0xFF0000 4\n");
+    TEST_ASSERT_TRUE(replied(LOG_ID_USAGE_TREE_EDIT));
+    TEST_ASSERT_EQUAL(USAGE_FEATURE_DURATION, usageTree()->nodes[0].feature);
+    typeLine("usage store\n");
+    TEST_ASSERT_TRUE(replied(LOG_ID_USAGE_TREE_APPLIED));
+    TEST_ASSERT_EQUAL(USAGE_LEAF, usageTree()->nodes[0].feature);
+    UsageEvent event = {};
+    TEST_ASSERT_EQUAL(USAGE_APPLIANCE, usageClassify(usageTree(), &event));
+
+    // A node pointing back up is refused at store; the tree in use stays
+    typeLine("usage node 0 0x000000 60\n");
+    typeLine("usage store\n");
+    TEST_ASSERT_TRUE(replied(LOG_ID_CONSOLE_SET_REJECTED));
+    TEST_ASSERT_EQUAL(USAGE_LEAF, usageTree()->nodes[0].feature);
+
+    // Nodes are added at the end only
+    typeLine("usage node 20 0xFF0000 1\n");
+    TEST_ASSERT_TRUE(replied(LOG_ID_CONSOLE_USAGE));
+
+    typeLine("usage default\n");
+    TEST_ASSERT_TRUE(replied(LOG_ID_USAGE_TREE));
+    TEST_ASSERT_EQUAL(USAGE_FEATURE_DURATION, usageTree()->nodes[0].feature);
+}
+
+void ConsoleTests(void) {
+    RUN_TEST(test_console_line_split_across_polls);
+    RUN_TEST(test_console_one_command_per_poll);
+    RUN_TEST(test_console_rejects_bad_input);
+    RUN_TEST(test_console_calibrate_counts_pulses);
+    RUN_TEST(test_console_calibrate_auto_session);
+    RUN_TEST(test_console_dump_history_streams_rows);
+    RUN_TEST(test_console_reset_counters_keeps_ledger);
+    RUN_TEST(test_console_usage_tree_edit);
+}
@@ -0,0 +1,26 @@
+/*
+ * Serial Console Tests
+ * Tests for the non-blocking line reader, tokenizer and command table
+ */
+
+#ifndef TEST_CONSOLE_H
+#define TEST_CONSOLE_H
+
+#include <unity.h>
+#include "hal_native.h"
+#include "console.h"
+
+// Test suite declarations
+void test_console_line_split_across_polls(void);
+void test_console_one_command_per_poll(void);
+void test_console_rejects_bad_input(void);
+void test_console_calibrate_counts_pulses(void);
+void test_console_calibrate_auto_session(void);
+void test_console_dump_history_streams_rows(void);
+void test_console_reset_counters_keeps_ledger(void);
+void test_console_usage_tree_edit(void);
+
+// Test suite runner
+void ConsoleTests(void);
+
+#endif // TEST_CONSOLE_H
@@ -0,0 +1,378 @@
+/*
+ * Consumption Bucket Tests
+ * Tests for the calendar, bucket rollover, Zigbee Time sync, NVS and the
+ * Metering consumption attributes
+ */
+
+#include "test_consumption.h"
+#include "test_helpers.h"
+#include "flow_history.h"
+#include "flow_math.h"
+#include "metering_cluster.h"
+#include "config_traits.h"
+
+// Device times (ZCL UTCTime): Saturday 2026-01-31 23:00 UTC, then the
+// midnights that start Sunday 2026-02-01 and Monday 2026-02-02
+#define SATURDAY_2300 823215600UL
+#define SUNDAY (SATURDAY_2300 + 3600)
+#define MONDAY (SUNDAY + 86400)
+
+static uint64_t ledgers[FLOW_CHANNELS];
+
+static void clearLedgers() {
+    for (uint8_t i = 0; i < FLOW_CHANNELS; i++) {
+        ledgers[i] = 0;
+    }
+}
+
+/**
+ * History and buckets begun on ledgers, the clock at deviceTime
+ */
+static void begin(uint32_t deviceTime) {
+    historyBegin(&ledgers[0]);
+    historySetClock(deviceTime);
+    consumptionBegin(ledgers);
+}
+
+// Let the clock run to deviceTime, and the jobs that fell due
+static void runUntil(uint32_t deviceTime) {
+    hal_native_advance_ms((deviceTime - historyNow()) * 1000);
+    schedulerRunDue();
+}
+
+static ConsumptionTotals totals() {
+    ConsumptionTotals t;
+    consumptionTotals(0, &t);
+    return t;
+}
+
+static uint64_t readAttribute(uint16_t attrId) {
+    HalAttribute attr;
+    TEST_ASSERT_TRUE(hal_native_radio_read_attribute(FLOW_ENDPOINT, METERING_CLUSTER_ID, attrId, &attr));
+    NativeRadioFrame frame = {};
+    frame.count = 1;
+    frame.attrs[0] = attr;
+    return frameValue(&frame, attrId);
+}
+
+void test_consumption_calendar(void) {
+    // 2000-01-01 was a Saturday: its week started on Monday 1999-12-27
+    ConsumptionPeriod p = consumptionPeriod(0);
+    TEST_ASSERT_EQUAL(0, p.week);
+    TEST_ASSERT_EQUAL(0, p.month);
+    TEST_ASSERT_EQUAL(0, consumptionPeriod(1).week);
+    TEST_ASSERT_EQUAL(1, consumptionPeriod(2).week);
+    TEST_ASSERT_EQUAL(-1, consumptionPeriod(-1).month);
+    TEST_ASSERT_EQUAL(0, consumptionPeriod(-1).week);
+
+    // Leap day, and the months around it
+    TEST_ASSERT_EQUAL(24 * 12 + 1, consumptionPeriod(8825).month);      // 2024-02-29
+    TEST_ASSERT_EQUAL(24 * 12 + 2, consumptionPeriod(8826).month);      // 2024-03-01
+    TEST_ASSERT_EQUAL(26 * 12 + 9, consumptionPeriod(9785).month);      // 2026-10-16
+
+    // Days from device time and zone offset
+    TEST_ASSERT_EQUAL(9527, consumptionDay(SATURDAY_2300, 0));
+    TEST_ASSERT_EQUAL(9528, consumptionDay(SATURDAY_2300, 3600));
+    TEST_ASSERT_EQUAL(-1, consumptionDay(0, -3600));
+}
+
+void test_consumption_rolls_at_midnight(void) {
+    clearLedgers();
+    begin(SATURDAY_2300);
+    ledgers[0] += 75;
+
+    runUntil(SUNDAY - 1);
+    ConsumptionTotals t = totals();
+    TEST_ASSERT_TRUE(t.todayMl == pulsesToMillilitres(75));
+    TEST_ASSERT_TRUE(t.yesterdayMl == 0);
+    TEST_ASSERT_TRUE(t.weekMl == pulsesToMillilitres(75));
+    TEST_ASSERT_TRUE(t.monthMl == pulsesToMillilitres(75));
+    TEST_ASSERT_TRUE(t.yearMl == pulsesToMillilitres(75));
+
+    // Sunday, February: a new day and month, the same week
+    runUntil(SUNDAY + 1);
+    t = totals();
+    TEST_ASSERT_TRUE(t.todayMl == 0);
+    TEST_ASSERT_TRUE(t.yesterdayMl == pulsesToMillilitres(75));
+    TEST_ASSERT_TRUE(t.weekMl == pulsesToMillilitres(75));
+    TEST_ASSERT_TRUE(t.monthMl == 0);
+    TEST_ASSERT_TRUE(t.yearMl == pulsesToMillilitres(75));
+
+    // Monday: a new week
+    ledgers[0] += 30;
+    runUntil(MONDAY + 1);
+    t = totals();
+    TEST_ASSERT_TRUE(t.todayMl == 0);
+    TEST_ASSERT_TRUE(t.yesterdayMl == pulsesToMillilitres(30));
+    TEST_ASSERT_TRUE(t.weekMl == 0);
+    TEST_ASSERT_TRUE(t.monthMl == pulsesToMillilitres(30));
+    TEST_ASSERT_TRUE(t.yearMl == pulsesToMillilitres(105));
+
+    // A day without water leaves yesterday empty
+    runUntil(MONDAY + 86400 + 1);
+    TEST_ASSERT_TRUE(totals().yesterdayMl == 0);
+}
+
+void test_consumption_rolling_year(void) {
+    ConsumptionBuckets b = {};
+    ConsumptionPeriod from = consumptionPeriod(9131);   // 2025-01-01
+    uint64_t ledger = 0;
+
+    // 14 months, month m using (m + 1) * 10 pulses: the year holds the 11
+    // months before this one plus this one
+    for (int32_t m = 0; m < 14; m++) {
+        ledger += (uint64_t)(m + 1) * 10;
+        ConsumptionPeriod to = from;
+        to.day += 31;
+        to.week += 5;
+        to.month += 1;
+        consumptionRoll(&b, ledger, &from, &to);
+        from = to;
+
+        uint64_t expected = 0;
+        for (int32_t k = m - 10 < 0 ? 0 : m - 10; k <= m; k++) {
+            expected += (uint64_t)(k + 1) * 10;
+        }
+        TEST_ASSERT_TRUE(b.yearPulses == expected);
+        TEST_ASSERT_TRUE(b.monthLedger == ledger);
+    }
+
+    // A year and more off: every month before this one is empty
+    ledger += 500;
+    ConsumptionPeriod to = from;
+    to.day += 800;
+    to.week += 115;
+    to.month += 26;
+    consumptionRoll(&b, ledger, &from, &to);
+    TEST_ASSERT_TRUE(b.yearPulses == 0);
+    TEST_ASSERT_TRUE(b.yesterdayPulses == 0);
+    TEST_ASSERT_TRUE(b.dayLedger == ledger);
+}
+
+void test_consumption_rollover_with_clock_behind(void) {
+    // Local midnights, including across a zone offset
+    int32_t saturday = consumptionDay(SATURDAY_2300, 0);
+    TEST_ASSERT_EQUAL(3600000, consumptionRolloverMs(saturday, SATURDAY_2300, 0));
+    TEST_ASSERT_EQUAL(1000, consumptionRolloverMs(saturday, SUNDAY, 0));
+    TEST_ASSERT_EQUAL(1800000, consumptionRolloverMs(saturday, SATURDAY_2300 - 1800, 3600));
+
+    // A clock 26 years behind the day (no history, no sync yet) waits a
+    // day at a time - seconds * 1000 would not fit 32 bits
+    TEST_ASSERT_EQUAL(86400000, consumptionRolloverMs(saturday, 0, 0));
+    TEST_ASSERT_EQUAL(86400000, consumptionRolloverMs(saturday, SATURDAY_2300 - 50 * 86400, 0));
+
+    // Buckets stored on Sunday, clock back at the 2000 epoch after a
+    // reboot: nothing rolls, and the water still counts today
+    clearLedgers();
+    begin(SUNDAY + 60);
+    consumptionSave();
+    resetConsumption();
+    schedulerReset();
+    resetFlowHistory();
+    historyBegin(&ledgers[0]);
+    TEST_ASSERT_TRUE(historyNow() < 86400);
+    consumptionBegin(ledgers);
+    ledgers[0] += 75;
+    for (uint8_t day = 0; day < 3; day++) {
+        hal_native_advance_ms(86400000UL);
+        schedulerRunDue();
+    }
+    TEST_ASSERT_TRUE(totals().todayMl == pulsesToMillilitres(75));
+    TEST_ASSERT_TRUE(totals().yesterdayMl == 0);
+}
+
+void test_consumption_time_sync(void) {
+    clearLedgers();
+    historyBegin(&ledgers[0]);
+    consumptionBegin(ledgers);
+
+    // Not joined: nothing asked
+    schedulerRunDue();
+    TEST_ASSERT_EQUAL(0, hal_native_radio_time_requests());
+    TEST_ASSERT_FALSE(consumptionTimeSynced());
+
+    // Joined: asked every TIME_SYNC_RETRY until the coordinator answers
+    zigbeeConnected = true;
+    hal_native_advance_ms(TIME_SYNC_RETRY_MS);
+    schedulerRunDue();
+    TEST_ASSERT_EQUAL(1, hal_native_radio_time_requests());
+    hal_native_advance_ms(TIME_SYNC_RETRY_MS);
+    schedulerRunDue();
+    TEST_ASSERT_EQUAL(2, hal_native_radio_time_requests());
+
+    // A coordinator without a clock does not count
+    HalTime unset = { HAL_TIME_INVALID, HAL_TIME_INVALID };
+    hal_native_radio_time_response(&unset);
+    TEST_ASSERT_FALSE(consumptionTimeSynced());
+
+    // Time sets the clock, LocalTime the zone
+    HalTime time = { SATURDAY_2300, SATURDAY_2300 + 3600 };
+    hal_native_radio_time_response(&time);
+    TEST_ASSERT_TRUE(consumptionTimeSynced());
+    TEST_ASSERT_EQUAL(SATURDAY_2300, historyNow());
+    TEST_ASSERT_EQUAL(3600, consumptionZoneOffset());
+
+    // Next read after TIME_SYNC_INTERVAL
+    hal_native_advance_ms(TIME_SYNC_RETRY_MS);
+    schedulerRunDue();
+    TEST_ASSERT_EQUAL(2, hal_native_radio_time_requests());
+    hal_native_advance_ms(TIME_SYNC_INTERVAL_MS - TIME_SYNC_RETRY_MS);
+    schedulerRunDue();
+    TEST_ASSERT_EQUAL(3, hal_native_radio_time_requests());
+
+    // A coordinator behind the device clock does not move it back; no
+    // LocalTime keeps the zone
+    uint32_t now = historyNow();
+    HalTime behind = { now - 60, HAL_TIME_INVALID };
+    hal_native_radio_time_response(&behind);
+    TEST_ASSERT_EQUAL(now, historyNow());
+    TEST_ASSERT_EQUAL(3600, consumptionZoneOffset());
+}
+
+void test_consumption_counted_before_first_sync(void) {
+    // First boot: no history, the clock at the 2000 epoch
+    clearLedgers();
+    historyBegin(&ledgers[0]);
+    consumptionBegin(ledgers);
+    ledgers[0] += 75;
+    hal_native_advance_ms(3600000UL);
+
+    // The sync jumps 26 years: the water lands in the synced day, week,
+    // month and year, not in a closed month of 2000
+    HalTime time = { SATURDAY_2300, SATURDAY_2300 };
+    hal_native_radio_time_response(&time);
+    ConsumptionTotals t = totals();
+    TEST_ASSERT_TRUE(t.todayMl == pulsesToMillilitres(75));
+    TEST_ASSERT_TRUE(t.weekMl == pulsesToMillilitres(75));
+    TEST_ASSERT_TRUE(t.monthMl == pulsesToMillilitres(75));
+    TEST_ASSERT_TRUE(t.yearMl == pulsesToMillilitres(75));
+    TEST_ASSERT_TRUE(t.yesterdayMl == 0);
+
+    // From there on midnight rolls as usual
+    runUntil(SUNDAY + 1);
+    TEST_ASSERT_TRUE(totals().yesterdayMl == pulsesToMillilitres(75));
+    TEST_ASSERT_TRUE(totals().monthMl == 0);
+    TEST_ASSERT_TRUE(totals().yearMl == pulsesToMillilitres(75));
+
+    // Stored on Sunday with 40 pulses; rebooted without history, 15 more
+    // before Monday's sync: Sunday keeps its 40, Monday gets the 15
+    ledgers[0] += 40;
+    consumptionSave();
+    resetConsumption();
+    schedulerReset();
+    resetFlowHistory();
+    historyBegin(&ledgers[0]);
+    consumptionBegin(ledgers);
+    ledgers[0] += 15;
+    HalTime monday = { MONDAY + 600, MONDAY + 600 };
+    hal_native_radio_time_response(&monday);
+    t = totals();
+    TEST_ASSERT_TRUE(t.yesterdayMl == pulsesToMillilitres(40));
+    TEST_ASSERT_TRUE(t.todayMl == pulsesToMillilitres(15));
+    TEST_ASSERT_TRUE(t.monthMl == pulsesToMillilitres(55));
+}
+
+void test_consumption_local_midnight(void) {
+    clearLedgers();
+    historyBegin(&ledgers[0]);
+    consumptionBegin(ledgers);
+
+    // 22:30 UTC is 23:30 at UTC+1
+    HalTime time = { SATURDAY_2300 - 1800, SATURDAY_2300 + 1800 };
+    hal_native_radio_time_response(&time);
+    ledgers[0] += 75;
+
+    // Local midnight is 23:00 UTC
+    runUntil(SATURDAY_2300 - 1);
+    TEST_ASSERT_TRUE(totals().yesterdayMl == 0);
+    runUntil(SATURDAY_2300 + 1);
+    TEST_ASSERT_TRUE(totals().yesterdayMl == pulsesToMillilitres(75));
+    TEST_ASSERT_TRUE(totals().todayMl == 0);
+}
+
+void test_consumption_saved_lazily(void) {
+    clearLedgers();
+    ledgers[0] = 1000;
+    begin(SATURDAY_2300);
+    TEST_ASSERT_FALSE(hal_native_nvs_has_key("consState"));
+
+    // A rollover changes the state; the next ledger save stores it
+    ledgers[0] += 75;
+    uint32_t writes = hal_native_nvs_write_count();
+    runUntil(SUNDAY + 1);
+    TEST_ASSERT_EQUAL(writes, hal_native_nvs_write_count());
+    saveTotalVolume();
+    TEST_ASSERT_TRUE(hal_native_nvs_has_key("consState"));
+
+    // ... once
+    writes = hal_native_nvs_write_count();
+    consumptionSave();
+    TEST_ASSERT_EQUAL(writes, hal_native_nvs_write_count());
+
+    // Reboot the same day: the buckets come back
+    ledgers[0] += 15;
+    resetConsumption();
+    schedulerReset();
+    consumptionBegin(ledgers);
+    ConsumptionTotals t = totals();
+    TEST_ASSERT_TRUE(t.todayMl == pulsesToMillilitres(15));
+    TEST_ASSERT_TRUE(t.yesterdayMl == pulsesToMillilitres(75));
+    TEST_ASSERT_TRUE(t.yearMl == pulsesToMillilitres(90));
+
+    // Off for two days: rolled over at boot, yesterday empty
+    resetConsumption();
+    schedulerReset();
+    hal_native_advance_ms(2 * 86400000UL);
+    consumptionBegin(ledgers);
+    t = totals();
+    TEST_ASSERT_TRUE(t.todayMl == 0);
+    TEST_ASSERT_TRUE(t.yesterdayMl == 0);
+    TEST_ASSERT_TRUE(t.monthMl == pulsesToMillilitres(15));
+
+    // Every channel's state is one NVS write
+    writes = hal_native_nvs_write_count();
+    consumptionSave();
+    TEST_ASSERT_EQUAL(writes + 1, hal_native_nvs_write_count());
+}
+
+void test_consumption_attributes(void) {
+    historyBegin(&totalPulses);
+    historySetClock(SATURDAY_2300);
+    consumptionBegin(flowChannels.ledger);
+    zigbeeConnected = true;
+
+    totalPulses += 75;
+    shouldReportFlow(0, totalVolumeMl(), 100);
+    TEST_ASSERT_TRUE(readAttribute(METERING_DAY_ATTR) == pulsesToMillilitres(75));
+    TEST_ASSERT_TRUE(readAttribute(METERING_WEEK_ATTR) == pulsesToMillilitres(75));
+    TEST_ASSERT_TRUE(readAttribute(METERING_MONTH_ATTR) == pulsesToMillilitres(75));
+    TEST_ASSERT_TRUE(readAttribute(METERING_YEAR_ATTR) == pulsesToMillilitres(75));
+    TEST_ASSERT_TRUE(readAttribute(METERING_PREVIOUS_DAY_ATTR) == 0);
+
+    // The rollover refreshes them without a report pass
+    runUntil(SUNDAY + 1);
+    TEST_ASSERT_TRUE(readAttribute(METERING_DAY_ATTR) == 0);
+    TEST_ASSERT_TRUE(readAttribute(METERING_PREVIOUS_DAY_ATTR) == pulsesToMillilitres(75));
+    TEST_ASSERT_TRUE(readAttribute(METERING_MONTH_ATTR) == 0);
+
+    // Day and week stop at the uint24 limit, month goes on
+    totalPulses += LITRES_TO_PULSES(20000.0);
+    shouldReportFlow(0, totalVolumeMl(), 100);
+    TEST_ASSERT_EQUAL(METERING_UINT24_MAX, readAttribute(METERING_DAY_ATTR));
+    TEST_ASSERT_EQUAL(METERING_UINT24_MAX, readAttribute(METERING_WEEK_ATTR));
+    TEST_ASSERT_TRUE(readAttribute(METERING_MONTH_ATTR) ==
+                     pulsesToMillilitres(LITRES_TO_PULSES(20000.0)));
+}
+
+// Test suite runner
+void ConsumptionTests(void) {
+    RUN_TEST(test_consumption_calendar);
+    RUN_TEST(test_consumption_rolls_at_midnight);
+    RUN_TEST(test_consumption_rolling_year);
+    RUN_TEST(test_consumption_rollover_with_clock_behind);
+    RUN_TEST(test_consumption_time_sync);
+    RUN_TEST(test_consumption_counted_before_first_sync);
+    RUN_TEST(test_consumption_local_midnight);
+    RUN_TEST(test_consumption_saved_lazily);
+    RUN_TEST(test_consumption_attributes);
+}
@@ -0,0 +1,27 @@
+/*
+ * Consumption Bucket Tests
+ * Tests for the calendar, bucket rollover, Zigbee Time sync, NVS and the
+ * Metering consumption attributes
+ */
+
+#ifndef TEST_CONSUMPTION_H
+#define TEST_CONSUMPTION_H
+
+#include <unity.h>
+#include "consumption.h"
+
+// Test suite declarations
+void test_consumption_calendar(void);
+void test_consumption_rolls_at_midnight(void);
+void test_consumption_rolling_year(void);
+void test_consumption_rollover_with_clock_behind(void);
+void test_consumption_time_sync(void);
+void test_consumption_counted_before_first_sync(void);
+void test_consumption_local_midnight(void);
+void test_consumption_saved_lazily(void);
+void test_consumption_attributes(void);
+
+// Test suite runner
+void ConsumptionTests(void);
+
+#endif // TEST_CONSUMPTION_H
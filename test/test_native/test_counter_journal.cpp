@@ -0,0 +1,127 @@
+/*
+ * Counter Journal Tests
+ * Tests for the wear-leveled ledger journal on the simulated flash
+ */
+
+#include "test_counter_journal.h"
+
+#define TEST_JOURNAL_SECTORS 4
+
+static CounterJournal journal;
+
+static void openJournal(void) {
+    hal_flash_begin("spiffs");
+    journalBegin(&journal, 0, TEST_JOURNAL_SECTORS);
+}
+
+static bool rebootAndRecover(uint64_t* value) {
+    openJournal();
+    return journalRecover(&journal, value);
+}
+
+void test_journal_empty_partition(void) {
+    uint64_t value = 42;
+    TEST_ASSERT_FALSE(rebootAndRecover(&value));
+    TEST_ASSERT_EQUAL(42, value);
+
+    // First append formats sector 0
+    TEST_ASSERT_TRUE(journalAppend(&journal, 7));
+    TEST_ASSERT_TRUE(rebootAndRecover(&value));
+    TEST_ASSERT_EQUAL(7, value);
+}
+
+void test_journal_recovers_latest_value(void) {
+    uint64_t value;
+    rebootAndRecover(&value);
+    for (uint64_t v = 1; v <= 100; v++) {
+        TEST_ASSERT_TRUE(journalAppend(&journal, v * 1000));
+    }
+
+    TEST_ASSERT_TRUE(rebootAndRecover(&value));
+    TEST_ASSERT_EQUAL(100000, value);
+
+    // Appending after recovery continues the sequence
+    TEST_ASSERT_TRUE(journalAppend(&journal, 123456));
+    TEST_ASSERT_TRUE(rebootAndRecover(&value));
+    TEST_ASSERT_EQUAL(123456, value);
+}
+
+void test_journal_rotates_sectors(void) {
+    uint64_t value;
+    rebootAndRecover(&value);
+
+    // Several trips round the ring, rebooting at awkward points
+    const uint32_t total = JOURNAL_SLOTS_PER_SECTOR * TEST_JOURNAL_SECTORS * 3 + 17;
+    for (uint32_t i = 1; i <= total; i++) {
+        TEST_ASSERT_TRUE(journalAppend(&journal, 0x100000000ULL + i));
+        if (i % 251 == 0 || i % JOURNAL_SLOTS_PER_SECTOR == 0) {
+            TEST_ASSERT_TRUE(rebootAndRecover(&value));
+            TEST_ASSERT_EQUAL_UINT64(0x100000000ULL + i, value);
+        }
+    }
+
+    TEST_ASSERT_TRUE(rebootAndRecover(&value));
+    TEST_ASSERT_EQUAL_UINT64(0x100000000ULL + total, value);
+}
+
+void test_journal_survives_torn_write(void) {
+    uint64_t value;
+    rebootAndRecover(&value);
+    for (uint64_t v = 1; v <= 10; v++) {
+        journalAppend(&journal, v);
+    }
+
+    // Power fails half way through the next record
+    hal_native_flash_fail_after(JOURNAL_RECORD_SIZE / 2);
+    TEST_ASSERT_FALSE(journalAppend(&journal, 11));
+    hal_native_flash_fail_after(0);
+
+    TEST_ASSERT_TRUE(rebootAndRecover(&value));
+    TEST_ASSERT_EQUAL(10, value);
+
+    // The torn slot is skipped, not reprogrammed
+    TEST_ASSERT_TRUE(journalAppend(&journal, 12));
+    TEST_ASSERT_TRUE(rebootAndRecover(&value));
+    TEST_ASSERT_EQUAL(12, value);
+}
+
+void test_journal_wear_is_even(void) {
+    uint64_t value;
+    rebootAndRecover(&value);
+    hal_native_flash_clear_stats();
+
+    const uint32_t rotations = 5;
+    const uint32_t appends = JOURNAL_SLOTS_PER_SECTOR * TEST_JOURNAL_SECTORS * rotations;
+    for (uint32_t i = 0; i < appends; i++) {
+        journalAppend(&journal, i);
+    }
+
+    const NativeFlashStats* stats = hal_native_flash_stats();
+    TEST_ASSERT_EQUAL(TEST_JOURNAL_SECTORS * rotations, stats->erases);
+    TEST_ASSERT_EQUAL(rotations, stats->maxSectorErases);
+    TEST_ASSERT_EQUAL((uint64_t)appends * JOURNAL_RECORD_SIZE, stats->bytesWritten);
+}
+
+void test_journal_recovery_read_cost(void) {
+    uint64_t value;
+    rebootAndRecover(&value);
+    for (uint32_t i = 0; i < JOURNAL_SLOTS_PER_SECTOR + 100; i++) {
+        journalAppend(&journal, i);
+    }
+
+    hal_native_flash_clear_stats();
+    TEST_ASSERT_TRUE(rebootAndRecover(&value));
+
+    // One read per sector header + log2(slots) probes + the final record
+    TEST_ASSERT_LESS_OR_EQUAL(TEST_JOURNAL_SECTORS + 8 + 1, hal_native_flash_stats()->reads);
+}
+
+// Test suite runner
+void CounterJournalTests(void) {
+    RUN_TEST(test_journal_empty_partition);
+    RUN_TEST(test_journal_recovers_latest_value);
+    RUN_TEST(test_journal_rotates_sectors);
+    RUN_TEST(test_journal_survives_torn_write);
+    RUN_TEST(test_journal_wear_is_even);
+    RUN_TEST(test_journal_recovery_read_cost);
+}
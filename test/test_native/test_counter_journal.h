@@ -0,0 +1,24 @@
+/*
+ * Counter Journal Tests
+ * Tests for the wear-leveled ledger journal on the simulated flash
+ */
+
+#ifndef TEST_COUNTER_JOURNAL_H
+#define TEST_COUNTER_JOURNAL_H
+
+#include <unity.h>
+#include "hal_native.h"
+#include "counter_journal.h"
+
+// Test suite declarations
+void test_journal_empty_partition(void);
+void test_journal_recovers_latest_value(void);
+void test_journal_rotates_sectors(void);
+void test_journal_survives_torn_write(void);
+void test_journal_wear_is_even(void);
+void test_journal_recovery_read_cost(void);
+
+// Test suite runner
+void CounterJournalTests(void);
+
+#endif // TEST_COUNTER_JOURNAL_H
@@ -0,0 +1,214 @@
+/*
+ * Deferred Log Tests
+ * Tests for the binary log ring, formatter, frames and level filter
+ */
+
+#include "test_deferred_log.h"
+#include "test_helpers.h"
+#include "flow_meter.h"
+#include "battery_monitor.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+static std::string debugOutput() {
+    size_t len;
+    const char* data = hal_native_debug_output(&len);
+    return std::string(data, len);
+}
+
+void test_log_record_round_trip(void) {
+    hal_native_set_micros(1234567);
+    logWrite(LOG_ID_ZIGBEE_CONNECTED, (unsigned long)300, (uint16_t)0x1234);
+
+    LogRecord record;
+    TEST_ASSERT_TRUE(logRead(&record));
+    TEST_ASSERT_EQUAL(LOG_ID_ZIGBEE_CONNECTED, record.id);
+    TEST_ASSERT_EQUAL(1234, record.timestampMs);
+    TEST_ASSERT_EQUAL(2, record.wordCount);
+    TEST_ASSERT_EQUAL(300, record.words[0]);
+    TEST_ASSERT_EQUAL(0x1234, record.words[1]);
+    TEST_ASSERT_FALSE(logRead(&record));
+}
+
+void test_log_format_matches_printf(void) {
+    LogRecord record;
+    char line[LOG_LINE_MAX];
+    char expected[LOG_LINE_MAX];
+
+    logWrite(LOG_ID_ZIGBEE_CONNECTED, (unsigned long)3120, (uint16_t)0xAB);
+    logRead(&record);
+    logFormat(&record, line, sizeof(line));
+    snprintf(expected, sizeof(expected), LOG_FORMAT_ZIGBEE_CONNECTED, 3120UL, 0xAB);
+    TEST_ASSERT_EQUAL_STRING(expected, line);
+
+    // %% and %u together
+    logWrite(LOG_ID_BATTERY_LEVEL, (unsigned long)3700, (uint8_t)58);
+    logRead(&record);
+    logFormat(&record, line, sizeof(line));
+    TEST_ASSERT_EQUAL_STRING("[Battery] Voltage: 3700 mV, Percentage: 58%", line);
+
+    // Missing arguments are marked, never read past the record
+    logWrite(LOG_ID_STATUS_WAKEUPS, (unsigned long)7);
+    logRead(&record);
+    logFormat(&record, line, sizeof(line));
+    TEST_ASSERT_EQUAL_STRING("Wake-ups: 7 (max late ? ms, longest job ? us)", line);
+
+    // Truncates to the buffer
+    logWrite(LOG_ID_SYSTEM_RULE);
+    logRead(&record);
+    TEST_ASSERT_EQUAL(9, logFormat(&record, line, 10));
+    TEST_ASSERT_EQUAL_STRING("=========", line);
+}
+
+void test_log_64bit_arguments(void) {
+    unsigned long long pulses = 0x123456789ULL;
+    logWrite(LOG_ID_LEDGER_PULSES, pulses);
+
+    LogRecord record;
+    char line[LOG_LINE_MAX];
+    TEST_ASSERT_TRUE(logRead(&record));
+    TEST_ASSERT_EQUAL(2, record.wordCount);
+    logFormat(&record, line, sizeof(line));
+    TEST_ASSERT_EQUAL_STRING("[EEPROM] Total pulses: 4886718345", line);
+}
+
+void test_log_levels_compiled_out(void) {
+    // Host tests build with LOG_LEVEL_WARN: debug/info calls store nothing
+    TEST_ASSERT_EQUAL(LOG_LEVEL_WARN, LOG_LEVEL);
+
+    LOG(FLOW_RATE, 1000UL, 2000ULL);
+    LOG(ZIGBEE_INIT);
+    TEST_ASSERT_EQUAL(0, logStats()->records);
+
+    LOG(BATTERY_CRITICAL, 5);
+    LOG(ZIGBEE_INIT_FAILED);
+    TEST_ASSERT_EQUAL(2, logStats()->records);
+
+    // A full flow session logs nothing at this level
+    setupFlowSensor();
+    scheduleFlowMeter(nullptr);
+    simulateScheduledFlow(10000, 100000);
+    TEST_ASSERT_EQUAL(2, logStats()->records);
+}
+
+void test_log_drain_outputs_text_lines(void) {
+    hal_native_set_adc_mv(1400);    // 2.8 V - below empty
+    setupBatteryMonitor();
+    simulateScheduledFlow(BATTERY_SAMPLES * BATTERY_SAMPLE_INTERVAL, 0);
+    TEST_ASSERT_EQUAL(0, batteryPercent);
+
+    // Nothing reaches the serial port until the drain runs
+    TEST_ASSERT_EQUAL_STRING("", debugOutput().c_str());
+    TEST_ASSERT_EQUAL(1, logDrain(0));
+    TEST_ASSERT_EQUAL_STRING("[Battery] CRITICAL: Battery at 0%\n", debugOutput().c_str());
+    TEST_ASSERT_EQUAL(0, logDrain(0));
+}
+
+void test_log_full_ring_drops_and_reports(void) {
+    // Each record is 2 header words + 1 argument
+    uint32_t fits = LOG_BUFFER_WORDS / 3;
+    for (uint32_t i = 0; i < fits + 10; i++) {
+        logWrite(LOG_ID_BATTERY_WARNING, (uint8_t)20);
+    }
+    TEST_ASSERT_EQUAL(fits, logStats()->records);
+    TEST_ASSERT_EQUAL(10, logStats()->dropped);
+    TEST_ASSERT_TRUE(logStats()->maxUsedWords <= LOG_BUFFER_WORDS);
+
+    TEST_ASSERT_EQUAL(fits, logDrain(0));
+    std::string out = debugOutput();
+    TEST_ASSERT_TRUE(out.find("[Log] 10 records dropped\n") != std::string::npos);
+
+    // Loss is reported once, and the ring is usable again
+    hal_native_debug_clear();
+    logWrite(LOG_ID_BATTERY_WARNING, (uint8_t)19);
+    TEST_ASSERT_EQUAL(1, logDrain(0));
+    TEST_ASSERT_EQUAL_STRING("[Battery] WARNING: Battery at 19%\n", debugOutput().c_str());
+}
+
+void test_log_wakes_drain_once_per_burst(void) {
+    logWrite(LOG_ID_ZIGBEE_INIT);
+    logWrite(LOG_ID_ZIGBEE_JOINING);
+    logWrite(LOG_ID_ZIGBEE_PAIRING_HINT);
+    TEST_ASSERT_EQUAL(1, hal_native_drain_wake_count());
+
+    // The registered task empties the ring, the next record wakes it again
+    logBegin();
+    hal_native_run_drain_task();
+    TEST_ASSERT_EQUAL(3, logStats()->drained);
+    logWrite(LOG_ID_ZIGBEE_LOST);
+    TEST_ASSERT_EQUAL(2, hal_native_drain_wake_count());
+}
+
+void test_log_frame_round_trip(void) {
+    LogRecord in;
+    in.id = LOG_ID_FLOW_REPORT;
+    in.wordCount = 4;
+    in.timestampMs = 0xDEADBEEF;
+    in.words[0] = 6000;
+    in.words[1] = 12345;
+    in.words[2] = 1;
+    in.words[3] = 87;
+
+    uint8_t frame[LOG_FRAME_MAX];
+    size_t len = logEncodeFrame(&in, frame);
+    TEST_ASSERT_EQUAL(LOG_FRAME_OVERHEAD + 16, len);
+
+    LogRecord out;
+    TEST_ASSERT_EQUAL(len, logDecodeFrame(frame, len, &out));
+    TEST_ASSERT_EQUAL(in.id, out.id);
+    TEST_ASSERT_EQUAL(in.timestampMs, out.timestampMs);
+    TEST_ASSERT_EQUAL(in.wordCount, out.wordCount);
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(in.words, out.words, 4);
+
+    // Truncated or corrupted frames are rejected
+    TEST_ASSERT_EQUAL(0, logDecodeFrame(frame, len - 1, &out));
+    frame[10] ^= 0x01;
+    TEST_ASSERT_EQUAL(0, logDecodeFrame(frame, len, &out));
+}
+
+void test_log_frame_decoder_resyncs(void) {
+    // Boot ROM noise, then two frames - the host decoder skips byte by byte
+    uint8_t stream[64] = { 0x00, 0xA5, 0x13, 0xFF, 0x42 };
+    size_t len = 5;
+
+    LogRecord record;
+    record.id = LOG_ID_ZIGBEE_INIT;
+    record.wordCount = 0;
+    record.timestampMs = 5;
+    len += logEncodeFrame(&record, stream + len);
+    record.id = LOG_ID_BATTERY_WARNING;
+    record.wordCount = 1;
+    record.words[0] = 24;
+    len += logEncodeFrame(&record, stream + len);
+
+    uint16_t ids[2];
+    size_t found = 0;
+    size_t pos = 0;
+    while (pos < len) {
+        size_t frame = logDecodeFrame(stream + pos, len - pos, &record);
+        if (frame == 0) {
+            pos++;
+            continue;
+        }
+        TEST_ASSERT_TRUE(found < 2);
+        ids[found++] = record.id;
+        pos += frame;
+    }
+    TEST_ASSERT_EQUAL(2, found);
+    TEST_ASSERT_EQUAL(LOG_ID_ZIGBEE_INIT, ids[0]);
+    TEST_ASSERT_EQUAL(LOG_ID_BATTERY_WARNING, ids[1]);
+}
+
+// Test suite runner
+void DeferredLogTests(void) {
+    RUN_TEST(test_log_record_round_trip);
+    RUN_TEST(test_log_format_matches_printf);
+    RUN_TEST(test_log_64bit_arguments);
+    RUN_TEST(test_log_levels_compiled_out);
+    RUN_TEST(test_log_drain_outputs_text_lines);
+    RUN_TEST(test_log_full_ring_drops_and_reports);
+    RUN_TEST(test_log_wakes_drain_once_per_burst);
+    RUN_TEST(test_log_frame_round_trip);
+    RUN_TEST(test_log_frame_decoder_resyncs);
+}
@@ -0,0 +1,27 @@
+/*
+ * Deferred Log Tests
+ * Tests for the binary log ring, formatter, frames and level filter
+ */
+
+#ifndef TEST_DEFERRED_LOG_H
+#define TEST_DEFERRED_LOG_H
+
+#include <unity.h>
+#include "hal_native.h"
+#include "deferred_log.h"
+
+// Test suite declarations
+void test_log_record_round_trip(void);
+void test_log_format_matches_printf(void);
+void test_log_64bit_arguments(void);
+void test_log_levels_compiled_out(void);
+void test_log_drain_outputs_text_lines(void);
+void test_log_full_ring_drops_and_reports(void);
+void test_log_wakes_drain_once_per_burst(void);
+void test_log_frame_round_trip(void);
+void test_log_frame_decoder_resyncs(void);
+
+// Test suite runner
+void DeferredLogTests(void);
+
+#endif // TEST_DEFERRED_LOG_H
@@ -0,0 +1,161 @@
+/*
+ * Flow Channels Tests
+ * Tests for the struct-of-arrays channel state and its flow window update
+ *
+ * The native build meters one channel (FLOW_CHANNELS 1): these tests drive
+ * FlowChannels<4> directly, the way four sensors on one board would
+ */
+
+#include <string.h>
+#include "test_flow_channels.h"
+#include "test_helpers.h"
+#include "report_engine.h"
+
+#define TEST_CHANNELS 4
+
+static CalibrationTable nominalTables[TEST_CHANNELS];
+
+static const CalibrationTable* uncalibrated() {
+    CalibrationCurve curve = {};
+    curve.count = 1;
+    curve.points[0].milliHz = 1000;
+    curve.points[0].kMilli = CALIBRATION_NOMINAL_MILLI;
+    for (uint8_t i = 0; i < TEST_CHANNELS; i++) {
+        nominalTables[i] = calibrationBuild(curve);
+    }
+    return nominalTables;
+}
+
+static void reading(PulseReading* readings, uint8_t channel, uint64_t count, uint64_t edgeUs) {
+    readings[channel].count = count;
+    readings[channel].edgeCount = count;
+    readings[channel].edgeUs = edgeUs;
+}
+
+void test_channels_count_independently(void) {
+    FlowChannels<TEST_CHANNELS> channels = flowChannelsInit<TEST_CHANNELS>();
+    const CalibrationTable* tables = uncalibrated();
+    PulseReading readings[TEST_CHANNELS] = {};
+
+    reading(readings, 0, 10, 900000);
+    reading(readings, 2, 75, 990000);
+    FlowChannelsTick tick = flowChannelsUpdate(&channels, readings, tables, 1000000, true);
+
+    TEST_ASSERT_EQUAL_HEX32(0xF, tick.updated);
+    TEST_ASSERT_EQUAL_HEX32(0x5, tick.counted);
+    TEST_ASSERT_EQUAL(10, channels.ledger[0]);
+    TEST_ASSERT_EQUAL(0, channels.ledger[1]);
+    TEST_ASSERT_EQUAL(75, channels.ledger[2]);
+    TEST_ASSERT_EQUAL(0, channels.ledger[3]);
+
+    // Channel 3 starts, the others carry on at their own counts
+    reading(readings, 0, 20, 1900000);
+    reading(readings, 2, 150, 1990000);
+    reading(readings, 3, 5, 1950000);
+    tick = flowChannelsUpdate(&channels, readings, tables, 2000000, true);
+    TEST_ASSERT_EQUAL_HEX32(0xD, tick.counted);
+    TEST_ASSERT_EQUAL(20, channels.ledger[0]);
+    TEST_ASSERT_EQUAL(150, channels.ledger[2]);
+    TEST_ASSERT_EQUAL(5, channels.ledger[3]);
+    TEST_ASSERT_TRUE(channels.rateMlMin[2] > channels.rateMlMin[0]);
+    TEST_ASSERT_EQUAL(0, channels.rateMlMin[1]);
+}
+
+void test_channels_apply_own_calibration(void) {
+    FlowChannels<TEST_CHANNELS> channels = flowChannelsInit<TEST_CHANNELS>();
+    CalibrationTable tables[TEST_CHANNELS];
+    memcpy(tables, uncalibrated(), sizeof(tables));
+
+    // Channel 1's sensor gives twice the nominal pulses per litre
+    CalibrationCurve curve = {};
+    curve.count = 1;
+    curve.points[0].milliHz = 1000;
+    curve.points[0].kMilli = CALIBRATION_NOMINAL_MILLI * 2;
+    tables[1] = calibrationBuild(curve);
+
+    PulseReading readings[TEST_CHANNELS] = {};
+    reading(readings, 0, 100, 990000);
+    reading(readings, 1, 100, 990000);
+    flowChannelsUpdate(&channels, readings, tables, 1000000, true);
+
+    TEST_ASSERT_EQUAL(100, channels.ledger[0]);
+    TEST_ASSERT_EQUAL(50, channels.ledger[1]);
+    TEST_ASSERT_EQUAL_HEX32(CALIBRATION_SCALE_ONE, channels.scale[0]);
+    TEST_ASSERT_EQUAL_HEX32(CALIBRATION_SCALE_ONE / 2, channels.scale[1]);
+    TEST_ASSERT_UINT32_WITHIN(1, channels.rateMlMin[0] / 2, channels.rateMlMin[1]);
+}
+
+void test_channels_start_early_alone(void) {
+    FlowChannels<TEST_CHANNELS> channels = flowChannelsInit<TEST_CHANNELS>();
+    const CalibrationTable* tables = uncalibrated();
+    PulseReading readings[TEST_CHANNELS] = {};
+
+    // Mid-window: only the channel with a first edge takes its reference
+    reading(readings, 1, 1, 400000);
+    FlowChannelsTick tick = flowChannelsUpdate(&channels, readings, tables, 400000, false);
+    TEST_ASSERT_EQUAL_HEX32(0x2, tick.updated);
+    TEST_ASSERT_TRUE(channels.estimator[1].hasReference);
+    TEST_ASSERT_FALSE(channels.estimator[0].hasReference);
+
+    // Second edge measures the starting flow before the window ends
+    reading(readings, 1, 2, 600000);
+    tick = flowChannelsUpdate(&channels, readings, tables, 600000, false);
+    TEST_ASSERT_EQUAL_HEX32(0x2, tick.updated);
+    TEST_ASSERT_TRUE(channels.rateMlMin[1] > 0);
+    TEST_ASSERT_EQUAL(2, channels.ledger[1]);
+}
+
+void test_channels_report_stopped_flow(void) {
+    FlowChannels<TEST_CHANNELS> channels = flowChannelsInit<TEST_CHANNELS>();
+    const CalibrationTable* tables = uncalibrated();
+    PulseReading readings[TEST_CHANNELS] = {};
+
+    reading(readings, 2, 10, 0);
+    flowChannelsUpdate(&channels, readings, tables, 1000000, true);
+    reading(readings, 2, 40, 1990000);
+    flowChannelsUpdate(&channels, readings, tables, 2000000, true);
+    TEST_ASSERT_TRUE(channels.rateMlMin[2] > 0);
+
+    // No pulses for FLOW_IDLE_TIMEOUT: the estimator gives up on channel 2
+    FlowChannelsTick tick = {};
+    for (uint64_t nowUs = 3000000; nowUs <= 40000000 && tick.stopped == 0; nowUs += 1000000) {
+        tick = flowChannelsUpdate(&channels, readings, tables, nowUs, true);
+    }
+    TEST_ASSERT_EQUAL_HEX32(0x4, tick.stopped);
+    TEST_ASSERT_EQUAL(0, channels.rateMlMin[2]);
+    TEST_ASSERT_EQUAL(40, channels.ledger[2]);
+}
+
+void test_channel_keys(void) {
+    char key[16];
+    flowChannelKey(key, sizeof(key), "ledger", 0);
+    TEST_ASSERT_EQUAL_STRING("ledger", key);
+    flowChannelKey(key, sizeof(key), "ledger", 3);
+    TEST_ASSERT_EQUAL_STRING("ledger.3", key);
+    flowChannelKey(key, sizeof(key), "cal.k7", 2);
+    TEST_ASSERT_EQUAL_STRING("cal.k7.2", key);
+}
+
+void test_calibration_cluster_endpoint_range(void) {
+    HalAttribute attr;
+    reportEncode(CALIBRATION_RUNS_ATTR, ZCL_TYPE_UINT8, 2, &attr);
+
+    TEST_ASSERT_EQUAL(ZCL_STATUS_SUCCESS,
+                      calibrationWriteAttribute(FLOW_ENDPOINT + FLOW_CHANNELS - 1,
+                                                CALIBRATION_CLUSTER_ID, &attr));
+    TEST_ASSERT_EQUAL(ZCL_STATUS_UNSUPPORTED_ATTRIBUTE,
+                      calibrationWriteAttribute(FLOW_ENDPOINT + FLOW_CHANNELS,
+                                                CALIBRATION_CLUSTER_ID, &attr));
+    TEST_ASSERT_EQUAL(ZCL_STATUS_UNSUPPORTED_ATTRIBUTE,
+                      calibrationWriteAttribute(FLOW_ENDPOINT - 1, CALIBRATION_CLUSTER_ID, &attr));
+}
+
+// Test suite runner
+void FlowChannelsTests(void) {
+    RUN_TEST(test_channels_count_independently);
+    RUN_TEST(test_channels_apply_own_calibration);
+    RUN_TEST(test_channels_start_early_alone);
+    RUN_TEST(test_channels_report_stopped_flow);
+    RUN_TEST(test_channel_keys);
+    RUN_TEST(test_calibration_cluster_endpoint_range);
+}
@@ -0,0 +1,23 @@
+/*
+ * Flow Channels Tests
+ * Tests for the struct-of-arrays channel state and its flow window update
+ */
+
+#ifndef TEST_FLOW_CHANNELS_H
+#define TEST_FLOW_CHANNELS_H
+
+#include <unity.h>
+#include "flow_channels.h"
+
+// Test suite declarations
+void test_channels_count_independently(void);
+void test_channels_apply_own_calibration(void);
+void test_channels_start_early_alone(void);
+void test_channels_report_stopped_flow(void);
+void test_channel_keys(void);
+void test_calibration_cluster_endpoint_range(void);
+
+// Test suite runner
+void FlowChannelsTests(void);
+
+#endif // TEST_FLOW_CHANNELS_H
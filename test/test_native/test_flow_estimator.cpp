@@ -0,0 +1,92 @@
+/*
+ * Flow Estimator Tests
+ * Tests for the adaptive period/count flow rate estimator
+ */
+
+#include "test_flow_estimator.h"
+#include "test_helpers.h"
+
+void test_estimator_needs_two_edges(void) {
+    FlowEstimator est;
+    flowEstimatorReset(&est);
+
+    TEST_ASSERT_TRUE(flowEstimatorStarting(&est, 1));
+    TEST_ASSERT_EQUAL(0, flowEstimatorUpdate(&est, 1, 1000, 2000, false));
+    TEST_ASSERT_TRUE(est.hasReference);
+
+    // Same count again - still waiting for the second edge
+    TEST_ASSERT_FALSE(flowEstimatorStarting(&est, 1));
+}
+
+void test_estimator_period_method_low_flow(void) {
+    FlowEstimator est;
+    flowEstimatorReset(&est);
+    flowEstimatorUpdate(&est, 1, 1000000, 1000000, true);
+
+    // One pulse 6.5 s later: 8 L/min / 6.5 = 1.23 L/min
+    // (a 1 s count window could only show 0 or 8 L/min)
+    uint32_t rate = flowEstimatorUpdate(&est, 2, 7500000, 7500000, true);
+    TEST_ASSERT_UINT32_WITHIN(1, 1230, rate);
+}
+
+void test_estimator_count_method_high_flow(void) {
+    FlowEstimator est;
+    flowEstimatorReset(&est);
+    flowEstimatorUpdate(&est, 1, 0, 1000000, true);
+
+    uint32_t pulses = FLOW_PERIOD_METHOD_MAX_PULSES + 4;
+    uint32_t rate = flowEstimatorUpdate(&est, 1 + pulses, 1990000, 2000000, true);
+    TEST_ASSERT_EQUAL(windowPulsesToFlowRate(pulses), rate);
+}
+
+void test_estimator_partial_window_uses_period(void) {
+    FlowEstimator est;
+    flowEstimatorReset(&est);
+
+    // Reference taken mid-window at a flow start
+    flowEstimatorUpdate(&est, 1, 500000, 500000, false);
+    TEST_ASSERT_TRUE(est.partialWindow);
+
+    // Many pulses, but the window only covered 0.5 s of them
+    uint32_t pulses = FLOW_PERIOD_METHOD_MAX_PULSES * 2;
+    uint32_t rate = flowEstimatorUpdate(&est, 1 + pulses, 1000000, 1000000, true);
+    TEST_ASSERT_EQUAL(periodToFlowRate(pulses, 500000), rate);
+    TEST_ASSERT_FALSE(est.partialWindow);
+}
+
+void test_estimator_decays_then_idles(void) {
+    FlowEstimator est;
+    flowEstimatorReset(&est);
+    flowEstimatorUpdate(&est, 1, 0, 0, true);
+    uint32_t rate = flowEstimatorUpdate(&est, 11, 1000000, 1000000, true);
+    TEST_ASSERT_EQUAL(80000, rate);
+
+    // 4 s with no edge: at most one pulse per 4 s = 2 L/min
+    rate = flowEstimatorUpdate(&est, 11, 1000000, 5000000, true);
+    TEST_ASSERT_EQUAL(2000, rate);
+
+    // Past FLOW_IDLE_TIMEOUT - stopped, reference dropped
+    rate = flowEstimatorUpdate(&est, 11, 1000000, 1000000 + FLOW_IDLE_TIMEOUT * 1000 + 1, true);
+    TEST_ASSERT_EQUAL(0, rate);
+    TEST_ASSERT_FALSE(est.hasReference);
+}
+
+void test_estimator_dripping_tap_through_loop(void) {
+    setupFlowSensor();
+
+    // One pulse every 20 s = 0.4 L/min through the real calculateFlow()
+    simulateFlow(61000, 20000000);
+
+    TEST_ASSERT_UINT32_WITHIN(10, 400, flowRateMlMin);
+    TEST_ASSERT_EQUAL(3, totalPulses);
+}
+
+// Test suite runner
+void FlowEstimatorTests(void) {
+    RUN_TEST(test_estimator_needs_two_edges);
+    RUN_TEST(test_estimator_period_method_low_flow);
+    RUN_TEST(test_estimator_count_method_high_flow);
+    RUN_TEST(test_estimator_partial_window_uses_period);
+    RUN_TEST(test_estimator_decays_then_idles);
+    RUN_TEST(test_estimator_dripping_tap_through_loop);
+}
@@ -0,0 +1,23 @@
+/*
+ * Flow Estimator Tests
+ * Tests for the adaptive period/count flow rate estimator
+ */
+
+#ifndef TEST_FLOW_ESTIMATOR_H
+#define TEST_FLOW_ESTIMATOR_H
+
+#include <unity.h>
+#include "flow_estimator.h"
+
+// Test suite declarations
+void test_estimator_needs_two_edges(void);
+void test_estimator_period_method_low_flow(void);
+void test_estimator_count_method_high_flow(void);
+void test_estimator_partial_window_uses_period(void);
+void test_estimator_decays_then_idles(void);
+void test_estimator_dripping_tap_through_loop(void);
+
+// Test suite runner
+void FlowEstimatorTests(void);
+
+#endif // TEST_FLOW_ESTIMATOR_H
@@ -0,0 +1,342 @@
+/*
+ * Flow History Tests
+ * Tests for the delta + varint interval history and its flash rings
+ */
+
+#include "test_flow_history.h"
+#include "test_helpers.h"
+
+static uint64_t ledger = 0;
+
+// Query sink: totals plus a check that intervals arrive in order, gap free
+struct Collected {
+    uint32_t seconds;
+    uint32_t calls;
+    uint32_t intervals;
+    uint64_t pulses;
+    uint32_t firstStart;
+    uint32_t nextStart;
+    bool contiguous;
+    uint32_t stopAfter;      // Calls before returning false (0 = never)
+};
+
+static void collectBegin(Collected* c, HistoryTier tier) {
+    *c = Collected();
+    c->seconds = historyIntervalSeconds(tier);
+    c->contiguous = true;
+}
+
+static bool collect(uint32_t start, uint32_t intervals, uint32_t pulses, void* context) {
+    Collected* c = (Collected*)context;
+    if (c->calls == 0) {
+        c->firstStart = start;
+    } else if (start != c->nextStart) {
+        c->contiguous = false;
+    }
+    c->calls++;
+    c->intervals += intervals;
+    c->pulses += (uint64_t)intervals * pulses;
+    c->nextStart = start + intervals * c->seconds;
+    return c->stopAfter == 0 || c->calls < c->stopAfter;
+}
+
+static Collected queryAll(HistoryTier tier) {
+    Collected c;
+    collectBegin(&c, tier);
+    historyQuery(tier, 0, UINT32_MAX, collect, &c);
+    return c;
+}
+
+/**
+ * One ledger step per simulated second: pulses, then the flow job's update
+ */
+static void runSeconds(uint32_t seconds, uint32_t pulsesPerSecond) {
+    for (uint32_t i = 0; i < seconds; i++) {
+        ledger += pulsesPerSecond;
+        hal_native_advance_ms(1000);
+        historyUpdate();
+    }
+}
+
+void test_history_varint_round_trip(void) {
+    const uint64_t values[] = { 0, 1, 127, 128, 300, 16383, 16384, 0xFFFFFFFFULL, 1ULL << 40 };
+    const size_t lengths[] = { 1, 1, 1, 2, 2, 2, 3, 5, 6 };
+    uint8_t buf[10];
+
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        uint64_t decoded = 0;
+        size_t len = historyPutVarint(buf, values[i]);
+        TEST_ASSERT_EQUAL(lengths[i], len);
+        TEST_ASSERT_EQUAL(len, historyGetVarint(buf, len, &decoded));
+        TEST_ASSERT_TRUE(decoded == values[i]);
+    }
+
+    // Truncated input is rejected
+    uint64_t decoded;
+    historyPutVarint(buf, 16384);
+    TEST_ASSERT_EQUAL(0, historyGetVarint(buf, 2, &decoded));
+}
+
+void test_history_idle_day_is_one_run(void) {
+    ledger = 0;
+    historyBegin(&ledger);
+    hal_native_advance_ms(86400000);
+
+    Collected c = queryAll(HISTORY_10S);
+    TEST_ASSERT_EQUAL(8640, c.intervals);
+    TEST_ASSERT_EQUAL(1, c.calls);
+    TEST_ASSERT_EQUAL(0, c.pulses);
+    TEST_ASSERT_EQUAL(0, historyStats()->blocksWritten);
+
+    c = queryAll(HISTORY_1H);
+    TEST_ASSERT_EQUAL(24, c.intervals);
+}
+
+void test_history_rollups_match_ledger(void) {
+    ledger = 1000;
+    historyBegin(&ledger);
+
+    // Two hours: showers, taps and idle stretches
+    runSeconds(600, 2);
+    runSeconds(1800, 0);
+    runSeconds(45, 1);
+    runSeconds(2000, 0);
+    runSeconds(480, 3);
+    runSeconds(2275, 0);
+    TEST_ASSERT_EQUAL(7200, historyNow());
+
+    uint64_t total = ledger - 1000;
+    Collected fine = queryAll(HISTORY_10S);
+    Collected minutes = queryAll(HISTORY_1MIN);
+    Collected hours = queryAll(HISTORY_1H);
+
+    TEST_ASSERT_EQUAL(720, fine.intervals);
+    TEST_ASSERT_EQUAL(120, minutes.intervals);
+    TEST_ASSERT_EQUAL(2, hours.intervals);
+    TEST_ASSERT_TRUE(fine.pulses == total);
+    TEST_ASSERT_TRUE(minutes.pulses == total);
+    TEST_ASSERT_TRUE(hours.pulses == total);
+    TEST_ASSERT_TRUE(fine.contiguous && minutes.contiguous && hours.contiguous);
+}
+
+void test_history_spills_full_blocks_to_flash(void) {
+    ledger = 0;
+    historyBegin(&ledger);
+
+    // Every 10 s interval busy with a varying count - no zero runs
+    for (uint32_t i = 0; i < 2000; i++) {
+        runSeconds(10, 1 + i % 40);
+    }
+
+    TEST_ASSERT_TRUE(historyStats()->blocksWritten >= 10);
+    Collected c = queryAll(HISTORY_10S);
+    TEST_ASSERT_EQUAL(2000, c.intervals);
+    TEST_ASSERT_EQUAL(0, c.firstStart);
+    TEST_ASSERT_TRUE(c.contiguous);
+    TEST_ASSERT_TRUE(c.pulses == ledger);
+}
+
+void test_history_range_query_clips(void) {
+    ledger = 0;
+    historyBegin(&ledger);
+    for (uint32_t i = 0; i < 1000; i++) {
+        runSeconds(10, 1);
+    }
+    historyFlush();
+
+    // [1005, 2000) holds intervals starting 1010 ... 1990
+    Collected c;
+    collectBegin(&c, HISTORY_10S);
+    TEST_ASSERT_EQUAL(99, historyQuery(HISTORY_10S, 1005, 2000, collect, &c));
+    TEST_ASSERT_EQUAL(1010, c.firstStart);
+    TEST_ASSERT_EQUAL(2000, c.nextStart);
+    TEST_ASSERT_TRUE(c.pulses == 99 * 10);
+
+    // Zero runs are clipped too
+    runSeconds(3600, 0);
+    collectBegin(&c, HISTORY_10S);
+    TEST_ASSERT_EQUAL(6, historyQuery(HISTORY_10S, 10000 + 60, 10000 + 120, collect, &c));
+    TEST_ASSERT_EQUAL(1, c.calls);
+    TEST_ASSERT_EQUAL(10060, c.firstStart);
+
+    // Empty range
+    collectBegin(&c, HISTORY_10S);
+    TEST_ASSERT_EQUAL(0, historyQuery(HISTORY_10S, 500, 500, collect, &c));
+}
+
+void test_history_query_can_stop_early(void) {
+    ledger = 0;
+    historyBegin(&ledger);
+    for (uint32_t i = 0; i < 100; i++) {
+        runSeconds(10, 1 + i % 3);
+    }
+
+    Collected c;
+    collectBegin(&c, HISTORY_10S);
+    c.stopAfter = 5;
+    historyQuery(HISTORY_10S, 0, UINT32_MAX, collect, &c);
+    TEST_ASSERT_EQUAL(5, c.calls);
+}
+
+void test_history_survives_reboot(void) {
+    ledger = 0;
+    historyBegin(&ledger);
+    runSeconds(95, 4);
+    historyFlush();
+    Collected before = queryAll(HISTORY_10S);
+
+    // Reboot: RAM state gone, flash kept, an hour passes while off
+    resetFlowHistory();
+    schedulerReset();
+    hal_native_advance_ms(3600000);
+    historyBegin(&ledger);
+
+    // Device time resumes at the end of the newest stored block
+    TEST_ASSERT_EQUAL(90, historyNow());
+    Collected after = queryAll(HISTORY_10S);
+    TEST_ASSERT_EQUAL(before.intervals, after.intervals);
+    TEST_ASSERT_TRUE(before.pulses == after.pulses);
+
+    // New data follows without going back in time
+    runSeconds(30, 1);
+    after = queryAll(HISTORY_10S);
+    TEST_ASSERT_EQUAL(before.intervals + 3, after.intervals);
+    TEST_ASSERT_TRUE(after.contiguous);
+}
+
+void test_history_ring_wraps(void) {
+    ledger = 0;
+    historyBegin(&ledger);
+
+    // Busy hours (128 per full block) fill the hourly ring more than once
+    const uint32_t hours = HISTORY_SECTORS_1H * 2500;
+    for (uint32_t h = 0; h < hours; h++) {
+        ledger += 300 + h % 7;
+        hal_native_advance_ms(3600000);
+        historyUpdate();
+    }
+    TEST_ASSERT_TRUE(historyStats()->sectorErases > HISTORY_SECTORS_1H);
+
+    // Oldest hours are gone, what is left is contiguous up to now
+    Collected c = queryAll(HISTORY_1H);
+    TEST_ASSERT_TRUE(c.firstStart > 0);
+    TEST_ASSERT_TRUE(c.contiguous);
+    TEST_ASSERT_EQUAL(hours * 3600, c.nextStart);
+    TEST_ASSERT_TRUE(c.intervals > hours / 2);
+
+    // A range inside the retained part is found by the sector search
+    const uint32_t day = hours - 1000;
+    Collected range;
+    collectBegin(&range, HISTORY_1H);
+    TEST_ASSERT_EQUAL(24, historyQuery(HISTORY_1H, day * 3600, (day + 24) * 3600, collect, &range));
+    TEST_ASSERT_EQUAL(day * 3600, range.firstStart);
+}
+
+void test_history_torn_block_is_skipped(void) {
+    ledger = 0;
+    historyBegin(&ledger);
+    runSeconds(100, 2);
+    historyFlush();
+
+    // Power fails part way through the next spill
+    runSeconds(100, 5);
+    hal_native_flash_fail_after(20);
+    historyFlush();
+    hal_native_flash_fail_after(0);
+
+    resetFlowHistory();
+    schedulerReset();
+    historyBegin(&ledger);
+    Collected c = queryAll(HISTORY_10S);
+    TEST_ASSERT_EQUAL(10, c.intervals);
+    TEST_ASSERT_TRUE(c.pulses == 200);
+
+    // Later blocks go to a fresh sector and read back
+    runSeconds(50, 1);
+    historyFlush();
+    TEST_ASSERT_TRUE(historyStats()->blocksWritten > 0);
+    c = queryAll(HISTORY_10S);
+    TEST_ASSERT_EQUAL(15, c.intervals);
+    TEST_ASSERT_TRUE(c.pulses == 250);
+}
+
+void test_history_set_clock_moves_forward_only(void) {
+    ledger = 0;
+    historyBegin(&ledger);
+    runSeconds(60, 1);
+
+    TEST_ASSERT_FALSE(historySetClock(30));
+    TEST_ASSERT_EQUAL(60, historyNow());
+
+    TEST_ASSERT_TRUE(historySetClock(1700000000));
+    TEST_ASSERT_EQUAL(1700000000, historyNow());
+    runSeconds(20, 1);
+
+    Collected c = queryAll(HISTORY_10S);
+    TEST_ASSERT_EQUAL(8, c.intervals);
+    TEST_ASSERT_FALSE(c.contiguous);   // Gap across the clock change
+    TEST_ASSERT_EQUAL(1700000000 + 20, c.nextStart);
+    TEST_ASSERT_TRUE(c.pulses == 80);
+}
+
+void test_history_clock_across_millis_wrap(void) {
+    // Boot half a second before hal_millis() wraps, read at odd steps
+    hal_native_set_micros((uint64_t)(UINT32_MAX - 500) * 1000);
+    ledger = 0;
+    historyBegin(&ledger);
+
+    uint64_t elapsedMs = 0;
+    for (uint32_t i = 0; i < 300; i++) {
+        hal_native_advance_ms(737);
+        elapsedMs += 737;
+        TEST_ASSERT_EQUAL((uint32_t)(elapsedMs / 1000), historyNow());
+    }
+    hal_native_advance_ms(3600000);   // A long sleep between reads
+    TEST_ASSERT_EQUAL((uint32_t)((elapsedMs + 3600000) / 1000), historyNow());
+}
+
+void test_history_through_flow_jobs(void) {
+    setupFlowSensor();
+    historyBegin(&totalPulses);
+    scheduleFlowMeter(nullptr);
+
+    // A minute at 10 pulses/s (80 L/min) until the flow job suspends
+    simulateScheduledFlow(60000, 100000);
+    simulateScheduledFlow(FLOW_IDLE_TIMEOUT + 2000, 0);
+    TEST_ASSERT_TRUE(flowMeterIdle());
+
+    // Ten idle minutes: history adds no wake-ups of its own
+    uint32_t wakeups = schedulerStats()->wakeups;
+    simulateScheduledFlow(600000, 0);
+    TEST_ASSERT_TRUE(schedulerStats()->wakeups - wakeups <=
+                     600 / FLOW_REPORT_INTERVAL + 600000 / MAX_SAVE_INTERVAL + 1);
+
+    Collected c = queryAll(HISTORY_10S);
+    TEST_ASSERT_EQUAL(historyNow() / 10, c.intervals);
+    TEST_ASSERT_TRUE(c.contiguous);
+    TEST_ASSERT_TRUE(c.pulses == totalPulses);
+    TEST_ASSERT_TRUE(totalPulses >= 590);
+
+    // Busy intervals each hold about 10 s of pulses
+    Collected busy;
+    collectBegin(&busy, HISTORY_10S);
+    historyQuery(HISTORY_10S, 10, 50, collect, &busy);
+    TEST_ASSERT_EQUAL(4, busy.intervals);
+    TEST_ASSERT_INT_WITHIN(10, 400, (int)busy.pulses);
+}
+
+// Test suite runner
+void FlowHistoryTests(void) {
+    RUN_TEST(test_history_varint_round_trip);
+    RUN_TEST(test_history_idle_day_is_one_run);
+    RUN_TEST(test_history_rollups_match_ledger);
+    RUN_TEST(test_history_spills_full_blocks_to_flash);
+    RUN_TEST(test_history_range_query_clips);
+    RUN_TEST(test_history_query_can_stop_early);
+    RUN_TEST(test_history_survives_reboot);
+    RUN_TEST(test_history_ring_wraps);
+    RUN_TEST(test_history_torn_block_is_skipped);
+    RUN_TEST(test_history_set_clock_moves_forward_only);
+    RUN_TEST(test_history_clock_across_millis_wrap);
+    RUN_TEST(test_history_through_flow_jobs);
+}
@@ -0,0 +1,30 @@
+/*
+ * Flow History Tests
+ * Tests for the delta + varint interval history and its flash rings
+ */
+
+#ifndef TEST_FLOW_HISTORY_H
+#define TEST_FLOW_HISTORY_H
+
+#include <unity.h>
+#include "hal_native.h"
+#include "flow_history.h"
+
+// Test suite declarations
+void test_history_varint_round_trip(void);
+void test_history_idle_day_is_one_run(void);
+void test_history_rollups_match_ledger(void);
+void test_history_spills_full_blocks_to_flash(void);
+void test_history_range_query_clips(void);
+void test_history_query_can_stop_early(void);
+void test_history_survives_reboot(void);
+void test_history_ring_wraps(void);
+void test_history_torn_block_is_skipped(void);
+void test_history_set_clock_moves_forward_only(void);
+void test_history_clock_across_millis_wrap(void);
+void test_history_through_flow_jobs(void);
+
+// Test suite runner
+void FlowHistoryTests(void);
+
+#endif // TEST_FLOW_HISTORY_H
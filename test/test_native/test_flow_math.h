@@ -0,0 +1,23 @@
+/*
+ * Fixed-Point Flow Math Tests
+ * Tests for ledger-to-volume/rate conversions and long-run accuracy
+ */
+
+#ifndef TEST_FLOW_MATH_H
+#define TEST_FLOW_MATH_H
+
+#include <unity.h>
+#include "hal_native.h"
+#include "flow_meter.h"
+
+// Test suite declarations
+void test_pulses_to_volume_exact(void);
+void test_window_pulses_to_flow_rate(void);
+void test_period_to_flow_rate_saturates(void);
+void test_volume_no_drift_after_1e9_pulses(void);
+void test_ledger_survives_pulse_counter_wrap(void);
+
+// Test suite runner
+void FlowMathTests(void);
+
+#endif // TEST_FLOW_MATH_H
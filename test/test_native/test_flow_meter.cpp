@@ -0,0 +1,252 @@
+/*
+ * Flow Meter Core Tests
+ * Exercises the production flow/report/persistence code on the host
+ */
+
+#include "test_flow_meter.h"
+#include "test_helpers.h"
+#include "counter_journal.h"
+#include "metering_cluster.h"
+#include "report_engine.h"
+#include <string.h>
+
+void test_calculate_flow_fast_start(void) {
+    setupFlowSensor();
+
+    // Pulses at 100, 200, 300 ms - well inside the first window
+    simulateFlow(300, 100000);
+
+    // Rate is known from the pulse period without waiting for the window
+    TEST_ASSERT_TRUE(hal_millis() < FLOW_CALC_INTERVAL);
+    TEST_ASSERT_UINT32_WITHIN(1, 80000, flowRateMlMin);   // 10 pulses/s
+    TEST_ASSERT_TRUE(pulseSourceCount() == 3);
+
+    // Remaining pulses reach the ledger at the window boundary
+    simulateFlow(FLOW_CALC_INTERVAL - 300, 0);
+    TEST_ASSERT_EQUAL(3, totalPulses);
+}
+
+void test_calculate_flow_rate_from_pulses(void) {
+    setupFlowSensor();
+
+    // 60 s at 12 pulses/s: 12 / 7.5 * 60 = 96 L/min, 720 pulses = 96 L
+    simulateFlow(60000, 1000000 / 12);
+
+    TEST_ASSERT_UINT32_WITHIN(100, 96000, flowRateMlMin);
+    TEST_ASSERT_EQUAL(720, totalPulses);
+    TEST_ASSERT_EQUAL(96000, totalVolumeMl());
+}
+
+void test_calculate_flow_idle_timeout(void) {
+    setupFlowSensor();
+    simulateFlow(5000, 100000);
+    TEST_ASSERT_TRUE(flowRateMlMin > 0);
+
+    // No pulses, but still within FLOW_IDLE_TIMEOUT - rate decays, not zero
+    simulateFlow(FLOW_IDLE_TIMEOUT - 2000, 0);
+    TEST_ASSERT_TRUE(flowRateMlMin > 0);
+
+    // Past the idle timeout - flow reported as stopped
+    simulateFlow(3000, 0);
+    TEST_ASSERT_EQUAL(0, flowRateMlMin);
+}
+
+void test_periodic_save_on_volume_threshold(void) {
+    loadTotalVolume();
+    uint32_t nvsWrites = hal_native_nvs_write_count();
+    uint64_t flashBytes = hal_native_flash_stats()->bytesWritten;
+
+    hal_native_advance_ms(1000);
+    totalPulses = LITRES_TO_PULSES(SAVE_THRESHOLD) - 1;
+    periodicSave();
+    TEST_ASSERT_EQUAL(flashBytes, hal_native_flash_stats()->bytesWritten);
+
+    totalPulses = LITRES_TO_PULSES(SAVE_THRESHOLD);
+    periodicSave();
+    TEST_ASSERT_EQUAL(totalPulses, lastSavedPulses);
+
+    // One 16-byte journal record, no NVS traffic
+    TEST_ASSERT_EQUAL(nvsWrites, hal_native_nvs_write_count());
+    TEST_ASSERT_EQUAL(flashBytes + JOURNAL_RECORD_SIZE, hal_native_flash_stats()->bytesWritten);
+
+    // Reboot - value comes back from the journal
+    uint64_t saved = totalPulses;
+    resetFlowMeter();
+    loadTotalVolume();
+    TEST_ASSERT_EQUAL(saved, totalPulses);
+}
+
+void test_periodic_save_on_max_interval(void) {
+    periodicSave();
+    TEST_ASSERT_EQUAL(0, hal_native_nvs_write_count());
+
+    hal_native_advance_ms(MAX_SAVE_INTERVAL + 1);
+    periodicSave();
+    TEST_ASSERT_TRUE(hal_native_nvs_write_count() > 0);
+    TEST_ASSERT_EQUAL(hal_millis(), lastSaveTime);
+}
+
+void test_load_total_volume_restores_state(void) {
+    hal_nvs_begin(EEPROM_NAMESPACE, false);
+    hal_nvs_put_u64("ledger", 9258750);   // 1,234,500 L
+    hal_nvs_put_u32("bootCount", 7);
+    hal_nvs_end();
+
+    loadTotalVolume();
+
+    TEST_ASSERT_EQUAL(9258750, totalPulses);
+    TEST_ASSERT_EQUAL(1234500000ULL, totalVolumeMl());
+    TEST_ASSERT_EQUAL(totalPulses, lastSavedPulses);
+    TEST_ASSERT_EQUAL(8, bootCount);
+
+    hal_nvs_begin(EEPROM_NAMESPACE, true);
+    TEST_ASSERT_EQUAL(8, hal_nvs_get_u32("bootCount", 0));
+    hal_nvs_end();
+}
+
+void test_load_total_volume_migrates_legacy_float(void) {
+    // The float firmware's 100.0 "L" stood for 100 * 7.5 * 60 pulses
+    hal_nvs_begin(EEPROM_NAMESPACE, false);
+    hal_nvs_put_float("totalVolume", 100.0);
+    hal_nvs_end();
+
+    loadTotalVolume();
+
+    TEST_ASSERT_EQUAL(45000, totalPulses);
+    TEST_ASSERT_EQUAL(6000000, totalVolumeMl());
+}
+
+void test_load_total_volume_migrates_accumulated_legacy_float(void) {
+    // Accumulate as the float firmware did: 18 pulses a second for an hour
+    float legacyVolume = 0.0;
+    for (uint32_t second = 0; second < 3600; second++) {
+        legacyVolume += 18 / (CALIBRATION_FACTOR * 60.0);
+    }
+    hal_nvs_begin(EEPROM_NAMESPACE, false);
+    hal_nvs_put_float("totalVolume", legacyVolume);
+    hal_nvs_end();
+
+    loadTotalVolume();
+
+    TEST_ASSERT_EQUAL(64800, totalPulses);
+    TEST_ASSERT_EQUAL(8640000, totalVolumeMl());
+}
+
+void test_report_not_sent_when_disconnected(void) {
+    hal_native_advance_ms(FLOW_REPORT_INTERVAL * 1000UL + 1);
+
+    TEST_ASSERT_TRUE(shouldReportFlow(1000, 1000, 100));
+    TEST_ASSERT_EQUAL(0, hal_native_radio_frame_count());
+}
+
+void test_report_on_interval(void) {
+    zigbeeConnected = true;
+
+    TEST_ASSERT_FALSE(shouldReportFlow(0, 0, 100));
+
+    hal_native_advance_ms(FLOW_REPORT_INTERVAL * 1000UL + 1);
+    TEST_ASSERT_TRUE(shouldReportFlow(2500, 1500, 100));
+
+    // Rate and volume share one frame
+    TEST_ASSERT_EQUAL(1, endpointFrameCount(FLOW_ENDPOINT));
+    const NativeRadioFrame* frame = endpointFrame(FLOW_ENDPOINT, 0);
+    TEST_ASSERT_NOT_NULL(frame);
+    TEST_ASSERT_EQUAL(FLOW_ENDPOINT, frame->endpoint);
+    TEST_ASSERT_EQUAL(METERING_CLUSTER_ID, frame->clusterId);
+    TEST_ASSERT_EQUAL(2, frame->count);
+
+    // Integers in ledger units all the way: mL and mL/h
+    TEST_ASSERT_EQUAL(METERING_SUMMATION_ATTR, frame->attrs[0].attrId);
+    TEST_ASSERT_EQUAL(ZCL_TYPE_UINT48, frame->attrs[0].zclType);
+    TEST_ASSERT_EQUAL(6, frame->attrs[0].len);
+    TEST_ASSERT_EQUAL(1500, frameValue(frame, METERING_SUMMATION_ATTR));
+    TEST_ASSERT_EQUAL(METERING_DEMAND_ATTR, frame->attrs[1].attrId);
+    TEST_ASSERT_EQUAL(ZCL_TYPE_INT24, frame->attrs[1].zclType);
+    TEST_ASSERT_EQUAL(3, frame->attrs[1].len);
+    TEST_ASSERT_EQUAL(150000, frameValue(frame, METERING_DEMAND_ATTR));
+}
+
+void test_report_on_flow_change(void) {
+    zigbeeConnected = true;
+
+    hal_native_advance_ms(REPORT_MIN_INTERVAL * 1000UL);
+    TEST_ASSERT_TRUE(shouldReportFlow(10000, 0, 100));
+
+    // Within 10% of the last reported rate
+    hal_native_advance_ms(REPORT_MIN_INTERVAL * 1000UL);
+    TEST_ASSERT_FALSE(shouldReportFlow(10500, 0, 100));
+    TEST_ASSERT_FALSE(shouldReportFlow(9000, 0, 100));
+
+    // More than 10% away - but not within the minimum interval
+    TEST_ASSERT_TRUE(shouldReportFlow(12000, 0, 100));
+    TEST_ASSERT_FALSE(shouldReportFlow(15000, 0, 100));
+    hal_native_advance_ms(REPORT_MIN_INTERVAL * 1000UL);
+    TEST_ASSERT_TRUE(shouldReportFlow(15000, 0, 100));
+
+    // Volume milestone
+    hal_native_advance_ms(REPORT_MIN_INTERVAL * 1000UL);
+    TEST_ASSERT_FALSE(shouldReportFlow(15000, LITRES_TO_ML(VOLUME_MILESTONE) - 1, 100));
+    TEST_ASSERT_TRUE(shouldReportFlow(15000, LITRES_TO_ML(VOLUME_MILESTONE), 100));
+}
+
+void test_scheduled_flow_wakes_on_pulse(void) {
+    uint8_t battery = 100;
+    setupFlowSensor();
+    scheduleFlowMeter(&battery);
+
+    // Idle: the flow job suspends itself after one window
+    simulateScheduledFlow(10000, 0);
+    TEST_ASSERT_TRUE(flowMeterIdle());
+    TEST_ASSERT_TRUE(schedulerStats()->wakeups <= 3);
+
+    // 12 pulses/s - the rate is known at the second edge, not the next window
+    uint64_t startUs = hal_native_now_us();
+    startScheduledPulses(83333);
+    while (flowRateMlMin == 0) {
+        schedulerRun();
+    }
+    TEST_ASSERT_EQUAL(startUs + 2 * 83333, hal_native_now_us());
+    TEST_ASSERT_UINT32_WITHIN(100, 96000, flowRateMlMin);
+
+    // Steady flow: the ISR stops waking the task, the flow job runs once a second
+    uint32_t notifications = schedulerStats()->notifications;
+    simulateScheduledFlow(60000, 83333);
+    TEST_ASSERT_EQUAL(notifications, schedulerStats()->notifications);
+    TEST_ASSERT_UINT32_WITHIN(100, 96000, flowRateMlMin);
+    TEST_ASSERT_UINT32_WITHIN(1, pulseSourceCount(), totalPulses);   // Next window catches up
+
+    // Flow stops: rate decays to zero and the flow job suspends again
+    simulateScheduledFlow(FLOW_IDLE_TIMEOUT + 2000, 0);
+    TEST_ASSERT_EQUAL(0, flowRateMlMin);
+    TEST_ASSERT_TRUE(flowMeterIdle());
+    TEST_ASSERT_EQUAL_UINT64(pulseSourceCount(), totalPulses);
+}
+
+void test_scheduled_reports_on_interval(void) {
+    uint8_t battery = 100;
+    zigbeeConnected = true;
+    setupFlowSensor();
+    scheduleFlowMeter(&battery);
+
+    // Idle meter still reports every FLOW_REPORT_INTERVAL, on the dot
+    simulateScheduledFlow(FLOW_REPORT_INTERVAL * 1000UL * 4 + 1, 0);
+    TEST_ASSERT_EQUAL(4, endpointFrameCount(FLOW_ENDPOINT));   // Rate + volume in one frame
+    TEST_ASSERT_EQUAL(0, schedulerStats()->maxLateMs);
+}
+
+// Test suite runner
+void FlowMeterTests(void) {
+    RUN_TEST(test_calculate_flow_fast_start);
+    RUN_TEST(test_calculate_flow_rate_from_pulses);
+    RUN_TEST(test_calculate_flow_idle_timeout);
+    RUN_TEST(test_periodic_save_on_volume_threshold);
+    RUN_TEST(test_periodic_save_on_max_interval);
+    RUN_TEST(test_load_total_volume_restores_state);
+    RUN_TEST(test_load_total_volume_migrates_legacy_float);
+    RUN_TEST(test_load_total_volume_migrates_accumulated_legacy_float);
+    RUN_TEST(test_report_not_sent_when_disconnected);
+    RUN_TEST(test_report_on_interval);
+    RUN_TEST(test_report_on_flow_change);
+    RUN_TEST(test_scheduled_flow_wakes_on_pulse);
+    RUN_TEST(test_scheduled_reports_on_interval);
+}
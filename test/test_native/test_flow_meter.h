@@ -0,0 +1,31 @@
+/*
+ * Flow Meter Core Tests
+ * Tests for calculateFlow(), shouldReportFlow() and periodicSave()
+ */
+
+#ifndef TEST_FLOW_METER_H
+#define TEST_FLOW_METER_H
+
+#include <unity.h>
+#include "hal_native.h"
+#include "flow_meter.h"
+
+// Test suite declarations
+void test_calculate_flow_fast_start(void);
+void test_calculate_flow_rate_from_pulses(void);
+void test_calculate_flow_idle_timeout(void);
+void test_periodic_save_on_volume_threshold(void);
+void test_periodic_save_on_max_interval(void);
+void test_load_total_volume_restores_state(void);
+void test_load_total_volume_migrates_legacy_float(void);
+void test_load_total_volume_migrates_accumulated_legacy_float(void);
+void test_report_not_sent_when_disconnected(void);
+void test_report_on_interval(void);
+void test_report_on_flow_change(void);
+void test_scheduled_flow_wakes_on_pulse(void);
+void test_scheduled_reports_on_interval(void);
+
+// Test suite runner
+void FlowMeterTests(void);
+
+#endif // TEST_FLOW_METER_H
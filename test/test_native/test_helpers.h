@@ -0,0 +1,121 @@
+/*
+ * Native Test Helpers
+ * Drives the metering loop against a simulated flow sensor
+ */
+
+#ifndef TEST_HELPERS_H
+#define TEST_HELPERS_H
+
+#include "hal_native.h"
+#include "flow_meter.h"
+#include "scheduler.h"
+
+#define TEST_LOOP_PERIOD_MS 10      // Polling period for simulateFlow()
+
+/**
+ * Run calculateFlow() every TEST_LOOP_PERIOD_MS for durationMs while the
+ * sensor produces one pulse every pulsePeriodUs (0 = no flow)
+ * The first pulse fires one period after the call; pulses land at their
+ * exact simulated times between loop iterations
+ */
+static inline void simulateFlow(uint32_t durationMs, uint32_t pulsePeriodUs) {
+    uint64_t endUs = hal_native_now_us() + (uint64_t)durationMs * 1000;
+    uint64_t nextPulseUs = hal_native_now_us() + pulsePeriodUs;
+
+    while (hal_native_now_us() < endUs) {
+        uint64_t tickEndUs = hal_native_now_us() + TEST_LOOP_PERIOD_MS * 1000;
+
+        while (pulsePeriodUs > 0 && nextPulseUs <= tickEndUs) {
+            hal_native_set_micros(nextPulseUs);
+            hal_native_pulse();
+            nextPulseUs += pulsePeriodUs;
+        }
+
+        hal_native_set_micros(tickEndUs);
+        calculateFlow();
+    }
+}
+
+// Pulse train fed to the scheduler's sleeps by simulateScheduledFlow()
+static uint64_t schedPulseNextUs = 0;
+static uint64_t schedPulseEndUs = 0;
+static uint32_t schedPulsePeriodUs = 0;
+
+static inline void schedulerPulseHook(uint64_t deadlineUs) {
+    while (schedPulsePeriodUs > 0 && schedPulseNextUs <= deadlineUs &&
+           schedPulseNextUs <= schedPulseEndUs && !hal_native_notify_pending()) {
+        hal_native_set_micros(schedPulseNextUs);
+        hal_native_pulse();
+        schedPulseNextUs += schedPulsePeriodUs;
+    }
+}
+
+/**
+ * Fire one pulse every pulsePeriodUs (0 = no flow) while the scheduler
+ * sleeps, until untilUs - exactly like the real ISR waking the main task
+ */
+static inline void startScheduledPulses(uint32_t pulsePeriodUs, uint64_t untilUs = UINT64_MAX) {
+    schedPulseNextUs = hal_native_now_us() + pulsePeriodUs;
+    schedPulseEndUs = untilUs;
+    schedPulsePeriodUs = pulsePeriodUs;
+    hal_native_set_wait_hook(schedulerPulseHook);
+}
+
+/**
+ * Run the scheduler main loop (schedulerRun) for durationMs while the
+ * sensor produces one pulse every pulsePeriodUs (0 = no flow)
+ */
+static inline void simulateScheduledFlow(uint32_t durationMs, uint32_t pulsePeriodUs) {
+    uint64_t endUs = hal_native_now_us() + (uint64_t)durationMs * 1000;
+    startScheduledPulses(pulsePeriodUs, endUs);
+
+    while (hal_native_now_us() < endUs) {
+        schedulerRun();
+    }
+
+    schedPulsePeriodUs = 0;
+}
+
+/**
+ * Captured frames sent from endpoint - a multi-channel build reports
+ * every channel's endpoint alongside FLOW_ENDPOINT
+ */
+static inline size_t endpointFrameCount(uint8_t endpoint) {
+    size_t count = 0;
+    for (size_t i = 0; i < hal_native_radio_frame_count(); i++) {
+        count += hal_native_radio_frame(i)->endpoint == endpoint;
+    }
+    return count;
+}
+
+/**
+ * The index-th captured frame sent from endpoint, or nullptr
+ */
+static inline const NativeRadioFrame* endpointFrame(uint8_t endpoint, size_t index) {
+    for (size_t i = 0; i < hal_native_radio_frame_count(); i++) {
+        const NativeRadioFrame* frame = hal_native_radio_frame(i);
+        if (frame->endpoint == endpoint && index-- == 0) {
+            return frame;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * Value of an attribute record in a captured frame (little endian
+ * integer), or UINT64_MAX if the frame does not carry the attribute
+ */
+static inline uint64_t frameValue(const NativeRadioFrame* frame, uint16_t attrId) {
+    for (uint8_t i = 0; i < frame->count; i++) {
+        if (frame->attrs[i].attrId == attrId) {
+            uint64_t value = 0;
+            for (uint8_t b = frame->attrs[i].len; b > 0; b--) {
+                value = value << 8 | frame->attrs[i].value[b - 1];
+            }
+            return value;
+        }
+    }
+    return UINT64_MAX;
+}
+
+#endif // TEST_HELPERS_H
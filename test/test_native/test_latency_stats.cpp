@@ -0,0 +1,99 @@
+/*
+ * Latency Statistics Tests
+ * Tests for the cycle-counter latency histograms and their diagnostics
+ */
+
+#include "test_latency_stats.h"
+#include "test_helpers.h"
+#include "report_engine.h"
+
+static uint32_t lateJobRuns = 0;
+
+static void lateJob() {
+    lateJobRuns++;
+}
+
+void test_latency_bucket_is_log2(void) {
+    TEST_ASSERT_EQUAL(0, latencyBucket(0));
+    TEST_ASSERT_EQUAL(1, latencyBucket(1));
+    TEST_ASSERT_EQUAL(2, latencyBucket(2));
+    TEST_ASSERT_EQUAL(2, latencyBucket(3));
+    TEST_ASSERT_EQUAL(11, latencyBucket(1024));
+    TEST_ASSERT_EQUAL(11, latencyBucket(2047));
+    TEST_ASSERT_EQUAL(LATENCY_BUCKETS - 1, latencyBucket(UINT32_MAX));
+}
+
+void test_latency_percentile_and_max(void) {
+    TEST_ASSERT_EQUAL(0, latencyPercentile(LATENCY_SAVE, 500));
+
+    // 99 fast samples and one slow one
+    for (int i = 0; i < 99; i++) {
+        latencyRecord(LATENCY_SAVE, 100);
+    }
+    latencyRecord(LATENCY_SAVE, 50000);
+
+    TEST_ASSERT_EQUAL(100, latencySamples(LATENCY_SAVE));
+    TEST_ASSERT_EQUAL(128, latencyPercentile(LATENCY_SAVE, 500));
+    TEST_ASSERT_EQUAL(128, latencyPercentile(LATENCY_SAVE, 990));
+    TEST_ASSERT_EQUAL(65536, latencyPercentile(LATENCY_SAVE, 1000));
+    TEST_ASSERT_EQUAL(50000, latencyHistogram(LATENCY_SAVE)->max);
+
+    resetLatencyStats();
+    TEST_ASSERT_EQUAL(0, latencySamples(LATENCY_SAVE));
+    TEST_ASSERT_EQUAL(0, latencyHistogram(LATENCY_SAVE)->max);
+}
+
+void test_latency_records_late_jobs(void) {
+    lateJobRuns = 0;
+    schedulerAdd(lateJob, 0, 10);
+
+    // The task oversleeps the deadline by 5 ms
+    hal_native_advance_ms(15);
+    schedulerRunDue();
+
+    TEST_ASSERT_EQUAL(1, lateJobRuns);
+    TEST_ASSERT_EQUAL(1, latencySamples(LATENCY_JOB_LATE));
+    TEST_ASSERT_EQUAL(5000UL * HAL_CPU_MHZ, latencyHistogram(LATENCY_JOB_LATE)->max);
+
+    // Every sleep closes one awake stretch of the main task
+    schedulerRun();
+    schedulerRun();
+    TEST_ASSERT_EQUAL(2, latencySamples(LATENCY_LOOP));
+}
+
+void test_latency_records_pulse_interrupts(void) {
+    setupFlowSensor();
+    simulateFlow(1000, 10000);
+
+    TEST_ASSERT_EQUAL(pulseSourceStats()->interrupts, latencySamples(LATENCY_PULSE_ISR));
+    TEST_ASSERT_TRUE(latencySamples(LATENCY_PULSE_ISR) > 0);
+}
+
+void test_latency_diagnostics_attributes(void) {
+    latencyBegin();
+    latencyRecord(LATENCY_REPORT, 3000);
+    latencyRecord(LATENCY_REPORT, 300);
+    latencyPublish();
+
+    HalAttribute attr;
+    uint16_t base = LATENCY_ATTR_BASE + LATENCY_REPORT * LATENCY_ATTR_STRIDE;
+    TEST_ASSERT_TRUE(hal_native_radio_read_attribute(FLOW_ENDPOINT, DIAGNOSTICS_CLUSTER_ID,
+                                                     base + LATENCY_ATTR_SAMPLES, &attr));
+    TEST_ASSERT_EQUAL(ZCL_TYPE_UINT32, attr.zclType);
+    TEST_ASSERT_EQUAL(4, attr.len);
+    TEST_ASSERT_EQUAL(2, attr.value[0]);
+
+    TEST_ASSERT_TRUE(hal_native_radio_read_attribute(FLOW_ENDPOINT, DIAGNOSTICS_CLUSTER_ID,
+                                                     base + LATENCY_ATTR_MAX, &attr));
+    uint32_t max = attr.value[0] | attr.value[1] << 8 | attr.value[2] << 16 | (uint32_t)attr.value[3] << 24;
+    TEST_ASSERT_EQUAL(3000, max);
+}
+
+// Test suite runner
+void LatencyStatsTests(void) {
+    RUN_TEST(test_latency_bucket_is_log2);
+    RUN_TEST(test_latency_percentile_and_max);
+    RUN_TEST(test_latency_records_late_jobs);
+    RUN_TEST(test_latency_records_pulse_interrupts);
+    RUN_TEST(test_latency_diagnostics_attributes);
+}
@@ -0,0 +1,23 @@
+/*
+ * Latency Statistics Tests
+ * Tests for the cycle-counter latency histograms and their diagnostics
+ */
+
+#ifndef TEST_LATENCY_STATS_H
+#define TEST_LATENCY_STATS_H
+
+#include <unity.h>
+#include "hal_native.h"
+#include "latency_stats.h"
+
+// Test suite declarations
+void test_latency_bucket_is_log2(void);
+void test_latency_percentile_and_max(void);
+void test_latency_records_late_jobs(void);
+void test_latency_records_pulse_interrupts(void);
+void test_latency_diagnostics_attributes(void);
+
+// Test suite runner
+void LatencyStatsTests(void);
+
+#endif // TEST_LATENCY_STATS_H
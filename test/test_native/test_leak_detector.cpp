@@ -0,0 +1,223 @@
+/*
+ * Leak Detector Tests
+ * Tests for the continuous-flow, never-quiet and burst leak rules
+ */
+
+#include "test_leak_detector.h"
+#include "test_helpers.h"
+#include "scheduler.h"
+#include "metering_cluster.h"
+#include "report_engine.h"
+#include "config_traits.h"
+
+#define TEST_WINDOW_MS 1000
+#define TEST_TRICKLE_ML_MIN 500      // Running toilet, ~1 pulse per 16 s
+
+/**
+ * A steady draw of one pulse per pulseMs for durationMs, one update per
+ * flow window. Returns the time of the first alarm (UINT32_MAX if none)
+ */
+static uint32_t draw(LeakDetector* leak, uint64_t* ledger, uint32_t* nowMs, uint32_t durationMs,
+                     uint32_t pulseMs, uint8_t alarm) {
+    uint32_t alarmMs = UINT32_MAX;
+    uint32_t sincePulse = 0;
+    for (uint32_t elapsed = 0; elapsed < durationMs; elapsed += TEST_WINDOW_MS) {
+        *nowMs += TEST_WINDOW_MS;
+        sincePulse += TEST_WINDOW_MS;
+        if (sincePulse >= pulseMs) {
+            (*ledger)++;
+            sincePulse = 0;
+        }
+        if ((leakDetectorUpdate(leak, *ledger, TEST_TRICKLE_ML_MIN, *nowMs) & alarm) &&
+            alarmMs == UINT32_MAX) {
+            alarmMs = *nowMs;
+        }
+    }
+    return alarmMs;
+}
+
+void test_leak_continuous_flow(void) {
+    LeakDetector leak;
+    uint64_t ledger = 0;
+    uint32_t nowMs = 0;
+    leakDetectorReset(&leak, ledger, nowMs);
+
+    uint32_t alarmMs = draw(&leak, &ledger, &nowMs, LEAK_CONTINUOUS_FLOW * 60000UL + 10000,
+                            16000, LEAK_ALARM_CONTINUOUS);
+    TEST_ASSERT_EQUAL_UINT32(TEST_WINDOW_MS + LEAK_CONTINUOUS_FLOW * 60000UL, alarmMs);
+    TEST_ASSERT_FALSE(leak.alarms & LEAK_ALARM_BURST);
+
+    // The toilet is fixed: the draw ends, and so does the alarm
+    nowMs += FLOW_IDLE_TIMEOUT;
+    TEST_ASSERT_EQUAL(0, leakDetectorUpdate(&leak, ledger, 0, nowMs) & LEAK_ALARM_CONTINUOUS);
+}
+
+void test_leak_short_draws_no_alarm(void) {
+    LeakDetector leak;
+    uint64_t ledger = 0;
+    uint32_t nowMs = 0;
+    leakDetectorReset(&leak, ledger, nowMs);
+
+    // Back-to-back showers with a stop between each: every draw starts over
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL_UINT32(UINT32_MAX,
+                                 draw(&leak, &ledger, &nowMs, LEAK_CONTINUOUS_FLOW * 30000UL, 4000,
+                                      LEAK_ALARM_CONTINUOUS | LEAK_ALARM_BURST));
+        nowMs += FLOW_IDLE_TIMEOUT;
+        leakDetectorUpdate(&leak, ledger, 0, nowMs);
+    }
+    TEST_ASSERT_EQUAL(0, leak.alarms);
+}
+
+void test_leak_never_quiet_slow_drip(void) {
+    LeakDetector leak;
+    uint64_t ledger = 0;
+    uint32_t nowMs = 0;
+    leakDetectorReset(&leak, ledger, nowMs);
+
+    // One drop-sized pulse every 20 minutes: the rate never stays above 0,
+    // and the detector only runs at the pulses
+    const uint32_t dripMs = LEAK_QUIET_PERIOD * 60000UL / 3;
+    uint32_t alarmMs = UINT32_MAX;
+    while (nowMs < LEAK_NEVER_QUIET * 3600000UL + dripMs) {
+        nowMs += dripMs;
+        ledger++;
+        if (leakDetectorUpdate(&leak, ledger, 0, nowMs) & LEAK_ALARM_NEVER_QUIET) {
+            alarmMs = nowMs;
+            break;
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(LEAK_NEVER_QUIET * 3600000UL, alarmMs);
+    TEST_ASSERT_FALSE(leak.alarms & LEAK_ALARM_CONTINUOUS);
+
+    // Dripping stops for a quiet period: the next pulse clears the alarm
+    nowMs += LEAK_QUIET_PERIOD * 60000UL;
+    ledger++;
+    TEST_ASSERT_EQUAL(0, leakDetectorUpdate(&leak, ledger, 0, nowMs));
+}
+
+void test_leak_quiet_nights_no_alarm(void) {
+    LeakDetector leak;
+    uint64_t ledger = 0;
+    uint32_t nowMs = 0;
+    leakDetectorReset(&leak, ledger, nowMs);
+
+    // Three days of use every 10 minutes from 6:00 to 24:00, nothing at night
+    for (uint32_t day = 0; day < 3; day++) {
+        for (uint32_t minute = 6 * 60; minute < 24 * 60; minute += 10) {
+            nowMs = day * 86400000UL + minute * 60000UL;
+            ledger += 10;
+            TEST_ASSERT_EQUAL(0, leakDetectorUpdate(&leak, ledger, 0, nowMs));
+        }
+    }
+}
+
+void test_leak_burst_volume(void) {
+    LeakDetector leak;
+    uint64_t ledger = 1000;
+    uint32_t nowMs = 0;
+    leakDetectorReset(&leak, ledger, nowMs);
+
+    // A burst pipe at 30 L/min: 3.75 pulses per window
+    uint32_t alarmMs = UINT32_MAX;
+    for (uint32_t window = 1; window < 3600 && alarmMs == UINT32_MAX; window++) {
+        nowMs = window * TEST_WINDOW_MS;
+        ledger = 1000 + window * 15 / 4;
+        if (leakDetectorUpdate(&leak, ledger, 30000, nowMs) & LEAK_ALARM_BURST) {
+            alarmMs = nowMs;
+        }
+    }
+    TEST_ASSERT_TRUE(ledger - 1000 >= LEAK_BURST_PULSES);
+    TEST_ASSERT_TRUE(ledger - 1000 < LEAK_BURST_PULSES + 4);
+    TEST_ASSERT_UINT32_WITHIN(TEST_WINDOW_MS, LEAK_BURST_VOLUME * 2 * 1000, alarmMs);
+
+    // Water shut off at the main: the draw ends and the alarm clears
+    nowMs += FLOW_IDLE_TIMEOUT;
+    TEST_ASSERT_EQUAL(0, leakDetectorUpdate(&leak, ledger, 0, nowMs));
+}
+
+void test_leak_alarm_reported_at_once(void) {
+    uint8_t battery = 100;
+    loadTotalVolume();
+    setupFlowSensor();
+    scheduleFlowMeter(&battery);
+    zigbeeConnected = true;
+    requestFlowReport();
+    simulateScheduledFlow(1000, 0);
+    hal_native_radio_clear();
+
+    // 30 L/min until the burst rule fires
+    const uint32_t periodUs = 266667;
+    uint64_t startUs = hal_native_now_us();
+    startScheduledPulses(periodUs);
+    while (leakAlarms() == 0) {
+        schedulerRun();
+    }
+    TEST_ASSERT_EQUAL(LEAK_ALARM_BURST, leakAlarms());
+
+    // Status goes out in the urgent lane from the flow window that saw the
+    // burst volume, within a pulse period of the newest pulse
+    const NativeRadioFrame* frame = nullptr;
+    for (size_t i = 0; i < hal_native_radio_frame_count() && frame == nullptr; i++) {
+        if (frameValue(hal_native_radio_frame(i), METERING_STATUS_ATTR) == METERING_STATUS_BURST) {
+            frame = hal_native_radio_frame(i);
+        }
+    }
+    TEST_ASSERT_NOT_NULL(frame);
+    uint64_t crossedUs = startUs + (LEAK_BURST_PULSES + 1) * periodUs;
+    TEST_ASSERT_TRUE(frame->timeUs >= crossedUs);
+    TEST_ASSERT_TRUE(frame->timeUs - crossedUs <= FLOW_CALC_INTERVAL * 1000ULL);
+    TEST_ASSERT_TRUE(frame->acked);
+    TEST_ASSERT_TRUE(reportEngineStats()->alarmLatencyUs <= periodUs);
+
+    HalAttribute attr;
+    TEST_ASSERT_TRUE(hal_native_radio_read_attribute(FLOW_ENDPOINT, METERING_CLUSTER_ID,
+                                                     METERING_LEAK_ALARMS_ATTR, &attr));
+    TEST_ASSERT_EQUAL(LEAK_ALARM_BURST, attr.value[0]);
+}
+
+void test_leak_never_quiet_clears_without_pulses(void) {
+    uint8_t battery = 100;
+    loadTotalVolume();
+    setupFlowSensor();
+    scheduleFlowMeter(&battery);
+    zigbeeConnected = true;
+    requestFlowReport();
+
+    // A drip every 20 minutes until the never-quiet rule fires
+    const uint32_t dripUs = LEAK_QUIET_PERIOD * 60000000UL / 3;
+    startScheduledPulses(dripUs);
+    while (!(leakAlarms() & LEAK_ALARM_NEVER_QUIET)) {
+        schedulerRun();
+    }
+    TEST_ASSERT_EQUAL(LEAK_ALARM_NEVER_QUIET, leakAlarms());
+
+    // The drip is fixed and no water is used afterwards: the alarm clears
+    // when the quiet period ends, with nothing else to run the rules
+    uint64_t fixedUs = hal_native_now_us();
+    hal_native_radio_clear();
+    simulateScheduledFlow(LEAK_QUIET_PERIOD * 60000UL + 1000, 0);
+    TEST_ASSERT_EQUAL(0, leakAlarms());
+
+    const NativeRadioFrame* frame = nullptr;
+    for (size_t i = 0; i < hal_native_radio_frame_count() && frame == nullptr; i++) {
+        if (frameValue(hal_native_radio_frame(i), METERING_STATUS_ATTR) == 0) {
+            frame = hal_native_radio_frame(i);
+        }
+    }
+    TEST_ASSERT_NOT_NULL(frame);
+    uint64_t quietUs = fixedUs + LEAK_QUIET_PERIOD * 60000000ULL;
+    TEST_ASSERT_TRUE(frame->timeUs + 1000000ULL >= quietUs);
+    TEST_ASSERT_TRUE(frame->timeUs <= quietUs + 1000000ULL);
+}
+
+// Test suite runner
+void LeakDetectorTests(void) {
+    RUN_TEST(test_leak_continuous_flow);
+    RUN_TEST(test_leak_short_draws_no_alarm);
+    RUN_TEST(test_leak_never_quiet_slow_drip);
+    RUN_TEST(test_leak_quiet_nights_no_alarm);
+    RUN_TEST(test_leak_burst_volume);
+    RUN_TEST(test_leak_alarm_reported_at_once);
+    RUN_TEST(test_leak_never_quiet_clears_without_pulses);
+}
@@ -0,0 +1,24 @@
+/*
+ * Leak Detector Tests
+ * Tests for the continuous-flow, never-quiet and burst leak rules
+ */
+
+#ifndef TEST_LEAK_DETECTOR_H
+#define TEST_LEAK_DETECTOR_H
+
+#include <unity.h>
+#include "leak_detector.h"
+
+// Test suite declarations
+void test_leak_continuous_flow(void);
+void test_leak_short_draws_no_alarm(void);
+void test_leak_never_quiet_slow_drip(void);
+void test_leak_quiet_nights_no_alarm(void);
+void test_leak_burst_volume(void);
+void test_leak_alarm_reported_at_once(void);
+void test_leak_never_quiet_clears_without_pulses(void);
+
+// Test suite runner
+void LeakDetectorTests(void);
+
+#endif // TEST_LEAK_DETECTOR_H
@@ -0,0 +1,98 @@
+/*
+ * Water Flow Meter - Native Test Suite
+ * Runs the real metering core on the host against the simulated HAL
+ *
+ * Run: pio test -e native
+ */
+
+#include <unity.h>
+#include "hal_native.h"
+#include "flow_meter.h"
+#include "scheduler.h"
+#include "battery_monitor.h"
+#include "zigbee_network.h"
+#include "deferred_log.h"
+#include "flow_history.h"
+#include "latency_stats.h"
+#include "console.h"
+#include "pulse_trace.h"
+#include "calibration.h"
+#include "consumption.h"
+
+// Include test modules
+#include "test_flow_meter.h"
+#include "test_flow_math.h"
+#include "test_flow_estimator.h"
+#include "test_counter_journal.h"
+#include "test_scheduler.h"
+#include "test_battery_sampler.h"
+#include "test_zigbee_network.h"
+#include "test_deferred_log.h"
+#include "test_flow_history.h"
+#include "test_pulse_source.h"
+#include "test_seqlock.h"
+#include "test_report_engine.h"
+#include "test_metering.h"
+#include "test_retained_ledger.h"
+#include "test_latency_stats.h"
+#include "test_console.h"
+#include "test_pulse_trace.h"
+#include "test_calibration.h"
+#include "test_config_traits.h"
+#include "test_flow_channels.h"
+#include "test_leak_detector.h"
+#include "test_usage_events.h"
+#include "test_consumption.h"
+
+void setUp(void) {
+    // Every test starts from a freshly booted, disconnected meter
+    hal_native_reset();
+    resetFlowMeter();
+    schedulerReset();
+    resetBatteryMonitor();
+    resetZigbeeNetwork();
+    resetDeferredLog();
+    resetFlowHistory();
+    resetLatencyStats();
+    resetConsole();
+    resetPulseTrace();
+    resetCalibration();
+    resetConsumption();
+}
+
+void tearDown(void) {
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+
+    UNITY_BEGIN();
+
+    // Run test suites
+    FlowMeterTests();
+    FlowMathTests();
+    FlowEstimatorTests();
+    CounterJournalTests();
+    SchedulerTests();
+    BatterySamplerTests();
+    ZigbeeNetworkTests();
+    DeferredLogTests();
+    FlowHistoryTests();
+    PulseSourceTests();
+    SeqlockTests();
+    ReportEngineTests();
+    MeteringTests();
+    RetainedLedgerTests();
+    LatencyStatsTests();
+    ConsoleTests();
+    PulseTraceTests();
+    CalibrationTests();
+    ConfigTraitsTests();
+    FlowChannelsTests();
+    LeakDetectorTests();
+    UsageEventsTests();
+    ConsumptionTests();
+
+    return UNITY_END();
+}
@@ -0,0 +1,159 @@
+/*
+ * Metering Cluster Tests
+ * Tests for the Metering cluster attributes and Configure Reporting
+ */
+
+#include "test_metering.h"
+#include "test_helpers.h"
+#include "report_engine.h"
+
+static uint64_t readAttribute(uint16_t attrId) {
+    HalAttribute attr;
+    TEST_ASSERT_TRUE(hal_native_radio_read_attribute(FLOW_ENDPOINT, METERING_CLUSTER_ID, attrId, &attr));
+    NativeRadioFrame frame = {};
+    frame.count = 1;
+    frame.attrs[0] = attr;
+    return frameValue(&frame, attrId);
+}
+
+static uint8_t configure(uint16_t attrId, uint8_t zclType, uint16_t minS, uint16_t maxS,
+                         uint64_t change) {
+    HalReportingConfig record = {};
+    record.endpoint = FLOW_ENDPOINT;
+    record.clusterId = METERING_CLUSTER_ID;
+    record.attrId = attrId;
+    record.zclType = zclType;
+    record.minIntervalS = minS;
+    record.maxIntervalS = maxS;
+    record.reportableChange = change;
+    return hal_native_radio_configure_reporting(&record);
+}
+
+// Boot the meter, joined, with the clusters registered
+static void bootConnected() {
+    zigbeeConnected = true;
+    TEST_ASSERT_FALSE(shouldReportFlow(0, 0, 100));
+}
+
+void test_metering_attributes_readable(void) {
+    bootConnected();
+
+    TEST_ASSERT_EQUAL(METERING_UNIT_M3, readAttribute(METERING_UNIT_ATTR));
+    TEST_ASSERT_EQUAL(1, readAttribute(METERING_MULTIPLIER_ATTR));
+    TEST_ASSERT_EQUAL(1000000, readAttribute(METERING_DIVISOR_ATTR));
+    TEST_ASSERT_EQUAL(METERING_DEVICE_WATER, readAttribute(METERING_DEVICE_TYPE_ATTR));
+
+    // The coordinator reads current values between reports
+    TEST_ASSERT_FALSE(shouldReportFlow(2500, 1500, 100));
+    TEST_ASSERT_EQUAL(1500, readAttribute(METERING_SUMMATION_ATTR));
+    TEST_ASSERT_EQUAL(150000, readAttribute(METERING_DEMAND_ATTR));
+}
+
+void test_metering_demand_clamped_to_int24(void) {
+    TEST_ASSERT_EQUAL(0, meteringDemand(0));
+    TEST_ASSERT_EQUAL(1800000, meteringDemand(30000));     // 30 L/min = 1.8 m3/h
+    TEST_ASSERT_EQUAL(METERING_DEMAND_MAX, meteringDemand(200000));
+}
+
+void test_metering_configure_reporting_sets_cadence(void) {
+    bootConnected();
+
+    // Every 5 minutes, or after 10 L
+    TEST_ASSERT_EQUAL(ZCL_STATUS_SUCCESS,
+                      configure(METERING_SUMMATION_ATTR, ZCL_TYPE_UINT48, 1, 300, 10000));
+    TEST_ASSERT_EQUAL(ZCL_STATUS_SUCCESS,
+                      configure(METERING_DEMAND_ATTR, ZCL_TYPE_INT24, 1, 300, 60000));
+
+    // 5 L is no longer worth a report, and the 30 s default deadline is gone
+    // (other channels' endpoints keep their own defaults)
+    hal_native_advance_ms(FLOW_REPORT_INTERVAL * 1000UL + 1);
+    shouldReportFlow(0, 5000, 100);
+    TEST_ASSERT_EQUAL(0, endpointFrameCount(FLOW_ENDPOINT));
+
+    TEST_ASSERT_TRUE(shouldReportFlow(0, 10000, 100));
+    TEST_ASSERT_EQUAL(1, endpointFrameCount(FLOW_ENDPOINT));
+    TEST_ASSERT_EQUAL(10000, frameValue(endpointFrame(FLOW_ENDPOINT, 0), METERING_SUMMATION_ATTR));
+
+    hal_native_advance_ms(299000);
+    TEST_ASSERT_TRUE(shouldReportFlow(0, 10000, 100));
+    TEST_ASSERT_EQUAL(2, endpointFrameCount(FLOW_ENDPOINT));
+}
+
+void test_metering_configure_reporting_persists(void) {
+    bootConnected();
+    TEST_ASSERT_EQUAL(ZCL_STATUS_SUCCESS,
+                      configure(METERING_DEMAND_ATTR, ZCL_TYPE_INT24, 60, 600, 0));
+
+    // Reboot: NVS survives, the compiled-in defaults do not come back
+    resetFlowMeter();
+    bootConnected();
+    const ReportAttributeConfig* config = nullptr;
+    for (int i = 0; reportAttributeConfig(i) != nullptr; i++) {
+        if (reportAttributeConfig(i)->endpoint == FLOW_ENDPOINT &&
+            reportAttributeConfig(i)->attrId == METERING_DEMAND_ATTR) {
+            config = reportAttributeConfig(i);
+        }
+    }
+    TEST_ASSERT_NOT_NULL(config);
+    TEST_ASSERT_EQUAL(60000, config->minIntervalMs);
+    TEST_ASSERT_EQUAL(600000, config->maxIntervalMs);
+    TEST_ASSERT_EQUAL(0, config->changePermille);
+}
+
+void test_metering_configure_reporting_back_to_defaults(void) {
+    bootConnected();
+    TEST_ASSERT_EQUAL(ZCL_STATUS_SUCCESS,
+                      configure(METERING_SUMMATION_ATTR, ZCL_TYPE_UINT48, 1, 300, 10000));
+    TEST_ASSERT_EQUAL(ZCL_STATUS_SUCCESS,
+                      configure(METERING_SUMMATION_ATTR, ZCL_TYPE_UINT48, 0xFFFF, 0, 0));
+
+    resetFlowMeter();
+    bootConnected();
+
+    // Default volume milestone again
+    hal_native_advance_ms(REPORT_MIN_INTERVAL * 1000UL);
+    TEST_ASSERT_TRUE(shouldReportFlow(0, LITRES_TO_ML(VOLUME_MILESTONE), 100));
+}
+
+void test_metering_configure_reporting_rejects_invalid(void) {
+    bootConnected();
+
+    TEST_ASSERT_EQUAL(ZCL_STATUS_UNSUPPORTED_ATTRIBUTE,
+                      configure(METERING_DIVISOR_ATTR, ZCL_TYPE_UINT24, 1, 300, 1));
+    TEST_ASSERT_EQUAL(ZCL_STATUS_INVALID_DATA_TYPE,
+                      configure(METERING_SUMMATION_ATTR, ZCL_TYPE_UINT24, 1, 300, 1));
+    TEST_ASSERT_EQUAL(ZCL_STATUS_INVALID_VALUE,
+                      configure(METERING_SUMMATION_ATTR, ZCL_TYPE_UINT48, 300, 60, 1));
+
+    // Nothing stored: defaults after a reboot
+    resetFlowMeter();
+    bootConnected();
+    hal_native_advance_ms(FLOW_REPORT_INTERVAL * 1000UL + 1);
+    TEST_ASSERT_TRUE(shouldReportFlow(0, 0, 100));
+}
+
+void test_metering_configure_reporting_off(void) {
+    bootConnected();
+    TEST_ASSERT_EQUAL(ZCL_STATUS_SUCCESS,
+                      configure(METERING_DEMAND_ATTR, ZCL_TYPE_INT24, 0, 0xFFFF, 0));
+
+    // Neither a large change nor a full report carries the demand
+    hal_native_advance_ms(REPORT_MIN_INTERVAL * 1000UL);
+    TEST_ASSERT_FALSE(shouldReportFlow(20000, 0, 100));
+    sendFlowReport(20000, 1500, 100);
+    TEST_ASSERT_EQUAL(1, endpointFrameCount(FLOW_ENDPOINT));
+    const NativeRadioFrame* frame = endpointFrame(FLOW_ENDPOINT, 0);
+    TEST_ASSERT_EQUAL(1500, frameValue(frame, METERING_SUMMATION_ATTR));
+    TEST_ASSERT_EQUAL(UINT64_MAX, frameValue(frame, METERING_DEMAND_ATTR));
+}
+
+// Test suite runner
+void MeteringTests(void) {
+    RUN_TEST(test_metering_attributes_readable);
+    RUN_TEST(test_metering_demand_clamped_to_int24);
+    RUN_TEST(test_metering_configure_reporting_sets_cadence);
+    RUN_TEST(test_metering_configure_reporting_persists);
+    RUN_TEST(test_metering_configure_reporting_back_to_defaults);
+    RUN_TEST(test_metering_configure_reporting_rejects_invalid);
+    RUN_TEST(test_metering_configure_reporting_off);
+}
@@ -0,0 +1,25 @@
+/*
+ * Metering Cluster Tests
+ * Tests for the Metering cluster attributes and Configure Reporting
+ */
+
+#ifndef TEST_METERING_H
+#define TEST_METERING_H
+
+#include <unity.h>
+#include "hal_native.h"
+#include "metering_cluster.h"
+
+// Test suite declarations
+void test_metering_attributes_readable(void);
+void test_metering_demand_clamped_to_int24(void);
+void test_metering_configure_reporting_sets_cadence(void);
+void test_metering_configure_reporting_persists(void);
+void test_metering_configure_reporting_back_to_defaults(void);
+void test_metering_configure_reporting_rejects_invalid(void);
+void test_metering_configure_reporting_off(void);
+
+// Test suite runner
+void MeteringTests(void);
+
+#endif // TEST_METERING_H
@@ -0,0 +1,221 @@
+/*
+ * Pulse Source Tests
+ * Tests for the GPIO interrupt and PCNT pulse counting backends
+ */
+
+#include "test_pulse_source.h"
+#include "test_helpers.h"
+
+/**
+ * A minute of steady flow at 12 pulses/s through the scheduled flow jobs,
+ * then idle until the flow job suspends - returns the interrupts taken
+ * while flowing
+ */
+static uint32_t runScheduledMinute(uint8_t backend) {
+    uint8_t battery = 100;
+    TEST_ASSERT_EQUAL(backend, selectPulseBackend(backend));
+    scheduleFlowMeter(&battery);
+
+    // Starting flow is measured at its second edge with either backend
+    uint64_t startUs = hal_native_now_us();
+    startScheduledPulses(83333);
+    while (flowRateMlMin == 0) {
+        schedulerRun();
+    }
+    TEST_ASSERT_EQUAL(startUs + 2 * 83333, hal_native_now_us());
+
+    uint32_t interrupts = pulseSourceStats()->interrupts;
+    simulateScheduledFlow(60000, 83333);
+    interrupts = pulseSourceStats()->interrupts - interrupts;
+    TEST_ASSERT_UINT32_WITHIN(100, 96000, flowRateMlMin);
+
+    simulateScheduledFlow(FLOW_IDLE_TIMEOUT + 2000, 0);
+    TEST_ASSERT_TRUE(flowMeterIdle());
+    TEST_ASSERT_TRUE(totalPulses == pulseSourceCount());
+    return interrupts;
+}
+
+void test_pcnt_scheduled_flow_matches_gpio(void) {
+    setupFlowSensor();
+    uint32_t gpioInterrupts = runScheduledMinute(PULSE_BACKEND_GPIO);
+    uint64_t gpioPulses = totalPulses;
+
+    hal_native_reset();
+    resetFlowMeter();
+    schedulerReset();
+    uint32_t pcntInterrupts = runScheduledMinute(PULSE_BACKEND_PCNT);
+
+    // Same ledger, but one timed edge per flow window instead of every edge
+    TEST_ASSERT_TRUE(totalPulses == gpioPulses);
+    TEST_ASSERT_UINT32_WITHIN(1, 720, gpioInterrupts);
+    TEST_ASSERT_TRUE(pcntInterrupts <= 60000 / FLOW_CALC_INTERVAL + 1);
+}
+
+void test_pcnt_filters_glitches(void) {
+    // Each real pulse followed by three 2 us bounce spikes
+    selectPulseBackend(PULSE_BACKEND_GPIO);
+    for (int i = 0; i < 100; i++) {
+        hal_native_pulse();
+        for (int g = 0; g < 3; g++) {
+            hal_native_glitch(2000);
+        }
+    }
+    TEST_ASSERT_TRUE(pulseSourceCount() == 400);   // Every spike counted
+
+    selectPulseBackend(PULSE_BACKEND_PCNT);
+    uint32_t interrupts = hal_native_isr_count();
+    for (int i = 0; i < 100; i++) {
+        hal_native_pulse();
+        for (int g = 0; g < 3; g++) {
+            hal_native_glitch(2000);
+        }
+    }
+    TEST_ASSERT_TRUE(pulseSourceCount() == 500);
+    TEST_ASSERT_TRUE(hal_native_isr_count() - interrupts <= 1);
+}
+
+void test_pcnt_extends_count_through_overflow(void) {
+    selectPulseBackend(PULSE_BACKEND_PCNT);
+
+    // Three full hardware ranges plus a few, read now and then
+    const uint32_t total = 3 * HAL_PCNT_LIMIT + 5;
+    PulseReading reading;
+    for (uint32_t i = 0; i < total; i++) {
+        hal_native_pulse();
+        if (i % 10000 == 0) {
+            pulseSourceRead(&reading);
+        }
+    }
+    pulseSourceRead(&reading);
+
+    TEST_ASSERT_TRUE(reading.count == total);
+    TEST_ASSERT_EQUAL(3, pulseSourceStats()->overflows);
+    TEST_ASSERT_TRUE(hal_pcnt_count(0) < HAL_PCNT_LIMIT);
+
+    // The next timed edge carries its extended count
+    hal_native_advance_ms(100);
+    hal_native_pulse();
+    pulseSourceRead(&reading);
+    TEST_ASSERT_EQUAL((uint32_t)(total + 1), reading.edgeCount);
+    TEST_ASSERT_EQUAL(hal_micros(), reading.edgeUs);
+}
+
+void test_pcnt_read_before_overflow_interrupt(void) {
+    selectPulseBackend(PULSE_BACKEND_PCNT);
+    for (uint32_t i = 0; i < HAL_PCNT_LIMIT - 1; i++) {
+        hal_native_pulse();
+    }
+    TEST_ASSERT_TRUE(pulseSourceCount() == HAL_PCNT_LIMIT - 1);
+
+    // Counter restarts at 0, the overflow interrupt has not run yet
+    hal_native_pcnt_hold_interrupts(true);
+    hal_native_pulse();
+    TEST_ASSERT_EQUAL(0, hal_pcnt_count(0));
+    TEST_ASSERT_TRUE(pulseSourceCount() == HAL_PCNT_LIMIT);
+
+    hal_native_pcnt_hold_interrupts(false);
+    TEST_ASSERT_TRUE(pulseSourceCount() == HAL_PCNT_LIMIT);
+    hal_native_pulse();
+    TEST_ASSERT_TRUE(pulseSourceCount() == HAL_PCNT_LIMIT + 1);
+}
+
+void test_pcnt_edge_during_timer_arming(void) {
+    selectPulseBackend(PULSE_BACKEND_PCNT);
+    hal_native_advance_ms(100);
+    hal_native_pulse();
+
+    // An edge lands between the count read and the unmasking of the timed
+    // edge interrupt
+    PulseReading reading;
+    hal_native_edges_before_unmask(1);
+    pulseSourceRead(&reading);
+    TEST_ASSERT_EQUAL(2, hal_pcnt_count(0));
+
+    // It is not taken for the edge after the read: the next one is timed
+    // with its own count
+    hal_native_advance_ms(100);
+    hal_native_pulse();
+    pulseSourceRead(&reading);
+    TEST_ASSERT_TRUE(reading.count == 3);
+    TEST_ASSERT_EQUAL(3, (uint32_t)reading.edgeCount);
+    TEST_ASSERT_EQUAL(hal_micros(), reading.edgeUs);
+}
+
+void test_pcnt_idle_meter_wakes_on_first_edge(void) {
+    uint8_t battery = 100;
+    setupFlowSensor();
+    selectPulseBackend(PULSE_BACKEND_PCNT);
+    scheduleFlowMeter(&battery);
+    simulateScheduledFlow(FLOW_IDLE_TIMEOUT + 2000, 0);
+    TEST_ASSERT_TRUE(flowMeterIdle());
+
+    // Nothing polls an idle meter - the timed edge interrupt restarts it
+    simulateScheduledFlow(10000, 83333);
+    TEST_ASSERT_FALSE(flowMeterIdle());
+    TEST_ASSERT_UINT32_WITHIN(100, 96000, flowRateMlMin);
+    TEST_ASSERT_TRUE(pulseSourceCount() - totalPulses <= 1000 / 83);
+}
+
+void test_pcnt_glitch_not_taken_for_timed_edge(void) {
+    selectPulseBackend(PULSE_BACKEND_PCNT);
+    hal_native_advance_ms(100);
+    hal_native_pulse();
+    uint64_t edgeUs = hal_micros64();
+    PulseReading reading;
+    pulseSourceRead(&reading);
+
+    // A spike the counter filters out still takes the timed edge interrupt
+    hal_native_advance_ms(100);
+    hal_native_glitch(2000);
+    pulseSourceRead(&reading);
+    TEST_ASSERT_TRUE(reading.count == 1);
+    TEST_ASSERT_TRUE(reading.edgeCount == 1);
+    TEST_ASSERT_TRUE(reading.edgeUs == edgeUs);
+
+    // The read armed it again for the real edge
+    hal_native_advance_ms(100);
+    hal_native_pulse();
+    pulseSourceRead(&reading);
+    TEST_ASSERT_TRUE(reading.edgeCount == 2);
+    TEST_ASSERT_TRUE(reading.edgeUs == hal_micros64());
+}
+
+void test_pulse_backend_switch_keeps_count(void) {
+    setupFlowSensor();
+    hal_native_pulses(10, 100000);
+    hal_native_advance_ms(FLOW_CALC_INTERVAL);
+    calculateFlow();
+
+    TEST_ASSERT_EQUAL(PULSE_BACKEND_PCNT, selectPulseBackend(PULSE_BACKEND_PCNT));
+    hal_native_pulses(5, 100000);
+    TEST_ASSERT_TRUE(pulseSourceCount() == 15);
+
+    TEST_ASSERT_EQUAL(PULSE_BACKEND_GPIO, selectPulseBackend(PULSE_BACKEND_GPIO));
+    hal_native_pulses(3, 100000);
+    hal_native_advance_ms(FLOW_CALC_INTERVAL);
+    calculateFlow();
+    TEST_ASSERT_TRUE(pulseSourceCount() == 18);
+    TEST_ASSERT_EQUAL(18, totalPulses);
+}
+
+void test_pcnt_unavailable_falls_back_to_gpio(void) {
+    hal_native_set_pcnt_available(false);
+    TEST_ASSERT_EQUAL(PULSE_BACKEND_GPIO, selectPulseBackend(PULSE_BACKEND_PCNT));
+    TEST_ASSERT_EQUAL(PULSE_BACKEND_GPIO, pulseSourceBackend());
+
+    hal_native_pulses(4, 100000);
+    TEST_ASSERT_TRUE(pulseSourceCount() == 4);
+}
+
+// Test suite runner
+void PulseSourceTests(void) {
+    RUN_TEST(test_pcnt_scheduled_flow_matches_gpio);
+    RUN_TEST(test_pcnt_filters_glitches);
+    RUN_TEST(test_pcnt_extends_count_through_overflow);
+    RUN_TEST(test_pcnt_read_before_overflow_interrupt);
+    RUN_TEST(test_pcnt_edge_during_timer_arming);
+    RUN_TEST(test_pcnt_idle_meter_wakes_on_first_edge);
+    RUN_TEST(test_pcnt_glitch_not_taken_for_timed_edge);
+    RUN_TEST(test_pulse_backend_switch_keeps_count);
+    RUN_TEST(test_pcnt_unavailable_falls_back_to_gpio);
+}
@@ -0,0 +1,27 @@
+/*
+ * Pulse Source Tests
+ * Tests for the GPIO interrupt and PCNT pulse counting backends
+ */
+
+#ifndef TEST_PULSE_SOURCE_H
+#define TEST_PULSE_SOURCE_H
+
+#include <unity.h>
+#include "hal_native.h"
+#include "pulse_source.h"
+
+// Test suite declarations
+void test_pcnt_scheduled_flow_matches_gpio(void);
+void test_pcnt_filters_glitches(void);
+void test_pcnt_extends_count_through_overflow(void);
+void test_pcnt_read_before_overflow_interrupt(void);
+void test_pcnt_edge_during_timer_arming(void);
+void test_pcnt_idle_meter_wakes_on_first_edge(void);
+void test_pcnt_glitch_not_taken_for_timed_edge(void);
+void test_pulse_backend_switch_keeps_count(void);
+void test_pcnt_unavailable_falls_back_to_gpio(void);
+
+// Test suite runner
+void PulseSourceTests(void);
+
+#endif // TEST_PULSE_SOURCE_H
@@ -0,0 +1,242 @@
+/*
+ * Pulse Trace Tests
+ * Tests for edge capture, the flash trace format and deterministic replay
+ */
+
+#include "test_pulse_trace.h"
+#include "test_helpers.h"
+#include "console.h"
+#include "deferred_log.h"
+#include "flow_history.h"
+#include <string.h>
+#include <vector>
+
+// Edge times fired by firePulses(), to check the trace against
+static std::vector<uint64_t> fired;
+
+// Replay source for the sleep hook
+static TraceReader reader;
+static bool edgePending = false;
+static uint64_t nextEdgeUs = 0;
+
+static void recordingHook(uint64_t deadlineUs) {
+    while (schedPulsePeriodUs > 0 && schedPulseNextUs <= deadlineUs &&
+           schedPulseNextUs <= schedPulseEndUs && !hal_native_notify_pending()) {
+        hal_native_set_micros(schedPulseNextUs);
+        hal_native_pulse();
+        fired.push_back(schedPulseNextUs);
+        schedPulseNextUs += schedPulsePeriodUs;
+    }
+}
+
+/**
+ * simulateScheduledFlow(), remembering every edge time
+ */
+static void recordedFlow(uint32_t durationMs, uint32_t pulsePeriodUs) {
+    uint64_t endUs = hal_native_now_us() + (uint64_t)durationMs * 1000;
+    startScheduledPulses(pulsePeriodUs, endUs);
+    hal_native_set_wait_hook(recordingHook);
+    while (hal_native_now_us() < endUs) {
+        schedulerRun();
+    }
+    schedPulsePeriodUs = 0;
+}
+
+static void replayHook(uint64_t deadlineUs) {
+    while (edgePending && nextEdgeUs <= deadlineUs && !hal_native_notify_pending()) {
+        hal_native_set_micros(nextEdgeUs);
+        hal_native_pulse();
+        edgePending = traceReaderNext(&reader, &nextEdgeUs);
+    }
+}
+
+/**
+ * Boot a joined meter at startUs from ledger, as tools/trace_replay does
+ */
+static void bootJoined(uint64_t startUs, uint64_t ledger) {
+    static uint8_t battery = 100;
+    hal_native_set_micros(startUs);
+    resetFlowMeter();
+    schedulerReset();
+    loadTotalVolume();
+    totalPulses = ledger;
+    lastSavedPulses = ledger;
+    setupFlowSensor();
+    scheduleFlowMeter(&battery);
+    zigbeeConnected = true;
+    requestFlowReport();
+}
+
+static bool sameFrame(const NativeRadioFrame* a, const NativeRadioFrame* b) {
+    if (a->timeUs != b->timeUs || a->endpoint != b->endpoint || a->clusterId != b->clusterId ||
+        a->count != b->count || a->bytesOnAir != b->bytesOnAir) {
+        return false;
+    }
+    for (uint8_t i = 0; i < a->count; i++) {
+        if (a->attrs[i].attrId != b->attrs[i].attrId || a->attrs[i].zclType != b->attrs[i].zclType ||
+            a->attrs[i].len != b->attrs[i].len ||
+            memcmp(a->attrs[i].value, b->attrs[i].value, a->attrs[i].len) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void test_trace_records_exact_edge_times(void) {
+    fired.clear();
+    bootJoined(5000000, 1234);
+    TEST_ASSERT_TRUE(traceStart());
+
+    // Fast flow, a pause longer than the 32-bit microsecond wrap, a drip
+    recordedFlow(20000, 4000);
+    recordedFlow(4400000, 0);
+    recordedFlow(60000, 1500000);
+    traceStop();
+    TEST_ASSERT_FALSE(traceCapturing());
+    TEST_ASSERT_EQUAL(fired.size(), traceStats()->edges);
+    TEST_ASSERT_EQUAL(0, traceStats()->dropped);
+
+    TEST_ASSERT_TRUE(traceReaderBegin(&reader));
+    TEST_ASSERT_EQUAL(5000000, reader.startUs);
+    TEST_ASSERT_EQUAL(1234, reader.startLedger);
+    uint64_t edgeUs;
+    size_t n = 0;
+    while (traceReaderNext(&reader, &edgeUs)) {
+        TEST_ASSERT_TRUE(n < fired.size());
+        TEST_ASSERT_EQUAL_UINT64(fired[n], edgeUs);
+        n++;
+    }
+    TEST_ASSERT_EQUAL(fired.size(), n);
+    TEST_ASSERT_EQUAL_UINT64(hal_native_now_us(), reader.timeUs);
+
+    // About two bytes per edge at a steady flow
+    TEST_ASSERT_TRUE(traceLength() < 4 * fired.size() + 1024);
+}
+
+void test_trace_spans_sectors_and_ignores_stale_chunks(void) {
+    fired.clear();
+    bootJoined(0, 0);
+    TEST_ASSERT_TRUE(traceStart());
+    recordedFlow(60000, 4000);
+    traceStop();
+    uint32_t longLength = traceLength();
+    TEST_ASSERT_TRUE(longLength > 2 * HAL_FLASH_SECTOR_SIZE);
+    TEST_ASSERT_EQUAL(15000, traceStats()->edges);
+
+    // A short trace erases only its own sector - the rest of the old one
+    // is still in flash but never read
+    fired.clear();
+    TEST_ASSERT_TRUE(traceStart());
+    recordedFlow(3000, 4000);
+    traceStop();
+    TEST_ASSERT_TRUE(traceLength() < HAL_FLASH_SECTOR_SIZE);
+
+    TEST_ASSERT_TRUE(traceReaderBegin(&reader));
+    uint64_t edgeUs;
+    size_t n = 0;
+    while (traceReaderNext(&reader, &edgeUs)) {
+        TEST_ASSERT_EQUAL_UINT64(fired[n], edgeUs);
+        n++;
+    }
+    TEST_ASSERT_EQUAL(fired.size(), n);
+}
+
+void test_trace_full_ring_counts_drops(void) {
+    setupFlowSensor();
+    TEST_ASSERT_TRUE(traceStart());
+
+    // Edges the flow job never gets to drain
+    for (int i = 0; i < TRACE_RING_EDGES + 10; i++) {
+        hal_native_advance_ms(1);
+        hal_native_pulse();
+    }
+    TEST_ASSERT_EQUAL(10, traceStats()->dropped);
+    traceStop();
+    TEST_ASSERT_EQUAL(TRACE_RING_EDGES, traceStats()->edges);
+}
+
+void test_trace_capture_restores_pcnt_backend(void) {
+    setupFlowSensor();
+    selectPulseBackend(PULSE_BACKEND_PCNT);
+
+    TEST_ASSERT_TRUE(traceStart());
+    TEST_ASSERT_EQUAL(PULSE_BACKEND_GPIO, pulseSourceBackend());
+    traceStop();
+    TEST_ASSERT_EQUAL(PULSE_BACKEND_PCNT, pulseSourceBackend());
+}
+
+void test_trace_export_replays_identical_reports(void) {
+    // Record: a joined meter captures a morning's worth of usage
+    fired.clear();
+    bootJoined(1000000, 0);
+    TEST_ASSERT_TRUE(traceStart());
+    recordedFlow(120000, 8000);      // Shower
+    recordedFlow(600000, 0);
+    recordedFlow(30000, 20000);      // Tap
+    recordedFlow(900000, 0);
+    recordedFlow(300000, 400000);    // Drip
+    traceStop();
+    uint64_t endUs = hal_native_now_us();
+    uint64_t recordedPulses = totalPulses;
+
+    std::vector<NativeRadioFrame> recorded;
+    for (size_t i = 0; i < hal_native_radio_frame_count(); i++) {
+        recorded.push_back(*hal_native_radio_frame(i));
+    }
+    TEST_ASSERT_TRUE(recorded.size() > 10);
+
+    // Export through the console and rebuild the image from the rows
+    resetDeferredLog();
+    hal_native_serial_input("trace export\n");
+    std::vector<uint8_t> image;
+    bool done = false;
+    for (int poll = 0; poll < 10000 && !done; poll++) {
+        consolePoll();
+        LogRecord record;
+        while (logRead(&record)) {
+            if (record.id == LOG_ID_TRACE_EXPORT_ROW) {
+                TEST_ASSERT_EQUAL(image.size(), record.words[0]);
+                for (int w = 1; w <= 6; w++) {
+                    for (int b = 0; b < 4; b++) {
+                        image.push_back((uint8_t)(record.words[w] >> (8 * b)));
+                    }
+                }
+            } else if (record.id == LOG_ID_TRACE_EXPORT_END) {
+                done = true;
+            }
+        }
+    }
+    TEST_ASSERT_TRUE(done);
+    TEST_ASSERT_TRUE(image.size() >= traceLength());
+
+    // Replay on a fresh host: same frames, byte for byte (usage events
+    // carry device time, which starts over with it)
+    hal_native_reset();
+    resetFlowHistory();
+    resetPulseTrace();
+    TEST_ASSERT_TRUE(hal_flash_begin(DATA_PARTITION_LABEL));
+    TEST_ASSERT_TRUE(hal_flash_write(TRACE_OFFSET, image.data(), image.size()));
+    TEST_ASSERT_TRUE(traceReaderBegin(&reader));
+    bootJoined(reader.startUs, reader.startLedger);
+    edgePending = traceReaderNext(&reader, &nextEdgeUs);
+    hal_native_set_wait_hook(replayHook);
+    while (edgePending || hal_native_now_us() < reader.timeUs) {
+        schedulerRun();
+    }
+
+    TEST_ASSERT_EQUAL_UINT64(endUs, reader.timeUs);
+    TEST_ASSERT_EQUAL_UINT64(recordedPulses, totalPulses);
+    TEST_ASSERT_EQUAL(recorded.size(), hal_native_radio_frame_count());
+    for (size_t i = 0; i < recorded.size(); i++) {
+        TEST_ASSERT_TRUE_MESSAGE(sameFrame(&recorded[i], hal_native_radio_frame(i)),
+                                 "replayed frame differs");
+    }
+}
+
+void PulseTraceTests(void) {
+    RUN_TEST(test_trace_records_exact_edge_times);
+    RUN_TEST(test_trace_spans_sectors_and_ignores_stale_chunks);
+    RUN_TEST(test_trace_full_ring_counts_drops);
+    RUN_TEST(test_trace_capture_restores_pcnt_backend);
+    RUN_TEST(test_trace_export_replays_identical_reports);
+}
@@ -0,0 +1,23 @@
+/*
+ * Pulse Trace Tests
+ * Tests for edge capture, the flash trace format and deterministic replay
+ */
+
+#ifndef TEST_PULSE_TRACE_H
+#define TEST_PULSE_TRACE_H
+
+#include <unity.h>
+#include "hal_native.h"
+#include "pulse_trace.h"
+
+// Test suite declarations
+void test_trace_records_exact_edge_times(void);
+void test_trace_spans_sectors_and_ignores_stale_chunks(void);
+void test_trace_full_ring_counts_drops(void);
+void test_trace_capture_restores_pcnt_backend(void);
+void test_trace_export_replays_identical_reports(void);
+
+// Test suite runner
+void PulseTraceTests(void);
+
+#endif // TEST_PULSE_TRACE_H
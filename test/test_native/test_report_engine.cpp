@@ -0,0 +1,269 @@
+/*
+ * Report Engine Tests
+ * Tests for report coalescing, hysteresis, the airtime budget and the
+ * urgent alarm lane
+ */
+
+#include <string.h>
+#include "test_report_engine.h"
+#include "test_helpers.h"
+#include "metering_cluster.h"
+#include "config_traits.h"
+
+static ReportAttributeConfig testAttribute(uint16_t clusterId, uint16_t attrId) {
+    ReportAttributeConfig config = {};
+    config.endpoint = FLOW_ENDPOINT;
+    config.clusterId = clusterId;
+    config.attrId = attrId;
+    config.zclType = ZCL_TYPE_UINT8;
+    config.minIntervalMs = 0;
+    config.maxIntervalMs = 60000;
+    config.minChange = 1;
+    return config;
+}
+
+void test_report_coalesces_cluster_into_one_frame(void) {
+    ReportAttributeConfig config = testAttribute(0xFC00, 0);
+    int a = reportAttributeAdd(&config);
+    config.attrId = 1;
+    int b = reportAttributeAdd(&config);
+    config.clusterId = 0x0001;
+    int other = reportAttributeAdd(&config);
+
+    // Both changed attributes of the cluster go in one frame, the
+    // unchanged cluster sends nothing
+    hal_native_advance_ms(1000);
+    reportAttributeSet(a, 10);
+    reportAttributeSet(b, 20);
+    TEST_ASSERT_EQUAL(1, reportPoll(true));
+    TEST_ASSERT_EQUAL(1, hal_native_radio_frame_count());
+    const NativeRadioFrame* frame = hal_native_radio_frame(0);
+    TEST_ASSERT_EQUAL(2, frame->count);
+    TEST_ASSERT_EQUAL(10, frame->attrs[0].value[0]);
+    TEST_ASSERT_EQUAL(20, frame->attrs[1].value[0]);
+    TEST_ASSERT_EQUAL(HAL_RADIO_FRAME_OVERHEAD + 2 * (HAL_RADIO_RECORD_OVERHEAD + 1),
+                      frame->bytesOnAir);
+
+    // A deadline carries every attribute of the cluster past half its interval
+    reportAttributeSet(other, 5);
+    hal_native_advance_ms(59000);
+    TEST_ASSERT_EQUAL(1, reportPoll(true));
+    TEST_ASSERT_EQUAL(2, hal_native_radio_frame_count());
+    TEST_ASSERT_EQUAL(0x0001, hal_native_radio_frame(1)->clusterId);
+
+    hal_native_advance_ms(1000);
+    TEST_ASSERT_EQUAL(1, reportPoll(true));
+    TEST_ASSERT_EQUAL(2, hal_native_radio_frame(2)->count);
+    TEST_ASSERT_EQUAL(59000, reportNextMs());   // The other cluster's deadline
+}
+
+void test_report_encodes_bitmap32(void) {
+    ReportAttributeConfig config = testAttribute(0x0001, 0x003E);
+    config.zclType = ZCL_TYPE_BITMAP32;
+    int state = reportAttributeAdd(&config);
+
+    // Four value bytes, little endian, and counted on air
+    hal_native_advance_ms(1000);
+    reportAttributeSet(state, 0x80000102UL);
+    TEST_ASSERT_EQUAL(1, reportPoll(true));
+    const NativeRadioFrame* frame = hal_native_radio_frame(0);
+    TEST_ASSERT_EQUAL(ZCL_TYPE_BITMAP32, frame->attrs[0].zclType);
+    TEST_ASSERT_EQUAL(4, frame->attrs[0].len);
+    const uint8_t expected[] = { 0x02, 0x01, 0x00, 0x80 };
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, frame->attrs[0].value, 4);
+    TEST_ASSERT_EQUAL(HAL_RADIO_FRAME_OVERHEAD + HAL_RADIO_RECORD_OVERHEAD + 4, frame->bytesOnAir);
+}
+
+void test_report_trickle_does_not_flood(void) {
+    zigbeeConnected = true;
+    shouldReportFlow(0, 0, 100);
+
+    // A wobbling 0.1-0.2 L/min trickle, checked every 10 ms loop tick:
+    // only the interval reports go out
+    const uint32_t rates[] = { 0, 200, 100, 240, 50 };
+    uint32_t reports = 0;
+    for (uint32_t tick = 0; tick < 6000; tick++) {
+        hal_native_advance_ms(10);
+        if (shouldReportFlow(rates[tick % 5], 0, 100)) {
+            reports++;
+        }
+    }
+    TEST_ASSERT_EQUAL(60 / FLOW_REPORT_INTERVAL, reports);
+
+    // Flow starting is still reported straight away
+    hal_native_advance_ms(REPORT_MIN_INTERVAL * 1000UL);
+    TEST_ASSERT_TRUE(shouldReportFlow(6000, 0, 100));
+}
+
+void test_report_budget_limits_change_frames(void) {
+    ReportAttributeConfig config = testAttribute(0xFC00, 0);
+    config.maxIntervalMs = 0;
+    int attr = reportAttributeAdd(&config);
+
+    // A value that changes every second for an hour
+    const uint32_t seconds = 3600;
+    for (uint32_t s = 1; s <= seconds; s++) {
+        hal_native_advance_ms(1000);
+        reportAttributeSet(attr, s & 1);
+        reportPoll(true);
+    }
+
+    uint32_t frameBytes = HAL_RADIO_FRAME_OVERHEAD + HAL_RADIO_RECORD_OVERHEAD + 1;
+    uint32_t allowed = (REPORT_BUDGET_BURST_BYTES + REPORT_BUDGET_BYTES_PER_HOUR) / frameBytes;
+    TEST_ASSERT_TRUE(reportEngineStats()->frames <= allowed);
+    TEST_ASSERT_TRUE(reportEngineStats()->frames >= allowed - 1);
+    TEST_ASSERT_TRUE(hal_native_radio_stats()->bytesOnAir <=
+                     REPORT_BUDGET_BURST_BYTES + REPORT_BUDGET_BYTES_PER_HOUR);
+    TEST_ASSERT_TRUE(reportEngineStats()->budgetDeferrals > 0);
+
+    // A held back change is retried once the bucket can pay for it
+    reportAttributeSet(attr, 7);
+    uint32_t wait = reportNextMs();
+    TEST_ASSERT_TRUE(wait > 0);
+    TEST_ASSERT_EQUAL(0, reportPoll(true));
+    hal_native_advance_ms(wait);
+    TEST_ASSERT_EQUAL(1, reportPoll(true));
+}
+
+void test_report_deadline_ignores_budget(void) {
+    ReportAttributeConfig config = testAttribute(0xFC00, 0);
+    int attr = reportAttributeAdd(&config);
+
+    // Spend the whole bucket on change frames
+    for (uint32_t i = 1; reportEngineStats()->budgetDeferrals == 0; i++) {
+        reportAttributeSet(attr, i);
+        reportPoll(true);
+    }
+    uint32_t frames = reportEngineStats()->frames;
+
+    // The deadline still reports, and a request too
+    hal_native_advance_ms(config.maxIntervalMs);
+    TEST_ASSERT_EQUAL(1, reportPoll(true));
+    reportRequestAll();
+    TEST_ASSERT_EQUAL(1, reportPoll(true));
+    TEST_ASSERT_EQUAL(frames + 2, reportEngineStats()->frames);
+    TEST_ASSERT_EQUAL(2, reportEngineStats()->deadlineFrames);
+}
+
+void test_report_held_change_sent_while_idle(void) {
+    uint8_t battery = 100;
+    zigbeeConnected = true;
+    setupFlowSensor();
+    scheduleFlowMeter(&battery);
+
+    simulateScheduledFlow(20000, 83333);
+    TEST_ASSERT_TRUE(flowRateMlMin > 0);
+
+    // Flow stops: the estimate decays to zero and the flow job suspends
+    // (the draw ends with it, releasing the held change reports)
+    startScheduledPulses(0);
+    uint64_t stoppedUs = hal_native_now_us();
+    while (flowRateMlMin > 0) {
+        schedulerRun();
+    }
+
+    // The zero rate is sent once the minimum interval allows
+    simulateScheduledFlow(REPORT_MIN_INTERVAL * 1000UL + 1, 0);
+    TEST_ASSERT_TRUE(flowMeterIdle());
+    const NativeRadioFrame* last = nullptr;
+    for (size_t i = 0; i < hal_native_radio_frame_count(); i++) {
+        if (hal_native_radio_frame(i)->clusterId == METERING_CLUSTER_ID) {
+            last = hal_native_radio_frame(i);
+        }
+    }
+    TEST_ASSERT_NOT_NULL(last);
+    TEST_ASSERT_TRUE(last->timeUs >= stoppedUs);
+    TEST_ASSERT_EQUAL(0, frameValue(last, METERING_DEMAND_ATTR));
+}
+
+void test_report_alarm_preempts_cadence(void) {
+    ReportAttributeConfig config = testAttribute(0xFC00, 0);
+    int telemetry = reportAttributeAdd(&config);
+    config = testAttribute(0x0702, 0x0200);
+    config.minIntervalMs = 60000;
+    config.maxIntervalMs = 0;
+    int alarm = reportAttributeAdd(&config);
+    reportAttributeSet(alarm, 0x08);
+    reportPoll(true);
+
+    // Spend the whole bucket, leaving a change held back by it
+    for (uint32_t i = 1; reportEngineStats()->budgetDeferrals == 0; i++) {
+        reportAttributeSet(telemetry, i);
+        reportPoll(true);
+    }
+    size_t frames = hal_native_radio_frame_count();
+
+    // Within its minimum interval, the alarm goes out alone, acknowledged,
+    // timed from its sample
+    hal_native_advance_ms(10);
+    reportAlarm(alarm, 0x20, hal_native_now_us() - 2500);
+    TEST_ASSERT_EQUAL(1, reportPollUrgent(true));
+    TEST_ASSERT_EQUAL(frames + 1, hal_native_radio_frame_count());
+    const NativeRadioFrame* frame = hal_native_radio_frame(frames);
+    TEST_ASSERT_EQUAL(0x0702, frame->clusterId);
+    TEST_ASSERT_TRUE(frame->acked);
+    TEST_ASSERT_EQUAL(0x20, frameValue(frame, 0x0200));
+    TEST_ASSERT_EQUAL(2500, reportEngineStats()->alarmLatencyUs);
+    TEST_ASSERT_EQUAL(1, reportEngineStats()->alarmFrames);
+    TEST_ASSERT_EQUAL(0, reportPollUrgent(true));
+}
+
+void test_report_alarm_resent_until_acked(void) {
+    NativeNetworkConfig network;
+    network.lostAcks = 2;
+    hal_native_radio_set_network(&network);
+    ReportAttributeConfig config = testAttribute(0x0702, 0x0200);
+    config.maxIntervalMs = 0;
+    int alarm = reportAttributeAdd(&config);
+
+    reportAlarm(alarm, 0x20, hal_native_now_us());
+    TEST_ASSERT_EQUAL(1, reportPoll(true));
+    TEST_ASSERT_EQUAL(REPORT_ACK_TIMEOUT_MS, reportNextMs());
+
+    // Each lost acknowledgement costs one more frame, with the current value
+    hal_native_advance_ms(REPORT_ACK_TIMEOUT_MS);
+    TEST_ASSERT_EQUAL(1, reportPoll(true));
+    reportAttributeSet(alarm, 0x28);
+    hal_native_advance_ms(REPORT_ACK_TIMEOUT_MS);
+    TEST_ASSERT_EQUAL(1, reportPoll(true));
+    TEST_ASSERT_EQUAL(0x28, frameValue(hal_native_radio_frame(2), 0x0200));
+
+    // The third is acknowledged: nothing left to send or wait for
+    hal_native_advance_ms(REPORT_ACK_TIMEOUT_MS);
+    TEST_ASSERT_EQUAL(0, reportPoll(true));
+    TEST_ASSERT_EQUAL(HAL_WAIT_FOREVER, reportNextMs());
+    TEST_ASSERT_EQUAL(3, reportEngineStats()->alarmFrames);
+    TEST_ASSERT_EQUAL(2, reportEngineStats()->alarmRetries);
+    TEST_ASSERT_EQUAL(0, reportEngineStats()->alarmsLost);
+}
+
+void test_report_alarm_given_up(void) {
+    NativeNetworkConfig network;
+    network.lostAcks = 100;
+    hal_native_radio_set_network(&network);
+    ReportAttributeConfig config = testAttribute(0x0702, 0x0200);
+    config.maxIntervalMs = 0;
+    int alarm = reportAttributeAdd(&config);
+
+    reportAlarm(alarm, 0x08, hal_native_now_us());
+    for (uint32_t i = 0; i < 2 * REPORT_ALARM_TRIES; i++) {
+        reportPoll(true);
+        hal_native_advance_ms(REPORT_ACK_TIMEOUT_MS);
+    }
+    TEST_ASSERT_EQUAL(REPORT_ALARM_TRIES, hal_native_radio_frame_count());
+    TEST_ASSERT_EQUAL(1, reportEngineStats()->alarmsLost);
+    TEST_ASSERT_EQUAL(HAL_WAIT_FOREVER, reportNextMs());
+}
+
+// Test suite runner
+void ReportEngineTests(void) {
+    RUN_TEST(test_report_coalesces_cluster_into_one_frame);
+    RUN_TEST(test_report_encodes_bitmap32);
+    RUN_TEST(test_report_trickle_does_not_flood);
+    RUN_TEST(test_report_budget_limits_change_frames);
+    RUN_TEST(test_report_deadline_ignores_budget);
+    RUN_TEST(test_report_held_change_sent_while_idle);
+    RUN_TEST(test_report_alarm_preempts_cadence);
+    RUN_TEST(test_report_alarm_resent_until_acked);
+    RUN_TEST(test_report_alarm_given_up);
+}
@@ -0,0 +1,28 @@
+/*
+ * Report Engine Tests
+ * Tests for report coalescing, hysteresis, the airtime budget and the
+ * urgent alarm lane
+ */
+
+#ifndef TEST_REPORT_ENGINE_H
+#define TEST_REPORT_ENGINE_H
+
+#include <unity.h>
+#include "hal_native.h"
+#include "report_engine.h"
+
+// Test suite declarations
+void test_report_coalesces_cluster_into_one_frame(void);
+void test_report_encodes_bitmap32(void);
+void test_report_trickle_does_not_flood(void);
+void test_report_budget_limits_change_frames(void);
+void test_report_deadline_ignores_budget(void);
+void test_report_held_change_sent_while_idle(void);
+void test_report_alarm_preempts_cadence(void);
+void test_report_alarm_resent_until_acked(void);
+void test_report_alarm_given_up(void);
+
+// Test suite runner
+void ReportEngineTests(void);
+
+#endif // TEST_REPORT_ENGINE_H
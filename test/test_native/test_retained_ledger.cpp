@@ -0,0 +1,157 @@
+/*
+ * Retained Ledger Tests
+ * Tests for resuming the pulse ledger from RTC memory after a reset
+ */
+
+#include "test_retained_ledger.h"
+#include "test_helpers.h"
+
+#define PULSE_PERIOD_US 40000      // 25 pulses/s, about 12 L/min
+#define TRICKLE_PERIOD_US 300000   // Slow enough that folds stay below SAVE_THRESHOLD
+
+static uint8_t battery = 100;
+
+// Boot the firmware the way setup() does, after a reset of the given kind
+static void boot(HalResetReason reason) {
+    if (reason == HAL_RESET_POWER_ON) {
+        hal_native_power_loss();
+    } else {
+        hal_native_set_reset_reason(reason);
+    }
+    resetFlowMeter();
+    schedulerReset();
+    loadTotalVolume();
+    setupFlowSensor();
+    scheduleFlowMeter(&battery);
+}
+
+// Trickle until the ledger is ahead of its flash copy
+static void countUnsavedPulses() {
+    for (int i = 0; i < 20 && totalPulses == lastSavedPulses; i++) {
+        simulateScheduledFlow(1000, TRICKLE_PERIOD_US);
+    }
+    TEST_ASSERT_TRUE(totalPulses > lastSavedPulses);
+}
+
+void test_retained_resume_after_watchdog_is_exact(void) {
+    boot(HAL_RESET_POWER_ON);
+    uint32_t nvsWrites = hal_native_nvs_write_count();
+
+    simulateScheduledFlow(10000, PULSE_PERIOD_US);
+    countUnsavedPulses();
+    uint64_t counted = totalPulses;
+
+    hal_native_flash_clear_stats();
+    boot(HAL_RESET_WATCHDOG);
+
+    TEST_ASSERT_EQUAL(counted, totalPulses);
+    TEST_ASSERT_EQUAL(1, resetCount);
+    TEST_ASSERT_EQUAL(1, bootCount);
+    TEST_ASSERT_EQUAL(0, hal_native_flash_stats()->reads);
+    TEST_ASSERT_EQUAL(nvsWrites, hal_native_nvs_write_count());
+
+    // The next save finds the journal cursor and lands after the old records
+    saveTotalVolume();
+    boot(HAL_RESET_POWER_ON);
+    TEST_ASSERT_EQUAL(counted, totalPulses);
+    TEST_ASSERT_EQUAL(2, bootCount);
+    TEST_ASSERT_EQUAL(0, resetCount);
+}
+
+void test_retained_power_loss_falls_back_to_flash(void) {
+    boot(HAL_RESET_POWER_ON);
+    countUnsavedPulses();
+    uint64_t saved = lastSavedPulses;
+
+    boot(HAL_RESET_POWER_ON);
+    TEST_ASSERT_EQUAL(saved, totalPulses);
+
+    // A brownout does not trust the retained memory either
+    countUnsavedPulses();
+    saved = lastSavedPulses;
+    boot(HAL_RESET_BROWNOUT);
+    TEST_ASSERT_EQUAL(saved, totalPulses);
+}
+
+void test_retained_torn_store_keeps_previous_slot(void) {
+    RetainedLedger ledger = {};
+    ledger.pulses = 1000;
+    retainedLedgerStore(&ledger);
+    ledger.pulses = 1001;
+    retainedLedgerStore(&ledger);
+
+    // Reset in the middle of the next store: half of its words written
+    uint32_t before[HAL_RETAINED_WORDS];
+    memcpy(before, hal_retained_memory(), sizeof(before));
+    ledger.pulses = 1002;
+    retainedLedgerStore(&ledger);
+    uint32_t* words = hal_retained_memory();
+    for (uint32_t i = 0; i < HAL_RETAINED_WORDS; i++) {
+        if (words[i] != before[i]) {
+            words[i] = before[i];
+            break;
+        }
+    }
+
+    hal_native_set_reset_reason(HAL_RESET_PANIC);
+    TEST_ASSERT_TRUE(retainedLedgerRecover(&ledger));
+    TEST_ASSERT_EQUAL(1001, ledger.pulses);
+}
+
+void test_retained_garbage_never_resumes(void) {
+    // Warm reset reason, but the memory was never written
+    RetainedLedger ledger;
+    hal_native_set_reset_reason(HAL_RESET_SOFTWARE);
+    TEST_ASSERT_FALSE(retainedLedgerRecover(&ledger));
+
+    memset(hal_retained_memory(), 0, HAL_RETAINED_WORDS * sizeof(uint32_t));
+    TEST_ASSERT_FALSE(retainedLedgerRecover(&ledger));
+}
+
+void test_retained_random_resets_never_lose_or_double_count(void) {
+    static const HalResetReason warm[] = { HAL_RESET_SOFTWARE, HAL_RESET_PANIC, HAL_RESET_WATCHDOG };
+    // Pulses a flow window can hold before the ledger picks them up
+    const uint64_t windowPulses = FLOW_CALC_INTERVAL * 1000ULL / PULSE_PERIOD_US + 1;
+    uint32_t rng = 12345;
+    uint32_t warmResets = 0;
+
+    boot(HAL_RESET_POWER_ON);
+    for (int i = 0; i < 300; i++) {
+        rng = rng * 1664525 + 1013904223;
+        uint32_t durationMs = 1 + (rng >> 8) % 15000;
+        static const uint32_t periods[] = { 0, PULSE_PERIOD_US, TRICKLE_PERIOD_US, PULSE_PERIOD_US };
+        uint32_t period = periods[rng & 3];
+
+        uint64_t bootPulses = totalPulses;
+        simulateScheduledFlow(durationMs, period);
+
+        // Everything the ledger holds was counted by the sensor this boot,
+        // and at most one flow window of the sensor's count is not in it yet
+        uint64_t sensed = pulseSourceCount();
+        uint64_t ledger = totalPulses;
+        uint64_t saved = lastSavedPulses;
+        TEST_ASSERT_TRUE(ledger - bootPulses <= sensed);
+        TEST_ASSERT_TRUE(sensed - (ledger - bootPulses) <= windowPulses);
+
+        rng = rng * 1664525 + 1013904223;
+        if ((rng >> 16) % 8 == 0) {
+            boot(HAL_RESET_POWER_ON);
+            TEST_ASSERT_EQUAL(saved, totalPulses);
+            warmResets = 0;
+        } else {
+            boot(warm[(rng >> 16) % 3]);
+            TEST_ASSERT_EQUAL(ledger, totalPulses);
+            TEST_ASSERT_EQUAL(saved, lastSavedPulses);
+            TEST_ASSERT_EQUAL(++warmResets, resetCount);
+        }
+    }
+}
+
+// Test suite runner
+void RetainedLedgerTests(void) {
+    RUN_TEST(test_retained_resume_after_watchdog_is_exact);
+    RUN_TEST(test_retained_power_loss_falls_back_to_flash);
+    RUN_TEST(test_retained_torn_store_keeps_previous_slot);
+    RUN_TEST(test_retained_garbage_never_resumes);
+    RUN_TEST(test_retained_random_resets_never_lose_or_double_count);
+}
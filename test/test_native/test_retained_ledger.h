@@ -0,0 +1,23 @@
+/*
+ * Retained Ledger Tests
+ * Tests for resuming the pulse ledger from RTC memory after a reset
+ */
+
+#ifndef TEST_RETAINED_LEDGER_H
+#define TEST_RETAINED_LEDGER_H
+
+#include <unity.h>
+#include "hal_native.h"
+#include "retained_ledger.h"
+
+// Test suite declarations
+void test_retained_resume_after_watchdog_is_exact(void);
+void test_retained_power_loss_falls_back_to_flash(void);
+void test_retained_torn_store_keeps_previous_slot(void);
+void test_retained_garbage_never_resumes(void);
+void test_retained_random_resets_never_lose_or_double_count(void);
+
+// Test suite runner
+void RetainedLedgerTests(void);
+
+#endif // TEST_RETAINED_LEDGER_H
@@ -0,0 +1,176 @@
+/*
+ * Scheduler Tests
+ * Tests for the deadline-ordered job scheduler on simulated time
+ */
+
+#include "test_scheduler.h"
+
+static uint8_t runOrder[8];
+static uint8_t runLen = 0;
+static uint32_t runTimes[32];
+static uint32_t runCount = 0;
+static uint32_t notifyCount = 0;
+
+static void jobA() { runOrder[runLen++] = 'A'; }
+static void jobB() { runOrder[runLen++] = 'B'; }
+static void jobC() { runOrder[runLen++] = 'C'; }
+
+static void timedJob() {
+    if (runCount < 32) {
+        runTimes[runCount] = hal_millis();
+    }
+    runCount++;
+}
+
+static void onNotify() {
+    notifyCount++;
+}
+
+static void resetRecorders() {
+    schedulerReset();
+    runLen = 0;
+    runCount = 0;
+    notifyCount = 0;
+}
+
+void test_scheduler_runs_in_deadline_order(void) {
+    resetRecorders();
+    schedulerAdd(jobC, 0, 30);
+    schedulerAdd(jobA, 0, 10);
+    schedulerAdd(jobB, 0, 20);
+
+    hal_native_advance_ms(30);
+    schedulerRunDue();
+
+    TEST_ASSERT_EQUAL(3, runLen);
+    TEST_ASSERT_EQUAL('A', runOrder[0]);
+    TEST_ASSERT_EQUAL('B', runOrder[1]);
+    TEST_ASSERT_EQUAL('C', runOrder[2]);
+
+    // One-shots stay registered but disarmed
+    TEST_ASSERT_EQUAL(HAL_WAIT_FOREVER, schedulerRunDue());
+}
+
+void test_scheduler_returns_time_to_next_deadline(void) {
+    resetRecorders();
+    schedulerAdd(timedJob, 100, 100);
+    schedulerAdd(timedJob, 0, 250);
+
+    TEST_ASSERT_EQUAL(100, schedulerRunDue());
+    hal_native_advance_ms(40);
+    TEST_ASSERT_EQUAL(60, schedulerRunDue());
+    TEST_ASSERT_EQUAL(0, runCount);
+}
+
+void test_scheduler_periodic_has_no_drift(void) {
+    resetRecorders();
+    schedulerAdd(timedJob, 1000, 1000);
+
+    while (hal_millis() < 10000) {
+        schedulerRun();
+    }
+    schedulerRunDue();
+
+    // Slept straight to each deadline: one wake-up per run, never late
+    TEST_ASSERT_EQUAL(10, runCount);
+    TEST_ASSERT_EQUAL(10, schedulerStats()->wakeups);
+    TEST_ASSERT_EQUAL(0, schedulerStats()->maxLateMs);
+    for (uint32_t i = 0; i < runCount; i++) {
+        TEST_ASSERT_EQUAL((i + 1) * 1000, runTimes[i]);
+    }
+}
+
+void test_scheduler_late_job_skips_missed_periods(void) {
+    resetRecorders();
+    schedulerAdd(timedJob, 100, 100);
+
+    hal_native_advance_ms(350);
+    TEST_ASSERT_EQUAL(50, schedulerRunDue());
+
+    // One catch-up run, then back on the original 100 ms phase
+    TEST_ASSERT_EQUAL(1, runCount);
+    TEST_ASSERT_EQUAL(250, schedulerStats()->maxLateMs);
+}
+
+void test_scheduler_cancel_and_rearm(void) {
+    resetRecorders();
+    int job = schedulerAdd(timedJob, 100, 100);
+    schedulerAdd(jobA, 0, 500);
+
+    schedulerCancel(job);
+    TEST_ASSERT_FALSE(schedulerArmed(job));
+    TEST_ASSERT_EQUAL(500, schedulerRunDue());
+
+    schedulerArm(job, 20);
+    TEST_ASSERT_TRUE(schedulerArmed(job));
+    TEST_ASSERT_EQUAL(20, schedulerRunDue());
+
+    // Re-arming an armed job moves it rather than adding a second entry
+    schedulerArm(job, 300);
+    hal_native_advance_ms(300);
+    schedulerRunDue();
+    TEST_ASSERT_EQUAL(1, runCount);
+    TEST_ASSERT_EQUAL(0, runLen);
+}
+
+void test_scheduler_survives_millis_wrap(void) {
+    resetRecorders();
+    hal_native_set_micros((uint64_t)(UINT32_MAX - 250) * 1000);
+    schedulerAdd(timedJob, 100, 100);
+    schedulerAdd(jobA, 0, 1000);
+
+    // Runs at -150, -50, +50, +150 ... relative to the wrap
+    for (int i = 0; i < 5; i++) {
+        schedulerRun();
+    }
+    schedulerRunDue();
+    TEST_ASSERT_EQUAL(5, runCount);
+    TEST_ASSERT_EQUAL(0, runLen);
+    TEST_ASSERT_EQUAL(0, schedulerStats()->maxLateMs);
+    TEST_ASSERT_EQUAL((uint32_t)(UINT32_MAX - 250 + 500), runTimes[4]);
+}
+
+void test_scheduler_notify_wakes_early(void) {
+    resetRecorders();
+    schedulerAdd(timedJob, 1000, 1000);
+    schedulerOnNotify(onNotify);
+
+    hal_native_advance_ms(100);
+    hal_notify_from_isr();
+    schedulerRun();
+
+    // Woke immediately, handler ran, timer untouched
+    TEST_ASSERT_EQUAL(1, notifyCount);
+    TEST_ASSERT_EQUAL(100, hal_millis());
+    TEST_ASSERT_EQUAL(0, runCount);
+    TEST_ASSERT_EQUAL(1, schedulerStats()->notifications);
+    TEST_ASSERT_EQUAL(900, schedulerRunDue());
+}
+
+void test_scheduler_capacity(void) {
+    resetRecorders();
+    for (int i = 0; i < SCHEDULER_MAX_JOBS; i++) {
+        TEST_ASSERT_EQUAL(i, schedulerAdd(timedJob, 10 * (i + 1), 10 * (SCHEDULER_MAX_JOBS - i)));
+    }
+    TEST_ASSERT_EQUAL(SCHEDULER_NO_JOB, schedulerAdd(timedJob, 10, 10));
+
+    // All of them still fire, in deadline order
+    hal_native_advance_ms(10 * SCHEDULER_MAX_JOBS);
+    schedulerRunDue();
+    TEST_ASSERT_EQUAL(SCHEDULER_MAX_JOBS, runCount);
+    for (uint32_t i = 1; i < runCount; i++) {
+        TEST_ASSERT_TRUE(runTimes[i - 1] <= runTimes[i]);
+    }
+}
+
+// Test suite runner
+void SchedulerTests(void) {
+    RUN_TEST(test_scheduler_runs_in_deadline_order);
+    RUN_TEST(test_scheduler_returns_time_to_next_deadline);
+    RUN_TEST(test_scheduler_periodic_has_no_drift);
+    RUN_TEST(test_scheduler_late_job_skips_missed_periods);
+    RUN_TEST(test_scheduler_cancel_and_rearm);
+    RUN_TEST(test_scheduler_survives_millis_wrap);
+    RUN_TEST(test_scheduler_notify_wakes_early);
+    RUN_TEST(test_scheduler_capacity);
+}
@@ -0,0 +1,26 @@
+/*
+ * Scheduler Tests
+ * Tests for the deadline-ordered job scheduler on simulated time
+ */
+
+#ifndef TEST_SCHEDULER_H
+#define TEST_SCHEDULER_H
+
+#include <unity.h>
+#include "hal_native.h"
+#include "scheduler.h"
+
+// Test suite declarations
+void test_scheduler_runs_in_deadline_order(void);
+void test_scheduler_returns_time_to_next_deadline(void);
+void test_scheduler_periodic_has_no_drift(void);
+void test_scheduler_late_job_skips_missed_periods(void);
+void test_scheduler_cancel_and_rearm(void);
+void test_scheduler_survives_millis_wrap(void);
+void test_scheduler_notify_wakes_early(void);
+void test_scheduler_capacity(void);
+
+// Test suite runner
+void SchedulerTests(void);
+
+#endif // TEST_SCHEDULER_H
@@ -0,0 +1,115 @@
+/*
+ * Seqlock Tests
+ * Tests for ISR-shared pulse state snapshots and clock wraparound
+ */
+
+#include <thread>
+#include "test_seqlock.h"
+#include "test_helpers.h"
+
+// Writes by the racing "ISR" thread - the low words of count and edgeUs
+// both wrap partway through
+#define STRESS_WRITES 20000000ULL
+#define STRESS_FIRST_COUNT (0x100000000ULL - STRESS_WRITES / 2)
+
+// Same layout as the GPIO backend's shared state
+struct StressEdge {
+    uint64_t count;
+    uint64_t edgeUs;
+};
+
+// Every published edgeUs is derived from its count - a torn read breaks it
+static inline uint64_t stressEdgeUs(uint64_t count) {
+    return count * 83333 + 0xFFFFFFFFULL;
+}
+
+void test_seqlock_reader_never_sees_torn_value(void) {
+    static Seqlock<StressEdge> shared;
+    const uint64_t lastCount = STRESS_FIRST_COUNT + STRESS_WRITES - 1;
+    StressEdge first = { STRESS_FIRST_COUNT, stressEdgeUs(STRESS_FIRST_COUNT) };
+    seqlockWrite(&shared, first);
+
+    std::thread isr([&]() {
+        for (uint64_t count = STRESS_FIRST_COUNT + 1; count <= lastCount; count++) {
+            StressEdge edge = { count, stressEdgeUs(count) };
+            seqlockWrite(&shared, edge);
+        }
+    });
+
+    uint64_t reads = 0;
+    uint64_t torn = 0;
+    uint64_t backwards = 0;
+    uint64_t previous = STRESS_FIRST_COUNT;
+    StressEdge edge;
+    do {
+        edge = seqlockRead(&shared);
+        reads++;
+        if (edge.edgeUs != stressEdgeUs(edge.count)) {
+            torn++;
+        }
+        if (edge.count < previous || edge.count > lastCount) {
+            backwards++;
+        }
+        previous = edge.count;
+    } while (edge.count != lastCount);
+    isr.join();
+
+    TEST_ASSERT_EQUAL(0, torn);
+    TEST_ASSERT_EQUAL(0, backwards);
+    TEST_ASSERT_TRUE(reads > 0);
+}
+
+void test_seqlock_sequence_wraps(void) {
+    Seqlock<StressEdge> shared = {};
+    shared.seq = 0xFFFFFFFEUL;
+
+    StressEdge edge = { 1, stressEdgeUs(1) };
+    seqlockWrite(&shared, edge);
+    TEST_ASSERT_EQUAL(0, shared.seq);
+    TEST_ASSERT_TRUE(seqlockRead(&shared).count == 1);
+
+    edge.count = 2;
+    seqlockWrite(&shared, edge);
+    TEST_ASSERT_EQUAL(2, shared.seq);
+    TEST_ASSERT_TRUE(seqlockRead(&shared).count == 2);
+}
+
+/**
+ * Boot startUs before a clock wrap, flow at 12 pulses/s across it with
+ * backend, then stop - rate, ledger and idle detection must not notice
+ */
+static void flowAcrossWrap(uint64_t startUs, uint8_t backend) {
+    uint8_t battery = 100;
+    hal_native_set_micros(startUs);
+    setupFlowSensor();
+    TEST_ASSERT_EQUAL(backend, selectPulseBackend(backend));
+    scheduleFlowMeter(&battery);
+
+    simulateScheduledFlow(60000, 83333);
+    TEST_ASSERT_UINT32_WITHIN(100, 96000, flowRateMlMin);
+    TEST_ASSERT_UINT32_WITHIN(12, pulseSourceCount(), totalPulses);   // At most one window behind
+
+    simulateScheduledFlow(FLOW_IDLE_TIMEOUT + 2000, 0);
+    TEST_ASSERT_EQUAL(0, flowRateMlMin);
+    TEST_ASSERT_TRUE(flowMeterIdle());
+    TEST_ASSERT_EQUAL_UINT64(720, totalPulses);
+}
+
+void test_flow_across_micros_wrap(void) {
+    // hal_micros() wraps after 71 minutes
+    flowAcrossWrap(0x100000000ULL - 30000000, PULSE_BACKEND_GPIO);
+}
+
+void test_flow_across_millis_wrap(void) {
+    // hal_millis() wraps after 49.7 days - the scheduler and every
+    // interval check run on it
+    flowAcrossWrap(0x100000000ULL * 1000 - 30000000, PULSE_BACKEND_PCNT);
+}
+
+// Test suite runner
+void SeqlockTests(void) {
+    RUN_TEST(test_seqlock_reader_never_sees_torn_value);
+    RUN_TEST(test_seqlock_sequence_wraps);
+    RUN_TEST(test_flow_across_micros_wrap);
+    RUN_TEST(test_flow_across_millis_wrap);
+}
@@ -0,0 +1,22 @@
+/*
+ * Seqlock Tests
+ * Tests for ISR-shared pulse state snapshots and clock wraparound
+ */
+
+#ifndef TEST_SEQLOCK_H
+#define TEST_SEQLOCK_H
+
+#include <unity.h>
+#include "hal_native.h"
+#include "seqlock.h"
+
+// Test suite declarations
+void test_seqlock_reader_never_sees_torn_value(void);
+void test_seqlock_sequence_wraps(void);
+void test_flow_across_micros_wrap(void);
+void test_flow_across_millis_wrap(void);
+
+// Test suite runner
+void SeqlockTests(void);
+
+#endif // TEST_SEQLOCK_H
@@ -0,0 +1,355 @@
+/*
+ * Usage Event Tests
+ * Tests for draw segmentation, the decision tree classifier and event reports
+ */
+
+#include "test_usage_events.h"
+#include "test_helpers.h"
+#include "scheduler.h"
+#include "report_engine.h"
+#include "metering_cluster.h"
+#include "config_traits.h"
+
+#define TEST_WINDOW_MS 1000
+
+/**
+ * One pulse every pulseWindows flow windows for windows windows at rate
+ * (the rate follows from the second pulse). Returns true if the draw ended
+ */
+static bool flow(UsageSegmenter* segmenter, uint64_t* ledger, uint32_t* nowMs, uint32_t windows,
+                 uint32_t pulseWindows, uint32_t rateMlMin, UsageEvent* event) {
+    bool ended = false;
+    for (uint32_t i = 0; i < windows; i++) {
+        *nowMs += TEST_WINDOW_MS;
+        if (i % pulseWindows == 0) {
+            (*ledger)++;
+        }
+        uint32_t rate = i >= pulseWindows ? rateMlMin : 0;
+        ended |= usageSegmenterUpdate(segmenter, *ledger, rate, false, *nowMs, *nowMs / 1000, event);
+    }
+    return ended;
+}
+
+// The estimator gives up FLOW_IDLE_TIMEOUT after the last pulse
+static bool stop(UsageSegmenter* segmenter, uint64_t ledger, uint32_t* nowMs, UsageEvent* event) {
+    *nowMs += FLOW_IDLE_TIMEOUT;
+    return usageSegmenterUpdate(segmenter, ledger, 0, true, *nowMs, *nowMs / 1000, event);
+}
+
+static UsageEvent shape(uint32_t durationS, uint32_t volumeMl, uint32_t peakMlMin) {
+    UsageEvent event = {};
+    event.durationS = durationS;
+    event.volumeMl = volumeMl;
+    event.peakMlMin = peakMlMin;
+    return event;
+}
+
+void test_usage_segments_draw(void) {
+    UsageSegmenter segmenter;
+    uint64_t ledger = 100;
+    uint32_t nowMs = 50000;
+    usageSegmenterReset(&segmenter, ledger);
+
+    // 60 pulses, one a second, and a pause shorter than the idle timeout
+    // does not split the draw
+    UsageEvent event;
+    TEST_ASSERT_FALSE(flow(&segmenter, &ledger, &nowMs, 40, 1, 8000, &event));
+    TEST_ASSERT_FALSE(flow(&segmenter, &ledger, &nowMs, 10, 5, 1000, &event));
+    TEST_ASSERT_FALSE(flow(&segmenter, &ledger, &nowMs, 18, 1, 6000, &event));
+    TEST_ASSERT_TRUE(segmenter.drawing);
+
+    // Ends when the estimator goes idle
+    TEST_ASSERT_TRUE(stop(&segmenter, ledger, &nowMs, &event));
+    TEST_ASSERT_FALSE(segmenter.drawing);
+    TEST_ASSERT_EQUAL_UINT32(51, event.startTime);
+    TEST_ASSERT_EQUAL_UINT32(67, event.durationS);
+    TEST_ASSERT_EQUAL_UINT32(pulsesToMillilitres(60), event.volumeMl);
+    TEST_ASSERT_EQUAL_UINT32(8000, event.peakMlMin);
+
+    // Idle windows after it do nothing
+    TEST_ASSERT_FALSE(stop(&segmenter, ledger, &nowMs, &event));
+}
+
+void test_usage_small_draw_ignored(void) {
+    UsageSegmenter segmenter;
+    uint64_t ledger = 0;
+    uint32_t nowMs = 0;
+    usageSegmenterReset(&segmenter, ledger);
+
+    // A single pulse, under USAGE_MIN_VOLUME, is not an event
+    UsageEvent event;
+    TEST_ASSERT_TRUE(USAGE_MIN_PULSES > 1);
+    TEST_ASSERT_FALSE(flow(&segmenter, &ledger, &nowMs, 1, 1, 0, &event));
+    TEST_ASSERT_FALSE(stop(&segmenter, ledger, &nowMs, &event));
+    TEST_ASSERT_FALSE(segmenter.drawing);
+
+    // A slow draw keeps its first pulse, before the rate is known
+    TEST_ASSERT_FALSE(flow(&segmenter, &ledger, &nowMs, 8, 4, 2000, &event));
+    TEST_ASSERT_TRUE(stop(&segmenter, ledger, &nowMs, &event));
+    TEST_ASSERT_EQUAL_UINT32(pulsesToMillilitres(2), event.volumeMl);
+    TEST_ASSERT_EQUAL_UINT32(4, event.durationS);
+    TEST_ASSERT_EQUAL_UINT32(2000, event.peakMlMin);
+}
+
+void test_usage_classifies_household_draws(void) {
+    const UsageTree* tree = usageTree();
+    struct Case { UsageEvent event; uint8_t usageClass; };
+    const Case cases[] = {
+        { shape(20, 1000, 4000), USAGE_TAP },            // Washing hands
+        { shape(60, 2000, 7000), USAGE_TAP },            // Filling a pot at full flow
+        { shape(45, 6000, 8500), USAGE_TOILET },         // Cistern refill
+        { shape(120, 30000, 15000), USAGE_OTHER },       // Filling a bucket
+        { shape(480, 72000, 9500), USAGE_SHOWER },
+        { shape(600, 18000, 2200), USAGE_APPLIANCE },    // Washing machine fill
+        { shape(1200, 300000, 16000), USAGE_GARDEN },    // Hose
+        { shape(3600, 540000, 9500), USAGE_GARDEN },     // Sprinkler for an hour
+    };
+    for (const Case& c : cases) {
+        TEST_ASSERT_EQUAL(c.usageClass, usageClassify(tree, &c.event));
+    }
+
+    // Mean rate: volume over duration, the peak for a draw under a second
+    UsageEvent event = shape(600, 18000, 2200);
+    TEST_ASSERT_EQUAL_UINT32(1800, usageFeature(&event, USAGE_FEATURE_MEAN));
+    event = shape(0, 250, 6000);
+    TEST_ASSERT_EQUAL_UINT32(6000, usageFeature(&event, USAGE_FEATURE_MEAN));
+}
+
+void test_usage_tree_stored_in_nvs(void) {
+    // Everything long is a shower
+    UsageTree tree = {};
+    tree.count = 3;
+    tree.nodes[0] = { USAGE_FEATURE_DURATION, 1, 2, 150 };
+    tree.nodes[1] = { USAGE_LEAF, 0, 0, USAGE_TAP };
+    tree.nodes[2] = { USAGE_LEAF, 0, 0, USAGE_SHOWER };
+    TEST_ASSERT_TRUE(usageStoreTree(&tree));
+    UsageEvent hose = shape(1200, 300000, 16000);
+    TEST_ASSERT_EQUAL(USAGE_SHOWER, usageClassify(usageTree(), &hose));
+
+    // Loaded at boot
+    resetUsageEvents();
+    TEST_ASSERT_EQUAL(USAGE_GARDEN, usageClassify(usageTree(), &hose));
+    usageBegin();
+    TEST_ASSERT_EQUAL(3, usageTree()->count);
+    TEST_ASSERT_EQUAL(USAGE_SHOWER, usageClassify(usageTree(), &hose));
+
+    // Trees that could loop, run off the end or name no class are rejected
+    UsageTree bad = tree;
+    bad.nodes[0].left = 0;
+    TEST_ASSERT_FALSE(usageStoreTree(&bad));
+    bad = tree;
+    bad.nodes[0].right = 3;
+    TEST_ASSERT_FALSE(usageStoreTree(&bad));
+    bad = tree;
+    bad.nodes[2].threshold = USAGE_CLASSES;
+    TEST_ASSERT_FALSE(usageStoreTree(&bad));
+    bad = tree;
+    bad.nodes[0].feature = USAGE_FEATURES;
+    TEST_ASSERT_FALSE(usageStoreTree(&bad));
+    TEST_ASSERT_EQUAL(3, usageTree()->count);
+
+    // A corrupt NVS copy falls back to the built-in tree
+    hal_nvs_begin(EEPROM_NAMESPACE, false);
+    hal_nvs_put_u64("usage2", 0);
+    hal_nvs_end();
+    usageBegin();
+    TEST_ASSERT_EQUAL(USAGE_GARDEN, usageClassify(usageTree(), &hose));
+
+    // As does a removed one
+    TEST_ASSERT_TRUE(usageStoreTree(&tree));
+    usageRestoreDefault();
+    usageBegin();
+    TEST_ASSERT_EQUAL(USAGE_GARDEN, usageClassify(usageTree(), &hose));
+}
+
+void test_usage_ring_keeps_newest(void) {
+    uint64_t ledgers[FLOW_CHANNELS] = {};
+    usageStart(ledgers);
+    TEST_ASSERT_NULL(usageEvent(0));
+
+    uint64_t ledger = 0;
+    uint32_t nowMs = 0;
+    for (uint32_t i = 0; i < USAGE_EVENT_RING + 3; i++) {
+        nowMs += TEST_WINDOW_MS;
+        ledger += USAGE_MIN_PULSES + i;
+        TEST_ASSERT_NULL(usageUpdate(0, ledger, 4000, false, nowMs));
+        nowMs += FLOW_IDLE_TIMEOUT;
+        const UsageEvent* event = usageUpdate(0, ledger, 0, true, nowMs);
+        TEST_ASSERT_NOT_NULL(event);
+        TEST_ASSERT_EQUAL_UINT32(i + 1, event->seq);
+        TEST_ASSERT_EQUAL_UINT32(pulsesToMillilitres(USAGE_MIN_PULSES + i), event->volumeMl);
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(USAGE_EVENT_RING + 3, usageEventCount());
+    TEST_ASSERT_EQUAL_UINT32(USAGE_EVENT_RING + 3, usageEvent(0)->seq);
+    TEST_ASSERT_EQUAL_UINT32(4, usageEvent(USAGE_EVENT_RING - 1)->seq);
+    TEST_ASSERT_NULL(usageEvent(USAGE_EVENT_RING));
+}
+
+static void bootConnected() {
+    static uint8_t battery = 100;
+    loadTotalVolume();
+    setupFlowSensor();
+    scheduleFlowMeter(&battery);
+    zigbeeConnected = true;
+    requestFlowReport();
+    simulateScheduledFlow(1000, 0);
+    hal_native_radio_clear();
+}
+
+static size_t usageFrames() {
+    size_t frames = 0;
+    for (size_t i = 0; i < hal_native_radio_frame_count(); i++) {
+        frames += hal_native_radio_frame(i)->clusterId == USAGE_CLUSTER_ID;
+    }
+    return frames;
+}
+
+static const NativeRadioFrame* usageFrame(size_t n) {
+    for (size_t i = 0; i < hal_native_radio_frame_count(); i++) {
+        const NativeRadioFrame* frame = hal_native_radio_frame(i);
+        if (frame->clusterId == USAGE_CLUSTER_ID && n-- == 0) {
+            return frame;
+        }
+    }
+    return nullptr;
+}
+
+void test_usage_event_reported_in_one_frame(void) {
+    bootConnected();
+
+    // A cistern refill: 6 L/min for 40 s, then the flow stops
+    simulateScheduledFlow(40000, 1333333);
+    TEST_ASSERT_EQUAL(0, usageFrames());
+    simulateScheduledFlow(FLOW_IDLE_TIMEOUT + 2000, 0);
+    TEST_ASSERT_EQUAL(1, usageEventCount());
+    const UsageEvent* event = usageEvent(0);
+    TEST_ASSERT_EQUAL(USAGE_TOILET, event->usageClass);
+    TEST_ASSERT_EQUAL_UINT32(pulsesToMillilitres(totalPulses), event->volumeMl);
+
+    // The whole event in one frame, on the flow endpoint
+    TEST_ASSERT_EQUAL(1, usageFrames());
+    const NativeRadioFrame* frame = usageFrame(0);
+    TEST_ASSERT_EQUAL(FLOW_ENDPOINT, frame->endpoint);
+    TEST_ASSERT_EQUAL(USAGE_ATTRIBUTES, frame->count);
+    TEST_ASSERT_EQUAL(1, frameValue(frame, USAGE_SEQ_ATTR));
+    TEST_ASSERT_EQUAL(0, frameValue(frame, USAGE_CHANNEL_ATTR));
+    TEST_ASSERT_EQUAL(USAGE_TOILET, frameValue(frame, USAGE_CLASS_ATTR));
+    TEST_ASSERT_EQUAL(event->startTime, frameValue(frame, USAGE_START_ATTR));
+    TEST_ASSERT_EQUAL(event->durationS, frameValue(frame, USAGE_DURATION_ATTR));
+    TEST_ASSERT_EQUAL(event->volumeMl, frameValue(frame, USAGE_VOLUME_ATTR));
+    TEST_ASSERT_EQUAL(event->peakMlMin, frameValue(frame, USAGE_PEAK_ATTR));
+
+    // Readable too, and not repeated by a full report
+    HalAttribute attr;
+    TEST_ASSERT_TRUE(hal_native_radio_read_attribute(FLOW_ENDPOINT, USAGE_CLUSTER_ID,
+                                                     USAGE_SEQ_ATTR, &attr));
+    TEST_ASSERT_EQUAL(1, attr.value[0]);
+    requestFlowReport();
+    simulateScheduledFlow(1000, 0);
+    TEST_ASSERT_EQUAL(1, usageFrames());
+}
+
+void test_usage_events_wait_for_radio(void) {
+    bootConnected();
+    zigbeeConnected = false;
+
+    // Two draws while the link is down
+    simulateScheduledFlow(20000, 1000000);
+    simulateScheduledFlow(FLOW_IDLE_TIMEOUT + 2000, 0);
+    simulateScheduledFlow(10000, 2000000);
+    simulateScheduledFlow(FLOW_IDLE_TIMEOUT + 2000, 0);
+    TEST_ASSERT_EQUAL(2, usageEventCount());
+    TEST_ASSERT_EQUAL(0, usageFrames());
+
+    // Back on the network: one frame each, oldest first
+    zigbeeConnected = true;
+    requestFlowReport();
+    simulateScheduledFlow(1000, 0);
+    TEST_ASSERT_EQUAL(2, usageFrames());
+    TEST_ASSERT_EQUAL(1, frameValue(usageFrame(0), USAGE_SEQ_ATTR));
+    TEST_ASSERT_EQUAL(2, frameValue(usageFrame(1), USAGE_SEQ_ATTR));
+    TEST_ASSERT_FALSE(usageReportNext());
+}
+
+void test_usage_one_event_per_report_pass(void) {
+    bootConnected();
+    zigbeeConnected = false;
+
+    // Three draws while the link is down
+    for (uint8_t i = 0; i < 3; i++) {
+        simulateScheduledFlow(20000, 1000000);
+        simulateScheduledFlow(FLOW_IDLE_TIMEOUT + 2000, 0);
+    }
+    TEST_ASSERT_EQUAL(3, usageEventCount());
+
+    // Back on the network while water runs: flow and report jobs both
+    // active, never more than one event frame per job run
+    zigbeeConnected = true;
+    requestFlowReport();
+    startScheduledPulses(1000000);
+    size_t before = usageFrames();
+    for (uint32_t runs = 0; runs < 200; runs++) {
+        schedulerRun();
+        size_t after = usageFrames();
+        TEST_ASSERT_TRUE(after - before <= 1);
+        before = after;
+    }
+    TEST_ASSERT_EQUAL(3, usageFrames());
+    for (uint8_t i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL(i + 1, frameValue(usageFrame(i), USAGE_SEQ_ATTR));
+    }
+}
+
+void test_usage_draw_holds_rate_reports(void) {
+    bootConnected();
+    uint64_t startUs = hal_native_now_us();
+
+    // An 8 minute shower at 9 L/min: the rate changes as the flow settles
+    // and wobbles, but only the Metering deadlines report while it runs
+    simulateScheduledFlow(20000, 1000000);
+    simulateScheduledFlow(460000, 888889);
+    TEST_ASSERT_TRUE(usageDrawing(0));
+    size_t metering = 0;
+    for (size_t i = 0; i < hal_native_radio_frame_count(); i++) {
+        const NativeRadioFrame* frame = hal_native_radio_frame(i);
+        metering += frame->endpoint == FLOW_ENDPOINT && frame->clusterId == METERING_CLUSTER_ID;
+    }
+    TEST_ASSERT_TRUE(metering <= 480000 / FLOW_REPORT_INTERVAL_MS + 1);
+    TEST_ASSERT_EQUAL(0, usageFrames());
+
+    // The event and the zero rate as it ends, the whole volume reported -
+    // by the next deadline at the latest if the other channels' endpoints
+    // spent the airtime budget
+    simulateScheduledFlow(FLOW_IDLE_TIMEOUT + REPORT_MIN_INTERVAL * 1000UL + 2000 +
+                          (FLOW_CHANNELS > 1 ? FLOW_REPORT_INTERVAL_MS : 0), 0);
+    TEST_ASSERT_FALSE(usageDrawing(0));
+    TEST_ASSERT_EQUAL(1, usageFrames());
+    const NativeRadioFrame* last = nullptr;
+    uint64_t volumeMl = 0;
+    for (size_t i = 0; i < hal_native_radio_frame_count(); i++) {
+        const NativeRadioFrame* frame = hal_native_radio_frame(i);
+        if (frame->endpoint == FLOW_ENDPOINT && frame->clusterId == METERING_CLUSTER_ID) {
+            last = frame;
+            volumeMl = frameValue(frame, METERING_SUMMATION_ATTR) != UINT64_MAX
+                           ? frameValue(frame, METERING_SUMMATION_ATTR) : volumeMl;
+        }
+    }
+    TEST_ASSERT_NOT_NULL(last);
+    TEST_ASSERT_TRUE(last->timeUs > startUs + 480000000ULL);
+    TEST_ASSERT_EQUAL(0, frameValue(last, METERING_DEMAND_ATTR));
+    TEST_ASSERT_EQUAL(totalVolumeMl(), volumeMl);
+}
+
+// Test suite runner
+void UsageEventsTests(void) {
+    RUN_TEST(test_usage_segments_draw);
+    RUN_TEST(test_usage_small_draw_ignored);
+    RUN_TEST(test_usage_classifies_household_draws);
+    RUN_TEST(test_usage_tree_stored_in_nvs);
+    RUN_TEST(test_usage_ring_keeps_newest);
+    RUN_TEST(test_usage_event_reported_in_one_frame);
+    RUN_TEST(test_usage_events_wait_for_radio);
+    RUN_TEST(test_usage_one_event_per_report_pass);
+    RUN_TEST(test_usage_draw_holds_rate_reports);
+}
@@ -0,0 +1,26 @@
+/*
+ * Usage Event Tests
+ * Tests for draw segmentation, the decision tree classifier and event reports
+ */
+
+#ifndef TEST_USAGE_EVENTS_H
+#define TEST_USAGE_EVENTS_H
+
+#include <unity.h>
+#include "usage_events.h"
+
+// Test suite declarations
+void test_usage_segments_draw(void);
+void test_usage_small_draw_ignored(void);
+void test_usage_classifies_household_draws(void);
+void test_usage_tree_stored_in_nvs(void);
+void test_usage_ring_keeps_newest(void);
+void test_usage_event_reported_in_one_frame(void);
+void test_usage_events_wait_for_radio(void);
+void test_usage_one_event_per_report_pass(void);
+void test_usage_draw_holds_rate_reports(void);
+
+// Test suite runner
+void UsageEventsTests(void);
+
+#endif // TEST_USAGE_EVENTS_H
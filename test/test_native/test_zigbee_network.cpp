@@ -0,0 +1,108 @@
+/*
+ * Zigbee Network Tests
+ * Tests for the background join/rejoin state machine
+ */
+
+#include "test_zigbee_network.h"
+#include "test_helpers.h"
+
+static uint8_t battery = 100;
+
+// Same order as setup() in main.cpp
+static void bootMeter(bool storedNetwork, uint32_t failAttempts) {
+    NativeNetworkConfig network;
+    network.storedNetwork = storedNetwork;
+    network.failAttempts = failAttempts;
+    hal_native_radio_set_network(&network);
+
+    setupFlowSensor();
+    loadTotalVolume();
+    scheduleFlowMeter(&battery);
+    zigbeeNetworkBegin();
+}
+
+void test_zigbee_warm_boot_under_one_second(void) {
+    bootMeter(true, 0);
+
+    // Water already running at boot
+    simulateScheduledFlow(1000, 83333);
+
+    TEST_ASSERT_EQUAL(ZB_STATE_CONNECTED, zigbeeJoinState());
+    TEST_ASSERT_EQUAL(1, hal_native_radio_stats()->rejoins);
+    TEST_ASSERT_EQUAL(0, hal_native_radio_stats()->joins);
+    TEST_ASSERT_TRUE(firstPulseMs < 100);
+    TEST_ASSERT_TRUE(firstReportMs < 1000);
+    TEST_ASSERT_TRUE(hal_native_radio_frame_count() > 0);
+}
+
+void test_zigbee_cold_boot_meters_while_joining(void) {
+    bootMeter(false, 0);
+
+    simulateScheduledFlow(2000, 83333);
+    TEST_ASSERT_EQUAL(ZB_STATE_JOINING, zigbeeJoinState());
+    TEST_ASSERT_FALSE(zigbeeConnected);
+    TEST_ASSERT_TRUE(totalPulses >= 12);
+    TEST_ASSERT_UINT32_WITHIN(100, 96000, flowRateMlMin);
+    TEST_ASSERT_EQUAL(0, hal_native_radio_frame_count());
+
+    // Full join completes in the background; first report follows at once
+    simulateScheduledFlow(3000, 83333);
+    TEST_ASSERT_TRUE(zigbeeConnected);
+    TEST_ASSERT_EQUAL(1, hal_native_radio_stats()->joins);
+    TEST_ASSERT_TRUE(firstReportMs - 4000 <= ZIGBEE_POLL_INTERVAL);
+}
+
+void test_zigbee_backoff_doubles_to_cap(void) {
+    TEST_ASSERT_EQUAL(ZIGBEE_BACKOFF_MIN, zigbeeBackoffMs(1));
+    TEST_ASSERT_EQUAL(ZIGBEE_BACKOFF_MIN * 2, zigbeeBackoffMs(2));
+    TEST_ASSERT_EQUAL(ZIGBEE_BACKOFF_MIN * 4, zigbeeBackoffMs(3));
+    TEST_ASSERT_EQUAL(ZIGBEE_BACKOFF_MAX, zigbeeBackoffMs(20));
+    TEST_ASSERT_EQUAL(ZIGBEE_BACKOFF_MAX, zigbeeBackoffMs(255));
+}
+
+void test_zigbee_retries_with_backoff(void) {
+    bootMeter(false, 2);
+
+    // Two failed 4 s joins with 1 s and 2 s (+25% jitter) backoff, then success
+    simulateScheduledFlow(4000 + 1250 + 4000 + 2500 + 4000 + 2 * ZIGBEE_POLL_INTERVAL, 0);
+    TEST_ASSERT_EQUAL(3, hal_native_radio_stats()->joins);
+    TEST_ASSERT_TRUE(zigbeeConnected);
+
+    // The main task only woke to poll the attempts, not while backing off
+    TEST_ASSERT_TRUE(schedulerStats()->wakeups < 3 * 4000 / ZIGBEE_POLL_INTERVAL + 20);
+}
+
+void test_zigbee_failed_rejoins_fall_back_to_join(void) {
+    bootMeter(true, ZIGBEE_REJOIN_ATTEMPTS);
+
+    simulateScheduledFlow(30000, 0);
+    TEST_ASSERT_EQUAL(ZIGBEE_REJOIN_ATTEMPTS, hal_native_radio_stats()->rejoins);
+    TEST_ASSERT_EQUAL(1, hal_native_radio_stats()->joins);
+    TEST_ASSERT_TRUE(zigbeeConnected);
+}
+
+void test_zigbee_rejoins_after_network_lost(void) {
+    bootMeter(true, 0);
+    simulateScheduledFlow(1000, 0);
+    TEST_ASSERT_TRUE(zigbeeConnected);
+    hal_native_radio_clear();
+
+    hal_native_radio_leave();
+    zigbeeNetworkLost();
+    TEST_ASSERT_FALSE(zigbeeConnected);
+
+    simulateScheduledFlow(1000, 0);
+    TEST_ASSERT_TRUE(zigbeeConnected);
+    TEST_ASSERT_EQUAL(2, hal_native_radio_stats()->rejoins);
+    TEST_ASSERT_TRUE(hal_native_radio_frame_count() > 0);   // Fresh report after rejoin
+}
+
+// Test suite runner
+void ZigbeeNetworkTests(void) {
+    RUN_TEST(test_zigbee_warm_boot_under_one_second);
+    RUN_TEST(test_zigbee_cold_boot_meters_while_joining);
+    RUN_TEST(test_zigbee_backoff_doubles_to_cap);
+    RUN_TEST(test_zigbee_retries_with_backoff);
+    RUN_TEST(test_zigbee_failed_rejoins_fall_back_to_join);
+    RUN_TEST(test_zigbee_rejoins_after_network_lost);
+}
@@ -0,0 +1,24 @@
+/*
+ * Zigbee Network Tests
+ * Tests for the background join/rejoin state machine
+ */
+
+#ifndef TEST_ZIGBEE_NETWORK_H
+#define TEST_ZIGBEE_NETWORK_H
+
+#include <unity.h>
+#include "hal_native.h"
+#include "zigbee_network.h"
+
+// Test suite declarations
+void test_zigbee_warm_boot_under_one_second(void);
+void test_zigbee_cold_boot_meters_while_joining(void);
+void test_zigbee_backoff_doubles_to_cap(void);
+void test_zigbee_retries_with_backoff(void);
+void test_zigbee_failed_rejoins_fall_back_to_join(void);
+void test_zigbee_rejoins_after_network_lost(void);
+
+// Test suite runner
+void ZigbeeNetworkTests(void);
+
+#endif // TEST_ZIGBEE_NETWORK_H
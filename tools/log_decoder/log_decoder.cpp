@@ -0,0 +1,88 @@
+/*
+ * Water Flow Meter - Binary Log Decoder
+ * Turns a serial capture of LOG_BINARY_OUTPUT frames back into text
+ *
+ * Build and run on the host (must be built from the same log_messages.h
+ * as the firmware that produced the capture):
+ *   pio run -e log_decoder
+ *   .pio/build/log_decoder/program capture.bin
+ *   pio device monitor --filter direct --quiet | .pio/build/log_decoder/program
+ *
+ * Bytes that are not part of a valid frame (boot ROM output, line noise)
+ * are skipped. Each record is printed as "<seconds>.<ms> <level> <message>".
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "deferred_log.h"
+
+static const char levelNames[] = "-EWID";
+
+/**
+ * Decode every complete frame in buf, returns the bytes consumed
+ * (an incomplete frame at the end is kept for the next read)
+ */
+static size_t decodeBuffer(const uint8_t* buf, size_t len, bool flush,
+                           uint32_t* frames, uint32_t* skipped) {
+    size_t pos = 0;
+    LogRecord record;
+    char line[LOG_LINE_MAX];
+
+    while (pos < len) {
+        size_t frame = logDecodeFrame(buf + pos, len - pos, &record);
+        if (frame == 0) {
+            // Could be the start of a frame that has not fully arrived yet
+            if (!flush && buf[pos] == LOG_FRAME_SYNC && len - pos < LOG_FRAME_MAX) {
+                break;
+            }
+            pos++;
+            (*skipped)++;
+            continue;
+        }
+
+        logFormat(&record, line, sizeof(line));
+        uint8_t level = logMessageLevel(record.id);
+        printf("%6lu.%03lu %c %s\n",
+               (unsigned long)(record.timestampMs / 1000), (unsigned long)(record.timestampMs % 1000),
+               level < sizeof(levelNames) - 1 ? levelNames[level] : '?', line);
+        (*frames)++;
+        pos += frame;
+    }
+    return pos;
+}
+
+int main(int argc, char** argv) {
+    FILE* in = stdin;
+    if (argc > 2 || (argc == 2 && strcmp(argv[1], "-h") == 0)) {
+        fprintf(stderr, "usage: %s [capture.bin]\n", argv[0]);
+        return 2;
+    }
+    if (argc == 2 && !(in = fopen(argv[1], "rb"))) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    uint8_t buf[4096];
+    size_t len = 0;
+    uint32_t frames = 0;
+    uint32_t skipped = 0;
+
+    for (;;) {
+        size_t n = fread(buf + len, 1, sizeof(buf) - len, in);
+        len += n;
+        size_t used = decodeBuffer(buf, len, n == 0, &frames, &skipped);
+        memmove(buf, buf + used, len - used);
+        len -= used;
+        fflush(stdout);
+        if (n == 0) {
+            break;
+        }
+    }
+
+    fprintf(stderr, "%lu records, %lu bytes skipped\n",
+            (unsigned long)frames, (unsigned long)skipped);
+    if (in != stdin) {
+        fclose(in);
+    }
+    return 0;
+}
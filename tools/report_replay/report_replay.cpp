@@ -0,0 +1,149 @@
+/*
+ * Water Flow Meter - Report Traffic Replay
+ * Replays a recorded usage trace through the metering core and reports
+ * the Zigbee report traffic it produces
+ *
+ * Build and run on the host:
+ *   pio run -e report_replay
+ *   .pio/build/report_replay/program tools/report_replay/household_day.csv
+ *
+ * A trace is text, one flow change per line: "<seconds>,<L/min>" - the
+ * flow holds from that time until the next line, and the replay ends at
+ * the last line. Blank lines and lines starting with '#' are skipped.
+ * The meter runs on the scheduler exactly as on the device, joined at
+ * time 0, with a pulse at every edge the flow implies. Prints frames and
+ * bytes on air (HAL_RADIO_FRAME_OVERHEAD per frame) for each hour.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "hal_native.h"
+#include "flow_meter.h"
+#include "scheduler.h"
+#include "report_engine.h"
+
+struct TraceStep {
+    uint64_t startUs;
+    uint64_t pulsePeriodUs;  // 0 = no flow
+};
+
+static std::vector<TraceStep> trace;
+static size_t step = 0;
+static uint64_t nextPulseUs = 0;
+
+static bool loadTrace(FILE* in) {
+    char line[128];
+    unsigned lineNo = 0;
+    while (fgets(line, sizeof(line), in)) {
+        lineNo++;
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') {
+            continue;
+        }
+        double seconds;
+        double lpm;
+        if (sscanf(line, "%lf,%lf", &seconds, &lpm) != 2 || seconds < 0 || lpm < 0 ||
+            (!trace.empty() && seconds * 1e6 < trace.back().startUs)) {
+            fprintf(stderr, "line %u: expected increasing \"<seconds>,<L/min>\"\n", lineNo);
+            return false;
+        }
+        TraceStep s;
+        s.startUs = (uint64_t)(seconds * 1e6);
+        s.pulsePeriodUs = lpm > 0 ? (uint64_t)(60e6 / (lpm * CALIBRATION_FACTOR)) : 0;
+        trace.push_back(s);
+    }
+    return trace.size() >= 2;
+}
+
+// First pulse of the step at or after fromUs
+static void enterStep(size_t index, uint64_t fromUs) {
+    step = index;
+    nextPulseUs = trace[step].pulsePeriodUs ? fromUs + trace[step].pulsePeriodUs : UINT64_MAX;
+}
+
+// Scheduler sleep hook: fire the pulses the trace puts before deadlineUs
+static void firePulses(uint64_t deadlineUs) {
+    while (!hal_native_notify_pending()) {
+        uint64_t stepEndUs = step + 1 < trace.size() ? trace[step + 1].startUs : UINT64_MAX;
+        if (stepEndUs <= deadlineUs && stepEndUs <= nextPulseUs) {
+            enterStep(step + 1, stepEndUs);
+            continue;
+        }
+        if (nextPulseUs > deadlineUs) {
+            break;
+        }
+        hal_native_set_micros(nextPulseUs);
+        hal_native_pulse();
+        nextPulseUs += trace[step].pulsePeriodUs;
+    }
+}
+
+int main(int argc, char** argv) {
+    FILE* in = stdin;
+    if (argc > 2 || (argc == 2 && argv[1][0] == '-' && argv[1][1] == 'h')) {
+        fprintf(stderr, "usage: %s [trace.csv]\n", argv[0]);
+        return 2;
+    }
+    if (argc == 2 && !(in = fopen(argv[1], "r"))) {
+        perror(argv[1]);
+        return 1;
+    }
+    bool loaded = loadTrace(in);
+    if (in != stdin) {
+        fclose(in);
+    }
+    if (!loaded) {
+        fprintf(stderr, "trace needs at least two lines\n");
+        return 1;
+    }
+
+    static uint8_t battery = 100;
+    hal_native_reset();
+    hal_native_radio_set_capture(false);
+    resetFlowMeter();
+    schedulerReset();
+    loadTotalVolume();
+    setupFlowSensor();
+    hal_native_set_micros(trace[0].startUs);
+    enterStep(0, trace[0].startUs);
+    hal_native_set_wait_hook(firePulses);
+    scheduleFlowMeter(&battery);
+    zigbeeConnected = true;
+    requestFlowReport();
+
+    const NativeRadioStats* radio = hal_native_radio_stats();
+    uint64_t endUs = trace.back().startUs;
+    uint64_t hourStartUs = trace[0].startUs;
+    uint32_t hourFrames = 0;
+    uint64_t hourBytes = 0;
+    uint64_t hourPulses = 0;
+
+    printf("%6s %8s %10s %10s\n", "hour", "frames", "bytes", "litres");
+    while (hal_native_now_us() < endUs) {
+        schedulerRun();
+        while (hal_native_now_us() >= hourStartUs + 3600000000ULL || hal_native_now_us() >= endUs) {
+            printf("%6llu %8lu %10llu %10.1f\n",
+                   (unsigned long long)(hourStartUs / 3600000000ULL),
+                   (unsigned long)(radio->frames - hourFrames),
+                   (unsigned long long)(radio->bytesOnAir - hourBytes),
+                   (double)pulsesToMicrolitres(totalPulses - hourPulses) / 1e6);
+            hourFrames = radio->frames;
+            hourBytes = radio->bytesOnAir;
+            hourPulses = totalPulses;
+            hourStartUs += 3600000000ULL;
+            if (hourStartUs >= endUs) {
+                break;
+            }
+        }
+    }
+
+    double hours = (endUs - trace[0].startUs) / 3.6e9;
+    const ReportEngineStats* stats = reportEngineStats();
+    printf("\n%.2f h replayed, %.1f L\n", hours, (double)pulsesToMicrolitres(totalPulses) / 1e6);
+    printf("frames:        %lu (%.1f/h), %lu on deadlines\n", (unsigned long)radio->frames,
+           radio->frames / hours, (unsigned long)stats->deadlineFrames);
+    printf("bytes on air:  %llu (%.0f/h)\n", (unsigned long long)radio->bytesOnAir,
+           radio->bytesOnAir / hours);
+    printf("budget holds:  %lu\n", (unsigned long)stats->budgetDeferrals);
+    return 0;
+}
@@ -0,0 +1,152 @@
+/*
+ * Water Flow Meter - Pulse Trace Replay
+ * Replays a pulse trace captured on the device through the metering core
+ * and prints every Zigbee report frame it produces
+ *
+ * Capture on the device (serial console), then save the export:
+ *   trace start      ... let the household use water ...
+ *   trace export     (the monitor output, e.g. pio device monitor | tee capture.log)
+ *
+ * Build and run on the host:
+ *   pio run -e trace_replay
+ *   .pio/build/trace_replay/program capture.log > reports.txt
+ *
+ * Only the "[Trace <offset>] <words>" rows of the input are used. The
+ * meter boots at the capture start with the ledger the device had then,
+ * joined, and every recorded edge fires the pulse ISR at its exact
+ * microsecond while the scheduler runs as on the device - hours of trace
+ * replay in well under a second. The output has one line per frame:
+ *   <ms since capture start> <endpoint> <cluster> <attr>:<type>:<value bytes>...
+ * and is the same byte for byte on every run, so diffing the output of
+ * two builds shows exactly what a change does to report traffic. Summary
+ * lines at the end start with '#'.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "hal_native.h"
+#include "flow_meter.h"
+#include "scheduler.h"
+#include "report_engine.h"
+#include "pulse_trace.h"
+
+#define ROW_WORDS 6
+
+static TraceReader reader;
+static bool edgePending = false;
+static uint64_t nextEdgeUs = 0;
+
+/**
+ * Rebuild the exported trace area from the console rows
+ */
+static bool loadExport(FILE* in, std::vector<uint8_t>* image) {
+    char line[256];
+    unsigned long lineNo = 0;
+    while (fgets(line, sizeof(line), in)) {
+        lineNo++;
+        const char* row = strstr(line, "[Trace ");
+        unsigned long offset;
+        unsigned long words[ROW_WORDS];
+        if (!row || sscanf(row, "[Trace %lx] %lx %lx %lx %lx %lx %lx", &offset, &words[0],
+                           &words[1], &words[2], &words[3], &words[4], &words[5]) != 7) {
+            continue;
+        }
+        if (offset != image->size()) {
+            fprintf(stderr, "line %lu: row at 0x%lx, expected 0x%zx - rows were lost, "
+                    "export again\n", lineNo, offset, image->size());
+            return false;
+        }
+        for (unsigned long word : words) {
+            for (int b = 0; b < 4; b++) {
+                image->push_back((uint8_t)(word >> (8 * b)));
+            }
+        }
+    }
+    return !image->empty();
+}
+
+// Scheduler sleep hook: fire the recorded edges before deadlineUs
+static void fireEdges(uint64_t deadlineUs) {
+    while (edgePending && nextEdgeUs <= deadlineUs && !hal_native_notify_pending()) {
+        hal_native_set_micros(nextEdgeUs);
+        hal_native_pulse();
+        edgePending = traceReaderNext(&reader, &nextEdgeUs);
+    }
+}
+
+static void printFrame(const NativeRadioFrame* frame, uint64_t startUs) {
+    uint64_t ms = (frame->timeUs - startUs) / 1000;
+    printf("%llu %u 0x%04x", (unsigned long long)ms, frame->endpoint, frame->clusterId);
+    for (uint8_t i = 0; i < frame->count; i++) {
+        const HalAttribute* attr = &frame->attrs[i];
+        printf(" %04x:%02x:", attr->attrId, attr->zclType);
+        for (uint8_t b = 0; b < attr->len; b++) {
+            printf("%02x", attr->value[b]);
+        }
+    }
+    printf("\n");
+}
+
+int main(int argc, char** argv) {
+    FILE* in = stdin;
+    if (argc > 2 || (argc == 2 && argv[1][0] == '-' && argv[1][1] == 'h')) {
+        fprintf(stderr, "usage: %s [capture.log]\n", argv[0]);
+        return 2;
+    }
+    if (argc == 2 && !(in = fopen(argv[1], "r"))) {
+        perror(argv[1]);
+        return 1;
+    }
+    std::vector<uint8_t> image;
+    bool loaded = loadExport(in, &image);
+    if (in != stdin) {
+        fclose(in);
+    }
+    if (!loaded) {
+        fprintf(stderr, "no trace export rows found\n");
+        return 1;
+    }
+
+    // The exported area goes back where the device had it
+    hal_native_reset();
+    if (!hal_flash_begin(DATA_PARTITION_LABEL) || image.size() > TRACE_AREA_BYTES ||
+        !hal_flash_write(TRACE_OFFSET, image.data(), image.size()) ||
+        !traceReaderBegin(&reader)) {
+        fprintf(stderr, "not a valid trace\n");
+        return 1;
+    }
+
+    // Boot at the capture start with the device's ledger
+    static uint8_t battery = 100;
+    hal_native_set_micros(reader.startUs);
+    resetFlowMeter();
+    schedulerReset();
+    loadTotalVolume();
+    totalPulses = reader.startLedger;
+    lastSavedPulses = reader.startLedger;
+    setupFlowSensor();
+    scheduleFlowMeter(&battery);
+    zigbeeConnected = true;
+    requestFlowReport();
+
+    edgePending = traceReaderNext(&reader, &nextEdgeUs);
+    hal_native_set_wait_hook(fireEdges);
+
+    size_t printed = 0;
+    while (edgePending || hal_native_now_us() < reader.timeUs) {
+        schedulerRun();
+        for (; printed < hal_native_radio_frame_count(); printed++) {
+            printFrame(hal_native_radio_frame(printed), reader.startUs);
+        }
+    }
+
+    const NativeRadioStats* radio = hal_native_radio_stats();
+    double hours = (reader.timeUs - reader.startUs) / 3.6e9;
+    printf("# %.2f h replayed, %llu edges, %.1f L\n", hours, (unsigned long long)reader.edges,
+           (double)pulsesToMicrolitres(totalPulses - reader.startLedger) / 1e6);
+    printf("# frames: %lu (%.1f/h), bytes on air: %llu (%.0f/h)\n",
+           (unsigned long)radio->frames, radio->frames / hours,
+           (unsigned long long)radio->bytesOnAir, radio->bytesOnAir / hours);
+    return 0;
+}